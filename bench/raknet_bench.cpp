@@ -0,0 +1,2039 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Standalone benchmarks for RakNet. Build with xmake build raknet_bench
+///
+/// Usage:
+///   raknet_bench memory [connections] [idleSeconds]
+///     Starts a server, connects \a connections clients from a child process, lets every client send a short burst
+///     and then go quiet, and reports how many heap bytes the server holds per slot and per idle connection.
+///   raknet_bench bitstream [iterations]
+///     Times BitStream::WriteBits and ReadBits on short unaligned fields and on long unaligned payloads against the
+///     byte at a time kernels they replaced, after checking both produce the same bits.
+///   raknet_bench scratch [ticks]
+///     Builds a tick's worth of medium sized temporary BitStreams on the heap, with Reserve(), and from a
+///     BitStreamArena, and reports heap calls and time per tick for each.
+///   raknet_bench schema [iterations]
+///     Writes and reads a typical replica state with BitStreamSchema and with the equivalent hand written Write() and
+///     Read() calls, after checking both produce the same bits.
+///   raknet_bench varint [iterations]
+///     Writes and reads small unsigned, small signed and full range integers with WriteCompressed() and with the
+///     LEB128 varints, and reports bits and time per value for each.
+///   raknet_bench huffman [iterations]
+///     Encodes and decodes a corpus of chat lines, names and paths with HuffmanEncodingTree and with the bit at a time
+///     tree walk it replaced, after checking both produce the same bits.
+///   raknet_bench rakstring [iterations] [threads]
+///     Copies, appends to and destroys short and long RakStrings shared between \a threads threads, and reports time
+///     and heap calls per operation for each.
+///   raknet_bench allocator [iterations] [threads]
+///     Allocates and frees blocks of RakNet's common sizes from \a threads threads through rakMalloc_Ex, with a share
+///     of them freed on a different thread, with malloc, with UseSlabAllocator(), and with UseAllocationTracking()
+///     counting call sites on top of that.
+///   raknet_bench threadpool [jobs] [threads]
+///     Runs \a jobs tiny jobs on \a threads threads with ThreadPool, added one at a time and in batches, and with the
+///     single mutex guarded queue it replaced, and reports time per job for each.
+///   raknet_bench sendthread [datagrams] [sockets]
+///     Sends \a datagrams MTU sized datagrams over loopback, spread over \a sockets sockets, straight from the
+///     calling thread and through SendToThread, and reports the calling thread's CPU time per datagram for each.
+///   raknet_bench trace [events]
+///     Records \a events datagram events with RAKNET_TRACE_EVENT while tracing is stopped and while it is running, and
+///     formats the same events as text lines the way PacketLogger does, and reports time per event for each.
+///   raknet_bench packetlog [messages]
+///     Logs \a messages sent messages with PacketFileLogger and with AsyncPacketFileLogger, and reports the time each
+///     OnInternalPacket() call takes on the calling thread, and how many records AsyncPacketFileLogger dropped.
+///   raknet_bench loopback [messages] [bytes] [connections]
+///     Connects a client to a server over 127.0.0.1 and sends \a messages messages of \a bytes bytes with each
+///     PacketReliability and each PacketPriority, then times round trips one message at a time, then connects
+///     \a connections more clients at once. Reports messages and MB per second and process CPU time per message for
+///     each, round trip percentiles, and how many connections the server accepted per second.
+///   raknet_bench virtual [clients] [messages] [lossPercent] [seed]
+///     Connects \a clients clients to a server on a VirtualNetwork with 50 ms latency, jitter and \a lossPercent loss,
+///     and has each send \a messages reliable ordered messages. Runs it twice and reports the virtual time taken,
+///     the datagram counts, and a digest of the order the server received messages in, which only changes with the
+///     arguments or the code.
+///
+
+#include "AllocationTracker.h"
+#include "AsyncPacketFileLogger.h"
+#include "BitStream.h"
+#include "BitStreamArena.h"
+#include "BitStreamSchema.h"
+#include "DS_HuffmanEncodingTree.h"
+#include "EventTrace.h"
+#include "GetTime.h"
+#include "InternalPacket.h"
+#include "LatencyHistogram.h"
+#include "MessageIdentifiers.h"
+#include "PacketFileLogger.h"
+#include "RakMemoryOverride.h"
+#include "RakPeerInterface.h"
+#include "RakNetSocket2.h"
+#include "RakString.h"
+#include "SendToThread.h"
+#include "SlabAllocator.h"
+#include "RakSleep.h"
+#include "ThreadPool.h"
+#include "VirtualNetwork.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include "WindowsIncludes.h"
+#else
+#include <time.h>
+#endif
+
+using namespace RakNet;
+
+// Every allocation made by this process, RakNet's own allocator hooks included, goes through a header recording
+// its size so the live heap can be read at any point.
+static std::atomic<long long> liveHeapBytes(0);
+static std::atomic<long long> heapCalls(0);
+
+// Sits in front of every block. The union keeps what follows it aligned like malloc's own result
+union AllocationHeader {
+    size_t      size;
+    max_align_t alignment;
+};
+
+// The header is found from the address rather than by stepping back from the caller's pointer. Once the global
+// operator new and delete are inlined the compiler treats that pointer as an array of exactly the size asked for,
+// and warns that the header is outside it.
+static AllocationHeader* GetAllocationHeader(void* p) {
+    return (AllocationHeader*)((uintptr_t)p - sizeof(AllocationHeader));
+}
+
+static void* CountedMalloc(size_t size) {
+    AllocationHeader* header = (AllocationHeader*)malloc(size + sizeof(AllocationHeader));
+    heapCalls++;
+    if (header == 0) return 0;
+    header->size   = size;
+    liveHeapBytes += (long long)size;
+    return header + 1;
+}
+
+static void CountedFree(void* p) {
+    if (p == 0) return;
+    AllocationHeader* header  = GetAllocationHeader(p);
+    liveHeapBytes            -= (long long)header->size;
+    free(header);
+}
+
+static void* CountedRealloc(void* p, size_t size) {
+    if (p == 0) return CountedMalloc(size);
+    AllocationHeader* header  = GetAllocationHeader(p);
+    size_t            oldSize = header->size;
+    header                    = (AllocationHeader*)realloc(header, size + sizeof(AllocationHeader));
+    heapCalls++;
+    if (header == 0) return 0;
+    header->size   = size;
+    liveHeapBytes += (long long)size - (long long)oldSize;
+    return header + 1;
+}
+
+static void* CountedMalloc_Ex(size_t size, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+    return CountedMalloc(size);
+}
+
+static void* CountedRealloc_Ex(void* p, size_t size, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+    return CountedRealloc(p, size);
+}
+
+static void CountedFree_Ex(void* p, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+    CountedFree(p);
+}
+
+void* operator new(size_t size) {
+    void* p = CountedMalloc(size ? size : 1);
+    if (p == 0) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedMalloc(size ? size : 1); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedMalloc(size ? size : 1); }
+void  operator delete(void* p) noexcept { CountedFree(p); }
+void  operator delete[](void* p) noexcept { CountedFree(p); }
+void  operator delete(void* p, size_t) noexcept { CountedFree(p); }
+void  operator delete[](void* p, size_t) noexcept { CountedFree(p); }
+
+static void InstallCountingAllocator(void) {
+    SetMalloc(CountedMalloc);
+    SetRealloc(CountedRealloc);
+    SetFree(CountedFree);
+    SetMalloc_Ex(CountedMalloc_Ex);
+    SetRealloc_Ex(CountedRealloc_Ex);
+    SetFree_Ex(CountedFree_Ex);
+}
+
+static const int           BURST_MESSAGE_COUNT = 8;
+static const RakNet::TimeMS CONNECT_TIMEOUT_MS  = 30000;
+
+// Child process: connects the clients, sends a short burst from each, then idles until the server goes away
+static int RunMemoryClients(unsigned short serverPort, int connections, int seconds) {
+    RakPeerInterface** clients = new RakPeerInterface*[connections];
+    for (int i = 0; i < connections; i++) {
+        clients[i] = RakPeerInterface::GetInstance();
+        SocketDescriptor socketDescriptor(0, "127.0.0.1");
+        if (clients[i]->Startup(1, &socketDescriptor, 1) != RAKNET_STARTED) {
+            fprintf(stderr, "client %i failed to start\n", i);
+            return 1;
+        }
+        clients[i]->Connect("127.0.0.1", serverPort, 0, 0);
+    }
+
+    // Clients are done once their connection attempt fails or the server closes the connection
+    bool*          done      = new bool[connections];
+    int            doneCount = 0;
+    RakNet::TimeMS endTime   = RakNet::GetTimeMS() + (RakNet::TimeMS)seconds * 1000;
+    memset(done, 0, sizeof(bool) * connections);
+    while (doneCount < connections && (int)(endTime - RakNet::GetTimeMS()) > 0) {
+        for (int i = 0; i < connections; i++) {
+            for (Packet* p = clients[i]->Receive(); p; clients[i]->DeallocatePacket(p), p = clients[i]->Receive()) {
+                if (p->data[0] == ID_CONNECTION_REQUEST_ACCEPTED) {
+                    for (int messageIndex = 0; messageIndex < BURST_MESSAGE_COUNT; messageIndex++) {
+                        BitStream bitStream;
+                        bitStream.Write((MessageID)ID_USER_PACKET_ENUM);
+                        bitStream.Write(messageIndex);
+                        clients[i]->Send(&bitStream, HIGH_PRIORITY, RELIABLE_ORDERED, 0, p->systemAddress, false);
+                    }
+                } else if (done[i] == false
+                           && (p->data[0] == ID_CONNECTION_ATTEMPT_FAILED
+                               || p->data[0] == ID_DISCONNECTION_NOTIFICATION
+                               || p->data[0] == ID_CONNECTION_LOST)) {
+                    done[i] = true;
+                    doneCount++;
+                }
+            }
+        }
+        RakSleep(10);
+    }
+
+    for (int i = 0; i < connections; i++) RakPeerInterface::DestroyInstance(clients[i]);
+    delete[] done;
+    delete[] clients;
+    return 0;
+}
+
+static int RunMemory(const char* executable, int connections, int idleSeconds) {
+    long long baselineBytes = liveHeapBytes;
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    SocketDescriptor  socketDescriptor(0, "127.0.0.1");
+    if (server->Startup((unsigned int)connections, &socketDescriptor, 1) != RAKNET_STARTED) {
+        fprintf(stderr, "server failed to start\n");
+        return 1;
+    }
+    server->SetMaximumIncomingConnections((unsigned int)connections);
+    long long startedBytes = liveHeapBytes;
+
+    // Clients live in their own process so their allocations do not count against the server
+    unsigned short serverPort  = server->GetMyBoundAddress().GetPort();
+    int            childSeconds = (int)(CONNECT_TIMEOUT_MS / 1000) + idleSeconds + 5;
+    std::string    command      = std::string("\"") + executable + "\" memory-clients " + std::to_string(serverPort)
+                        + " " + std::to_string(connections) + " " + std::to_string(childSeconds);
+    std::thread childThread([command]() { (void)system(command.c_str()); });
+
+    int            connected = 0, messagesReceived = 0;
+    RakNet::TimeMS startTime = RakNet::GetTimeMS();
+    while ((connected < connections || messagesReceived < connections * BURST_MESSAGE_COUNT)
+           && RakNet::GetTimeMS() - startTime < CONNECT_TIMEOUT_MS) {
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {
+            if (p->data[0] == ID_NEW_INCOMING_CONNECTION) connected++;
+            else if (p->data[0] == ID_USER_PACKET_ENUM) messagesReceived++;
+        }
+        RakSleep(10);
+    }
+    long long connectedBytes = liveHeapBytes;
+
+    // Give the connections time to go quiet
+    RakNet::TimeMS idleStartTime = RakNet::GetTimeMS();
+    while (RakNet::GetTimeMS() - idleStartTime < (RakNet::TimeMS)idleSeconds * 1000) {
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {}
+        RakSleep(10);
+    }
+    long long idleBytes          = liveHeapBytes;
+    int       idleConnectedCount = (int)server->NumberOfConnections();
+
+    // Shutting down notifies the clients, which ends the child process
+    server->Shutdown(500);
+    RakPeerInterface::DestroyInstance(server);
+    childThread.join();
+
+    printf("{\n");
+    printf("  \"benchmark\": \"memory\",\n");
+    printf("  \"connections\": %i,\n", connections);
+    printf("  \"connected\": %i,\n", idleConnectedCount);
+    printf("  \"messages_received\": %i,\n", messagesReceived);
+    printf("  \"idle_seconds\": %i,\n", idleSeconds);
+    printf("  \"bytes_per_slot\": %lld,\n", (startedBytes - baselineBytes) / connections);
+    printf("  \"bytes_per_active_connection\": %lld,\n", (connectedBytes - startedBytes) / (connected ? connected : 1));
+    printf("  \"bytes_per_idle_connection\": %lld\n", (idleBytes - startedBytes) / (connected ? connected : 1));
+    printf("}\n");
+    return connected == connections ? 0 : 1;
+}
+
+// The byte at a time BitStream kernels, kept as the baseline for the bitstream benchmark. They work on a caller
+// owned buffer with room for everything written.
+static void ReferenceWriteBits(
+    unsigned char*       data,
+    BitSize_t&           numberOfBitsUsed,
+    const unsigned char* inByteArray,
+    BitSize_t            numberOfBitsToWrite,
+    const bool           rightAlignedBits
+) {
+    const BitSize_t numberOfBitsUsedMod8 = numberOfBitsUsed & 7;
+    if (numberOfBitsUsedMod8 == 0 && (numberOfBitsToWrite & 7) == 0) {
+        memcpy(data + (numberOfBitsUsed >> 3), inByteArray, numberOfBitsToWrite >> 3);
+        numberOfBitsUsed += numberOfBitsToWrite;
+        return;
+    }
+
+    const unsigned char* inputPtr = inByteArray;
+    while (numberOfBitsToWrite > 0) {
+        unsigned char dataByte = *(inputPtr++);
+        if (numberOfBitsToWrite < 8 && rightAlignedBits) dataByte <<= 8 - numberOfBitsToWrite;
+
+        if (numberOfBitsUsedMod8 == 0) *(data + (numberOfBitsUsed >> 3)) = dataByte;
+        else {
+            *(data + (numberOfBitsUsed >> 3)) |= dataByte >> (numberOfBitsUsedMod8);
+            if (8 - (numberOfBitsUsedMod8) < numberOfBitsToWrite)
+                *(data + (numberOfBitsUsed >> 3) + 1) = (unsigned char)(dataByte << (8 - (numberOfBitsUsedMod8)));
+        }
+
+        if (numberOfBitsToWrite >= 8) {
+            numberOfBitsUsed    += 8;
+            numberOfBitsToWrite -= 8;
+        } else {
+            numberOfBitsUsed    += numberOfBitsToWrite;
+            numberOfBitsToWrite  = 0;
+        }
+    }
+}
+
+static void ReferenceReadBits(
+    const unsigned char* data,
+    BitSize_t&           readOffset,
+    unsigned char*       inOutByteArray,
+    BitSize_t            numberOfBitsToRead,
+    const bool           alignBitsToRight
+) {
+    const BitSize_t readOffsetMod8 = readOffset & 7;
+    if (readOffsetMod8 == 0 && (numberOfBitsToRead & 7) == 0) {
+        memcpy(inOutByteArray, data + (readOffset >> 3), numberOfBitsToRead >> 3);
+        readOffset += numberOfBitsToRead;
+        return;
+    }
+
+    BitSize_t offset = 0;
+    memset(inOutByteArray, 0, (size_t)BITS_TO_BYTES(numberOfBitsToRead));
+    while (numberOfBitsToRead > 0) {
+        *(inOutByteArray + offset) |= *(data + (readOffset >> 3)) << (readOffsetMod8);
+        if (readOffsetMod8 > 0 && numberOfBitsToRead > 8 - (readOffsetMod8))
+            *(inOutByteArray + offset) |= *(data + (readOffset >> 3) + 1) >> (8 - (readOffsetMod8));
+
+        if (numberOfBitsToRead >= 8) {
+            numberOfBitsToRead -= 8;
+            readOffset         += 8;
+        } else {
+            if (alignBitsToRight) *(inOutByteArray + offset) >>= 8 - numberOfBitsToRead;
+            readOffset         += numberOfBitsToRead;
+            numberOfBitsToRead  = 0;
+        }
+        offset++;
+    }
+}
+
+// Field widths of a typical message header: flags, a message id, a sequence number, ranges and a timestamp
+static const BitSize_t HEADER_FIELD_BITS[]  = {1, 3, 8, 24, 5, 13, 16, 1, 32, 11};
+static const int       HEADER_FIELD_COUNT   = (int)(sizeof(HEADER_FIELD_BITS) / sizeof(HEADER_FIELD_BITS[0]));
+static const BitSize_t PAYLOAD_BITS         = 1200 * 8;
+static const BitSize_t PAYLOAD_OFFSET_BITS  = 3;
+static const int       BITSTREAM_REPEAT     = 4;
+static const int       BITSTREAM_ROUNDS     = 5;
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Writes the fields once through each implementation and compares the bits written and read back
+static bool CheckBitStreamKernels(const BitSize_t* fieldBits, int fieldCount, const unsigned char* source) {
+    unsigned char reference[4096], readBack[2048], referenceReadBack[2048];
+    BitSize_t     referenceBits = 0, referenceOffset = 0;
+    BitStream     bitStream;
+    memset(reference, 0, sizeof(reference));
+
+    for (int i = 0; i < fieldCount; i++) {
+        ReferenceWriteBits(reference, referenceBits, source, fieldBits[i], true);
+        bitStream.WriteBits(source, fieldBits[i], true);
+    }
+    if (referenceBits != bitStream.GetNumberOfBitsUsed()) return false;
+    // Only bits inside the stream are defined
+    BitSize_t wholeBytes = referenceBits >> 3;
+    if (memcmp(reference, bitStream.GetData(), (size_t)wholeBytes) != 0) return false;
+    if ((referenceBits & 7) != 0) {
+        unsigned char mask = (unsigned char)(0xFF << (8 - (referenceBits & 7)));
+        if (((reference[wholeBytes] ^ bitStream.GetData()[wholeBytes]) & mask) != 0) return false;
+    }
+
+    for (int i = 0; i < fieldCount; i++) {
+        memset(readBack, 0, sizeof(readBack));
+        ReferenceReadBits(reference, referenceOffset, referenceReadBack, fieldBits[i], true);
+        if (bitStream.ReadBits(readBack, fieldBits[i], true) == false) return false;
+        if (memcmp(readBack, referenceReadBack, (size_t)BITS_TO_BYTES(fieldBits[i])) != 0) return false;
+    }
+    return true;
+}
+
+// Returns ns per write and per read for both implementations, each over the whole field list. Each is the best of
+// several rounds, which also keeps stream growth out of the result
+static void TimeBitStreamKernels(
+    const BitSize_t*     fieldBits,
+    int                  fieldCount,
+    const unsigned char* source,
+    int                  iterations,
+    double               results[4]
+) {
+    unsigned char reference[8192], readBack[2048];
+    BitStream     bitStream;
+    unsigned int  checksum = 0;
+    double        elapsed[4];
+    for (int i = 0; i < 4; i++) results[i] = 1e300;
+
+    for (int round = 0; round < BITSTREAM_ROUNDS; round++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            bitStream.Reset();
+            for (int repeat = 0; repeat < BITSTREAM_REPEAT; repeat++)
+                for (int i = 0; i < fieldCount; i++) bitStream.WriteBits(source, fieldBits[i], true);
+            checksum += bitStream.GetData()[iteration & 15];
+        }
+        elapsed[0] = NanosecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            bitStream.ResetReadPointer();
+            for (int repeat = 0; repeat < BITSTREAM_REPEAT; repeat++)
+                for (int i = 0; i < fieldCount; i++) bitStream.ReadBits(readBack, fieldBits[i], true);
+            checksum += readBack[0];
+        }
+        elapsed[1] = NanosecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            BitSize_t referenceBits = 0;
+            for (int repeat = 0; repeat < BITSTREAM_REPEAT; repeat++)
+                for (int i = 0; i < fieldCount; i++)
+                    ReferenceWriteBits(reference, referenceBits, source, fieldBits[i], true);
+            checksum += reference[iteration & 15];
+        }
+        elapsed[2] = NanosecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            BitSize_t referenceOffset = 0;
+            for (int repeat = 0; repeat < BITSTREAM_REPEAT; repeat++)
+                for (int i = 0; i < fieldCount; i++)
+                    ReferenceReadBits(reference, referenceOffset, readBack, fieldBits[i], true);
+            checksum += readBack[0];
+        }
+        elapsed[3] = NanosecondsSince(start);
+
+        for (int i = 0; i < 4; i++)
+            if (elapsed[i] < results[i]) results[i] = elapsed[i];
+    }
+
+    // Keeps the loops from being optimized away
+    if (checksum == 0xFFFFFFFF) printf("\n");
+    for (int i = 0; i < 4; i++) results[i] /= (double)iterations * BITSTREAM_REPEAT;
+}
+
+static int RunBitStream(int iterations) {
+    unsigned char source[2048];
+    for (unsigned int i = 0; i < sizeof(source); i++) source[i] = (unsigned char)(i * 167 + 13);
+
+    const BitSize_t payloadFields[] = {PAYLOAD_OFFSET_BITS, PAYLOAD_BITS};
+
+    // Every offset and width a single field can take, with partial bytes, for the correctness check
+    bool matches = CheckBitStreamKernels(HEADER_FIELD_BITS, HEADER_FIELD_COUNT, source)
+                && CheckBitStreamKernels(payloadFields, 2, source);
+    for (BitSize_t offset = 0; offset < 8 && matches; offset++) {
+        for (BitSize_t width = 1; width <= 300 && matches; width++) {
+            const BitSize_t fields[] = {offset, width, 7, width};
+            matches                  = CheckBitStreamKernels(offset ? fields : fields + 1, offset ? 4 : 3, source);
+        }
+    }
+    if (matches == false) {
+        fprintf(stderr, "BitStream kernels do not match the reference\n");
+        return 1;
+    }
+
+    double header[4], payload[4];
+    TimeBitStreamKernels(HEADER_FIELD_BITS, HEADER_FIELD_COUNT, source, iterations, header);
+    TimeBitStreamKernels(payloadFields, 2, source, iterations / 10 + 1, payload);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"bitstream\",\n");
+    printf("  \"iterations\": %i,\n", iterations);
+    printf("  \"header_fields\": %i,\n", HEADER_FIELD_COUNT);
+    printf("  \"header_write_ns\": %.1f,\n", header[0]);
+    printf("  \"header_read_ns\": %.1f,\n", header[1]);
+    printf("  \"header_write_reference_ns\": %.1f,\n", header[2]);
+    printf("  \"header_read_reference_ns\": %.1f,\n", header[3]);
+    printf("  \"payload_bytes\": %u,\n", (unsigned int)(PAYLOAD_BITS / 8));
+    printf("  \"payload_write_ns\": %.1f,\n", payload[0]);
+    printf("  \"payload_read_ns\": %.1f,\n", payload[1]);
+    printf("  \"payload_write_reference_ns\": %.1f,\n", payload[2]);
+    printf("  \"payload_read_reference_ns\": %.1f\n", payload[3]);
+    printf("}\n");
+    return 0;
+}
+
+// Roughly a tick of replica serialization: one stream per object, most over the stack allocation
+static const int SCRATCH_STREAMS_PER_TICK = 64;
+static const int SCRATCH_MIN_BYTES        = 200;
+static const int SCRATCH_MAX_BYTES        = 2000;
+
+enum ScratchMode { SCRATCH_HEAP, SCRATCH_RESERVE, SCRATCH_ARENA };
+
+// Builds one tick of streams, written a block of fields at a time
+static unsigned int BuildScratchTick(ScratchMode mode, BitStreamArena* arena, int tick) {
+    static const char fields[32] = {0};
+    unsigned int      checksum   = 0;
+    if (mode == SCRATCH_ARENA) arena->Reset();
+    for (int streamIndex = 0; streamIndex < SCRATCH_STREAMS_PER_TICK; streamIndex++) {
+        int bytes = SCRATCH_MIN_BYTES
+                  + (streamIndex * 7919 + tick * 104729) % (SCRATCH_MAX_BYTES - SCRATCH_MIN_BYTES);
+        BitStream bitStream;
+        if (mode == SCRATCH_ARENA) bitStream.SetArena(arena);
+        else if (mode == SCRATCH_RESERVE) bitStream.Reserve(BYTES_TO_BITS(bytes));
+        for (int i = 0; i < bytes / (int)sizeof(fields); i++) bitStream.Write(fields, sizeof(fields));
+        checksum += bitStream.GetData()[bytes / 2];
+    }
+    return checksum;
+}
+
+static int RunScratch(int ticks) {
+    static const char* const modeNames[] = {"heap", "reserve", "arena"};
+    BitStreamArena           arena;
+    double                   nsPerTick[3];
+    double                   heapCallsPerTick[3];
+    unsigned int             checksum = 0;
+
+    for (int mode = SCRATCH_HEAP; mode <= SCRATCH_ARENA; mode++) {
+        // Warm up, so the arena has grown to a tick's worth
+        for (int tick = 0; tick < 4; tick++) checksum += BuildScratchTick((ScratchMode)mode, &arena, tick);
+
+        long long                             startHeapCalls = heapCalls;
+        std::chrono::steady_clock::time_point start          = std::chrono::steady_clock::now();
+        for (int tick = 0; tick < ticks; tick++) checksum += BuildScratchTick((ScratchMode)mode, &arena, tick);
+        nsPerTick[mode]        = NanosecondsSince(start) / ticks;
+        heapCallsPerTick[mode] = (double)(heapCalls - startHeapCalls) / ticks;
+    }
+    // Keeps the loops from being optimized away
+    if (checksum == 0xFFFFFFFF) printf("\n");
+
+    printf("{\n");
+    printf("  \"benchmark\": \"scratch\",\n");
+    printf("  \"ticks\": %i,\n", ticks);
+    printf("  \"streams_per_tick\": %i,\n", SCRATCH_STREAMS_PER_TICK);
+    for (int mode = SCRATCH_HEAP; mode <= SCRATCH_ARENA; mode++) {
+        printf("  \"%s_heap_calls_per_tick\": %.2f,\n", modeNames[mode], heapCallsPerTick[mode]);
+        printf("  \"%s_ns_per_tick\": %.0f,\n", modeNames[mode], nsPerTick[mode]);
+    }
+    printf("  \"arena_bytes_allocated\": %u,\n", (unsigned int)arena.GetBytesAllocated());
+    printf("  \"arena_block_allocations\": %u\n", arena.GetBlockAllocationCount());
+    printf("}\n");
+    return 0;
+}
+
+struct BenchPlayerState {
+    uint32_t id;
+    uint16_t sequence;
+    bool     alive;
+    bool     crouching;
+    uint8_t  team;
+    int16_t  health;
+    float    x, y, z;
+    float    yaw;
+    uint64_t lastInputTime;
+};
+
+typedef BitStreamSchema<
+    BenchPlayerState,
+    SchemaField<&BenchPlayerState::id>,
+    SchemaField<&BenchPlayerState::sequence>,
+    SchemaField<&BenchPlayerState::alive>,
+    SchemaField<&BenchPlayerState::crouching>,
+    SchemaRange<&BenchPlayerState::team, 0, 3>,
+    SchemaRange<&BenchPlayerState::health, -100, 1000>,
+    SchemaQuantized<&BenchPlayerState::x, -4096.0f, 4096.0f, 16>,
+    SchemaQuantized<&BenchPlayerState::y, -4096.0f, 4096.0f, 16>,
+    SchemaQuantized<&BenchPlayerState::z, -4096.0f, 4096.0f, 16>,
+    SchemaQuantized<&BenchPlayerState::yaw, -4.0f, 4.0f, 16>,
+    SchemaField<&BenchPlayerState::lastInputTime>>
+    BenchPlayerStateSchema;
+
+static void WritePlayerStateByHand(BitStream* bitStream, const BenchPlayerState& state) {
+    bitStream->Write(state.id);
+    bitStream->Write(state.sequence);
+    bitStream->Write(state.alive);
+    bitStream->Write(state.crouching);
+    bitStream->WriteBitsFromIntegerRange(state.team, (uint8_t)0, (uint8_t)3);
+    bitStream->WriteBitsFromIntegerRange(state.health, (int16_t)-100, (int16_t)1000);
+    bitStream->WriteFloat16(state.x, -4096.0f, 4096.0f);
+    bitStream->WriteFloat16(state.y, -4096.0f, 4096.0f);
+    bitStream->WriteFloat16(state.z, -4096.0f, 4096.0f);
+    bitStream->WriteFloat16(state.yaw, -4.0f, 4.0f);
+    bitStream->Write(state.lastInputTime);
+}
+
+static bool ReadPlayerStateByHand(BitStream* bitStream, BenchPlayerState& state) {
+    return bitStream->Read(state.id) && bitStream->Read(state.sequence) && bitStream->Read(state.alive)
+        && bitStream->Read(state.crouching)
+        && bitStream->ReadBitsFromIntegerRange(state.team, (uint8_t)0, (uint8_t)3)
+        && bitStream->ReadBitsFromIntegerRange(state.health, (int16_t)-100, (int16_t)1000)
+        && bitStream->ReadFloat16(state.x, -4096.0f, 4096.0f) && bitStream->ReadFloat16(state.y, -4096.0f, 4096.0f)
+        && bitStream->ReadFloat16(state.z, -4096.0f, 4096.0f) && bitStream->ReadFloat16(state.yaw, -4.0f, 4.0f)
+        && bitStream->Read(state.lastInputTime);
+}
+
+static bool PlayerStatesMatch(const BenchPlayerState& a, const BenchPlayerState& b) {
+    return a.id == b.id && a.sequence == b.sequence && a.alive == b.alive && a.crouching == b.crouching
+        && a.team == b.team && a.health == b.health && a.x == b.x && a.y == b.y && a.z == b.z && a.yaw == b.yaw
+        && a.lastInputTime == b.lastInputTime;
+}
+
+static const int SCHEMA_STATES = 64;
+
+static int RunSchema(int iterations) {
+    BenchPlayerState states[SCHEMA_STATES];
+    for (int i = 0; i < SCHEMA_STATES; i++) {
+        states[i].id            = 1000 + i * 7;
+        states[i].sequence      = (uint16_t)(i * 331);
+        states[i].alive         = (i % 3) != 0;
+        states[i].crouching     = (i % 5) == 0;
+        states[i].team          = (uint8_t)(i % 4);
+        states[i].health        = (int16_t)(i * 17 % 1100 - 100);
+        states[i].x             = -4000.0f + i * 123.25f;
+        states[i].y             = 17.5f * i;
+        states[i].z             = -3.0f * i;
+        states[i].yaw           = -3.1f + i * 0.09f;
+        states[i].lastInputTime = 0x0123456789ABCDEFull + (uint64_t)i;
+    }
+
+    // The same bits either way, starting aligned and unaligned, and each reads back what the other wrote
+    for (int leadingBits = 0; leadingBits < 8; leadingBits++) {
+        BitStream byHand, bySchema;
+        for (int i = 0; i < leadingBits; i++) {
+            byHand.Write1();
+            bySchema.Write1();
+        }
+        for (int i = 0; i < SCHEMA_STATES; i++) {
+            WritePlayerStateByHand(&byHand, states[i]);
+            BenchPlayerStateSchema::Write(&bySchema, states[i]);
+        }
+        if (byHand.GetNumberOfBitsUsed() != bySchema.GetNumberOfBitsUsed()
+            || memcmp(byHand.GetData(), bySchema.GetData(), byHand.GetNumberOfBytesUsed() - 1) != 0) {
+            fprintf(stderr, "BitStreamSchema does not match the hand written serialization\n");
+            return 1;
+        }
+        byHand.IgnoreBits(leadingBits);
+        bySchema.IgnoreBits(leadingBits);
+        for (int i = 0; i < SCHEMA_STATES; i++) {
+            BenchPlayerState fromHand, fromSchema;
+            if (BenchPlayerStateSchema::Read(&byHand, fromSchema) == false
+                || ReadPlayerStateByHand(&bySchema, fromHand) == false
+                || PlayerStatesMatch(fromHand, fromSchema) == false || fromSchema.id != states[i].id
+                || fromSchema.health != states[i].health) {
+                fprintf(stderr, "BitStreamSchema does not read back the hand written serialization\n");
+                return 1;
+            }
+        }
+    }
+
+    BitStream        bitStream;
+    BenchPlayerState readState;
+    unsigned int     checksum = 0;
+    double           results[4];
+    for (int method = 0; method < 2; method++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            bitStream.Reset();
+            if (method == 0)
+                for (int i = 0; i < SCHEMA_STATES; i++) WritePlayerStateByHand(&bitStream, states[i]);
+            else
+                for (int i = 0; i < SCHEMA_STATES; i++) BenchPlayerStateSchema::Write(&bitStream, states[i]);
+            checksum += bitStream.GetData()[iteration & 15];
+        }
+        results[method * 2] = NanosecondsSince(start) / ((double)iterations * SCHEMA_STATES);
+
+        start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            bitStream.ResetReadPointer();
+            if (method == 0)
+                for (int i = 0; i < SCHEMA_STATES; i++) ReadPlayerStateByHand(&bitStream, readState);
+            else
+                for (int i = 0; i < SCHEMA_STATES; i++) BenchPlayerStateSchema::Read(&bitStream, readState);
+            checksum += readState.id;
+        }
+        results[method * 2 + 1] = NanosecondsSince(start) / ((double)iterations * SCHEMA_STATES);
+    }
+    // Keeps the loops from being optimized away
+    if (checksum == 0xFFFFFFFF) printf("\n");
+
+    printf("{\n");
+    printf("  \"benchmark\": \"schema\",\n");
+    printf("  \"iterations\": %i,\n", iterations);
+    printf("  \"message_bits\": %u,\n", (unsigned int)BenchPlayerStateSchema::NUMBER_OF_BITS);
+    printf("  \"hand_written_write_ns\": %.1f,\n", results[0]);
+    printf("  \"hand_written_read_ns\": %.1f,\n", results[1]);
+    printf("  \"schema_write_ns\": %.1f,\n", results[2]);
+    printf("  \"schema_read_ns\": %.1f\n", results[3]);
+    printf("}\n");
+    return 0;
+}
+
+static const int VARINT_VALUES = 1024;
+
+enum VarIntEncoding { VARINT_COMPRESSED, VARINT_LEB128 };
+
+// Writes then reads every value, returning false if anything does not read back
+static bool TimeVarInt(
+    const int32_t* values,
+    bool           zigZag,
+    VarIntEncoding encoding,
+    int            iterations,
+    double&        bitsPerValue,
+    double&        writeNs,
+    double&        readNs
+) {
+    BitStream bitStream;
+    int32_t   checksum = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        bitStream.Reset();
+        for (int i = 0; i < VARINT_VALUES; i++) {
+            if (encoding == VARINT_COMPRESSED) {
+                if (zigZag) bitStream.WriteCompressed(values[i]);
+                else bitStream.WriteCompressed((uint32_t)values[i]);
+            } else {
+                if (zigZag) bitStream.WriteVarIntZigZag(values[i]);
+                else bitStream.WriteVarInt((uint32_t)values[i]);
+            }
+        }
+    }
+    writeNs      = NanosecondsSince(start) / ((double)iterations * VARINT_VALUES);
+    bitsPerValue = (double)bitStream.GetNumberOfBitsUsed() / VARINT_VALUES;
+
+    start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        bitStream.ResetReadPointer();
+        for (int i = 0; i < VARINT_VALUES; i++) {
+            int32_t  value         = 0;
+            uint32_t unsignedValue = 0;
+            bool     success;
+            if (encoding == VARINT_COMPRESSED)
+                success = zigZag ? bitStream.ReadCompressed(value) : bitStream.ReadCompressed(unsignedValue);
+            else success = zigZag ? bitStream.ReadVarIntZigZag(value) : bitStream.ReadVarInt(unsignedValue);
+            if (zigZag == false) value = (int32_t)unsignedValue;
+            if (success == false || value != values[i]) return false;
+            checksum += value;
+        }
+    }
+    readNs = NanosecondsSince(start) / ((double)iterations * VARINT_VALUES);
+    // Keeps the loops from being optimized away
+    if (checksum == 0x7FFFFFFF) printf("\n");
+    return true;
+}
+
+static int RunVarInt(int iterations) {
+    static const char* distributions[] = {"small_unsigned", "small_signed", "full_range"};
+    int32_t            values[3][VARINT_VALUES];
+    unsigned int       seed = 12345;
+    for (int i = 0; i < VARINT_VALUES; i++) {
+        seed         = seed * 1103515245 + 12345;
+        values[0][i] = (int32_t)(seed >> 16) % 300;
+        values[1][i] = (int32_t)((seed >> 16) % 200) - 100;
+        values[2][i] = (int32_t)(seed ^ (seed << 13));
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"varint\",\n");
+    printf("  \"iterations\": %i", iterations);
+    for (int distribution = 0; distribution < 3; distribution++) {
+        // Only the signed values go through zigzag
+        bool zigZag = distribution != 0;
+        for (int encoding = VARINT_COMPRESSED; encoding <= VARINT_LEB128; encoding++) {
+            double bitsPerValue, writeNs, readNs;
+            bool   readBack = TimeVarInt(
+                values[distribution],
+                zigZag,
+                (VarIntEncoding)encoding,
+                iterations,
+                bitsPerValue,
+                writeNs,
+                readNs
+            );
+            if (readBack == false) {
+                fprintf(stderr, "\nvarint %s did not read back\n", distributions[distribution]);
+                return 1;
+            }
+            const char* name = encoding == VARINT_COMPRESSED ? "compressed" : "varint";
+            printf(",\n  \"%s_%s_bits\": %.2f", distributions[distribution], name, bitsPerValue);
+            printf(",\n  \"%s_%s_write_ns\": %.1f", distributions[distribution], name, writeNs);
+            printf(",\n  \"%s_%s_read_ns\": %.1f", distributions[distribution], name, readNs);
+        }
+    }
+    printf("\n}\n");
+    return 0;
+}
+
+static const char* HUFFMAN_CORPUS[] = {
+    "gg",
+    "anyone want to trade a sword for 200 gold?",
+    "Player_4821 has joined the game",
+    "Player_4821 has left the game (timed out)",
+    "lol that was close",
+    "meet at the north gate in 5 minutes",
+    "maps/desert/outpost_03.map",
+    "textures/characters/knight_helmet_diffuse.dds",
+    "The server will restart in 10 minutes for maintenance.",
+    "DragonSlayer99",
+    "xXShadowHunterXx",
+    "can someone revive me? I'm at the bridge",
+    "[Team] push mid now, they only have two left",
+    "Welcome to the official EU #3 server! Please read the rules at www.example.com/rules",
+    "brb",
+    "/whisper Aria thanks for the help earlier :)",
+};
+
+// The tree walk HuffmanEncodingTree used before its decode table, rebuilt from the codes the tree produces
+struct ReferenceHuffman {
+    struct Node {
+        int           child[2];
+        unsigned char value;
+    };
+    std::vector<Node> nodes;
+    unsigned char     encoding[256][32];
+    unsigned int      bitLength[256];
+
+    void Generate(HuffmanEncodingTree& tree) {
+        nodes.assign(1, Node());
+        nodes[0].child[0] = nodes[0].child[1] = -1;
+        for (int symbol = 0; symbol < 256; symbol++) {
+            unsigned char input = (unsigned char)symbol;
+            BitStream     encoded;
+            tree.EncodeArray(&input, 1, &encoded);
+            // The code is followed by padding, so find where it ends by decoding longer and longer prefixes
+            unsigned char decoded;
+            bitLength[symbol] = 1;
+            while (true) {
+                encoded.ResetReadPointer();
+                if (tree.DecodeArray(&encoded, bitLength[symbol], 1, &decoded) == 1) break;
+                bitLength[symbol]++;
+            }
+            memcpy(encoding[symbol], encoded.GetData(), encoded.GetNumberOfBytesUsed());
+
+            int node = 0;
+            for (unsigned int bit = 0; bit < bitLength[symbol]; bit++) {
+                int side = (encoding[symbol][bit >> 3] >> (7 - (bit & 7))) & 1;
+                if (nodes[node].child[side] < 0) {
+                    nodes[node].child[side] = (int)nodes.size();
+                    Node child;
+                    child.child[0] = child.child[1] = -1;
+                    child.value                     = 0;
+                    nodes.push_back(child);
+                }
+                node = nodes[node].child[side];
+            }
+            nodes[node].value = (unsigned char)symbol;
+        }
+    }
+
+    void Encode(const unsigned char* input, size_t sizeInBytes, BitStream* output) const {
+        for (size_t i = 0; i < sizeInBytes; i++) output->WriteBits(encoding[input[i]], bitLength[input[i]], false);
+    }
+
+    unsigned Decode(BitStream* input, BitSize_t sizeInBits, unsigned char* output) const {
+        unsigned outputWriteIndex = 0;
+        int      node             = 0;
+        for (BitSize_t counter = 0; counter < sizeInBits; counter++) {
+            node = nodes[node].child[input->ReadBit() ? 1 : 0];
+            if (nodes[node].child[0] < 0) {
+                output[outputWriteIndex++] = nodes[node].value;
+                node                       = 0;
+            }
+        }
+        return outputWriteIndex;
+    }
+};
+
+static int RunHuffman(int iterations) {
+    const int    corpusLines = (int)(sizeof(HUFFMAN_CORPUS) / sizeof(HUFFMAN_CORPUS[0]));
+    unsigned int frequencyTable[256];
+    size_t       corpusBytes = 0;
+    memset(frequencyTable, 0, sizeof(frequencyTable));
+    for (int line = 0; line < corpusLines; line++) {
+        for (const char* c = HUFFMAN_CORPUS[line]; *c; c++) frequencyTable[(unsigned char)*c]++;
+        corpusBytes += strlen(HUFFMAN_CORPUS[line]);
+    }
+
+    HuffmanEncodingTree tree;
+    tree.GenerateFromFrequencyTable(frequencyTable);
+    ReferenceHuffman reference;
+    reference.Generate(tree);
+
+    // Encode every line both ways, which must give the same bits, and check each decoder reads them back
+    BitStream     encoded[2];
+    unsigned char decoded[256];
+    for (int line = 0; line < corpusLines; line++) {
+        const unsigned char* input  = (const unsigned char*)HUFFMAN_CORPUS[line];
+        size_t               length = strlen(HUFFMAN_CORPUS[line]);
+        BitStream            byTree, byReference;
+        tree.EncodeArray((unsigned char*)input, length, &byTree);
+        reference.Encode(input, length, &byReference);
+        if (byTree.GetNumberOfBitsUsed() < byReference.GetNumberOfBitsUsed()
+            || memcmp(byTree.GetData(), byReference.GetData(), BITS_TO_BYTES(byReference.GetNumberOfBitsUsed()) - 1)
+                   != 0
+            || reference.Decode(&byTree, byReference.GetNumberOfBitsUsed(), decoded) != length
+            || memcmp(decoded, input, length) != 0
+            || tree.DecodeArray(&byReference, byReference.GetNumberOfBitsUsed(), sizeof(decoded), decoded) != length
+            || memcmp(decoded, input, length) != 0) {
+            fprintf(stderr, "HuffmanEncodingTree does not match the tree walk on line %i\n", line);
+            return 1;
+        }
+        byReference.ResetReadPointer();
+        byTree.ResetReadPointer();
+        encoded[0].Write(byReference.GetNumberOfBitsUsed());
+        encoded[0].Write(byReference);
+        encoded[1].Write(byTree.GetNumberOfBitsUsed());
+        encoded[1].Write(byTree);
+    }
+
+    // Both encoders, then both decoders, each over the whole corpus
+    BitStream    bitStream;
+    unsigned int checksum = 0;
+    double       nsPerByte[4];
+    for (int method = 0; method < 2; method++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            for (int line = 0; line < corpusLines; line++) {
+                bitStream.Reset();
+                unsigned char* input = (unsigned char*)HUFFMAN_CORPUS[line];
+                if (method == 0) reference.Encode(input, strlen(HUFFMAN_CORPUS[line]), &bitStream);
+                else tree.EncodeArray(input, strlen(HUFFMAN_CORPUS[line]), &bitStream);
+                checksum += bitStream.GetData()[0];
+            }
+        }
+        nsPerByte[method * 2] = NanosecondsSince(start) / ((double)iterations * corpusBytes);
+
+        start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            encoded[method].ResetReadPointer();
+            for (int line = 0; line < corpusLines; line++) {
+                BitSize_t bitsUsed = 0;
+                encoded[method].Read(bitsUsed);
+                if (method == 0) checksum += reference.Decode(&encoded[method], bitsUsed, decoded);
+                else checksum += tree.DecodeArray(&encoded[method], bitsUsed, sizeof(decoded), decoded);
+            }
+        }
+        nsPerByte[method * 2 + 1] = NanosecondsSince(start) / ((double)iterations * corpusBytes);
+    }
+    // Keeps the loops from being optimized away
+    if (checksum == 0xFFFFFFFF) printf("\n");
+
+    printf("{\n");
+    printf("  \"benchmark\": \"huffman\",\n");
+    printf("  \"iterations\": %i,\n", iterations);
+    printf("  \"corpus_bytes\": %u,\n", (unsigned int)corpusBytes);
+    printf(
+        "  \"encoded_bytes\": %u,\n",
+        (unsigned int)(encoded[1].GetNumberOfBytesUsed() - corpusLines * sizeof(BitSize_t))
+    );
+    printf("  \"tree_walk_encode_ns_per_byte\": %.2f,\n", nsPerByte[0]);
+    printf("  \"tree_walk_decode_ns_per_byte\": %.2f,\n", nsPerByte[1]);
+    printf("  \"table_encode_ns_per_byte\": %.2f,\n", nsPerByte[2]);
+    printf("  \"table_decode_ns_per_byte\": %.2f\n", nsPerByte[3]);
+    printf("}\n");
+    return 0;
+}
+
+static const int RAKSTRING_SOURCES = 64;
+
+// Each thread copies strings the others are copying too, and appends to one so it has to be cloned
+static double TimeRakString(const RakString* sources, int iterations, int threads, double& heapCallsPerOperation) {
+    std::atomic<size_t>      checksum(0);
+    std::vector<std::thread> workers;
+    long long                heapCallsBefore = heapCalls.load();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int thread = 0; thread < threads; thread++) {
+        workers.emplace_back([&, thread]() {
+            size_t length = 0;
+            for (int i = 0; i < iterations; i++) {
+                RakString copy     = sources[(i + thread) % RAKSTRING_SOURCES];
+                RakString appended = copy;
+                appended          += '!';
+                length            += copy.GetLength() + appended.GetLength();
+            }
+            checksum += length;
+        });
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double nanoseconds = NanosecondsSince(start);
+
+    heapCallsPerOperation = (double)(heapCalls.load() - heapCallsBefore) / ((double)iterations * threads);
+    // Keeps the loops from being optimized away
+    if (checksum.load() == 0) printf("\n");
+    return nanoseconds / ((double)iterations * threads);
+}
+
+static int RunRakString(int iterations, int threads) {
+    RakString shortSources[RAKSTRING_SOURCES];
+    RakString longSources[RAKSTRING_SOURCES];
+    for (int i = 0; i < RAKSTRING_SOURCES; i++) {
+        shortSources[i] = RakString("Player_%i", i);
+        longSources[i]  = RakString("Player_%i has joined the game, say hello in the lobby channel", i);
+    }
+
+    double shortHeapCalls, longHeapCalls;
+    double shortNs = TimeRakString(shortSources, iterations, threads, shortHeapCalls);
+    double longNs  = TimeRakString(longSources, iterations, threads, longHeapCalls);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"rakstring\",\n");
+    printf("  \"iterations\": %i,\n", iterations);
+    printf("  \"threads\": %i,\n", threads);
+    printf("  \"short_ns\": %.1f,\n", shortNs);
+    printf("  \"short_heap_calls\": %.3f,\n", shortHeapCalls);
+    printf("  \"long_ns\": %.1f,\n", longNs);
+    printf("  \"long_heap_calls\": %.3f\n", longHeapCalls);
+    printf("}\n");
+    return 0;
+}
+
+static const int ALLOCATOR_SLOTS = 1024;
+
+// Each thread keeps a window of live blocks. Every fourth block is swapped through a table shared by all threads,
+// so it is freed by whichever thread takes it out
+static double TimeAllocator(int iterations, int threads) {
+    static const size_t sizes[] = {sizeof(InternalPacket), sizeof(Packet), MAXIMUM_MTU_SIZE, 32, 64, 200, 600, 4096};
+    static const int    sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+
+    std::vector<std::atomic<void*>> shared(ALLOCATOR_SLOTS);
+    std::vector<std::thread>        workers;
+    std::atomic<size_t>             checksum(0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int thread = 0; thread < threads; thread++) {
+        workers.emplace_back([&, thread]() {
+            void*        local[ALLOCATOR_SLOTS] = {0};
+            unsigned int seed                   = thread + 1;
+            size_t       touched                = 0;
+            for (int i = 0; i < iterations; i++) {
+                seed                 = seed * 1103515245 + 12345;
+                size_t         size  = sizes[(seed >> 16) % sizeCount];
+                unsigned char* block = (unsigned char*)rakMalloc_Ex(size, _FILE_AND_LINE_);
+                block[0]             = (unsigned char)i;
+                touched             += block[0];
+                void*& slot          = local[(seed >> 8) % ALLOCATOR_SLOTS];
+                if ((i & 3) == 0) {
+                    rakFree_Ex(shared[(seed >> 8) % ALLOCATOR_SLOTS].exchange(block), _FILE_AND_LINE_);
+                } else {
+                    rakFree_Ex(slot, _FILE_AND_LINE_);
+                    slot = block;
+                }
+            }
+            for (int i = 0; i < ALLOCATOR_SLOTS; i++) rakFree_Ex(local[i], _FILE_AND_LINE_);
+            checksum += touched;
+        });
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double nanoseconds = NanosecondsSince(start);
+    for (int i = 0; i < ALLOCATOR_SLOTS; i++) rakFree_Ex(shared[i].exchange(0), _FILE_AND_LINE_);
+
+    // Keeps the loops from being optimized away
+    if (checksum.load() == 1) printf("\n");
+    return nanoseconds / ((double)iterations * threads);
+}
+
+static int RunAllocator(int iterations, int threads) {
+    // Time plain malloc rather than the counting hooks. Nothing has been allocated through them yet
+    SetMalloc_Ex(_RakMalloc_Ex);
+    SetRealloc_Ex(_RakRealloc_Ex);
+    SetFree_Ex(_RakFree_Ex);
+    double mallocNs = TimeAllocator(iterations, threads);
+
+    if (UseSlabAllocator(true) == false) {
+        fprintf(stderr, "UseSlabAllocator failed\n");
+        return 1;
+    }
+    double slabNs = TimeAllocator(iterations, threads);
+
+    // Every block from the runs before has been freed, so nothing is missing its header
+    UseAllocationTracking();
+    double trackedNs = TimeAllocator(iterations, threads);
+
+    SlabAllocatorStatistics statistics;
+    GetSlabAllocatorStatistics(&statistics);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"allocator\",\n");
+    printf("  \"iterations\": %i,\n", iterations);
+    printf("  \"threads\": %i,\n", threads);
+    printf("  \"malloc_ns\": %.1f,\n", mallocNs);
+    printf("  \"slab_ns\": %.1f,\n", slabNs);
+    printf("  \"slab_tracked_ns\": %.1f,\n", trackedNs);
+    printf("  \"slab_bytes\": %llu,\n", (unsigned long long)statistics.slabBytes);
+    printf("  \"huge_pages\": %s\n", statistics.hugePages ? "true" : "false");
+    printf("}\n");
+    return 0;
+}
+
+static std::atomic<int> threadPoolJobsDone(0);
+
+static int ThreadPoolJob(int input, bool* returnOutput, void* perThreadData) {
+    (void)perThreadData;
+    *returnOutput = false;
+    threadPoolJobsDone.fetch_add(1, std::memory_order_relaxed);
+    return input;
+}
+
+// What ThreadPool did before it had a queue per thread: one queue behind a mutex, signalled on every AddInput()
+struct MutexQueuePool {
+    SimpleMutex                                       inputQueueMutex, workingThreadCountMutex, runThreadsMutex;
+    DataStructures::Queue<int>                        inputQueue;
+    DataStructures::Queue<int (*)(int, bool*, void*)> inputFunctionQueue;
+    SignaledEvent                                     quitAndIncomingDataEvents;
+    bool                                              runThreads;
+    int                                               numThreadsWorking;
+    std::vector<std::thread>                          workers;
+
+    void Start(int threads) {
+        quitAndIncomingDataEvents.InitEvent();
+        runThreads        = true;
+        numThreadsWorking = 0;
+        for (int i = 0; i < threads; i++) workers.emplace_back([this]() { Work(); });
+    }
+    void Stop(void) {
+        runThreadsMutex.Lock();
+        runThreads = false;
+        runThreadsMutex.Unlock();
+        for (size_t i = 0; i < workers.size(); i++) {
+            quitAndIncomingDataEvents.SetEvent();
+            workers[i].join();
+        }
+        quitAndIncomingDataEvents.CloseEvent();
+    }
+    void AddInput(int (*callback)(int, bool*, void*), int input) {
+        inputQueueMutex.Lock();
+        inputQueue.Push(input, _FILE_AND_LINE_);
+        inputFunctionQueue.Push(callback, _FILE_AND_LINE_);
+        inputQueueMutex.Unlock();
+        quitAndIncomingDataEvents.SetEvent();
+    }
+    void Work(void) {
+        int (*callback)(int, bool*, void*) = 0;
+        int  input                         = 0;
+        bool returnOutput;
+        while (1) {
+            if (callback == 0) quitAndIncomingDataEvents.WaitOnEvent(1000);
+
+            runThreadsMutex.Lock();
+            bool run = runThreads;
+            runThreadsMutex.Unlock();
+            if (run == false) break;
+
+            workingThreadCountMutex.Lock();
+            ++numThreadsWorking;
+            workingThreadCountMutex.Unlock();
+
+            callback = 0;
+            inputQueueMutex.Lock();
+            if (inputFunctionQueue.Size()) {
+                callback = inputFunctionQueue.Pop();
+                input    = inputQueue.Pop();
+            }
+            inputQueueMutex.Unlock();
+            if (callback) callback(input, &returnOutput, 0);
+
+            workingThreadCountMutex.Lock();
+            --numThreadsWorking;
+            workingThreadCountMutex.Unlock();
+        }
+    }
+};
+
+static const int THREADPOOL_BATCH = 64;
+
+enum ThreadPoolMode { THREADPOOL_MUTEX_QUEUE, THREADPOOL_ADD_INPUT, THREADPOOL_ADD_INPUTS };
+
+// Adds every job from this thread and waits for the last to finish
+static double TimeThreadPool(ThreadPoolMode mode, int jobs, int threads) {
+    MutexQueuePool       mutexQueuePool;
+    ThreadPool<int, int> threadPool;
+    if (mode == THREADPOOL_MUTEX_QUEUE) mutexQueuePool.Start(threads);
+    else threadPool.StartThreads(threads, 0);
+    threadPoolJobsDone = 0;
+
+    int inputs[THREADPOOL_BATCH];
+    for (int i = 0; i < THREADPOOL_BATCH; i++) inputs[i] = i;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (mode == THREADPOOL_ADD_INPUTS) {
+        for (int i = 0; i < jobs; i += THREADPOOL_BATCH)
+            threadPool.AddInputs(ThreadPoolJob, inputs, (unsigned int)std::min(THREADPOOL_BATCH, jobs - i));
+    } else {
+        for (int i = 0; i < jobs; i++) {
+            if (mode == THREADPOOL_MUTEX_QUEUE) mutexQueuePool.AddInput(ThreadPoolJob, i);
+            else threadPool.AddInput(ThreadPoolJob, i);
+        }
+    }
+    while (threadPoolJobsDone.load(std::memory_order_relaxed) < jobs) std::this_thread::yield();
+    double nanoseconds = NanosecondsSince(start);
+
+    if (mode == THREADPOOL_MUTEX_QUEUE) mutexQueuePool.Stop();
+    else threadPool.StopThreads();
+    return nanoseconds / jobs;
+}
+
+static int RunThreadPool(int jobs, int threads) {
+    double mutexQueueNs = TimeThreadPool(THREADPOOL_MUTEX_QUEUE, jobs, threads);
+    double addInputNs   = TimeThreadPool(THREADPOOL_ADD_INPUT, jobs, threads);
+    double addInputsNs  = TimeThreadPool(THREADPOOL_ADD_INPUTS, jobs, threads);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"threadpool\",\n");
+    printf("  \"jobs\": %i,\n", jobs);
+    printf("  \"threads\": %i,\n", threads);
+    printf("  \"mutex_queue_ns_per_job\": %.1f,\n", mutexQueueNs);
+    printf("  \"add_input_ns_per_job\": %.1f,\n", addInputNs);
+    printf("  \"add_inputs_ns_per_job\": %.1f\n", addInputsNs);
+    printf("}\n");
+    return 0;
+}
+
+// CPU time used by the calling thread, which unlike wall time leaves out the send threads
+static double ThreadCpuNanoseconds(void) {
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+    unsigned long long kernel = ((unsigned long long)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    unsigned long long user   = ((unsigned long long)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    return (double)(kernel + user) * 100.0;
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+#endif
+}
+
+static RakNetSocket2* BindLoopbackSocket(void) {
+    RakNetSocket2* s = RakNetSocket2Allocator::AllocRNS2();
+    if (s->IsBerkleySocket() == false) {
+        RakNetSocket2Allocator::DeallocRNS2(s);
+        return 0;
+    }
+    RNS2_BerkleyBindParameters bbp;
+    bbp.port                                      = 0;
+    bbp.hostAddress                               = (char*)"127.0.0.1";
+    bbp.addressFamily                             = AF_INET;
+    bbp.type                                      = SOCK_DGRAM;
+    bbp.protocol                                  = 0;
+    bbp.nonBlockingSocket                         = false;
+    bbp.setBroadcast                              = false;
+    bbp.setIPHdrIncl                              = false;
+    bbp.doNotFragment                             = false;
+    bbp.pollingThreadPriority                     = 0;
+    bbp.eventHandler                              = 0;
+    bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2 = 0;
+    if (((RNS2_Berkley*)s)->Bind(&bbp, _FILE_AND_LINE_) != BR_SUCCESS) {
+        RakNetSocket2Allocator::DeallocRNS2(s);
+        return 0;
+    }
+    return s;
+}
+
+static const int SENDTHREAD_DATAGRAM_BYTES = 1200;
+
+static int RunSendThread(int datagrams, int sockets) {
+    // Nothing reads from the receiver, so the kernel drops what does not fit in its buffer
+    RakNetSocket2* receiver = BindLoopbackSocket();
+    if (receiver == 0) {
+        fprintf(stderr, "Could not bind a loopback socket\n");
+        return 1;
+    }
+    std::vector<RakNetSocket2*> senders;
+    for (int i = 0; i < sockets; i++) {
+        RakNetSocket2* s = BindLoopbackSocket();
+        if (s == 0) {
+            fprintf(stderr, "Could not bind a loopback socket\n");
+            return 1;
+        }
+        senders.push_back(s);
+    }
+
+    char payload[SENDTHREAD_DATAGRAM_BYTES];
+    for (int i = 0; i < SENDTHREAD_DATAGRAM_BYTES; i++) payload[i] = (char)i;
+    SystemAddress target = receiver->GetBoundAddress();
+
+    RNS2_SendParameters bsp;
+    bsp.data          = payload;
+    bsp.length        = SENDTHREAD_DATAGRAM_BYTES;
+    bsp.systemAddress = target;
+    double cpuStart   = ThreadCpuNanoseconds();
+    for (int i = 0; i < datagrams; i++) senders[i % sockets]->Send(&bsp, _FILE_AND_LINE_);
+    double directCpuNs = (ThreadCpuNanoseconds() - cpuStart) / datagrams;
+
+    SendToThread::AddRef();
+    // Starts the send threads outside the timed loop
+    for (int i = 0; i < sockets; i++) {
+        SendToThread::SendToThreadBlock* block = SendToThread::AllocateBlock();
+        memcpy(block->data, payload, SENDTHREAD_DATAGRAM_BYTES);
+        block->dataWriteOffset = SENDTHREAD_DATAGRAM_BYTES;
+        block->s               = senders[i];
+        block->systemAddress   = target;
+        SendToThread::ProcessBlock(block);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cpuStart                                    = ThreadCpuNanoseconds();
+    for (int i = 0; i < datagrams; i++) {
+        SendToThread::SendToThreadBlock* block = SendToThread::AllocateBlock();
+        memcpy(block->data, payload, SENDTHREAD_DATAGRAM_BYTES);
+        block->dataWriteOffset = SENDTHREAD_DATAGRAM_BYTES;
+        block->s               = senders[i % sockets];
+        block->systemAddress   = target;
+        SendToThread::ProcessBlock(block);
+    }
+    double threadedCpuNs = (ThreadCpuNanoseconds() - cpuStart) / datagrams;
+    // Waits for everything queued to be sent
+    for (int i = 0; i < sockets; i++) SendToThread::RemoveSocket(senders[i]);
+    double threadedWallNs = NanosecondsSince(start) / datagrams;
+    SendToThread::Deref();
+
+    for (int i = 0; i < sockets; i++) RakNetSocket2Allocator::DeallocRNS2(senders[i]);
+    RakNetSocket2Allocator::DeallocRNS2(receiver);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"sendthread\",\n");
+    printf("  \"datagrams\": %i,\n", datagrams);
+    printf("  \"sockets\": %i,\n", sockets);
+    printf("  \"datagram_bytes\": %i,\n", SENDTHREAD_DATAGRAM_BYTES);
+    printf("  \"direct_cpu_ns\": %.1f,\n", directCpuNs);
+    printf("  \"threaded_cpu_ns\": %.1f,\n", threadedCpuNs);
+    printf("  \"threaded_wall_ns\": %.1f\n", threadedWallNs);
+    printf("}\n");
+    return 0;
+}
+
+// Kept out of reach of the optimizer, so the disabled case still loads and branches
+static volatile uint32_t traceBenchBytes = 1200;
+
+static int RunTrace(int events) {
+    SystemAddress systemAddress("127.0.0.1", 60000);
+
+    StopEventTrace();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < events; i++)
+        RAKNET_TRACE_EVENT(EVENT_TRACE_DATAGRAM_SENT, systemAddress, (uint32_t)i, traceBenchBytes, 1);
+    double disabledNs = NanosecondsSince(start) / events;
+
+    StartEventTrace();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < events; i++)
+        RAKNET_TRACE_EVENT(EVENT_TRACE_DATAGRAM_SENT, systemAddress, (uint32_t)i, traceBenchBytes, 1);
+    double tracedNs = NanosecondsSince(start) / events;
+    StopEventTrace();
+
+    // What PacketLogger::FormatLine() does for each datagram, short of writing the line anywhere
+    char         line[256];
+    char         address[64];
+    unsigned int checksum = 0;
+    start                 = std::chrono::steady_clock::now();
+    for (int i = 0; i < events; i++) {
+        systemAddress.ToString(true, address);
+        checksum += (unsigned int)snprintf(
+            line,
+            sizeof(line),
+            "%s,%s%s,%s,%s,%5u,%s,%u,%" PRINTF_64_BIT_MODIFIER "u,%s,%s,%i,%i,%i,%i,%s,",
+            "Snd",
+            "Raw",
+            "",
+            "",
+            "",
+            (unsigned int)i,
+            "",
+            (unsigned int)traceBenchBytes,
+            (unsigned long long)RakNet::GetTimeUS(),
+            address,
+            address,
+            i,
+            0,
+            0,
+            1,
+            "ID_USER_PACKET_ENUM"
+        );
+    }
+    double textNs = NanosecondsSince(start) / events;
+    if (checksum == 0xFFFFFFFF) printf("\n");
+
+    printf("{\n");
+    printf("  \"benchmark\": \"trace\",\n");
+    printf("  \"events\": %i,\n", events);
+    printf("  \"disabled_ns_per_event\": %.1f,\n", disabledNs);
+    printf("  \"traced_ns_per_event\": %.1f,\n", tracedNs);
+    printf("  \"text_ns_per_event\": %.1f\n", textNs);
+    printf("}\n");
+    return 0;
+}
+
+// Writes to a temporary file, rather than one named after the time in the working directory
+class BenchPacketFileLogger : public PacketFileLogger {
+public:
+    void StartTemporaryLog(void) {
+        packetLogFile = tmpfile();
+        LogHeader();
+    }
+};
+
+static int RunPacketLog(int messages) {
+    RakPeerInterface* peer = RakPeerInterface::GetInstance();
+    SystemAddress     remoteSystemAddress("127.0.0.1", 60000);
+
+    unsigned char  data[64] = {ID_USER_PACKET_ENUM};
+    InternalPacket internalPacket;
+    internalPacket.data             = data;
+    internalPacket.dataBitLength    = BYTES_TO_BITS(sizeof(data));
+    internalPacket.reliability      = RELIABLE_ORDERED;
+    internalPacket.splitPacketId    = 0;
+    internalPacket.splitPacketIndex = 0;
+    internalPacket.splitPacketCount = 0;
+    internalPacket.orderingIndex    = 0;
+
+    BenchPacketFileLogger fileLogger;
+    peer->AttachPlugin(&fileLogger);
+    fileLogger.StartTemporaryLog();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        internalPacket.reliableMessageNumber = i;
+        internalPacket.orderingIndex         = i;
+        fileLogger.OnInternalPacket(&internalPacket, i, remoteSystemAddress, RakNet::GetTimeMS(), 1);
+    }
+    double fileNs = NanosecondsSince(start) / messages;
+    peer->DetachPlugin(&fileLogger);
+
+    AsyncPacketFileLogger asyncLogger;
+    peer->AttachPlugin(&asyncLogger);
+    asyncLogger.StartLog(tmpfile());
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        internalPacket.reliableMessageNumber = i;
+        internalPacket.orderingIndex         = i;
+        asyncLogger.OnInternalPacket(&internalPacket, i, remoteSystemAddress, RakNet::GetTimeMS(), 1);
+    }
+    double asyncNs = NanosecondsSince(start) / messages;
+    start          = std::chrono::steady_clock::now();
+    asyncLogger.StopLog();
+    double       drainMs = NanosecondsSince(start) / 1000000.0;
+    unsigned int dropped = asyncLogger.GetDroppedRecordCount();
+    peer->DetachPlugin(&asyncLogger);
+    RakPeerInterface::DestroyInstance(peer);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"packetlog\",\n");
+    printf("  \"messages\": %i,\n", messages);
+    printf("  \"file_ns_per_message\": %.1f,\n", fileNs);
+    printf("  \"async_ns_per_message\": %.1f,\n", asyncNs);
+    printf("  \"async_stop_ms\": %.1f,\n", drainMs);
+    printf("  \"async_dropped\": %u\n", dropped);
+    printf("}\n");
+    return 0;
+}
+
+// CPU time used by every thread of the process, RakPeer's own threads included
+static double ProcessCpuNanoseconds(void) {
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+    unsigned long long kernel = ((unsigned long long)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    unsigned long long user   = ((unsigned long long)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    return (double)(kernel + user) * 100.0;
+#else
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+#endif
+}
+
+static const int            LOOPBACK_PINGS           = 500;
+static const RakNet::TimeMS LOOPBACK_IDLE_TIMEOUT_MS = 1000;
+
+struct LoopbackCase {
+    PacketReliability reliability;
+    PacketPriority    priority;
+    const char*       reliabilityName;
+    const char*       priorityName;
+};
+
+// Every reliability at MEDIUM_PRIORITY, then the other priorities with RELIABLE_ORDERED
+static const LoopbackCase LOOPBACK_CASES[] = {
+    {UNRELIABLE,           MEDIUM_PRIORITY,    "UNRELIABLE",           "MEDIUM_PRIORITY"   },
+    {UNRELIABLE_SEQUENCED, MEDIUM_PRIORITY,    "UNRELIABLE_SEQUENCED", "MEDIUM_PRIORITY"   },
+    {RELIABLE,             MEDIUM_PRIORITY,    "RELIABLE",             "MEDIUM_PRIORITY"   },
+    {RELIABLE_ORDERED,     MEDIUM_PRIORITY,    "RELIABLE_ORDERED",     "MEDIUM_PRIORITY"   },
+    {RELIABLE_SEQUENCED,   MEDIUM_PRIORITY,    "RELIABLE_SEQUENCED",   "MEDIUM_PRIORITY"   },
+    {RELIABLE_ORDERED,     IMMEDIATE_PRIORITY, "RELIABLE_ORDERED",     "IMMEDIATE_PRIORITY"},
+    {RELIABLE_ORDERED,     HIGH_PRIORITY,      "RELIABLE_ORDERED",     "HIGH_PRIORITY"     },
+    {RELIABLE_ORDERED,     LOW_PRIORITY,       "RELIABLE_ORDERED",     "LOW_PRIORITY"      },
+};
+static const int LOOPBACK_CASE_COUNT = (int)(sizeof(LOOPBACK_CASES) / sizeof(LOOPBACK_CASES[0]));
+
+struct LoopbackResult {
+    int    received;
+    double messagesPerSecond;
+    double megabytesPerSecond;
+    double cpuNsPerMessage;
+};
+
+static RakPeerInterface* StartLoopbackPeer(unsigned int maxConnections) {
+    RakPeerInterface* peer = RakPeerInterface::GetInstance();
+    SocketDescriptor  socketDescriptor(0, "127.0.0.1");
+    if (peer->Startup(maxConnections, &socketDescriptor, 1) != RAKNET_STARTED) {
+        RakPeerInterface::DestroyInstance(peer);
+        return 0;
+    }
+    return peer;
+}
+
+// Sends \a messages messages of \a bytes bytes from client to server all at once, and times until the server has
+// them all, or has gone LOOPBACK_IDLE_TIMEOUT_MS without one. Unreliable messages still queued after RakPeer's default
+// unreliable timeout of 1000 ms are dropped, so those cases receive fewer
+static void TimeLoopbackCase(
+    RakPeerInterface*   server,
+    RakPeerInterface*   client,
+    SystemAddress       serverAddress,
+    const LoopbackCase& loopbackCase,
+    int                 messages,
+    int                 bytes,
+    LoopbackResult&     result
+) {
+    std::vector<char> payload(bytes);
+    for (int i = 0; i < bytes; i++) payload[i] = (char)i;
+    payload[0] = (char)ID_USER_PACKET_ENUM;
+
+    std::chrono::steady_clock::time_point start    = std::chrono::steady_clock::now();
+    double                                cpuStart = ProcessCpuNanoseconds();
+    for (int i = 0; i < messages; i++)
+        client->Send(&payload[0], bytes, loopbackCase.priority, loopbackCase.reliability, 0, serverAddress, false);
+
+    int            received        = 0;
+    double         elapsedNs       = 0.0;
+    double         cpuNs           = 0.0;
+    RakNet::TimeMS lastReceiveTime = RakNet::GetTimeMS();
+    while (received < messages && RakNet::GetTimeMS() - lastReceiveTime < LOOPBACK_IDLE_TIMEOUT_MS) {
+        bool gotMessage = false;
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {
+            if (p->data[0] != ID_USER_PACKET_ENUM) continue;
+            received++;
+            gotMessage = true;
+        }
+        for (Packet* p = client->Receive(); p; client->DeallocatePacket(p), p = client->Receive()) {}
+        if (gotMessage) {
+            elapsedNs       = NanosecondsSince(start);
+            cpuNs           = ProcessCpuNanoseconds() - cpuStart;
+            lastReceiveTime = RakNet::GetTimeMS();
+        } else RakSleep(1);
+    }
+
+    double seconds            = elapsedNs > 0.0 ? elapsedNs / 1e9 : 1.0;
+    result.received           = received;
+    result.messagesPerSecond  = received / seconds;
+    result.megabytesPerSecond = (double)received * bytes / seconds / 1e6;
+    result.cpuNsPerMessage    = received ? cpuNs / received : 0.0;
+}
+
+// Sends LOOPBACK_PINGS timestamps from client to server one at a time, which the server sends back, and records the
+// round trip times
+static void TimeLoopbackRoundTrips(
+    RakPeerInterface* server,
+    RakPeerInterface* client,
+    SystemAddress     serverAddress,
+    LatencyHistogram& histogram
+) {
+    for (int i = 0; i < LOOPBACK_PINGS; i++) {
+        BitStream bitStream;
+        bitStream.Write((MessageID)(ID_USER_PACKET_ENUM + 1));
+        bitStream.Write(RakNet::GetTimeUS());
+        client->Send(&bitStream, HIGH_PRIORITY, RELIABLE_ORDERED, 0, serverAddress, false);
+
+        bool           answered  = false;
+        RakNet::TimeMS startTime = RakNet::GetTimeMS();
+        while (answered == false && RakNet::GetTimeMS() - startTime < LOOPBACK_IDLE_TIMEOUT_MS) {
+            for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {
+                if (p->data[0] == ID_USER_PACKET_ENUM + 1)
+                    server->Send((const char*)p->data, p->length, HIGH_PRIORITY, RELIABLE_ORDERED, 0, p->guid, false);
+            }
+            for (Packet* p = client->Receive(); p; client->DeallocatePacket(p), p = client->Receive()) {
+                if (p->data[0] != ID_USER_PACKET_ENUM + 1) continue;
+                BitStream      reply(p->data, p->length, false);
+                RakNet::TimeUS sentTime;
+                reply.IgnoreBytes(sizeof(MessageID));
+                reply.Read(sentTime);
+                histogram.Record(RakNet::GetTimeUS() - sentTime);
+                answered = true;
+            }
+            if (answered == false) RakSleep(0);
+        }
+    }
+}
+
+// Connects \a connections clients at once and returns how long the server took to accept them all, in nanoseconds
+static double TimeLoopbackAccepts(unsigned short serverPort, RakPeerInterface* server, int connections, int& accepted) {
+    std::vector<RakPeerInterface*> clients;
+    for (int i = 0; i < connections; i++) {
+        RakPeerInterface* client = StartLoopbackPeer(1);
+        if (client) clients.push_back(client);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < clients.size(); i++) clients[i]->Connect("127.0.0.1", serverPort, 0, 0);
+    accepted                 = 0;
+    double         elapsedNs = 0.0;
+    RakNet::TimeMS startTime = RakNet::GetTimeMS();
+    while (accepted < connections && RakNet::GetTimeMS() - startTime < CONNECT_TIMEOUT_MS) {
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {
+            if (p->data[0] != ID_NEW_INCOMING_CONNECTION) continue;
+            accepted++;
+            elapsedNs = NanosecondsSince(start);
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            for (Packet* p = clients[i]->Receive(); p; clients[i]->DeallocatePacket(p), p = clients[i]->Receive()) {}
+        }
+        RakSleep(1);
+    }
+
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i]->Shutdown(0);
+        RakPeerInterface::DestroyInstance(clients[i]);
+    }
+    return elapsedNs;
+}
+
+static int RunLoopback(int messages, int bytes, int connections) {
+    RakPeerInterface* server = StartLoopbackPeer((unsigned int)connections + 1);
+    RakPeerInterface* client = StartLoopbackPeer(1);
+    if (server == 0 || client == 0) {
+        fprintf(stderr, "Could not start peers on 127.0.0.1\n");
+        return 1;
+    }
+    server->SetMaximumIncomingConnections((unsigned int)connections + 1);
+    unsigned short serverPort = server->GetMyBoundAddress().GetPort();
+
+    client->Connect("127.0.0.1", serverPort, 0, 0);
+    SystemAddress  serverAddress;
+    bool           connected = false;
+    RakNet::TimeMS startTime = RakNet::GetTimeMS();
+    while (connected == false && RakNet::GetTimeMS() - startTime < CONNECT_TIMEOUT_MS) {
+        for (Packet* p = client->Receive(); p; client->DeallocatePacket(p), p = client->Receive()) {
+            if (p->data[0] == ID_CONNECTION_REQUEST_ACCEPTED) {
+                serverAddress = p->systemAddress;
+                connected     = true;
+            }
+        }
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {}
+        RakSleep(1);
+    }
+    if (connected == false) {
+        fprintf(stderr, "Could not connect to the server\n");
+        return 1;
+    }
+
+    LoopbackResult results[LOOPBACK_CASE_COUNT];
+    for (int i = 0; i < LOOPBACK_CASE_COUNT; i++)
+        TimeLoopbackCase(server, client, serverAddress, LOOPBACK_CASES[i], messages, bytes, results[i]);
+
+    LatencyHistogram roundTrips;
+    TimeLoopbackRoundTrips(server, client, serverAddress, roundTrips);
+
+    int    accepted  = 0;
+    double acceptsNs = TimeLoopbackAccepts(serverPort, server, connections, accepted);
+
+    client->Shutdown(100);
+    server->Shutdown(100);
+    RakPeerInterface::DestroyInstance(client);
+    RakPeerInterface::DestroyInstance(server);
+
+    // Sequenced messages may be skipped and unreliable ones lost, so only RELIABLE and RELIABLE_ORDERED must arrive
+    bool allDelivered = accepted == connections;
+    printf("{\n");
+    printf("  \"benchmark\": \"loopback\",\n");
+    printf("  \"messages\": %i,\n", messages);
+    printf("  \"message_bytes\": %i,\n", bytes);
+    printf("  \"throughput\": [\n");
+    for (int i = 0; i < LOOPBACK_CASE_COUNT; i++) {
+        const LoopbackCase& loopbackCase = LOOPBACK_CASES[i];
+        if ((loopbackCase.reliability == RELIABLE || loopbackCase.reliability == RELIABLE_ORDERED)
+            && results[i].received != messages)
+            allDelivered = false;
+        printf("    {\n");
+        printf("      \"reliability\": \"%s\",\n", loopbackCase.reliabilityName);
+        printf("      \"priority\": \"%s\",\n", loopbackCase.priorityName);
+        printf("      \"received\": %i,\n", results[i].received);
+        printf("      \"messages_per_second\": %.1f,\n", results[i].messagesPerSecond);
+        printf("      \"mb_per_second\": %.2f,\n", results[i].megabytesPerSecond);
+        printf("      \"cpu_ns_per_message\": %.1f\n", results[i].cpuNsPerMessage);
+        printf("    }%s\n", i + 1 < LOOPBACK_CASE_COUNT ? "," : "");
+    }
+    printf("  ],\n");
+    printf("  \"rtt_samples\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)roundTrips.GetCount());
+    printf("  \"rtt_p50_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)roundTrips.GetPercentile(50.0));
+    printf("  \"rtt_p90_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)roundTrips.GetPercentile(90.0));
+    printf("  \"rtt_p99_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)roundTrips.GetPercentile(99.0));
+    printf("  \"rtt_max_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)roundTrips.GetMaximum());
+    printf("  \"connections\": %i,\n", connections);
+    printf("  \"accepted\": %i,\n", accepted);
+    printf("  \"accepts_per_second\": %.1f\n", acceptsNs > 0.0 ? accepted / (acceptsNs / 1e9) : 0.0);
+    printf("}\n");
+    return allDelivered ? 0 : 1;
+}
+
+static const RakNet::TimeUS VIRTUAL_STEP_US        = 1000;
+static const RakNet::TimeUS VIRTUAL_TIMEOUT_US     = 120000000;
+static const int            VIRTUAL_MESSAGE_BYTES  = 100;
+static const uint64_t       VIRTUAL_CLIENT_BITS    = 2000000;
+static const uint64_t       VIRTUAL_SERVER_BITS    = 100000000;
+static const RakNet::TimeUS VIRTUAL_LATENCY_US     = 50000;
+static const RakNet::TimeUS VIRTUAL_JITTER_US      = 5000;
+static const RakNet::TimeUS VIRTUAL_QUEUE_DELAY_US = 200000;
+
+struct VirtualResult {
+    int                      connected;
+    int                      received;
+    RakNet::TimeUS           connectUs;
+    RakNet::TimeUS           deliverUs;
+    double                   wallNs;
+    uint64_t                 digest;
+    VirtualNetworkStatistics statistics;
+};
+
+// Runs every peer once: one update cycle, then everything it received. Returns the server's messages in \a received
+// and folds them into \a digest
+static void StepVirtualPeers(
+    VirtualNetwork&                 network,
+    std::vector<RakPeerInterface*>& peers,
+    BitStream&                      updateBitStream,
+    int&                            connected,
+    int&                            received,
+    uint64_t&                       digest
+) {
+    network.AdvanceTime(VIRTUAL_STEP_US);
+    for (size_t i = 0; i < peers.size(); i++) {
+        peers[i]->RunUpdateCycle(updateBitStream);
+        for (Packet* p = peers[i]->Receive(); p; peers[i]->DeallocatePacket(p), p = peers[i]->Receive()) {
+            if (i == 0 && p->data[0] == ID_USER_PACKET_ENUM) {
+                received++;
+                // FNV-1a over arrival time, sender and message number
+                uint64_t fields[3] = {
+                    network.GetTime(),
+                    p->data[1] | ((uint64_t)p->data[2] << 8),
+                    p->data[3] | ((uint64_t)p->data[4] << 8)
+                };
+                for (int f = 0; f < 3; f++) {
+                    digest ^= fields[f];
+                    digest *= 1099511628211ULL;
+                }
+            } else if (i != 0 && p->data[0] == ID_CONNECTION_REQUEST_ACCEPTED) connected++;
+        }
+    }
+}
+
+static bool RunVirtualOnce(int clients, int messages, float lossRate, unsigned int seed, VirtualResult& result) {
+    VirtualNetwork      network(seed);
+    VirtualLinkSettings clientLink;
+    clientLink.bitsPerSecond     = VIRTUAL_CLIENT_BITS;
+    clientLink.maximumQueueDelay = VIRTUAL_QUEUE_DELAY_US;
+    clientLink.latency           = VIRTUAL_LATENCY_US;
+    clientLink.jitter            = VIRTUAL_JITTER_US;
+    clientLink.lossRate          = lossRate;
+    network.SetDefaultLinkSettings(clientLink);
+    network.UseAsClock(true);
+
+    std::vector<RakPeerInterface*> peers;
+    for (int i = 0; i <= clients; i++) {
+        RakPeerInterface* peer = RakPeerInterface::GetInstance();
+        SocketDescriptor  socketDescriptor;
+        socketDescriptor.virtualNetwork = &network;
+        if (peer->Startup(i == 0 ? (unsigned int)clients : 1, &socketDescriptor, 1) != RAKNET_STARTED) {
+            RakPeerInterface::DestroyInstance(peer);
+            break;
+        }
+        peers.push_back(peer);
+    }
+    if ((int)peers.size() != clients + 1) {
+        for (size_t i = 0; i < peers.size(); i++) RakPeerInterface::DestroyInstance(peers[i]);
+        return false;
+    }
+
+    VirtualLinkSettings serverLink = clientLink;
+    serverLink.bitsPerSecond       = VIRTUAL_SERVER_BITS;
+    SystemAddress serverAddress    = peers[0]->GetMyBoundAddress();
+    network.SetLinkSettings(serverAddress, serverLink);
+    peers[0]->SetMaximumIncomingConnections((unsigned short)clients);
+    char serverHost[64];
+    serverAddress.ToString(false, serverHost);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    RakNet::TimeUS                        begin = network.GetTime();
+    BitStream                             updateBitStream(MAXIMUM_MTU_SIZE);
+    result.connected = 0;
+    result.received  = 0;
+    result.digest    = 14695981039346656037ULL;
+    for (int i = 1; i <= clients; i++) peers[i]->Connect(serverHost, serverAddress.GetPort(), 0, 0);
+    while (result.connected < clients && network.GetTime() - begin < VIRTUAL_TIMEOUT_US)
+        StepVirtualPeers(network, peers, updateBitStream, result.connected, result.received, result.digest);
+    result.connectUs = network.GetTime() - begin;
+
+    char payload[VIRTUAL_MESSAGE_BYTES];
+    memset(payload, 0, sizeof(payload));
+    payload[0] = (char)ID_USER_PACKET_ENUM;
+    for (int i = 1; i <= clients; i++) {
+        payload[1] = (char)(i & 0xFF);
+        payload[2] = (char)((i >> 8) & 0xFF);
+        for (int m = 0; m < messages; m++) {
+            payload[3] = (char)(m & 0xFF);
+            payload[4] = (char)((m >> 8) & 0xFF);
+            peers[i]->Send(payload, sizeof(payload), MEDIUM_PRIORITY, RELIABLE_ORDERED, 0, serverAddress, false);
+        }
+    }
+    begin = network.GetTime();
+    while (result.received < clients * messages && network.GetTime() - begin < VIRTUAL_TIMEOUT_US)
+        StepVirtualPeers(network, peers, updateBitStream, result.connected, result.received, result.digest);
+    result.deliverUs  = network.GetTime() - begin;
+    result.wallNs     = NanosecondsSince(start);
+    result.statistics = network.GetStatistics();
+
+    for (size_t i = 0; i < peers.size(); i++) {
+        peers[i]->Shutdown(0);
+        RakPeerInterface::DestroyInstance(peers[i]);
+    }
+    return true;
+}
+
+static int RunVirtual(int clients, int messages, int lossPercent, unsigned int seed) {
+    VirtualResult results[2];
+    for (int run = 0; run < 2; run++) {
+        if (RunVirtualOnce(clients, messages, lossPercent / 100.0f, seed, results[run]) == false) {
+            fprintf(stderr, "Could not start peers on the virtual network\n");
+            return 1;
+        }
+    }
+
+    const VirtualResult&            result     = results[0];
+    const VirtualNetworkStatistics& statistics = result.statistics;
+    bool reproducible = results[0].digest == results[1].digest && results[0].deliverUs == results[1].deliverUs
+                     && results[0].statistics.datagramsSent == results[1].statistics.datagramsSent;
+    printf("{\n");
+    printf("  \"benchmark\": \"virtual\",\n");
+    printf("  \"clients\": %i,\n", clients);
+    printf("  \"messages_per_client\": %i,\n", messages);
+    printf("  \"loss_percent\": %i,\n", lossPercent);
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"connected\": %i,\n", result.connected);
+    printf("  \"received\": %i,\n", result.received);
+    printf("  \"virtual_connect_ms\": %.1f,\n", result.connectUs / 1000.0);
+    printf("  \"virtual_deliver_ms\": %.1f,\n", result.deliverUs / 1000.0);
+    printf("  \"wall_ms\": %.1f,\n", result.wallNs / 1e6);
+    printf("  \"datagrams_sent\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)statistics.datagramsSent);
+    printf("  \"datagrams_lost\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)statistics.datagramsLost);
+    printf(
+        "  \"datagrams_queue_dropped\": %" PRINTF_64_BIT_MODIFIER "u,\n",
+        (unsigned long long)statistics.datagramsQueueDropped
+    );
+    printf("  \"digest\": \"%016" PRINTF_64_BIT_MODIFIER "x\",\n", (unsigned long long)result.digest);
+    printf("  \"reproducible\": %s\n", reproducible ? "true" : "false");
+    printf("}\n");
+    return result.connected == clients && result.received == clients * messages && reproducible ? 0 : 1;
+}
+
+static void PrintUsage(void) {
+    printf("Usage:\n");
+    printf("  raknet_bench memory [connections=256] [idleSeconds=5]\n");
+    printf("  raknet_bench bitstream [iterations=200000]\n");
+    printf("  raknet_bench scratch [ticks=20000]\n");
+    printf("  raknet_bench schema [iterations=100000]\n");
+    printf("  raknet_bench varint [iterations=20000]\n");
+    printf("  raknet_bench huffman [iterations=20000]\n");
+    printf("  raknet_bench rakstring [iterations=1000000] [threads=4]\n");
+    printf("  raknet_bench allocator [iterations=1000000] [threads=4]\n");
+    printf("  raknet_bench threadpool [jobs=1000000] [threads=4]\n");
+    printf("  raknet_bench sendthread [datagrams=200000] [sockets=1]\n");
+    printf("  raknet_bench trace [events=2000000]\n");
+    printf("  raknet_bench packetlog [messages=200000]\n");
+    printf("  raknet_bench loopback [messages=20000] [bytes=100] [connections=64]\n");
+    printf("  raknet_bench virtual [clients=100] [messages=100] [lossPercent=2] [seed=1]\n");
+}
+
+int main(int argc, char** argv) {
+    InstallCountingAllocator();
+
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "memory") == 0) {
+        int connections = argc > 2 ? atoi(argv[2]) : 256;
+        int idleSeconds = argc > 3 ? atoi(argv[3]) : 5;
+        if (connections <= 0 || idleSeconds < 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunMemory(argv[0], connections, idleSeconds);
+    }
+    if (strcmp(argv[1], "bitstream") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 200000;
+        if (iterations <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunBitStream(iterations);
+    }
+    if (strcmp(argv[1], "scratch") == 0) {
+        int ticks = argc > 2 ? atoi(argv[2]) : 20000;
+        if (ticks <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunScratch(ticks);
+    }
+    if (strcmp(argv[1], "schema") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+        if (iterations <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunSchema(iterations);
+    }
+    if (strcmp(argv[1], "varint") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+        if (iterations <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunVarInt(iterations);
+    }
+    if (strcmp(argv[1], "huffman") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+        if (iterations <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunHuffman(iterations);
+    }
+    if (strcmp(argv[1], "rakstring") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+        int threads    = argc > 3 ? atoi(argv[3]) : 4;
+        if (iterations <= 0 || threads <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunRakString(iterations, threads);
+    }
+    if (strcmp(argv[1], "allocator") == 0) {
+        int iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+        int threads    = argc > 3 ? atoi(argv[3]) : 4;
+        if (iterations <= 0 || threads <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunAllocator(iterations, threads);
+    }
+    if (strcmp(argv[1], "threadpool") == 0) {
+        int jobs    = argc > 2 ? atoi(argv[2]) : 1000000;
+        int threads = argc > 3 ? atoi(argv[3]) : 4;
+        if (jobs <= 0 || threads <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunThreadPool(jobs, threads);
+    }
+    if (strcmp(argv[1], "sendthread") == 0) {
+        int datagrams = argc > 2 ? atoi(argv[2]) : 200000;
+        int sockets   = argc > 3 ? atoi(argv[3]) : 1;
+        if (datagrams <= 0 || sockets <= 0 || sockets > SEND_TO_THREAD_MAX_SOCKETS) {
+            PrintUsage();
+            return 1;
+        }
+        return RunSendThread(datagrams, sockets);
+    }
+    if (strcmp(argv[1], "trace") == 0) {
+        int events = argc > 2 ? atoi(argv[2]) : 2000000;
+        if (events <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunTrace(events);
+    }
+    if (strcmp(argv[1], "packetlog") == 0) {
+        int messages = argc > 2 ? atoi(argv[2]) : 200000;
+        if (messages <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunPacketLog(messages);
+    }
+    if (strcmp(argv[1], "loopback") == 0) {
+        int messages    = argc > 2 ? atoi(argv[2]) : 20000;
+        int bytes       = argc > 3 ? atoi(argv[3]) : 100;
+        int connections = argc > 4 ? atoi(argv[4]) : 64;
+        if (messages <= 0 || bytes <= 0 || connections <= 0) {
+            PrintUsage();
+            return 1;
+        }
+        return RunLoopback(messages, bytes, connections);
+    }
+    if (strcmp(argv[1], "virtual") == 0) {
+        int clients     = argc > 2 ? atoi(argv[2]) : 100;
+        int messages    = argc > 3 ? atoi(argv[3]) : 100;
+        int lossPercent = argc > 4 ? atoi(argv[4]) : 2;
+        int seed        = argc > 5 ? atoi(argv[5]) : 1;
+        // Clients and message numbers are sent in 16 bits
+        if (clients <= 0 || clients > 65535 || messages <= 0 || messages > 65536 || lossPercent < 0
+            || lossPercent > 100) {
+            PrintUsage();
+            return 1;
+        }
+        return RunVirtual(clients, messages, lossPercent, (unsigned int)seed);
+    }
+    if (strcmp(argv[1], "memory-clients") == 0 && argc > 4)
+        return RunMemoryClients((unsigned short)atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+
+    PrintUsage();
+    return 1;
+}
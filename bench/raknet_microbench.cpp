@@ -0,0 +1,564 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Microbenchmarks for the DataStructures containers and BitStream, against their std:: equivalents. Build with
+/// xmake build raknet_microbench
+///
+/// Usage:
+///   raknet_microbench [operations] [benchmark...]
+///     Runs each benchmark at 16, 256 and 4096 elements, repeating it until about \a operations element operations
+///     were timed at each size, and reports nanoseconds per element operation for RakNet and, where there is one, the
+///     std:: equivalent. Benchmarks are list, queue, orderedlist, heap, hash, bplustree, rangelist, memorypool and
+///     bitstream. Runs them all if none are named.
+///
+
+#include "BitStream.h"
+#include "DS_BPlusTree.h"
+#include "DS_Hash.h"
+#include "DS_Heap.h"
+#include "DS_List.h"
+#include "DS_MemoryPool.h"
+#include "DS_OrderedList.h"
+#include "DS_Queue.h"
+#include "DS_RangeList.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace RakNet;
+
+static const unsigned int SIZES[]    = {16, 256, 4096};
+static const int          SIZE_COUNT = (int)(sizeof(SIZES) / sizeof(SIZES[0]));
+
+// Keeps results alive so the optimizer cannot drop the work. Never printed
+static unsigned int checksum = 0;
+
+static int  operationsPerSize = 1000000;
+static bool firstResult       = true;
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Runs \a pass, which does \a size element operations, until operationsPerSize were done, and returns nanoseconds per
+// element operation
+static double TimePasses(unsigned int size, const std::function<void(void)>& pass) {
+    int passes = operationsPerSize / (int)size;
+    if (passes < 1) passes = 1;
+    // Once untimed, so every container starts warm
+    pass();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) pass();
+    return NanosecondsSince(start) / ((double)passes * size);
+}
+
+// A negative stdNs means there is no std:: equivalent
+static void PrintResult(
+    const char*  benchmark,
+    const char*  operation,
+    unsigned int size,
+    double       raknetNs,
+    double       stdNs
+) {
+    printf("%s    {\n", firstResult ? "" : ",\n");
+    printf("      \"benchmark\": \"%s\",\n", benchmark);
+    printf("      \"operation\": \"%s\",\n", operation);
+    printf("      \"size\": %u,\n", size);
+    if (stdNs >= 0.0) {
+        printf("      \"raknet_ns\": %.2f,\n", raknetNs);
+        printf("      \"std_ns\": %.2f\n", stdNs);
+    } else printf("      \"raknet_ns\": %.2f\n", raknetNs);
+    printf("    }");
+    firstResult = false;
+}
+
+// Distinct keys in random order, the same on every run
+static std::vector<unsigned int> ShuffledKeys(unsigned int size) {
+    std::vector<unsigned int> keys(size);
+    for (unsigned int i = 0; i < size; i++) keys[i] = i * 2654435761u;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(size));
+    return keys;
+}
+
+static void RunList(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int              size = SIZES[s];
+        std::vector<unsigned int> keys = ShuffledKeys(size);
+
+        double raknetNs = TimePasses(size, [&]() {
+            DataStructures::List<unsigned int> list;
+            for (unsigned int i = 0; i < size; i++) list.Insert(keys[i], _FILE_AND_LINE_);
+            checksum += list.Size();
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            std::vector<unsigned int> list;
+            for (unsigned int i = 0; i < size; i++) list.push_back(keys[i]);
+            checksum += (unsigned int)list.size();
+        });
+        PrintResult("list", "push", size, raknetNs, stdNs);
+
+        DataStructures::List<unsigned int> list;
+        std::vector<unsigned int>          vector;
+        for (unsigned int i = 0; i < size; i++) {
+            list.Insert(keys[i], _FILE_AND_LINE_);
+            vector.push_back(keys[i]);
+        }
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < list.Size(); i++) checksum += list[i];
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (size_t i = 0; i < vector.size(); i++) checksum += vector[i];
+        });
+        PrintResult("list", "iterate", size, raknetNs, stdNs);
+
+        // Unordered removal from the middle, as RakPeer does with its lists of systems
+        raknetNs = TimePasses(size, [&]() {
+            DataStructures::List<unsigned int> copy = list;
+            while (copy.Size()) {
+                checksum += copy[copy.Size() / 2];
+                copy.RemoveAtIndexFast(copy.Size() / 2);
+            }
+        });
+        stdNs = TimePasses(size, [&]() {
+            std::vector<unsigned int> copy = vector;
+            while (copy.size()) {
+                checksum += copy[copy.size() / 2];
+                copy[copy.size() / 2] = copy.back();
+                copy.pop_back();
+            }
+        });
+        PrintResult("list", "copy_and_remove_fast", size, raknetNs, stdNs);
+    }
+}
+
+static void RunQueue(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int size = SIZES[s];
+
+        // Push everything, then pop everything, reusing the queue
+        DataStructures::Queue<unsigned int> queue;
+        std::deque<unsigned int>            deque;
+
+        double raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) queue.Push(i, _FILE_AND_LINE_);
+            while (queue.Size()) checksum += queue.Pop();
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) deque.push_back(i);
+            while (deque.size()) {
+                checksum += deque.front();
+                deque.pop_front();
+            }
+        });
+        PrintResult("queue", "fill_and_drain", size, raknetNs, stdNs);
+
+        // A queue that stays at size elements, as the send and receive buffers do
+        for (unsigned int i = 0; i < size; i++) {
+            queue.Push(i, _FILE_AND_LINE_);
+            deque.push_back(i);
+        }
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) {
+                queue.Push(i, _FILE_AND_LINE_);
+                checksum += queue.Pop();
+            }
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) {
+                deque.push_back(i);
+                checksum += deque.front();
+                deque.pop_front();
+            }
+        });
+        PrintResult("queue", "steady_push_pop", size, raknetNs, stdNs);
+    }
+}
+
+static void RunOrderedList(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int              size = SIZES[s];
+        std::vector<unsigned int> keys = ShuffledKeys(size);
+
+        DataStructures::OrderedList<unsigned int, unsigned int> orderedList;
+        std::map<unsigned int, unsigned int>                    map;
+
+        double raknetNs = TimePasses(size, [&]() {
+            orderedList.Clear(true, _FILE_AND_LINE_);
+            for (unsigned int i = 0; i < size; i++) orderedList.Insert(keys[i], keys[i], true, _FILE_AND_LINE_);
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            map.clear();
+            for (unsigned int i = 0; i < size; i++) map.emplace(keys[i], keys[i]);
+        });
+        PrintResult("orderedlist", "insert_random", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) checksum += orderedList.GetElementFromKey(keys[i]);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) checksum += map.find(keys[i])->second;
+        });
+        PrintResult("orderedlist", "find", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            DataStructures::OrderedList<unsigned int, unsigned int> copy = orderedList;
+            for (unsigned int i = 0; i < size; i++) copy.Remove(keys[i]);
+        });
+        stdNs = TimePasses(size, [&]() {
+            std::map<unsigned int, unsigned int> copy = map;
+            for (unsigned int i = 0; i < size; i++) copy.erase(keys[i]);
+        });
+        PrintResult("orderedlist", "copy_and_remove", size, raknetNs, stdNs);
+    }
+}
+
+static void RunHeap(void) {
+    typedef std::pair<unsigned int, unsigned int> WeightAndData;
+
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int              size = SIZES[s];
+        std::vector<unsigned int> keys = ShuffledKeys(size);
+
+        // Push everything, then pop everything lowest first, as the ordering channels do
+        DataStructures::Heap<unsigned int, unsigned int, false> heap;
+
+        double raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) heap.Push(keys[i], i, _FILE_AND_LINE_);
+            while (heap.Size()) checksum += heap.Pop(0);
+        });
+        std::priority_queue<WeightAndData, std::vector<WeightAndData>, std::greater<WeightAndData>> priorityQueue;
+
+        double stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) priorityQueue.push(WeightAndData(keys[i], i));
+            while (priorityQueue.size()) {
+                checksum += priorityQueue.top().second;
+                priorityQueue.pop();
+            }
+        });
+        PrintResult("heap", "push_and_pop_all", size, raknetNs, stdNs);
+
+        // Weights in order, as ReliabilityLayer pushes with PushSeries()
+        raknetNs = TimePasses(size, [&]() {
+            heap.StartSeries();
+            for (unsigned int i = 0; i < size; i++) heap.PushSeries(i, i, _FILE_AND_LINE_);
+            while (heap.Size()) checksum += heap.Pop(0);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) priorityQueue.push(WeightAndData(i, i));
+            while (priorityQueue.size()) {
+                checksum += priorityQueue.top().second;
+                priorityQueue.pop();
+            }
+        });
+        PrintResult("heap", "push_series_and_pop_all", size, raknetNs, stdNs);
+    }
+}
+
+static unsigned long HashUnsignedInt(const unsigned int& key) { return key * 2654435761u; }
+
+static void RunHash(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int              size = SIZES[s];
+        std::vector<unsigned int> keys = ShuffledKeys(size);
+
+        // 256 slots, as TeamManager uses
+        DataStructures::Hash<unsigned int, unsigned int, 256, HashUnsignedInt> hash;
+        std::unordered_map<unsigned int, unsigned int>                         unorderedMap;
+
+        double raknetNs = TimePasses(size, [&]() {
+            hash.Clear(_FILE_AND_LINE_);
+            for (unsigned int i = 0; i < size; i++) hash.Push(keys[i], i, _FILE_AND_LINE_);
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            unorderedMap.clear();
+            for (unsigned int i = 0; i < size; i++) unorderedMap.emplace(keys[i], i);
+        });
+        PrintResult("hash", "insert", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) checksum += *hash.Peek(keys[i]);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) checksum += unorderedMap.find(keys[i])->second;
+        });
+        PrintResult("hash", "find", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) hash.Remove(keys[i], _FILE_AND_LINE_);
+            for (unsigned int i = 0; i < size; i++) hash.Push(keys[i], i, _FILE_AND_LINE_);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) unorderedMap.erase(keys[i]);
+            for (unsigned int i = 0; i < size; i++) unorderedMap.emplace(keys[i], i);
+        });
+        PrintResult("hash", "remove_and_insert", size, raknetNs, stdNs);
+    }
+}
+
+static void RunBPlusTree(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int              size = SIZES[s];
+        std::vector<unsigned int> keys = ShuffledKeys(size);
+
+        // Order 16, as Table uses
+        DataStructures::BPlusTree<unsigned int, unsigned int, 16> tree;
+        std::map<unsigned int, unsigned int>                      map;
+
+        double raknetNs = TimePasses(size, [&]() {
+            tree.Clear();
+            for (unsigned int i = 0; i < size; i++) tree.Insert(keys[i], i);
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            map.clear();
+            for (unsigned int i = 0; i < size; i++) map.emplace(keys[i], i);
+        });
+        PrintResult("bplustree", "insert_random", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            unsigned int data;
+            for (unsigned int i = 0; i < size; i++)
+                if (tree.Get(keys[i], data)) checksum += data;
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) checksum += map.find(keys[i])->second;
+        });
+        PrintResult("bplustree", "find", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) tree.Delete(keys[i]);
+            for (unsigned int i = 0; i < size; i++) tree.Insert(keys[i], i);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) map.erase(keys[i]);
+            for (unsigned int i = 0; i < size; i++) map.emplace(keys[i], i);
+        });
+        PrintResult("bplustree", "remove_and_insert", size, raknetNs, stdNs);
+    }
+}
+
+static void RunRangeList(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int size = SIZES[s];
+
+        // Datagram numbers to acknowledge, with every eighth one lost, as ReliabilityLayer builds its ACKs
+        DataStructures::RangeList<unsigned int> rangeList;
+
+        double insertNs = TimePasses(size, [&]() {
+            rangeList.Clear();
+            for (unsigned int i = 0; i < size; i++)
+                if ((i & 7) != 7) rangeList.Insert(i);
+            checksum += rangeList.Size();
+        });
+        PrintResult("rangelist", "insert_with_gaps", size, insertNs, -1.0);
+
+        BitStream bitStream;
+
+        double serializeNs = TimePasses(size, [&]() {
+            bitStream.Reset();
+            checksum += rangeList.Serialize(&bitStream, (BitSize_t)-1, false);
+        });
+        PrintResult("rangelist", "serialize", size, serializeNs, -1.0);
+    }
+}
+
+// About the size of a Packet or InternalPacket
+struct MicrobenchBlock {
+    char data[256];
+};
+
+static void RunMemoryPool(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int                  size = SIZES[s];
+        std::vector<MicrobenchBlock*> blocks(size);
+        std::vector<unsigned int>     order(size);
+        for (unsigned int i = 0; i < size; i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(size));
+
+        DataStructures::MemoryPool<MicrobenchBlock> pool;
+
+        double raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) blocks[i] = pool.Allocate(_FILE_AND_LINE_);
+            for (unsigned int i = size; i-- > 0;) pool.Release(blocks[i], _FILE_AND_LINE_);
+        });
+
+        double stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) blocks[i] = new MicrobenchBlock;
+            for (unsigned int i = size; i-- > 0;) delete blocks[i];
+        });
+        PrintResult("memorypool", "allocate_and_release_lifo", size, raknetNs, stdNs);
+
+        raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) blocks[i] = pool.Allocate(_FILE_AND_LINE_);
+            for (unsigned int i = 0; i < size; i++) pool.Release(blocks[order[i]], _FILE_AND_LINE_);
+        });
+        stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) blocks[i] = new MicrobenchBlock;
+            for (unsigned int i = 0; i < size; i++) delete blocks[order[i]];
+        });
+        PrintResult("memorypool", "allocate_and_release_random", size, raknetNs, stdNs);
+        pool.Clear(_FILE_AND_LINE_);
+    }
+}
+
+// A typical small game message: an identifier, an entity id, a position, flags, a health value and a counter
+struct MicrobenchMessage {
+    unsigned char  id;
+    unsigned int   entity;
+    float          position[3];
+    bool           flags[4];
+    unsigned short health;
+    unsigned int   counter;
+};
+
+static void RunBitStream(void) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        unsigned int                   size = SIZES[s];
+        std::vector<MicrobenchMessage> messages(size);
+        for (unsigned int i = 0; i < size; i++) {
+            MicrobenchMessage& m = messages[i];
+            m.id                 = 135;
+            m.entity             = i * 7919;
+            m.position[0]        = (float)i;
+            m.position[1]        = (float)i * 0.5f;
+            m.position[2]        = -(float)i;
+            for (int f = 0; f < 4; f++) m.flags[f] = ((i >> f) & 1) != 0;
+            m.health  = (unsigned short)(i % 100);
+            m.counter = i & 0xFF;
+        }
+
+        // Each message written to and read back from a stream of its own, as a game sends them
+        BitStream bitStream;
+
+        double raknetNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) {
+                const MicrobenchMessage& m = messages[i];
+                bitStream.Reset();
+                bitStream.Write(m.id);
+                bitStream.Write(m.entity);
+                for (int v = 0; v < 3; v++) bitStream.Write(m.position[v]);
+                for (int f = 0; f < 4; f++) bitStream.Write(m.flags[f]);
+                bitStream.Write(m.health);
+                bitStream.WriteCompressed(m.counter);
+
+                MicrobenchMessage out;
+                bitStream.Read(out.id);
+                bitStream.Read(out.entity);
+                for (int v = 0; v < 3; v++) bitStream.Read(out.position[v]);
+                for (int f = 0; f < 4; f++) bitStream.Read(out.flags[f]);
+                bitStream.Read(out.health);
+                bitStream.ReadCompressed(out.counter);
+                checksum += out.entity + out.counter;
+            }
+        });
+
+        // The same fields copied byte aligned into a std::vector, which cannot pack the flags into bits
+        std::vector<unsigned char> buffer;
+
+        double stdNs = TimePasses(size, [&]() {
+            for (unsigned int i = 0; i < size; i++) {
+                const MicrobenchMessage& m = messages[i];
+                buffer.clear();
+                buffer.push_back(m.id);
+                buffer.insert(buffer.end(), (const unsigned char*)&m.entity, (const unsigned char*)&m.entity + 4);
+                buffer.insert(buffer.end(), (const unsigned char*)m.position, (const unsigned char*)m.position + 12);
+                for (int f = 0; f < 4; f++) buffer.push_back(m.flags[f]);
+                buffer.insert(buffer.end(), (const unsigned char*)&m.health, (const unsigned char*)&m.health + 2);
+                buffer.insert(buffer.end(), (const unsigned char*)&m.counter, (const unsigned char*)&m.counter + 4);
+
+                MicrobenchMessage    out;
+                const unsigned char* p = &buffer[0];
+                out.id                 = *p++;
+                memcpy(&out.entity, p, 4);
+                memcpy(out.position, p + 4, 12);
+                for (int f = 0; f < 4; f++) out.flags[f] = p[16 + f] != 0;
+                memcpy(&out.health, p + 20, 2);
+                memcpy(&out.counter, p + 22, 4);
+                checksum += out.entity + out.counter;
+            }
+        });
+        PrintResult("bitstream", "write_and_read_message", size, raknetNs, stdNs);
+    }
+}
+
+struct Microbenchmark {
+    const char* name;
+    void (*run)(void);
+};
+
+static const Microbenchmark MICROBENCHMARKS[] = {
+    {"list",        RunList       },
+    {"queue",       RunQueue      },
+    {"orderedlist", RunOrderedList},
+    {"heap",        RunHeap       },
+    {"hash",        RunHash       },
+    {"bplustree",   RunBPlusTree  },
+    {"rangelist",   RunRangeList  },
+    {"memorypool",  RunMemoryPool },
+    {"bitstream",   RunBitStream  },
+};
+static const int MICROBENCHMARK_COUNT = (int)(sizeof(MICROBENCHMARKS) / sizeof(MICROBENCHMARKS[0]));
+
+static void PrintUsage(void) {
+    printf("Usage: raknet_microbench [operations=1000000] [benchmark...]\n");
+    printf("Benchmarks:");
+    for (int i = 0; i < MICROBENCHMARK_COUNT; i++) printf(" %s", MICROBENCHMARKS[i].name);
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int firstName = 1;
+    if (argc > 1 && argv[1][0] >= '0' && argv[1][0] <= '9') {
+        operationsPerSize = atoi(argv[1]);
+        firstName         = 2;
+    }
+    if (operationsPerSize <= 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    bool selected[MICROBENCHMARK_COUNT];
+    for (int i = 0; i < MICROBENCHMARK_COUNT; i++) selected[i] = firstName == argc;
+    for (int a = firstName; a < argc; a++) {
+        int i = 0;
+        while (i < MICROBENCHMARK_COUNT && strcmp(argv[a], MICROBENCHMARKS[i].name) != 0) i++;
+        if (i == MICROBENCHMARK_COUNT) {
+            PrintUsage();
+            return 1;
+        }
+        selected[i] = true;
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"microbench\",\n");
+    printf("  \"operations\": %i,\n", operationsPerSize);
+    printf("  \"results\": [\n");
+    for (int i = 0; i < MICROBENCHMARK_COUNT; i++)
+        if (selected[i]) MICROBENCHMARKS[i].run();
+    printf("\n  ]\n");
+    printf("}\n");
+    if (checksum == 0xFFFFFFFF) printf("\n");
+    return 0;
+}
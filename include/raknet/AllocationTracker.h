@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file AllocationTracker.h
+/// \brief Optional accounting of live memory by the _FILE_AND_LINE_ passed to rakMalloc_Ex.
+///
+
+
+#ifndef __ALLOCATION_TRACKER_H
+#define __ALLOCATION_TRACKER_H
+
+#include "Export.h"
+#include "NativeTypes.h"
+#include "RakNetTime.h"
+#include <stdio.h>
+
+namespace RakNet {
+struct RAKNET_API AllocationSiteStatistics {
+    /// As passed to rakMalloc_Ex. "" for rakMalloc, which has no call site, and "(other sites)" once
+    /// ALLOCATION_TRACKER_MAX_SITES are in use
+    const char*  file;
+    unsigned int line;
+    uint64_t     allocations;
+    uint64_t     frees;
+    /// Bytes allocated here and not yet freed. A realloc counts as a free at the old site and an allocation here
+    int64_t      liveBytes;
+    /// Most bytes that were live at once
+    int64_t      highWaterBytes;
+};
+
+/// \brief Wraps rakMalloc, rakRealloc, rakFree and their _Ex versions to count live bytes per call site.
+/// \details Whatever allocator is installed at the time, such as UseSlabAllocator(), keeps doing the allocating. Each
+/// block gets a 16 byte header holding its size and site. Sites are told apart by the file pointer and line, so a
+/// header included in several files can show up as several sites with the same name.
+/// Only what goes through those hooks is counted. OP_NEW, OP_NEW_ARRAY and the other templates in RakMemoryOverride.h
+/// only call them when _USE_RAK_MEMORY_OVERRIDE is 1. It defaults to 0, in which case they expand to plain new and are
+/// not tracked, and neither is anything allocated with new directly.
+/// Call once, before RakNet allocates anything, and after installing any other allocator. Until then nothing is
+/// tracked and nothing costs anything.
+/// \return false if tracking was already enabled
+RAKNET_API bool UseAllocationTracking(void);
+
+/// Returns true once UseAllocationTracking() has been called
+RAKNET_API bool IsAllocationTrackingEnabled(void);
+
+/// \brief Copies the \a maxSites sites with the most live bytes into \a sites, most first.
+/// \details Allocates nothing, so it is safe to call from anywhere, including from inside an allocator hook.
+/// \return How many sites there are, which may be more than were copied
+RAKNET_API unsigned int GetAllocationSiteStatistics(AllocationSiteStatistics* sites, unsigned int maxSites);
+
+/// Writes the \a maxSites sites with the most live bytes to \a fp, one line each
+RAKNET_API void DumpAllocationSites(FILE* fp, unsigned int maxSites = 32);
+
+/// \brief Calls DumpAllocationSites() from a thread of its own every \a intervalMs until StopAllocationSiteDump()
+/// \details \a fp must stay open until then. Replaces any dump already running.
+/// \return false if tracking is not enabled or the thread could not be started
+RAKNET_API bool StartAllocationSiteDump(FILE* fp, RakNet::TimeMS intervalMs, unsigned int maxSites = 32);
+
+/// Stops the thread started by StartAllocationSiteDump(), returning once it has exited
+RAKNET_API void StopAllocationSiteDump(void);
+
+} // namespace RakNet
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Packet logger that queues fixed size binary records for a thread that writes them to a file
+///
+
+
+#include "NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_PacketLogger == 1
+
+#ifndef __ASYNC_PACKET_FILE_LOGGER_H
+#define __ASYNC_PACKET_FILE_LOGGER_H
+
+#include "PacketLogger.h"
+#include "RakThread.h"
+#include "SignaledEvent.h"
+#include <atomic>
+#include <stdio.h>
+
+namespace RakNet {
+
+/// What a PacketLogRecord was written for
+enum PacketLogRecordType {
+    /// PacketLogger::OnDirectSocketSend()
+    PACKET_LOG_RAW_SEND = 1,
+    /// PacketLogger::OnDirectSocketReceive()
+    PACKET_LOG_RAW_RECEIVE,
+    /// PacketLogger::OnInternalPacket()
+    PACKET_LOG_INTERNAL_PACKET,
+    /// PacketLogger::OnAck()
+    PACKET_LOG_ACK,
+    /// PacketLogger::OnPushBackPacket()
+    PACKET_LOG_PUSH_BACK,
+    /// PacketLogger::OnReliabilityLayerNotification() with isError true
+    PACKET_LOG_RELIABILITY_ERROR,
+    /// PacketLogger::OnReliabilityLayerNotification() with isError false
+    PACKET_LOG_RELIABILITY_WARNING,
+    /// A line passed to AddToLog(), such as from WriteMiscellaneous()
+    PACKET_LOG_TEXT,
+    /// reliableMessageNumber records were dropped because the queue was full
+    PACKET_LOG_DROPPED,
+    /// More of the text of the record before, which did not fit in its text
+    PACKET_LOG_TEXT_CONTINUATION,
+};
+
+/// \brief One hook call, as written to the files of AsyncPacketFileLogger
+/// \details Holds the arguments PacketLogger passes to FormatLine(), so AsyncPacketFileLogger::WriteTextLog() can write
+/// the same lines later.
+struct PacketLogRecord {
+    uint64_t time;
+    uint32_t reliableMessageNumber;
+    /// For records with text, how many PACKET_LOG_TEXT_CONTINUATION records follow
+    uint32_t frame;
+    uint32_t bitLength;
+    uint32_t splitPacketId;
+    uint32_t splitPacketIndex;
+    uint32_t splitPacketCount;
+    uint32_t orderingIndex;
+    /// Network order, as in the sockaddr
+    uint16_t localPort;
+    uint16_t remotePort;
+    /// The first 4 bytes for IPv4
+    uint8_t  localAddress[16];
+    uint8_t  remoteAddress[16];
+    /// 4 or 6
+    uint8_t  localIPVersion;
+    uint8_t  remoteIPVersion;
+    /// PacketLogRecordType
+    uint8_t  type;
+    uint8_t  messageIdentifier;
+    /// The isSend parameter of OnInternalPacket()
+    uint8_t  isSend;
+    /// 1 if an internal packet started with ID_TIMESTAMP
+    uint8_t  timestamped;
+    /// The error message of a reliability layer notification, or the line of PACKET_LOG_TEXT. Only terminated if it
+    /// ends here. Text after the first 1023 characters, the longest line PacketFileLogger formats, is cut and ends in
+    /// "..."
+    char     text[50];
+};
+static_assert(sizeof(PacketLogRecord) == 128, "PacketLogRecord is written to files as is");
+
+/// \ingroup PACKETLOGGER_GROUP
+/// \brief Packet logger that does not format or write anything on the network thread.
+/// \details Each hook copies its arguments into a PacketLogRecord in a lock-free queue of
+/// ASYNC_PACKET_LOGGER_QUEUE_RECORDS records, and a thread started by StartLog() writes them to the file in batches. If
+/// the writer falls behind, records are dropped rather than waiting, and the file says how many.
+/// Use WriteTextLog(), or tools/raknet_packetlog, to turn the file into the lines PacketFileLogger would have written.
+/// The Clock column is the time of the conversion.
+class RAKNET_API AsyncPacketFileLogger : public PacketLogger {
+public:
+    // GetInstance() and DestroyInstance(instance*)
+    STATIC_FACTORY_DECLARATIONS(AsyncPacketFileLogger)
+
+    /// Addresses SetAddressFilter() can hold
+    static const unsigned int MAX_FILTER_ADDRESSES = 16;
+
+    AsyncPacketFileLogger();
+    virtual ~AsyncPacketFileLogger();
+
+    /// \brief Creates \a filenamePrefix_<time>.bin, or PacketLog_<time>.bin if \a filenamePrefix is 0, and starts the
+    /// writer thread
+    /// \return false if the file could not be created or the thread could not be started
+    bool StartLog(const char* filenamePrefix);
+
+    /// Same as StartLog(const char*), writing to \a fp, which must be opened in binary mode. StopLog() closes it
+    bool StartLog(FILE* fp);
+
+    /// Writes everything still queued, stops the writer thread and closes the file
+    void StopLog(void);
+
+    /// \brief Only log messages to and from \a addresses. Port 0 matches every port of that IP.
+    /// \details Pass 0 addresses to log every system again. Can be called while logging.
+    void SetAddressFilter(const SystemAddress* addresses, unsigned int count);
+
+    /// Returns how many records were dropped since StartLog() because the writer thread fell behind
+    unsigned int GetDroppedRecordCount(void) const;
+
+    /// \brief Reads a file written by this class and writes the lines PacketFileLogger would have written to \a out.
+    /// \details Uses this logger's FormatLine(), prefix, suffix and SetPrintID() setting.
+    /// \param[in] binaryLog The file, opened in binary mode
+    /// \return false if \a binaryLog was not written by this class, or was written by a machine with the other byte
+    /// order
+    bool WriteTextLog(FILE* binaryLog, FILE* out);
+
+    virtual void OnDirectSocketSend(const char* data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+    virtual void OnDirectSocketReceive(const char* data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+    virtual void OnReliabilityLayerNotification(
+        const char*     errorMessage,
+        const BitSize_t bitsUsed,
+        SystemAddress   remoteSystemAddress,
+        bool            isError
+    );
+    virtual void OnInternalPacket(
+        InternalPacket* internalPacket,
+        unsigned        frameNumber,
+        SystemAddress   remoteSystemAddress,
+        RakNet::TimeMS  time,
+        int             isSend
+    );
+    virtual void OnAck(unsigned int messageNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time);
+    virtual void OnPushBackPacket(const char* data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+
+protected:
+    struct QueueSlot {
+        /// Which pass over the queue may write or read this slot next
+        std::atomic<uint32_t> sequence;
+        PacketLogRecord       record;
+    };
+
+    virtual void AddToLog(const char* str);
+    /// Returns false if \a remoteSystemAddress does not pass the filter
+    bool         IsLogged(const SystemAddress& remoteSystemAddress) const;
+    /// Returns the first of \a count consecutive slots to fill in, or 0 if the queue does not have that many free. Pass
+    /// each slot and its position, from \a position on, to Commit()
+    QueueSlot*   Reserve(uint32_t& position, uint32_t count = 1);
+    void         Commit(QueueSlot* slot, uint32_t position);
+    /// Queues a record of \a type holding \a text, and the PACKET_LOG_TEXT_CONTINUATION records the rest of it needs
+    void         QueueText(
+        PacketLogRecordType  type,
+        uint64_t             time,
+        const SystemAddress& local,
+        const SystemAddress& remote,
+        BitSize_t            bitLength,
+        const char*          text
+    );
+
+    static RAK_THREAD_DECLARATION(WriteLoop);
+
+    FILE*                 packetLogFile;
+    QueueSlot*            queue;
+    std::atomic<uint32_t> enqueuePosition;
+    // Only written by the writer thread, read by the hooks to tell how full the queue is
+    std::atomic<uint32_t> dequeuePosition;
+    std::atomic<uint32_t> droppedRecords;
+    std::atomic<bool>     sleeping;
+    // Set by the hook that wakes the writer thread, so the others do not
+    std::atomic<bool>     wakePending;
+    std::atomic<bool>     running;
+    std::atomic<bool>     active;
+    SignaledEvent         writerEvent;
+
+    std::atomic<uint64_t>     addressFilter[MAX_FILTER_ADDRESSES];
+    std::atomic<unsigned int> addressFilterCount;
+};
+
+} // namespace RakNet
+
+#endif
+
+#endif // _RAKNET_SUPPORT_*
@@ -31,6 +31,7 @@
 #include <cstddef>
 #include <float.h>
 #include <math.h>
+#include <type_traits>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -42,6 +43,8 @@
 #endif
 
 namespace RakNet {
+class BitStreamArena;
+
 /// This class allows you to write and read native types as a string of bits.  BitStream is used extensively throughout
 /// RakNet and is designed to be used by users as well.
 /// \sa BitStreamSample.txt
@@ -147,6 +150,26 @@ public:
     template <class templateType>
     bool SerializeCompressedDelta(bool writeToBitstream, templateType& inOutTemplateVar);
 
+    /// \brief Bidirectional serialize/deserialize an integral type as a LEB128 varint.
+    /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream
+    /// and write to your data
+    /// \param[in] inOutTemplateVar The value to write
+    /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.
+    /// false if \a writeToBitstream is false and the read was not successful.
+    /// \sa WriteVarInt()
+    template <class templateType>
+    bool SerializeVarInt(bool writeToBitstream, templateType& inOutTemplateVar);
+
+    /// \brief Bidirectional serialize/deserialize a signed integral type as a zigzag LEB128 varint.
+    /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream
+    /// and write to your data
+    /// \param[in] inOutTemplateVar The value to write
+    /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.
+    /// false if \a writeToBitstream is false and the read was not successful.
+    /// \sa WriteVarIntZigZag()
+    template <class templateType>
+    bool SerializeVarIntZigZag(bool writeToBitstream, templateType& inOutTemplateVar);
+
     /// \brief Bidirectional serialize/deserialize an array or casted stream or raw data.  This does NOT do endian
     /// swapping.
     /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream
@@ -335,6 +358,23 @@ public:
     template <class templateType>
     void WriteCompressedDelta(const templateType& currentValue);
 
+    /// \brief Write any integral type as an unsigned LEB128 varint.
+    /// \details Each byte holds 7 bits of the value, least significant group first, with the high bit set on every
+    /// byte but the last. Values under 128 take 1 byte and a 64 bit value at most 10. This is the varint used by
+    /// protobuf and most game protocols, so it can be read by code outside RakNet. The bytes are not aligned, and the
+    /// encoding does not depend on __BITSTREAM_NATIVE_END. Signed types are written as their unsigned bit pattern, so
+    /// negative numbers always take the maximum length; use WriteVarIntZigZag() for those.
+    /// \param[in] inTemplateVar The value to write
+    template <class templateType>
+    void WriteVarInt(const templateType& inTemplateVar);
+
+    /// \brief Write a signed integral type as a zigzag encoded LEB128 varint.
+    /// \details Zigzag maps 0, -1, 1, -2, 2... to 0, 1, 2, 3, 4... so numbers near zero of either sign stay short.
+    /// -64 to 63 take 1 byte.
+    /// \param[in] inTemplateVar The value to write
+    template <class templateType>
+    void WriteVarIntZigZag(const templateType& inTemplateVar);
+
     /// \brief Read any integral type from a bitstream.
     /// \details Define __BITSTREAM_NATIVE_END if you need endian swapping.
     /// \param[in] outTemplateVar The value to read
@@ -374,6 +414,20 @@ public:
     template <class templateType>
     bool ReadCompressedDelta(templateType& outTemplateVar);
 
+    /// \brief Read an integral type written with WriteVarInt().
+    /// \details Fails, without moving the read offset, if the stream ends inside the varint, if it is longer than
+    /// \a templateType needs, or if its value does not fit in \a templateType.
+    /// \param[in] outTemplateVar The value to read
+    /// \return true on success, false on failure.
+    template <class templateType>
+    bool ReadVarInt(templateType& outTemplateVar);
+
+    /// \brief Read a signed integral type written with WriteVarIntZigZag().
+    /// \param[in] outTemplateVar The value to read
+    /// \return true on success, false on failure.
+    template <class templateType>
+    bool ReadVarIntZigZag(templateType& outTemplateVar);
+
     /// \brief Read one bitstream to another.
     /// \param[in] numberOfBits bits to read
     /// \param bitStream the bitstream to read into from
@@ -736,6 +790,21 @@ public:
     /// \brief Reallocates (if necessary) in preparation of writing numberOfBitsToWrite
     void AddBitsAndReallocate(const BitSize_t numberOfBitsToWrite);
 
+    /// \brief Allocates exactly enough to write \a numberOfBitsToWrite more bits without reallocating.
+    /// \details AddBitsAndReallocate() doubles the allocation as the stream grows. Call this first when you know how
+    /// much you will write, so a large stream is allocated once and at the right size.
+    void Reserve(const BitSize_t numberOfBitsToWrite);
+
+    /// \brief Takes storage from \a _arena rather than the heap once the stream outgrows the stack allocation.
+    /// \details Use for temporary streams built and thrown away every tick, so they make no heap calls once the arena
+    /// is large enough. Anything already written is moved to the new storage. Pass 0 to go back to the heap, which
+    /// must be done before the arena is reset if the stream is to be kept.
+    /// \param[in] _arena The arena to allocate from, or 0 for the heap. Must outlive the stream's use of it
+    void SetArena(BitStreamArena* _arena);
+
+    /// \return The arena the stream allocates from, or 0 for the heap
+    inline BitStreamArena* GetArena(void) const { return arena; }
+
     /// \internal
     /// \return How many bits have been allocated internally
     BitSize_t GetNumberOfBitsAllocated(void) const;
@@ -1000,6 +1069,15 @@ private:
     /// \brief Assume the input source points to a native type, compress and write it.
     void WriteCompressed(const unsigned char* inByteArray, const unsigned int size, const bool unsignedData);
 
+    /// Moves the data to storage for \a newNumberOfBitsAllocated bits, from the arena if there is one
+    void Reallocate(const BitSize_t newNumberOfBitsAllocated);
+
+    /// \brief Writes \a value as an unsigned LEB128 varint.
+    void WriteVarInt64(uint64_t value);
+
+    /// \brief Reads an unsigned LEB128 varint of at most \a maxBytes bytes. The read offset only moves on success.
+    bool ReadVarInt64(uint64_t& value, const unsigned int maxBytes);
+
     /// \brief Assume the input source points to a compressed native type. Decompress and read it.
     bool ReadCompressed(unsigned char* inOutByteArray, const unsigned int size, const bool unsignedData);
 
@@ -1015,6 +1093,9 @@ private:
     /// true if the internal buffer is copy of the data passed to the constructor
     bool copyData;
 
+    /// If set, storage beyond stackData comes from here and is never freed by the stream
+    BitStreamArena* arena;
+
     /// BitStreams that use less than BITSTREAM_STACK_ALLOCATION_SIZE use the stack, rather than the heap to store data.
     /// It switches over if BITSTREAM_STACK_ALLOCATION_SIZE is exceeded
     unsigned char stackData[BITSTREAM_STACK_ALLOCATION_SIZE];
@@ -1067,6 +1148,20 @@ inline bool BitStream::SerializeCompressedDelta(bool writeToBitstream, templateT
     return true;
 }
 
+template <class templateType>
+inline bool BitStream::SerializeVarInt(bool writeToBitstream, templateType& inOutTemplateVar) {
+    if (writeToBitstream) WriteVarInt(inOutTemplateVar);
+    else return ReadVarInt(inOutTemplateVar);
+    return true;
+}
+
+template <class templateType>
+inline bool BitStream::SerializeVarIntZigZag(bool writeToBitstream, templateType& inOutTemplateVar) {
+    if (writeToBitstream) WriteVarIntZigZag(inOutTemplateVar);
+    else return ReadVarIntZigZag(inOutTemplateVar);
+    return true;
+}
+
 inline bool BitStream::Serialize(bool writeToBitstream, char* inOutByteArray, const unsigned int numberOfBytes) {
     if (writeToBitstream) Write(inOutByteArray, numberOfBytes);
     else return Read(inOutByteArray, numberOfBytes);
@@ -1456,6 +1551,28 @@ inline void BitStream::WriteCompressedDelta(const bool& currentValue) {
     Write(currentValue);
 }
 
+template <class templateType>
+inline void BitStream::WriteVarInt(const templateType& inTemplateVar) {
+    static_assert(
+        std::is_integral<templateType>::value && !std::is_same<templateType, bool>::value,
+        "WriteVarInt needs an integral type"
+    );
+    WriteVarInt64((uint64_t)(typename std::make_unsigned<templateType>::type)inTemplateVar);
+}
+
+template <class templateType>
+inline void BitStream::WriteVarIntZigZag(const templateType& inTemplateVar) {
+    static_assert(
+        std::is_integral<templateType>::value && std::is_signed<templateType>::value,
+        "WriteVarIntZigZag needs a signed integral type"
+    );
+    typedef typename std::make_unsigned<templateType>::type UnsignedType;
+    // The arithmetic shift fills with the sign bit, so negative numbers invert the shifted magnitude
+    UnsignedType zigZag = (UnsignedType)((UnsignedType)inTemplateVar << 1)
+                        ^ (UnsignedType)(inTemplateVar >> (sizeof(templateType) * 8 - 1));
+    WriteVarInt64((uint64_t)zigZag);
+}
+
 /// \brief Read any integral type from a bitstream.  Define __BITSTREAM_NATIVE_END if you need endian swapping.
 /// \param[in] outTemplateVar The value to read
 template <class templateType>
@@ -1718,6 +1835,40 @@ inline bool BitStream::ReadCompressedDelta(bool& outTemplateVar) {
     return Read(outTemplateVar);
 }
 
+template <class templateType>
+inline bool BitStream::ReadVarInt(templateType& outTemplateVar) {
+    static_assert(
+        std::is_integral<templateType>::value && !std::is_same<templateType, bool>::value,
+        "ReadVarInt needs an integral type"
+    );
+    typedef typename std::make_unsigned<templateType>::type UnsignedType;
+
+    const BitSize_t startOffset = readOffset;
+    uint64_t        value;
+    if (ReadVarInt64(value, (sizeof(templateType) * 8 + 6) / 7) == false) return false;
+    if (value > (uint64_t)(UnsignedType)-1) {
+        // More bits than the type holds
+        readOffset = startOffset;
+        return false;
+    }
+    outTemplateVar = (templateType)(UnsignedType)value;
+    return true;
+}
+
+template <class templateType>
+inline bool BitStream::ReadVarIntZigZag(templateType& outTemplateVar) {
+    static_assert(
+        std::is_integral<templateType>::value && std::is_signed<templateType>::value,
+        "ReadVarIntZigZag needs a signed integral type"
+    );
+    typedef typename std::make_unsigned<templateType>::type UnsignedType;
+
+    UnsignedType zigZag;
+    if (ReadVarInt(zigZag) == false) return false;
+    outTemplateVar = (templateType)((UnsignedType)(zigZag >> 1) ^ (UnsignedType)(0 - (zigZag & 1)));
+    return true;
+}
+
 template <class destinationType, class sourceType>
 void BitStream::WriteCasted(const sourceType& value) {
     destinationType val = (destinationType)value;
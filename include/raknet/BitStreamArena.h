@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file BitStreamArena.h
+/// \brief Bump allocator for the storage of short lived BitStreams.
+///
+
+
+#ifndef __BITSTREAM_ARENA_H
+#define __BITSTREAM_ARENA_H
+
+#include "Export.h"
+#include <stddef.h>
+
+namespace RakNet {
+/// \brief Backs temporary BitStreams that are all thrown away at the same point, such as once per tick.
+/// \details Storage is handed out by moving a pointer through a block and is only given back, all at once, by Reset().
+/// If a tick needs more than the block holds more blocks are allocated, and the next Reset() replaces them with one
+/// block large enough for the whole tick. Once ticks stop growing no heap calls are made at all.
+/// Not thread safe. Every BitStream using the arena must be destroyed, or moved off it with
+/// BitStream::SetArena(0), before Reset() is called.
+/// \sa BitStream::SetArena()
+class RAKNET_API BitStreamArena {
+public:
+    /// \param[in] initialBytesToAllocate Size of the first block. If 0 it is allocated on first use, with
+    /// BITSTREAM_ARENA_BLOCK_SIZE bytes.
+    BitStreamArena(size_t initialBytesToAllocate = 0);
+    ~BitStreamArena();
+
+    /// Returns \a numberOfBytes of storage, valid until the next Reset()
+    void* Allocate(size_t numberOfBytes);
+
+    /// \brief Grows \a block, returned by Allocate() or Reallocate(), from \a oldNumberOfBytes to \a newNumberOfBytes.
+    /// \details The most recent allocation grows in place while the block has room. Anything else is copied to a new
+    /// allocation, and the old one is not reused before Reset().
+    void* Reallocate(void* block, size_t oldNumberOfBytes, size_t newNumberOfBytes);
+
+    /// Makes all storage available again. If more than one block was needed since the last Reset(), they are replaced
+    /// with a single block that holds all of it.
+    void Reset(void);
+
+    /// Frees every block
+    void Clear(void);
+
+    /// \return Bytes handed out since the last Reset()
+    size_t GetBytesUsed(void) const { return bytesUsed; }
+
+    /// \return Bytes held in blocks
+    size_t GetBytesAllocated(void) const { return bytesAllocated; }
+
+    /// \return How many blocks have been allocated from the heap over the lifetime of the arena
+    unsigned int GetBlockAllocationCount(void) const { return blockAllocationCount; }
+
+private:
+    BitStreamArena(const BitStreamArena&);
+    BitStreamArena& operator=(const BitStreamArena&);
+
+    struct Block {
+        Block* next;
+        size_t capacity;
+    };
+
+    void AddBlock(size_t minimumCapacity);
+
+    static unsigned char* GetBlockData(Block* block);
+
+    // The block being allocated from is first. The others are full
+    Block*       blocks;
+    // Offset of the next allocation in the first block
+    size_t       blockOffset;
+    void*        lastAllocation;
+    size_t       initialBlockSize;
+    size_t       bytesUsed;
+    size_t       bytesAllocated;
+    unsigned int blockAllocationCount;
+};
+
+} // namespace RakNet
+
+#endif
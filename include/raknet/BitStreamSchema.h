@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file BitStreamSchema.h
+/// \brief Serialize a struct whose fields are declared once, at compile time, instead of with a sequence of Write() and
+/// Read() calls.
+///
+
+
+#ifndef __BITSTREAM_SCHEMA_H
+#define __BITSTREAM_SCHEMA_H
+
+#include "BitStream.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace RakNet {
+/// \internal
+/// \brief Places bit fields in a message image, most significant bit first as BitStream stores them.
+/// \details Offsets and widths are template arguments, so each call compiles to a few shifts, or to plain byte stores
+/// when the field is byte aligned.
+struct BitStreamSchemaPacker {
+    // Whether full width values are written most significant byte first, as BitStream::Write() does unless
+    // __BITSTREAM_NATIVE_END is defined
+#ifndef __BITSTREAM_NATIVE_END
+    static constexpr bool networkOrder = true;
+#else
+    static constexpr bool networkOrder = std::endian::native == std::endian::big;
+#endif
+
+    template <BitSize_t offset, unsigned int numberOfBits>
+    static inline void Put(unsigned char* buffer, uint64_t value) {
+        static_assert(numberOfBits <= 64, "Fields are at most 64 bits");
+        if constexpr ((offset & 7) == 0 && (numberOfBits & 7) == 0) {
+            for (unsigned int i = 0; i < numberOfBits / 8; i++)
+                buffer[offset / 8 + i] = (unsigned char)(value >> (numberOfBits - 8 - 8 * i));
+        } else if constexpr ((offset & 7) + numberOfBits <= 64) {
+            // Line the field up with the bytes it covers in one word, then store those bytes
+            constexpr unsigned int bitInByte = (unsigned int)(offset & 7);
+            constexpr unsigned int bytes     = (bitInByte + numberOfBits + 7) / 8;
+            constexpr uint64_t     mask      = ~0ull >> (64 - numberOfBits);
+            uint64_t               word      = (value & mask) << (64 - bitInByte - numberOfBits);
+            for (unsigned int i = 0; i < bytes; i++) buffer[offset / 8 + i] |= (unsigned char)(word >> (56 - 8 * i));
+        } else {
+            unsigned int written = 0;
+            while (written < numberOfBits) {
+                BitSize_t    bit       = offset + written;
+                unsigned int bitInByte = (unsigned int)(bit & 7);
+                unsigned int count     = 8 - bitInByte;
+                if (count > numberOfBits - written) count = numberOfBits - written;
+                unsigned int chunk = (unsigned int)(value >> (numberOfBits - written - count)) & ((1u << count) - 1);
+                buffer[bit >> 3] |= (unsigned char)(chunk << (8 - bitInByte - count));
+                written += count;
+            }
+        }
+    }
+
+    template <BitSize_t offset, unsigned int numberOfBits>
+    static inline uint64_t Get(const unsigned char* buffer) {
+        static_assert(numberOfBits <= 64, "Fields are at most 64 bits");
+        uint64_t value = 0;
+        if constexpr ((offset & 7) == 0 && (numberOfBits & 7) == 0) {
+            for (unsigned int i = 0; i < numberOfBits / 8; i++) value = (value << 8) | buffer[offset / 8 + i];
+        } else if constexpr ((offset & 7) + numberOfBits <= 64) {
+            constexpr unsigned int bitInByte = (unsigned int)(offset & 7);
+            constexpr unsigned int bytes     = (bitInByte + numberOfBits + 7) / 8;
+            uint64_t               word      = 0;
+            for (unsigned int i = 0; i < bytes; i++) word |= (uint64_t)buffer[offset / 8 + i] << (56 - 8 * i);
+            value = (word << bitInByte) >> (64 - numberOfBits);
+        } else {
+            unsigned int read = 0;
+            while (read < numberOfBits) {
+                BitSize_t    bit       = offset + read;
+                unsigned int bitInByte = (unsigned int)(bit & 7);
+                unsigned int count     = 8 - bitInByte;
+                if (count > numberOfBits - read) count = numberOfBits - read;
+                value  = (value << count) | ((buffer[bit >> 3] >> (8 - bitInByte - count)) & ((1u << count) - 1));
+                read  += count;
+            }
+        }
+        return value;
+    }
+
+    // Unsigned integer the size of T
+    template <class T>
+    using WireType = std::conditional_t<
+        sizeof(T) == 1,
+        uint8_t,
+        std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+
+    // The bytes of \a value in the order BitStream::Write() puts them on the wire, as an integer
+    template <class T>
+    static inline uint64_t ToWire(const T& value) {
+        WireType<T> bits;
+        memcpy(&bits, &value, sizeof(T));
+        if constexpr (networkOrder == false && sizeof(T) > 1) bits = ReverseBytes(bits);
+        return bits;
+    }
+
+    template <class T>
+    static inline void FromWire(uint64_t wire, T& value) {
+        WireType<T> bits = (WireType<T>)wire;
+        if constexpr (networkOrder == false && sizeof(T) > 1) bits = ReverseBytes(bits);
+        memcpy(&value, &bits, sizeof(T));
+    }
+
+    template <class T>
+    static inline T ReverseBytes(T value) {
+        T reversed = 0;
+        for (unsigned int i = 0; i < sizeof(T); i++) reversed = (T)((reversed << 8) | ((value >> (8 * i)) & 0xFF));
+        return reversed;
+    }
+};
+
+/// \internal
+template <class T>
+struct BitStreamSchemaMember;
+template <class StructType, class MemberType>
+struct BitStreamSchemaMember<MemberType StructType::*> {
+    typedef StructType Struct;
+    typedef MemberType Member;
+};
+
+/// \brief A field written exactly as BitStream::Write() writes it: one bit for a bool, otherwise every byte of the
+/// value, in network order unless __BITSTREAM_NATIVE_END is defined.
+/// \param[in] member Pointer to the field, such as &Player::health
+template <auto member>
+struct SchemaField {
+    typedef typename BitStreamSchemaMember<decltype(member)>::Struct Struct;
+    typedef typename BitStreamSchemaMember<decltype(member)>::Member Member;
+    static_assert(std::is_arithmetic_v<Member> || std::is_enum_v<Member>, "SchemaField needs an arithmetic or enum");
+    static_assert(sizeof(Member) <= 8, "SchemaField is at most 64 bits");
+
+    static constexpr BitSize_t NUMBER_OF_BITS = std::is_same_v<Member, bool> ? 1 : sizeof(Member) * 8;
+
+    template <BitSize_t offset>
+    static inline void Pack(unsigned char* buffer, const Struct& s) {
+        if constexpr (std::is_same_v<Member, bool>)
+            BitStreamSchemaPacker::Put<offset, 1>(buffer, s.*member ? 1 : 0);
+        else BitStreamSchemaPacker::Put<offset, NUMBER_OF_BITS>(buffer, BitStreamSchemaPacker::ToWire(s.*member));
+    }
+    template <BitSize_t offset>
+    static inline void Unpack(const unsigned char* buffer, Struct& s) {
+        if constexpr (std::is_same_v<Member, bool>) s.*member = BitStreamSchemaPacker::Get<offset, 1>(buffer) != 0;
+        else BitStreamSchemaPacker::FromWire(BitStreamSchemaPacker::Get<offset, NUMBER_OF_BITS>(buffer), s.*member);
+    }
+};
+
+/// \brief An integer known to lie in [\a minimum, \a maximum], written with only the bits that range needs.
+/// \details Matches BitStream::WriteBitsFromIntegerRange() with allowOutsideRange false, so either side can be
+/// read with the other.
+template <auto member, auto minimum, auto maximum>
+struct SchemaRange {
+    typedef typename BitStreamSchemaMember<decltype(member)>::Struct Struct;
+    typedef typename BitStreamSchemaMember<decltype(member)>::Member Member;
+    typedef std::make_unsigned_t<Member>                            UnsignedType;
+    static_assert(std::is_integral_v<Member> && !std::is_same_v<Member, bool>, "SchemaRange needs an integer");
+    static_assert((Member)maximum >= (Member)minimum, "SchemaRange needs maximum >= minimum");
+
+    static constexpr BitSize_t NUMBER_OF_BITS =
+        (BitSize_t)std::bit_width((UnsignedType)((UnsignedType)(Member)maximum - (UnsignedType)(Member)minimum));
+
+    // Little endian bytes, the last one partial, as WriteBitsFromIntegerRange() writes them
+    template <BitSize_t offset>
+    static inline void Pack(unsigned char* buffer, const Struct& s) {
+        RakAssert(s.*member >= (Member)minimum && s.*member <= (Member)maximum);
+        uint64_t valueOffMin = (UnsignedType)((UnsignedType)(s.*member) - (UnsignedType)(Member)minimum);
+        PackBytes<offset, 0>(buffer, valueOffMin);
+    }
+    template <BitSize_t offset>
+    static inline void Unpack(const unsigned char* buffer, Struct& s) {
+        uint64_t valueOffMin = 0;
+        UnpackBytes<offset, 0>(buffer, valueOffMin);
+        s.*member = (Member)(UnsignedType)((UnsignedType)valueOffMin + (UnsignedType)(Member)minimum);
+    }
+
+private:
+    template <BitSize_t offset, unsigned int byteIndex>
+    static inline void PackBytes(unsigned char* buffer, uint64_t value) {
+        if constexpr (byteIndex * 8 < NUMBER_OF_BITS) {
+            constexpr unsigned int bits = NUMBER_OF_BITS - byteIndex * 8 < 8 ? NUMBER_OF_BITS - byteIndex * 8 : 8;
+            BitStreamSchemaPacker::Put<offset + byteIndex * 8, bits>(buffer, (value >> (byteIndex * 8)) & 0xFF);
+            PackBytes<offset, byteIndex + 1>(buffer, value);
+        }
+    }
+    template <BitSize_t offset, unsigned int byteIndex>
+    static inline void UnpackBytes(const unsigned char* buffer, uint64_t& value) {
+        if constexpr (byteIndex * 8 < NUMBER_OF_BITS) {
+            constexpr unsigned int bits = NUMBER_OF_BITS - byteIndex * 8 < 8 ? NUMBER_OF_BITS - byteIndex * 8 : 8;
+            value |= BitStreamSchemaPacker::Get<offset + byteIndex * 8, bits>(buffer) << (byteIndex * 8);
+            UnpackBytes<offset, byteIndex + 1>(buffer, value);
+        }
+    }
+};
+
+/// \brief A float or double in [\a minimum, \a maximum], quantized to \a numberOfBits bits.
+/// \details With 16 bits and __BITSTREAM_NATIVE_END not defined this matches BitStream::WriteFloat16().
+template <auto member, auto minimum, auto maximum, unsigned int numberOfBits>
+struct SchemaQuantized {
+    typedef typename BitStreamSchemaMember<decltype(member)>::Struct Struct;
+    typedef typename BitStreamSchemaMember<decltype(member)>::Member Member;
+    static_assert(std::is_floating_point_v<Member>, "SchemaQuantized needs a float or double");
+    static_assert(numberOfBits >= 1 && numberOfBits <= 32, "SchemaQuantized is 1 to 32 bits");
+    static_assert((Member)maximum > (Member)minimum, "SchemaQuantized needs maximum > minimum");
+
+    static constexpr BitSize_t NUMBER_OF_BITS = numberOfBits;
+    static constexpr Member    STEPS          = (Member)((1ull << numberOfBits) - 1);
+
+    template <BitSize_t offset>
+    static inline void Pack(unsigned char* buffer, const Struct& s) {
+        Member percentile = STEPS * (s.*member - (Member)minimum) / ((Member)maximum - (Member)minimum);
+        if (percentile < 0) percentile = 0;
+        if (percentile > STEPS) percentile = STEPS;
+        BitStreamSchemaPacker::Put<offset, numberOfBits>(buffer, (uint64_t)percentile);
+    }
+    template <BitSize_t offset>
+    static inline void Unpack(const unsigned char* buffer, Struct& s) {
+        Member percentile = (Member)BitStreamSchemaPacker::Get<offset, numberOfBits>(buffer);
+        Member value      = (Member)minimum + (percentile / STEPS) * ((Member)maximum - (Member)minimum);
+        if (value < (Member)minimum) value = (Member)minimum;
+        else if (value > (Member)maximum) value = (Member)maximum;
+        s.*member = value;
+    }
+};
+
+/// \brief Serializes \a Struct as the list of \a Fields, in order.
+/// \details The layout is fixed, so the whole message is assembled in a buffer on the stack and written with a single
+/// WriteBits(), which is a memcpy when the stream is byte aligned. Reading checks the length once and reads the whole
+/// message before unpacking any field. The bits are the same as calling the equivalent Write() functions in order.
+/// \code
+/// struct PlayerState { uint32_t id; bool alive; uint8_t team; float x, y; };
+/// typedef RakNet::BitStreamSchema<
+///     PlayerState,
+///     RakNet::SchemaField<&PlayerState::id>,
+///     RakNet::SchemaField<&PlayerState::alive>,
+///     RakNet::SchemaRange<&PlayerState::team, 0, 3>,
+///     RakNet::SchemaQuantized<&PlayerState::x, -1024.0f, 1024.0f, 20>,
+///     RakNet::SchemaQuantized<&PlayerState::y, -1024.0f, 1024.0f, 20>>
+///     PlayerStateSchema;
+///
+/// PlayerStateSchema::Write(&bitStream, playerState);
+/// \endcode
+template <class Struct, class... Fields>
+class BitStreamSchema {
+public:
+    /// Length of every message with this schema
+    static constexpr BitSize_t NUMBER_OF_BITS = (Fields::NUMBER_OF_BITS + ... + 0);
+
+    static_assert((std::is_same_v<typename Fields::Struct, Struct> && ...), "Every field must be a member of Struct");
+    static_assert(NUMBER_OF_BITS > 0, "A schema needs at least one bit");
+
+    static void Write(BitStream* bitStream, const Struct& s) {
+        unsigned char buffer[BITS_TO_BYTES(NUMBER_OF_BITS)] = {};
+        Pack(buffer, s, std::index_sequence_for<Fields...>());
+        bitStream->WriteBits(buffer, NUMBER_OF_BITS, false);
+    }
+
+    /// \return false, leaving \a s untouched, if the stream does not hold a whole message
+    static bool Read(BitStream* bitStream, Struct& s) {
+        unsigned char buffer[BITS_TO_BYTES(NUMBER_OF_BITS)];
+        if (bitStream->ReadBits(buffer, NUMBER_OF_BITS, false) == false) return false;
+        Unpack(buffer, s, std::index_sequence_for<Fields...>());
+        return true;
+    }
+
+    static bool Serialize(bool writeToBitstream, BitStream* bitStream, Struct& s) {
+        if (writeToBitstream) Write(bitStream, s);
+        else return Read(bitStream, s);
+        return true;
+    }
+
+private:
+    template <size_t index>
+    static constexpr BitSize_t FieldOffset(void) {
+        constexpr BitSize_t fieldBits[] = {Fields::NUMBER_OF_BITS...};
+        BitSize_t           offset      = 0;
+        for (size_t i = 0; i < index; i++) offset += fieldBits[i];
+        return offset;
+    }
+
+    template <size_t... indices>
+    static inline void Pack(unsigned char* buffer, const Struct& s, std::index_sequence<indices...>) {
+        (std::tuple_element_t<indices, std::tuple<Fields...>>::template Pack<FieldOffset<indices>()>(buffer, s), ...);
+    }
+    template <size_t... indices>
+    static inline void Unpack(const unsigned char* buffer, Struct& s, std::index_sequence<indices...>) {
+        (std::tuple_element_t<indices, std::tuple<Fields...>>::template Unpack<FieldOffset<indices>()>(buffer, s),
+         ...);
+    }
+};
+
+} // namespace RakNet
+
+#endif
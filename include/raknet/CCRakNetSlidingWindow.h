@@ -196,6 +196,8 @@ public:
 
     bool     GetIsInSlowStart(void) const { return IsInSlowStart(); }
     uint32_t GetCWNDLimit(void) const { return (uint32_t)0; }
+    /// Bytes allowed on the wire at once, for EVENT_TRACE_CONGESTION_WINDOW
+    uint32_t GetCWNDBytes(void) const { return (uint32_t)cwnd; }
 
 
     /// Is a > b, accounting for variable overflow?
@@ -203,6 +203,8 @@ public:
 
     bool     GetIsInSlowStart(void) const { return isInSlowStart; }
     uint32_t GetCWNDLimit(void) const { return (uint32_t)(CWND * MAXIMUM_MTU_INCLUDING_UDP_HEADER); }
+    /// Bytes allowed on the wire at once, for EVENT_TRACE_CONGESTION_WINDOW
+    uint32_t GetCWNDBytes(void) const { return GetCWNDLimit(); }
 
 
     /// Is a > b, accounting for variable overflow?
@@ -59,10 +59,38 @@ private:
     struct CharacterEncoding {
         unsigned char* encoding;
         unsigned short bitLength;
+        /// The same code right aligned, if bitLength is 64 or less
+        uint64_t       code;
     };
 
     CharacterEncoding encodingTable[256];
 
+    /// Bits looked up at once when decoding. Most codes for text are shorter than this
+    static const unsigned int DECODE_TABLE_BITS = 10;
+
+    /// One entry for every value of the next DECODE_TABLE_BITS bits of input
+    struct DecodeTableEntry {
+        /// Node reached after DECODE_TABLE_BITS bits, when the code is longer than that
+        HuffmanEncodingTreeNode* node;
+        unsigned char            value;
+        /// Length of the code the bits start with, 0 if it is longer than DECODE_TABLE_BITS
+        unsigned char            bitLength;
+    };
+
+    DecodeTableEntry* decodeTable;
+
+    void GenerateDecodeTable(void);
+
+    /// Decodes from \a bitOffset up to \a endOffset, stopping early once \a outputSize characters are written.
+    /// \a bitOffset is moved past the bits used.
+    size_t DecodeBits(
+        const unsigned char* input,
+        BitSize_t&           bitOffset,
+        const BitSize_t      endOffset,
+        unsigned char*       output,
+        size_t               outputSize
+    ) const;
+
     void InsertNodeIntoSortedList(
         HuffmanEncodingTreeNode*                              node,
         DataStructures::LinkedList<HuffmanEncodingTreeNode*>* huffmanEncodingTreeNodeList
@@ -53,6 +53,8 @@ public:
     MemoryBlockType* Allocate(const char* file, unsigned int line);
     void             Release(MemoryBlockType* m, const char* file, unsigned int line);
     void             Clear(const char* file, unsigned int line);
+    // Frees every page that has no blocks in use, keeping pages that still have blocks handed out
+    void             ReleaseEmptyPages(const char* file, unsigned int line);
 
     int GetAvailablePagesSize(void) const { return availablePagesSize; }
     int GetUnavailablePagesSize(void) const { return unavailablePagesSize; }
@@ -236,6 +238,33 @@ void MemoryPool<MemoryBlockType>::Clear(const char* file, unsigned int line) {
     unavailablePagesSize = 0;
 #endif
 }
+template <class MemoryBlockType>
+void MemoryPool<MemoryBlockType>::ReleaseEmptyPages(const char* file, unsigned int line) {
+#ifdef _DISABLE_MEMORY_POOL
+    (void)file;
+    (void)line;
+    return;
+#else
+    // Full pages are on the unavailable list, so only the available list can hold empty pages
+    const int bpp          = BlocksPerPage();
+    int       pagesToCheck = availablePagesSize;
+    Page*     cur          = availablePages;
+    while (pagesToCheck-- > 0) {
+        Page* next = cur->next;
+        if (cur->availableStackSize == bpp) {
+            if (cur == availablePages) availablePages = next;
+            cur->prev->next = cur->next;
+            cur->next->prev = cur->prev;
+            availablePagesSize--;
+            rakFree_Ex(cur->availableStack, file, line);
+            rakFree_Ex(cur->block, file, line);
+            rakFree_Ex(cur, file, line);
+        }
+        cur = next;
+    }
+#endif
+}
+
 template <class MemoryBlockType>
 int MemoryPool<MemoryBlockType>::BlocksPerPage(void) const {
     return memoryPoolPageSize / sizeof(MemoryWithPage);
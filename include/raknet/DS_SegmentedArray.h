@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_SegmentedArray.h
+/// \internal
+/// \brief A fixed capacity array whose storage is allocated a page at a time.
+///
+
+
+#ifndef __SEGMENTED_ARRAY_H
+#define __SEGMENTED_ARRAY_H
+
+// Template classes have to have all the code in the header file
+#include "Export.h"
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include <atomic>
+
+/// The namespace DataStructures was only added to avoid compiler errors for commonly named data structures
+/// As these data structures are stand-alone, you can use them outside of RakNet for your own projects if you wish.
+namespace DataStructures {
+/// \brief An array with a fixed capacity whose elements are allocated in pages of \a pageSize elements on demand.
+/// Only the page directory, one pointer per page, is allocated up front. Elements never move once their page is
+/// allocated, so pointers and indices into the array stay valid until their page is removed.
+/// One thread allocates and removes pages. Other threads may read through GetPointer(), which returns 0 for elements
+/// whose page is not allocated. A page removed by UnpublishPage() is not freed, so the caller can wait until no other
+/// thread can still be reading it, for example with a RakNet::GracePeriod, before passing it to DeletePage().
+template <class element_type, unsigned int pageSize = 64>
+class RAKNET_API SegmentedArray {
+public:
+    SegmentedArray();
+    ~SegmentedArray();
+
+    // Allocates the page directory for \a capacity elements, freeing anything held before. No pages are allocated
+    void Init(unsigned int capacity, const char* file, unsigned int line);
+    // Frees every page and the directory. No other thread may be reading the array
+    void Clear(const char* file, unsigned int line);
+
+    // The page holding \a index must be allocated
+    inline element_type& operator[](unsigned int index) const;
+    // Returns 0 if \a index is out of range or its page is not allocated
+    inline element_type* GetPointer(unsigned int index) const;
+
+    // Returns a new page of PageLength(pageIndex) default constructed elements for \a pageIndex. It is not visible
+    // through the array until passed to PublishPage(), so the caller can finish initializing it first.
+    element_type* NewPage(unsigned int pageIndex, const char* file, unsigned int line);
+    // Makes \a page, returned by NewPage(), the storage for \a pageIndex, which must not already be allocated
+    void          PublishPage(unsigned int pageIndex, element_type* page);
+    // Removes the page of \a pageIndex from the array and returns it. Readers that already hold it may keep using it
+    // until it is passed to DeletePage()
+    element_type* UnpublishPage(unsigned int pageIndex);
+    // Destroys a page returned by NewPage() or UnpublishPage()
+    static void   DeletePage(element_type* page, const char* file, unsigned int line);
+
+    inline bool         IsPageAllocated(unsigned int pageIndex) const;
+    inline unsigned int Capacity(void) const;
+    inline unsigned int PageCount(void) const;
+    inline unsigned int AllocatedPageCount(void) const;
+    // Elements in \a pageIndex. pageSize, except for the last page, which only holds up to the capacity
+    inline unsigned int PageLength(unsigned int pageIndex) const;
+    // One past the last element of the highest allocated page. Elements at or above this are never allocated
+    inline unsigned int Size(void) const;
+
+    static unsigned int PageSize(void) { return pageSize; }
+    static unsigned int PageOf(unsigned int index) { return index / pageSize; }
+
+private:
+    SegmentedArray(const SegmentedArray&);
+    SegmentedArray& operator=(const SegmentedArray&);
+
+    // Written by the allocating thread with release, read by the others with acquire, so a page is only seen once
+    // its elements are
+    std::atomic<element_type*>* pages;
+    unsigned int                capacity;
+    unsigned int                pageCount;
+    unsigned int                allocatedPageCount;
+    // One past the highest allocated page. Read by other threads through Size()
+    std::atomic<unsigned int>   usedPageCount;
+};
+
+template <class element_type, unsigned int pageSize>
+SegmentedArray<element_type, pageSize>::SegmentedArray() {
+    pages              = 0;
+    capacity           = 0;
+    pageCount          = 0;
+    allocatedPageCount = 0;
+    usedPageCount.store(0, std::memory_order_relaxed);
+}
+
+template <class element_type, unsigned int pageSize>
+SegmentedArray<element_type, pageSize>::~SegmentedArray() {
+    Clear(_FILE_AND_LINE_);
+}
+
+template <class element_type, unsigned int pageSize>
+void SegmentedArray<element_type, pageSize>::Init(unsigned int _capacity, const char* file, unsigned int line) {
+    Clear(file, line);
+    if (_capacity == 0) return;
+
+    pageCount = (_capacity + pageSize - 1) / pageSize;
+    pages     = RakNet::OP_NEW_ARRAY<std::atomic<element_type*>>(pageCount, file, line);
+    for (unsigned int i = 0; i < pageCount; i++) pages[i].store(0, std::memory_order_relaxed);
+    capacity = _capacity;
+}
+
+template <class element_type, unsigned int pageSize>
+void SegmentedArray<element_type, pageSize>::Clear(const char* file, unsigned int line) {
+    capacity = 0;
+    for (unsigned int i = 0; i < pageCount; i++) {
+        element_type* page = pages[i].load(std::memory_order_relaxed);
+        if (page) RakNet::OP_DELETE_ARRAY(page, file, line);
+    }
+    if (pages) RakNet::OP_DELETE_ARRAY(pages, file, line);
+    pages              = 0;
+    pageCount          = 0;
+    allocatedPageCount = 0;
+    usedPageCount.store(0, std::memory_order_relaxed);
+}
+
+template <class element_type, unsigned int pageSize>
+inline element_type& SegmentedArray<element_type, pageSize>::operator[](unsigned int index) const {
+    RakAssert(index < capacity && pages[index / pageSize].load(std::memory_order_relaxed) != 0);
+    return pages[index / pageSize].load(std::memory_order_acquire)[index % pageSize];
+}
+
+template <class element_type, unsigned int pageSize>
+inline element_type* SegmentedArray<element_type, pageSize>::GetPointer(unsigned int index) const {
+    if (index >= capacity) return 0;
+    element_type* page = pages[index / pageSize].load(std::memory_order_acquire);
+    if (page == 0) return 0;
+    return page + index % pageSize;
+}
+
+template <class element_type, unsigned int pageSize>
+element_type*
+SegmentedArray<element_type, pageSize>::NewPage(unsigned int pageIndex, const char* file, unsigned int line) {
+    RakAssert(pageIndex < pageCount);
+    return RakNet::OP_NEW_ARRAY<element_type>(PageLength(pageIndex), file, line);
+}
+
+template <class element_type, unsigned int pageSize>
+void SegmentedArray<element_type, pageSize>::PublishPage(unsigned int pageIndex, element_type* page) {
+    RakAssert(pageIndex < pageCount && pages[pageIndex].load(std::memory_order_relaxed) == 0);
+    pages[pageIndex].store(page, std::memory_order_release);
+    allocatedPageCount++;
+    if (pageIndex >= usedPageCount.load(std::memory_order_relaxed))
+        usedPageCount.store(pageIndex + 1, std::memory_order_relaxed);
+}
+
+template <class element_type, unsigned int pageSize>
+element_type* SegmentedArray<element_type, pageSize>::UnpublishPage(unsigned int pageIndex) {
+    RakAssert(pageIndex < pageCount && pages[pageIndex].load(std::memory_order_relaxed) != 0);
+    element_type* page = pages[pageIndex].load(std::memory_order_relaxed);
+    // Ordered before whatever the caller does next to wait out the readers
+    pages[pageIndex].store(0, std::memory_order_seq_cst);
+    allocatedPageCount--;
+    unsigned int used = usedPageCount.load(std::memory_order_relaxed);
+    while (used > 0 && pages[used - 1].load(std::memory_order_relaxed) == 0) used--;
+    usedPageCount.store(used, std::memory_order_relaxed);
+    return page;
+}
+
+template <class element_type, unsigned int pageSize>
+void SegmentedArray<element_type, pageSize>::DeletePage(element_type* page, const char* file, unsigned int line) {
+    RakNet::OP_DELETE_ARRAY(page, file, line);
+}
+
+template <class element_type, unsigned int pageSize>
+inline bool SegmentedArray<element_type, pageSize>::IsPageAllocated(unsigned int pageIndex) const {
+    return pageIndex < pageCount && pages[pageIndex].load(std::memory_order_acquire) != 0;
+}
+
+template <class element_type, unsigned int pageSize>
+inline unsigned int SegmentedArray<element_type, pageSize>::Capacity(void) const {
+    return capacity;
+}
+
+template <class element_type, unsigned int pageSize>
+inline unsigned int SegmentedArray<element_type, pageSize>::PageCount(void) const {
+    return pageCount;
+}
+
+template <class element_type, unsigned int pageSize>
+inline unsigned int SegmentedArray<element_type, pageSize>::AllocatedPageCount(void) const {
+    return allocatedPageCount;
+}
+
+template <class element_type, unsigned int pageSize>
+inline unsigned int SegmentedArray<element_type, pageSize>::PageLength(unsigned int pageIndex) const {
+    unsigned int firstIndex = pageIndex * pageSize;
+    return capacity - firstIndex < pageSize ? capacity - firstIndex : pageSize;
+}
+
+template <class element_type, unsigned int pageSize>
+inline unsigned int SegmentedArray<element_type, pageSize>::Size(void) const {
+    unsigned int size = usedPageCount.load(std::memory_order_relaxed) * pageSize;
+    return size < capacity ? size : capacity;
+}
+} // namespace DataStructures
+
+#endif
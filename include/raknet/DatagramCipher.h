@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DatagramCipher.h
+/// \brief \b [Internal] Authenticated encryption of connected datagrams, keyed by an ephemeral X25519 exchange.
+///
+/// The key exchange rides on ID_OPEN_CONNECTION_REQUEST_2 / ID_OPEN_CONNECTION_REPLY_2. Each datagram is then sealed
+/// with AES-256-GCM when both ends have AES-NI and PCLMULQDQ, or with ChaCha20-Poly1305 otherwise. Encryption and
+/// decryption happen in place on the socket buffer; the only cost in size is OVERHEAD_BYTES per datagram.
+/// \note The exchange is anonymous. It protects against passive observers and tampering, but does not authenticate
+/// the remote system.
+
+#ifndef __DATAGRAM_CIPHER_H
+#define __DATAGRAM_CIPHER_H
+
+#include "Export.h"
+#include "NativeFeatureIncludes.h"
+#include "NativeTypes.h"
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+
+namespace RakNet {
+
+/// Cipher suites that can be negotiated for a connection. Sent on the wire, so do not renumber.
+enum DatagramCipherSuite {
+    DCS_NONE              = 0,
+    DCS_CHACHA20_POLY1305 = 1,
+    DCS_AES_256_GCM       = 2,
+};
+
+/// \internal
+/// Per-connection datagram encryption state. One key and nonce salt per direction, plus a replay window.
+class RAKNET_API DatagramCipher {
+public:
+    static const int PUBLIC_KEY_BYTES  = 32;
+    static const int PRIVATE_KEY_BYTES = 32;
+    static const int COUNTER_BYTES     = 4;
+    static const int TAG_BYTES         = 16;
+    static const int OVERHEAD_BYTES    = COUNTER_BYTES + TAG_BYTES;
+
+    DatagramCipher();
+    ~DatagramCipher();
+
+    /// \return Bitmask of (1 << DatagramCipherSuite) that this CPU can run
+    static unsigned char GetSupportedSuites(void);
+
+    /// Picks the fastest suite both ends support
+    /// \param[in] remoteSuites Bitmask as returned by GetSupportedSuites() on the remote system
+    /// \return DCS_NONE if there is nothing in common
+    static DatagramCipherSuite ChooseSuite(unsigned char remoteSuites);
+
+    /// Generates an ephemeral X25519 key pair from the operating system's random number generator
+    /// \return false if no secure random source was available
+    static bool GenerateKeyPair(unsigned char* publicKey, unsigned char* privateKey);
+
+    /// Derives the session keys and enables encryption
+    /// \param[in] suite Negotiated cipher suite
+    /// \param[in] privateKey Our ephemeral private key. Not retained.
+    /// \param[in] publicKey Our ephemeral public key
+    /// \param[in] remotePublicKey The other system's ephemeral public key
+    /// \param[in] weInitiatedTheConnection Selects which derived key is used for sending
+    /// \return false if the suite is unsupported or the remote key is degenerate
+    bool Initialize(
+        DatagramCipherSuite  suite,
+        const unsigned char* privateKey,
+        const unsigned char* publicKey,
+        const unsigned char* remotePublicKey,
+        bool                 weInitiatedTheConnection
+    );
+
+    /// Wipes keys and disables encryption
+    void Clear(void);
+
+    /// \return true if Initialize() succeeded since the last Clear()
+    bool IsActive(void) const { return suite != DCS_NONE; }
+
+    DatagramCipherSuite GetSuite(void) const { return suite; }
+
+    /// Encrypts \a length bytes in place and appends the counter and tag
+    /// \pre \a buffer has room for length + OVERHEAD_BYTES
+    /// \return The new length
+    unsigned int Encrypt(unsigned char* buffer, unsigned int length);
+
+    /// Authenticates and decrypts in place
+    /// \param[in,out] length On success, reduced by OVERHEAD_BYTES
+    /// \return false if the datagram was forged, corrupted, or replayed
+    bool Decrypt(unsigned char* buffer, unsigned int& length);
+
+protected:
+    struct DirectionKey {
+        // AES-256 round keys (15 blocks) followed by H^1..H^4, or the ChaCha20 key in the first 32 bytes
+        alignas(16) unsigned char schedule[19 * 16];
+        unsigned char nonceSalt[4];
+    };
+
+    void Seal(DirectionKey& key, uint64_t counter, unsigned char* buffer, unsigned int length, unsigned char* tag);
+    bool Open(DirectionKey& key, uint64_t counter, unsigned char* buffer, unsigned int length, const unsigned char* tag);
+
+    DatagramCipherSuite suite;
+    DirectionKey        sendKey, receiveKey;
+    uint64_t            sendCounter;
+    uint64_t            highestReceivedCounter;
+    uint64_t            receivedCounterWindow;
+};
+
+} // namespace RakNet
+
+#endif // RAKNET_DATAGRAM_ENCRYPTION
+
+#endif
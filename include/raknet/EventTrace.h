@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file EventTrace.h
+/// \brief Binary tracing of datagram and congestion control events, cheap enough to leave on in production.
+///
+
+
+#ifndef __EVENT_TRACE_H
+#define __EVENT_TRACE_H
+
+#include "Export.h"
+#include "NativeTypes.h"
+#include "RakNetDefines.h"
+#include <atomic>
+#include <stdio.h>
+
+namespace RakNet {
+struct SystemAddress;
+
+/// What an EventTraceRecord is about, and what its values mean
+enum EventTraceType {
+    /// value1 = datagram number, value2 = bytes, value3 = messages in the datagram
+    EVENT_TRACE_DATAGRAM_SENT = 1,
+    /// value1 = datagram number, value2 = bytes
+    EVENT_TRACE_DATAGRAM_RECEIVED,
+    /// value1 = datagram number acknowledged, value3 = round trip time in microseconds
+    EVENT_TRACE_ACK_RECEIVED,
+    /// value1 = datagram number the remote system reported missing
+    EVENT_TRACE_NAK_RECEIVED,
+    /// value1 = reliable message number, value2 = times sent including this one, value3 = bytes
+    EVENT_TRACE_MESSAGE_RESENT,
+    /// value1 = split packet id, value2 = split packet count, value3 = bytes of the assembled message
+    EVENT_TRACE_SPLIT_PACKET_ASSEMBLED,
+    /// value1 = congestion window in bytes, value2 = the congestion window before, value3 = bytes per second limit
+    EVENT_TRACE_CONGESTION_WINDOW,
+    /// value1 = 1 if the remote system connected to us, 0 if we connected to it
+    EVENT_TRACE_CONNECTION_OPENED,
+    /// value1 = the RakPeer::RemoteSystemStruct::ConnectMode the connection was in when closed
+    EVENT_TRACE_CONNECTION_CLOSED,
+
+    EVENT_TRACE_TYPE_COUNT
+};
+
+/// \brief One event, as written to the ring buffer and to the files written by DumpEventTrace()
+/// \details Little more than a copy of the arguments to TraceEvent(), so the decoding is all left to
+/// DecodeEventTrace().
+struct EventTraceRecord {
+    /// RakNet::GetTimeUS() when recorded
+    uint64_t timeUs;
+    uint64_t value3;
+    uint32_t value1;
+    uint32_t value2;
+    /// IPv4 address in network order. SystemAddress::ToInteger() for IPv6, which cannot be turned back into the
+    /// address
+    uint32_t address;
+    uint16_t port;
+    /// EventTraceType
+    uint8_t  type;
+    /// Which ring buffer the event was written to. Each thread writes to its own
+    uint8_t  thread;
+};
+static_assert(sizeof(EventTraceRecord) == 32, "EventTraceRecord is written to files as is");
+
+/// \internal Set by StartEventTrace()
+extern RAKNET_API std::atomic<bool> eventTraceEnabled;
+
+/// Returns true between StartEventTrace() and StopEventTrace()
+inline bool IsEventTraceEnabled(void) { return eventTraceEnabled.load(std::memory_order_relaxed); }
+
+/// \brief Starts recording events, discarding any recorded before.
+/// \details Each thread that records an event is given a ring buffer of EVENT_TRACE_RING_EVENTS events the first time,
+/// which it keeps writing over. Buffers are kept for threads to come once their thread exits.
+RAKNET_API void StartEventTrace(void);
+
+/// Stops recording events. What was recorded stays until the next StartEventTrace()
+RAKNET_API void StopEventTrace(void);
+
+/// \brief Records one event, if tracing is enabled. Use RAKNET_TRACE_EVENT rather than calling this directly.
+/// \details Never blocks and never allocates, except once per thread for its ring buffer.
+RAKNET_API void TraceEvent(
+    EventTraceType       type,
+    const SystemAddress& systemAddress,
+    uint32_t             value1,
+    uint32_t             value2,
+    uint64_t             value3
+);
+
+/// \brief Writes every event still in the ring buffers to \a fp, which must be opened in binary mode.
+/// \details Can be called while tracing. Events written over during the copy are left out.
+/// \return How many events were written, or -1 if writing failed
+RAKNET_API int DumpEventTrace(FILE* fp);
+
+/// Same as DumpEventTrace(FILE*), creating or replacing the file at \a path
+RAKNET_API int DumpEventTrace(const char* path);
+
+/// \brief Reads a file written by DumpEventTrace() and writes its events to \a out as text, oldest first.
+/// \param[in] in The file, opened in binary mode
+/// \param[out] out Where to write the text
+/// \param[in] csv If true, one comma separated line per event with a header line, rather than lines meant for reading
+/// \return false if \a in is not a trace file or was written by a machine with the other byte order
+RAKNET_API bool DecodeEventTrace(FILE* in, FILE* out, bool csv);
+
+/// Returns the name DecodeEventTrace() writes for \a type
+RAKNET_API const char* EventTraceTypeToString(EventTraceType type);
+
+} // namespace RakNet
+
+#if EVENT_TRACE == 1
+/// Records an event with RakNet::TraceEvent(), only evaluating the arguments while tracing is enabled
+#define RAKNET_TRACE_EVENT(type, systemAddress, value1, value2, value3)                                                \
+    do {                                                                                                               \
+        if (RakNet::IsEventTraceEnabled()) RakNet::TraceEvent(type, systemAddress, value1, value2, value3);            \
+    } while (0)
+#else
+#define RAKNET_TRACE_EVENT(type, systemAddress, value1, value2, value3)                                                \
+    do {                                                                                                               \
+    } while (0)
+#endif
+
+#endif
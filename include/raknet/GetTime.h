@@ -36,6 +36,15 @@ RakNet::TimeMS RAKNET_API GetTimeMS(void);
 /// NormalizeTime() in the cpp.
 RakNet::TimeUS RAKNET_API GetTimeUS(void);
 
+/// Returns the time in microseconds, in place of the system clock
+typedef RakNet::TimeUS (*TimeSourceUS)(void);
+
+/// \brief Makes GetTimeUS(), GetTimeMS() and GetTime() return \a source instead of the system clock. Pass 0 to use the
+/// system clock again.
+/// \details Used by VirtualNetwork to run peers on a virtual clock. Not thread safe, so set it before starting any
+/// RakPeer.
+void RAKNET_API SetTimeSourceUS(TimeSourceUS source);
+
 /// a > b?
 extern RAKNET_API bool GreaterThan(RakNet::Time a, RakNet::Time b);
 /// a < b?
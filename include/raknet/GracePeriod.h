@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file GracePeriod.h
+/// \internal
+/// \brief Lets one thread free memory that other threads read without a lock, once none of them can still hold it.
+///
+
+
+#ifndef __GRACE_PERIOD_H
+#define __GRACE_PERIOD_H
+
+#include "Export.h"
+#include <atomic>
+
+namespace RakNet {
+
+/// \internal
+/// \brief Tracks readers in two phases, so one thread can tell when everyone reading before a point has left.
+/// \details Readers hold a ReadScope, or call EnterRead() and LeaveRead(), for as long as they use the memory. To free
+/// memory, the reclaiming thread first makes it unreachable, then calls Start(). Once Poll() returns true, every reader
+/// that could have reached the memory has left and it can be freed. Readers never wait, and the reclaiming thread polls
+/// instead of blocking, so a slow reader only delays the reclamation. One thread starts and polls grace periods, and
+/// only one runs at a time.
+class RAKNET_API GracePeriod {
+public:
+    GracePeriod();
+
+    /// \return The phase to pass to LeaveRead()
+    unsigned int EnterRead(void) const;
+    void         LeaveRead(unsigned int phase) const;
+
+    /// Starts a grace period covering everything made unreachable before this call
+    /// \pre IsRunning() returns false
+    void Start(void);
+
+    /// \return true once the grace period started by Start() is over, which ends it
+    bool Poll(void);
+
+    bool IsRunning(void) const { return running; }
+
+    /// Reads from construction to destruction
+    class ReadScope {
+    public:
+        ReadScope(const GracePeriod& _gracePeriod) : gracePeriod(_gracePeriod) { phase = gracePeriod.EnterRead(); }
+        ~ReadScope() { gracePeriod.LeaveRead(phase); }
+
+    private:
+        ReadScope(const ReadScope&);
+        ReadScope& operator=(const ReadScope&);
+
+        const GracePeriod& gracePeriod;
+        unsigned int       phase;
+    };
+
+protected:
+    // Readers count themselves under the phase they entered in. Start() moves new readers to the other counter, and the
+    // grace period is over once the old one drains
+    mutable std::atomic<unsigned int> phase;
+    mutable std::atomic<unsigned int> readers[2];
+    bool                              running;
+};
+
+} // namespace RakNet
+
+#endif
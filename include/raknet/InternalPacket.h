@@ -93,6 +93,8 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader {
     RakNet::TimeUS nextActionTime;
     // For debugging
     RakNet::TimeUS retransmissionTime;
+    /// When this packet was first sent, for LATENCY_RESEND_BUFFER_WAIT
+    RakNet::TimeUS firstSendTime;
     // Size of the header when encoded into a bitstream
     BitSize_t headerLength;
     /// Buffer is a pointer to the actual data, assuming this packet has data at all
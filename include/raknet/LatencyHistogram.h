@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file LatencyHistogram.h
+/// \brief Fixed size, log-linear histogram of latencies, for reading percentiles such as p99 per connection.
+///
+
+
+#ifndef __LATENCY_HISTOGRAM_H
+#define __LATENCY_HISTOGRAM_H
+
+#include "Export.h"
+#include "NativeTypes.h"
+#include "RakNetDefines.h"
+#include <bit>
+
+namespace RakNet {
+
+/// Latencies ReliabilityLayer records for each connection when LATENCY_HISTOGRAMS is 1
+enum LatencyHistogramType {
+    /// Round trip time of each acknowledged datagram, as passed to the congestion control
+    LATENCY_ACK_RTT,
+
+    /// Time a message waited in the send buffer between RakPeerInterface::Send() and being first sent. Congestion
+    /// control and the outgoing bandwidth limit make this grow
+    LATENCY_SEND_BUFFER_WAIT,
+
+    /// Time a reliable message spent in the resend list, between being first sent and being acknowledged
+    LATENCY_RESEND_BUFFER_WAIT,
+
+    /// Time an ordered or sequenced message was held back waiting for earlier messages on its ordering channel. 0 for
+    /// messages that arrived in order
+    LATENCY_ORDERING_HOLD,
+
+    LATENCY_HISTOGRAM_TYPE_COUNT
+};
+
+/// \brief Counts latencies in microseconds in buckets that grow with the value, in the manner of HdrHistogram.
+/// \details Values below 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS get a bucket each. Above that, every power of two is
+/// split into 2^(LATENCY_HISTOGRAM_SUB_BUCKET_BITS-1) buckets, so a percentile is within 1 part in
+/// 2^(LATENCY_HISTOGRAM_SUB_BUCKET_BITS-1) of the real value. Values of 2^32 microseconds (71 minutes) and above share
+/// the last bucket.
+/// Recording is a few instructions and never allocates. Histograms of several connections can be merged to read
+/// percentiles over all of them.
+class RAKNET_API LatencyHistogram {
+public:
+    static const unsigned int SUB_BUCKET_HALF_COUNT = 1 << (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1);
+    static const unsigned int BUCKET_COUNT = (34 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS) * SUB_BUCKET_HALF_COUNT;
+
+    LatencyHistogram();
+
+    /// Forgets every value recorded
+    void Reset(void);
+
+    /// Counts one latency of \a microseconds
+    inline void Record(uint64_t microseconds) {
+        counts[GetBucketIndex(microseconds)]++;
+        totalCount += 1;
+        sum        += microseconds;
+        if (microseconds < minimum) minimum = microseconds;
+        if (microseconds > maximum) maximum = microseconds;
+    }
+
+    /// Adds every value counted by \a other to this histogram
+    void Merge(const LatencyHistogram& other);
+
+    /// \brief Returns the latency that \a percentile percent of the values are at or below
+    /// \details Reported as the highest value of its bucket, but never more than GetMaximum(). For example
+    /// GetPercentile(99.9) for p999.
+    /// \return 0 if nothing was recorded
+    uint64_t GetPercentile(double percentile) const;
+
+    /// Returns how many values were recorded
+    uint64_t GetCount(void) const { return totalCount; }
+
+    /// Returns the smallest value recorded, or 0 if nothing was recorded
+    uint64_t GetMinimum(void) const { return totalCount ? minimum : 0; }
+
+    /// Returns the largest value recorded, or 0 if nothing was recorded
+    uint64_t GetMaximum(void) const { return maximum; }
+
+    /// Returns the average of the values recorded, or 0 if nothing was recorded
+    double GetMean(void) const { return totalCount ? (double)sum / (double)totalCount : 0.0; }
+
+    /// Returns which bucket \a microseconds is counted in
+    static inline unsigned int GetBucketIndex(uint64_t microseconds) {
+        if (microseconds < 2 * SUB_BUCKET_HALF_COUNT) return (unsigned int)microseconds;
+        if (microseconds >> 32) return BUCKET_COUNT - 1;
+
+        unsigned int shift = (unsigned int)std::bit_width(microseconds) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKET_HALF_COUNT + (unsigned int)(microseconds >> shift) - SUB_BUCKET_HALF_COUNT;
+    }
+
+    /// Returns the smallest value counted in bucket \a index
+    static uint64_t GetBucketLowestValue(unsigned int index);
+
+    /// Returns the largest value counted in bucket \a index
+    static uint64_t GetBucketHighestValue(unsigned int index);
+
+protected:
+    // Wraps after 2^32 values in one bucket. GetCount() does not
+    uint32_t counts[BUCKET_COUNT];
+    uint64_t totalCount;
+    uint64_t sum;
+    uint64_t minimum;
+    uint64_t maximum;
+};
+
+} // namespace RakNet
+
+#endif
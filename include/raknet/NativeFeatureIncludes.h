@@ -42,6 +42,11 @@
 #ifndef LIBCAT_SECURITY
 #define LIBCAT_SECURITY 0
 #endif
+// Built-in X25519 + AES-GCM / ChaCha20-Poly1305 datagram encryption. Still off per connection until enabled with
+// RakPeerInterface::SetDatagramEncryption()
+#ifndef RAKNET_DATAGRAM_ENCRYPTION
+#define RAKNET_DATAGRAM_ENCRYPTION 1
+#endif
 #ifndef _RAKNET_SUPPORT_ConnectionGraph2
 #define _RAKNET_SUPPORT_ConnectionGraph2 1
 #endif
@@ -216,6 +216,8 @@ void UseRaknetFixedHeap(
 // Free memory allocated from UseRaknetFixedHeap
 void FreeRakNetFixedHeap(void);
 
+// For a size class allocator with per thread caches, see RakNet::UseSlabAllocator() in SlabAllocator.h
+
 // #if _USE_RAK_MEMORY_OVERRIDE==1
 // 	#if defined(RMO_NEW_UNDEF)
 // 	#pragma pop_macro("new")
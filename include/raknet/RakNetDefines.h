@@ -66,6 +66,62 @@
 #define BITSTREAM_STACK_ALLOCATION_SIZE 256
 #endif
 
+/// Size of the first block of a BitStreamArena when none is given. It is replaced by a larger one if a tick needs more
+#ifndef BITSTREAM_ARENA_BLOCK_SIZE
+#define BITSTREAM_ARENA_BLOCK_SIZE 16384
+#endif
+
+/// Address space reserved by RakNet::UseSlabAllocator(). Memory is only committed as slabs are handed out, and
+/// allocations fall back to malloc once it is used up
+#ifndef SLAB_ALLOCATOR_RESERVED_SIZE
+#define SLAB_ALLOCATOR_RESERVED_SIZE (sizeof(void*) == 8 ? ((size_t)1 << 30) : ((size_t)1 << 28))
+#endif
+
+/// Call sites RakNet::UseAllocationTracking() can tell apart. Must be a power of two. Allocations from sites beyond
+/// this are counted together
+#ifndef ALLOCATION_TRACKER_MAX_SITES
+#define ALLOCATION_TRACKER_MAX_SITES 4096
+#endif
+
+/// Buckets a second is split into for the per second values of RakNetStatistics. Must be a power of two. More buckets
+/// make valueOverLastSecond cover closer to exactly one second
+#ifndef BPS_TRACKER_BUCKET_COUNT
+#define BPS_TRACKER_BUCKET_COUNT 16
+#endif
+
+/// Set to 0 to stop ReliabilityLayer keeping a LatencyHistogram of each LatencyHistogramType per connection, which
+/// takes about 4 KB each with the default LATENCY_HISTOGRAM_SUB_BUCKET_BITS, half for the copy other threads read
+#ifndef LATENCY_HISTOGRAMS
+#define LATENCY_HISTOGRAMS 1
+#endif
+
+/// LatencyHistogram splits each power of two into 2^(LATENCY_HISTOGRAM_SUB_BUCKET_BITS-1) buckets. Each bit more
+/// halves the error of a percentile and doubles the size of the histogram
+#ifndef LATENCY_HISTOGRAM_SUB_BUCKET_BITS
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 5
+#endif
+
+/// Set to 0 to compile out the RAKNET_TRACE_EVENT calls in ReliabilityLayer and RakPeer. Otherwise they cost a load
+/// and a branch each until StartEventTrace() is called
+#ifndef EVENT_TRACE
+#define EVENT_TRACE 1
+#endif
+
+/// Events each thread keeps once StartEventTrace() is called, at 32 bytes each. Must be a power of two
+#ifndef EVENT_TRACE_RING_EVENTS
+#define EVENT_TRACE_RING_EVENTS 16384
+#endif
+
+/// How often the network thread copies each connection's RakNetStatistics for RakPeer::GetStatisticsSnapshots()
+#ifndef STATISTICS_SNAPSHOT_INTERVAL_MS
+#define STATISTICS_SNAPSHOT_INTERVAL_MS 250
+#endif
+
+/// Length of each window the histograms of RakPeer::SetUpdateProfiling() keep. They cover the last one to two windows
+#ifndef UPDATE_PROFILE_WINDOW_MS
+#define UPDATE_PROFILE_WINDOW_MS 1000
+#endif
+
 // Redefine if you want to disable or change the target for debug RAKNET_DEBUG_PRINTF
 #ifndef RAKNET_DEBUG_PRINTF
 #define RAKNET_DEBUG_PRINTF printf
@@ -169,6 +225,13 @@
 #define INTERNAL_PACKET_PAGE_SIZE 8
 #endif
 
+// Controls how many connection slots are allocated at once as connections arrive. RakPeer::Startup() only reserves a
+// pointer per page, so a large maxConnections costs nothing until it is used. Each slot is about 5 KB.
+// Pages are kept until RakPeer::Shutdown()
+#ifndef REMOTE_SYSTEM_PAGE_SIZE
+#define REMOTE_SYSTEM_PAGE_SIZE 32
+#endif
+
 // If defined to 1, the user is responsible for calling RakPeer::RunUpdateCycle and RakPeer::RunRecvfrom
 #ifndef RAKPEER_USER_THREADED
 #define RAKPEER_USER_THREADED 0
@@ -178,7 +241,17 @@
 #define USE_ALLOCA 1
 #endif
 
-
+// Define to send datagrams from a thread per socket, through SendToThread, rather than from the update thread
 // #define USE_THREADED_SEND
 
+// Sockets SendToThread gives a thread of their own. Datagrams for any more are sent from the calling thread
+#ifndef SEND_TO_THREAD_MAX_SOCKETS
+#define SEND_TO_THREAD_MAX_SOCKETS 16
+#endif
+
+/// Records AsyncPacketFileLogger can hold for its writer thread, at 128 bytes each. Must be a power of two
+#ifndef ASYNC_PACKET_LOGGER_QUEUE_RECORDS
+#define ASYNC_PACKET_LOGGER_QUEUE_RECORDS 16384
+#endif
+
 #endif // __RAKNET_DEFINES_H
@@ -59,7 +59,8 @@ enum RNS2Type {
     RNS2T_XBOX_360,
     RNS2T_XBOX_720,
     RNS2T_WINDOWS,
-    RNS2T_LINUX
+    RNS2T_LINUX,
+    RNS2T_VIRTUAL
 };
 
 struct RNS2_SendParameters {
@@ -119,6 +120,11 @@ public:
     void                   SetUserConnectionSocketIndex(unsigned int i);
     RNS2EventHandler*      GetEventHandler(void) const;
 
+    // Sends count datagrams in order. By default calls Send() for each, sockets that can hand several to the system at
+    // once override it
+    virtual void
+    SendMultiple(RNS2_SendParameters* sendParameters, unsigned int count, const char* file, unsigned int line);
+
     // ----------- STATICS ------------
     static void GetMyIP(SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS]);
     static void DomainNameToIP(const char* domainName, char ip[65]);
@@ -361,6 +367,8 @@ class RNS2_Linux : public RNS2_Berkley, public RNS2_Windows_Linux_360 {
 public:
     RNS2BindResult Bind(RNS2_BerkleyBindParameters* bindParameters, const char* file, unsigned int line);
     RNS2SendResult Send(RNS2_SendParameters* sendParameters, const char* file, unsigned int line);
+    // Uses sendmmsg on Linux
+    void SendMultiple(RNS2_SendParameters* sendParameters, unsigned int count, const char* file, unsigned int line);
 
     // ----------- STATICS ------------
     static void GetMyIP(SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS]);
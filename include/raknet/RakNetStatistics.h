@@ -46,6 +46,10 @@ enum RNSPerSecondMetrics {
     /// How many actual bytes were received, including overead and acks.
     ACTUAL_BYTES_RECEIVED,
 
+    /// How many datagrams were sent that carried only acks. Counts datagrams, not bytes.
+    /// \sa RakPeerInterface::SetAckFrequency()
+    ACK_ONLY_DATAGRAMS_SENT,
+
     /// \internal
     RNS_PER_SECOND_METRICS_COUNT
 };
@@ -97,6 +101,10 @@ struct RAKNET_API RakNetStatistics {
     /// What is the average total packetloss over the lifetime of the connection?
     float packetlossTotal;
 
+    /// How many lost datagrams were rebuilt from forward error correction parity, rather than waiting on a resend?
+    /// \sa RakPeerInterface::SetForwardErrorCorrection()
+    uint64_t datagramsRecoveredByFEC;
+
     RakNetStatistics& operator+=(const RakNetStatistics& other) {
         unsigned i;
         for (i = 0; i < NUMBER_OF_PRIORITIES; i++) {
@@ -109,6 +117,8 @@ struct RAKNET_API RakNetStatistics {
             runningTotal[i]        += other.runningTotal[i];
         }
 
+        datagramsRecoveredByFEC += other.datagramsRecoveredByFEC;
+
         return *this;
     }
 };
@@ -29,6 +29,7 @@ namespace RakNet {
 class RakPeerInterface;
 class BitStream;
 struct Packet;
+class VirtualNetwork;
 
 enum StartupResult {
     RAKNET_STARTED,
@@ -164,6 +165,11 @@ struct RAKNET_API SocketDescriptor {
     /// XBOX only: set IPPROTO_VDP if you want to use VDP. If enabled, this socket does not support broadcast to
     /// 255.255.255.255
     unsigned int extraSocketOptions;
+
+    /// \brief Binds to this in-process network instead of a real socket. See VirtualNetwork.
+    /// \details \a hostAddress is the IPv4 address to take on it, or empty for the next free one. If one socket
+    /// descriptor passed to RakPeer::Startup() sets this, all of them must.
+    VirtualNetwork* virtualNetwork;
 };
 
 extern bool NonNumericHostString(const char* host);
@@ -30,12 +30,15 @@
 #include "SingleProducerConsumer.h"
 // #include "RakNetSocket.h"
 #include "DS_Queue.h"
+#include "DS_SegmentedArray.h"
 #include "DS_ThreadsafeAllocatingQueue.h"
+#include "GracePeriod.h"
 #include "LocklessTypes.h"
 #include "NativeFeatureIncludes.h"
 #include "RakNetSmartPtr.h"
 #include "SecureHandshake.h"
 #include "SignaledEvent.h"
+#include <atomic>
 
 namespace RakNet {
 /// Forward declarations
@@ -76,9 +79,10 @@ public:
     /// must first call Shutdown().
     /// \note Call SetMaximumIncomingConnections if you want to accept incoming connections.
     /// \param[in] maxConnections Maximum number of connections between this instance of RakPeer and another instance of
-    /// RakPeer. Required so that the network can preallocate and for thread safety. A pure client would set this to 1.
-    /// A pure server would set it to the number of allowed clients.A hybrid would set it to the sum of both types of
-    /// connections.
+    /// RakPeer. Connection slots are allocated REMOTE_SYSTEM_PAGE_SIZE at a time as connections arrive, and freed again
+    /// some seconds after they are all unused, so a large limit costs little until it is used. A pure client would set
+    /// this to 1. A pure server would set it to the number of allowed clients.A hybrid would set it to the sum of both
+    /// types of connections.
     /// \param[in] localPort The port to listen for connections on. On linux the system may be set up so thast ports
     /// under 1024 are restricted for everything but the root user. Use a higher port for maximum compatibility.
     /// \param[in] socketDescriptors An array of SocketDescriptor structures to force RakNet to listen on a particular
@@ -130,6 +134,20 @@ public:
     /// \return True if the IP address is found in security exception list, else returns false.
     bool IsInSecurityExceptionList(const char* ip);
 
+    /// \brief Enables the built-in datagram encryption on connections started after this call.
+    /// \details Both systems must enable it. The connecting system offers an ephemeral X25519 key, the system being
+    /// connected to picks AES-256-GCM (if both CPUs have AES-NI) or ChaCha20-Poly1305 and answers with its own key.
+    /// Every datagram is then encrypted and authenticated. Unlike InitializeSecurity() this does not authenticate the
+    /// remote system.
+    /// \pre RAKNET_DATAGRAM_ENCRYPTION must be 1 in NativeFeatureIncludes.h for this function to have any effect
+    /// \param[in] enabled Offer encryption when connecting, accept it when connected to
+    /// \param[in] required Refuse connections that did not negotiate encryption
+    void SetDatagramEncryption(bool enabled, bool required = false);
+
+    /// \param[in] systemIdentifier Which connected system to check
+    /// \return true if datagrams to and from this system are encrypted
+    bool IsDatagramEncryptionActive(const AddressOrGUID systemIdentifier) const;
+
     /// \brief Sets the maximum number of incoming connections allowed.
     /// \details If the number of incoming connections is less than the number of players currently connected,
     /// no more players will be allowed to connect.  If this is greater than the maximum number of peers allowed,
@@ -684,6 +702,22 @@ public:
     /// \param[in] timeoutMS How many ms to wait before simply not sending an unreliable message.
     void SetUnreliableTimeout(RakNet::TimeMS timeoutMS);
 
+    /// \brief Enables forward error correction for unreliable messages on \a orderingChannel.
+    /// \details Every \a groupSize datagrams carrying UNRELIABLE or UNRELIABLE_SEQUENCED messages on the channel are
+    /// followed by one XOR parity datagram, from which the remote system rebuilds a single lost datagram in the group.
+    /// Recovered datagrams are counted in RakNetStatistics::datagramsRecoveredByFEC.
+    /// \param[in] orderingChannel The channel passed to Send().
+    /// \param[in] groupSize 1 to FEC_MAX_GROUP_SIZE. 0 to disable, which is the default.
+    void SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize);
+
+    /// \brief Reduces how many datagrams are sent only to carry acks.
+    /// \details Each connection acknowledges every \a datagramsPerAck datagrams, or after half the round trip capped at
+    /// \a maxAckDelay, and writes pending acks ahead of outgoing data. Only used with remote systems that enabled it
+    /// too. See ACK_ONLY_DATAGRAMS_SENT in RakNetStatistics.
+    /// \param[in] datagramsPerAck Datagrams received per ack. 0 or 1 to disable, which is the default.
+    /// \param[in] maxAckDelay Longest time to hold back an ack, in milliseconds.
+    void SetAckFrequency(unsigned int datagramsPerAck, RakNet::TimeMS maxAckDelay);
+
     /// \brief Send a message to a host, with the IP socket option TTL set to 3.
     /// \details This message will not reach the host, but will open the router.
     /// \param[in] host The address of the remote host in dotted notation.
@@ -816,6 +850,68 @@ public:
         DataStructures::List<RakNetStatistics>& statistics
     );
 
+    /// \brief Copies the statistics of every connected system, as last published by the network thread.
+    /// \details The network thread publishes the RakNetStatistics of each connected system every
+    /// STATISTICS_SNAPSHOT_INTERVAL_MS, together with its address and guid, and each entry is copied from one of those
+    /// as a whole. Unlike GetStatisticsList(), this never reads connection state the network thread is changing, and
+    /// does not allocate. A system that connects or disconnects during the call may be left out.
+    /// \param[out] addresses SystemAddress for each connected system. Pass 0 if not needed
+    /// \param[out] guids RakNetGUID for each connected system. Pass 0 if not needed
+    /// \param[out] statistics RakNetStatistics for each connected system
+    /// \param[in] maxSystems Length of the arrays
+    /// \return How many systems were written, at most \a maxSystems
+    virtual unsigned int GetStatisticsSnapshots(
+        SystemAddress*    addresses,
+        RakNetGUID*       guids,
+        RakNetStatistics* statistics,
+        unsigned int      maxSystems
+    );
+    /// \brief Same as GetStatisticsSnapshots(), for one system
+    /// \return false if \a systemAddress is not connected, or has not been updated since it connected
+    virtual bool GetStatisticsSnapshot(const SystemAddress systemAddress, RakNetStatistics* rns);
+
+    /// \brief Copies the LatencyHistogram of \a type for one connection, or for every connected system merged.
+    /// \details Read percentiles with LatencyHistogram::GetPercentile(). Like GetStatisticsSnapshot(), this reads copies
+    /// the network thread publishes every STATISTICS_SNAPSHOT_INTERVAL_MS, so it is safe from any thread and lags by up
+    /// to that long. Values are in microseconds, whatever CC_TIME_TYPE_BYTES is.
+    /// \param[in] systemAddress Which connection. UNASSIGNED_SYSTEM_ADDRESS to merge every connected system
+    /// \param[in] type Which latency
+    /// \param[out] histogram Overwritten with the result
+    /// \return false if \a systemAddress is not connected, or LATENCY_HISTOGRAMS is 0
+    virtual bool GetLatencyHistogram(
+        const SystemAddress  systemAddress,
+        LatencyHistogramType type,
+        LatencyHistogram*    histogram
+    );
+
+    /// \brief Starts or stops timing the update loop per phase, per plugin and per message identifier.
+    /// \details Read the times, in nanoseconds, with GetUpdatePhaseProfile(), GetPluginProfile() and
+    /// GetMessageProfile(). Each covers the last one to two windows of UPDATE_PROFILE_WINDOW_MS, so a slow tick stays
+    /// readable for at least one window. Starting forgets what was recorded before. While stopped, each timed place
+    /// costs a branch.
+    /// Times are real time, so a thread the operating system switches out while timing counts the time it waited.
+    /// \param[in] enabled true to start, false to stop
+    virtual void SetUpdateProfiling(bool enabled);
+
+    /// \brief Copies the times of \a phase recorded by SetUpdateProfiling()
+    /// \details Safe to call from any thread, while the network thread is adding to them.
+    /// \return false if SetUpdateProfiling() was never started
+    virtual bool GetUpdatePhaseProfile(UpdateProfilePhase phase, LatencyHistogram* histogram);
+
+    /// \brief Copies the times of \a call to \a plugin recorded by SetUpdateProfiling()
+    /// \return false if SetUpdateProfiling() was never started, or nothing was recorded for \a plugin since
+    virtual bool GetPluginProfile(
+        PluginInterface2*       plugin,
+        UpdateProfilePluginCall call,
+        LatencyHistogram*       histogram
+    );
+
+    /// \brief Copies the times Receive() took to pass messages starting with \a messageId through the plugins, recorded
+    /// by SetUpdateProfiling()
+    /// \details Timestamped messages are counted under the identifier after ID_TIMESTAMP.
+    /// \return false if SetUpdateProfiling() was never started
+    virtual bool GetMessageProfile(unsigned char messageId, LatencyHistogram* histogram);
+
     /// \Returns how many messages are waiting when you call Receive()
     virtual unsigned int GetReceiveBufferSize(void);
 
@@ -893,6 +989,12 @@ public:
         char client_public_key[cat::EasyHandshake::PUBLIC_KEY_BYTES];
 #endif
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+        // Cached so a duplicate ID_OPEN_CONNECTION_REQUEST_2 gets the same ID_OPEN_CONNECTION_REPLY_2
+        unsigned char datagramCipherSuite;
+        unsigned char datagramCipherPublicKey[DatagramCipher::PUBLIC_KEY_BYTES];
+#endif
+
         enum ConnectMode {
             NO_ACTION,
             DISCONNECT_ASAP,
@@ -991,6 +1093,8 @@ protected:
         int                          byteSize
     );
     void OnConnectionRequest(RakPeer::RemoteSystemStruct* remoteSystem, RakNet::Time incomingTimestamp);
+    // Reads the feature byte a newer remote system appends to its half of the connection handshake
+    void ReadConnectionFeatures(RakNet::BitStream* bitStream, RemoteSystemStruct* remoteSystem);
     /// Send a reliable disconnect packet to this player and disconnect them when it is delivered
     void NotifyAndFlagForShutdown(
         const SystemAddress systemAddress,
@@ -1052,21 +1156,44 @@ protected:
     char          incomingPassword[256];
     unsigned char incomingPasswordLength;
 
-    /// This is an array of pointers to RemoteSystemStruct
-    /// This allows us to preallocate the list when starting, so we don't have to allocate or delete at runtime.
-    /// Another benefit is that is lets us add and remove active players simply by setting systemAddress
-    /// and moving elements in the list by copying pointers variables without affecting running threads, even if they
-    /// are in the reliability layer
-    RemoteSystemStruct* remoteSystemList;
-    /// activeSystemList holds a list of pointers and is preallocated to be the same size as remoteSystemList. It is
-    /// updated only by the network thread, but read by both threads When the isActive member of RemoteSystemStruct is
-    /// set to true or false, that system is added to this list of pointers Threadsafe because RemoteSystemStruct is
-    /// preallocated, and the list is only added to, not removed from
-    RemoteSystemStruct** activeSystemList;
-    unsigned int         activeSystemListSize;
+    /// This is an array of RemoteSystemStruct, indexed by SystemIndex, with room for maximumNumberOfPeers.
+    /// Slots are allocated REMOTE_SYSTEM_PAGE_SIZE at a time by the network thread as connections arrive, so Startup
+    /// does not pay for connections that never happen. Pages never move, so we can add and remove active players
+    /// simply by setting systemAddress without affecting running threads, even if they are in the reliability layer.
+    /// Pages whose slots have all been inactive for REMOTE_SYSTEM_PAGE_IDLE_SWEEPS sweeps are removed, and freed once
+    /// remoteSystemReaders shows no other thread can still be using them. Use GetPointer() for indices that may not be
+    /// allocated.
+    DataStructures::SegmentedArray<RemoteSystemStruct, REMOTE_SYSTEM_PAGE_SIZE> remoteSystemList;
+    /// Per page of remoteSystemList, how many consecutive sweeps found every slot inactive
+    unsigned char* remoteSystemPageIdleSweeps;
+    RakNet::TimeMS nextRemoteSystemPageSweepTime;
+    /// activeSystemList holds a list of pointers with the same capacity as remoteSystemList, grown a page at a time.
+    /// It is updated only by the network thread, but read by both threads When the isActive member of
+    /// RemoteSystemStruct is set to true or false, that system is added to this list of pointers. Other threads read it
+    /// through GetActiveSystem()
+    DataStructures::SegmentedArray<RemoteSystemStruct*, REMOTE_SYSTEM_PAGE_SIZE> activeSystemList;
+    unsigned int                                                                 activeSystemListSize;
+
+    /// Functions called from threads other than the network thread hold a GracePeriod::ReadScope on this while they use
+    /// slots of remoteSystemList or entries of activeSystemList
+    GracePeriod                                remoteSystemReaders;
+    /// Pages removed from remoteSystemList and activeSystemList, freed once the grace period started after removing
+    /// them is over
+    DataStructures::List<RemoteSystemStruct*>  retiredRemoteSystemPages;
+    DataStructures::List<RemoteSystemStruct**> retiredActiveSystemPages;
+
+    RemoteSystemStruct* AllocateRemoteSystemPage(unsigned int pageIndex);
+    void                SweepRemoteSystemPages(RakNet::TimeMS time);
+    void                FreeRetiredRemoteSystemPages(void);
+    // activeSystemList[index] for threads other than the network thread, or 0 if it is not there
+    RemoteSystemStruct* GetActiveSystem(unsigned int index) const;
 
     // Use a hash, with binaryAddress plus port mod length as the index
+    // The hash grows with the highest allocated slot in remoteSystemList, rather than being sized for
+    // maximumNumberOfPeers up front
     RemoteSystemIndex** remoteSystemLookup;
+    unsigned int        remoteSystemLookupSize;
+    void                GrowRemoteSystemLookup(void);
     unsigned int        RemoteSystemLookupHashIndex(const SystemAddress& sa) const;
     void                ReferenceRemoteSystem(const SystemAddress& sa, unsigned int remoteSystemListIndex);
     void                DereferenceRemoteSystem(const SystemAddress& sa);
@@ -1135,6 +1262,12 @@ protected:
         char                      remote_public_key[cat::EasyHandshake::PUBLIC_KEY_BYTES];
 //		char remote_challenge[cat::EasyHandshake::CHALLENGE_BYTES];
 //	char random[16];
+#endif
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+        // Ephemeral key pair, generated on the first ID_OPEN_CONNECTION_REPLY_1 and reused for resends
+        bool          datagramCipherKeysGenerated;
+        unsigned char datagramCipherPublicKey[DatagramCipher::PUBLIC_KEY_BYTES];
+        unsigned char datagramCipherPrivateKey[DatagramCipher::PRIVATE_KEY_BYTES];
 #endif
     };
 #if LIBCAT_SECURITY == 1
@@ -1301,6 +1434,9 @@ protected:
     SystemAddress  firstExternalID;
     int            splitMessageProgressInterval;
     RakNet::TimeMS unreliableTimeout;
+    unsigned char  forwardErrorCorrectionGroupSize[NUMBER_OF_ORDERED_STREAMS];
+    unsigned int   ackFrequencyDatagrams;
+    RakNet::TimeMS ackFrequencyMaxDelay;
 
     bool (*incomingDatagramEventHandler)(RNS2RecvStruct*);
 
@@ -1336,6 +1472,17 @@ protected:
     void        OnConnectedPong(RakNet::Time sendPingTime, RakNet::Time sendPongTime, RemoteSystemStruct* remoteSystem);
     void        CallPluginCallbacks(DataStructures::List<PluginInterface2*>& pluginList, Packet* packet);
 
+    /// Allocated the first time SetUpdateProfiling() starts, and kept until the destructor, so a thread that saw
+    /// updateProfiling set never finds it gone. Stored before updateProfiling with release, so reading the flag with
+    /// acquire makes the profiler visible
+    std::atomic<UpdateProfiler*> updateProfiler;
+    std::atomic<bool>            updateProfiling;
+    void                ProfilePluginUpdates(void);
+    PluginReceiveResult ProfileOnReceive(PluginInterface2* plugin, Packet* packet);
+    void                RecordMessageProfile(unsigned char messageId, uint64_t startNs);
+    // Returns the time the phase ended, which the next one starts from
+    uint64_t            RecordUpdatePhase(UpdateProfilePhase phase, uint64_t startNs);
+
 #if LIBCAT_SECURITY == 1
     // Encryption and security
     bool                      _using_security, _require_client_public_key;
@@ -1345,6 +1492,8 @@ protected:
     bool                      InitializeClientSecurity(RequestedConnectionStruct* rcs, const char* public_key);
 #endif
 
+    bool datagramEncryptionEnabled, datagramEncryptionRequired;
+
 
     virtual void OnRNS2Recv(RNS2RecvStruct* recvStruct);
     void         FillIPList(void);
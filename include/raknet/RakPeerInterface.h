@@ -18,11 +18,13 @@
 
 #include "DS_List.h"
 #include "Export.h"
+#include "LatencyHistogram.h"
 #include "PacketPriority.h"
 #include "RakMemoryOverride.h"
 #include "RakNetSmartPtr.h"
 #include "RakNetSocket2.h"
 #include "RakNetTypes.h"
+#include "UpdateProfile.h"
 
 namespace RakNet {
 // Forward declarations
@@ -56,9 +58,9 @@ public:
     /// function again with different settings, you must first call Shutdown().
     /// \note Call SetMaximumIncomingConnections if you want to accept incoming connections
     /// \param[in] maxConnections The maximum number of connections between this instance of RakPeer and another
-    /// instance of RakPeer. Required so the network can preallocate and for thread safety. A pure client would set this
-    /// to 1.  A pure server would set it to the number of allowed clients.- A hybrid would set it to the sum of both
-    /// types of connections
+    /// instance of RakPeer. Connection slots are allocated as connections arrive, so a large limit costs little until
+    /// it is used. A pure client would set this to 1.  A pure server would set it to the number of allowed clients.- A
+    /// hybrid would set it to the sum of both types of connections
     /// \param[in] localPort The port to listen for connections on. On linux the system may be set up so thast ports
     /// under 1024 are restricted for everything but the root user. Use a higher port for maximum compatibility.
     /// \param[in] socketDescriptors An array of SocketDescriptor structures to force RakNet to listen on a particular
@@ -108,6 +110,19 @@ public:
     /// \param[in] IP address to check.
     virtual bool IsInSecurityExceptionList(const char* ip) = 0;
 
+    /// Enables the built-in datagram encryption on connections started after this call. Both systems must enable it.
+    /// The connecting system offers an ephemeral X25519 key, the system being connected to picks AES-256-GCM (if both
+    /// CPUs have AES-NI) or ChaCha20-Poly1305 and answers with its own key. Every datagram is then encrypted and
+    /// authenticated. Unlike InitializeSecurity() this does not authenticate the remote system.
+    /// \pre RAKNET_DATAGRAM_ENCRYPTION must be 1 in NativeFeatureIncludes.h for this function to have any effect
+    /// \param[in] enabled Offer encryption when connecting, accept it when connected to
+    /// \param[in] required Refuse connections that did not negotiate encryption
+    virtual void SetDatagramEncryption(bool enabled, bool required = false) = 0;
+
+    /// \param[in] systemIdentifier Which connected system to check
+    /// \return true if datagrams to and from this system are encrypted
+    virtual bool IsDatagramEncryptionActive(const AddressOrGUID systemIdentifier) const = 0;
+
     /// Sets how many incoming connections are allowed. If this is less than the number of players currently connected,
     /// no more players will be allowed to connect.  If this is greater than the maximum number of peers allowed,
     /// it will be reduced to the maximum number of peers allowed.
@@ -555,7 +570,8 @@ public:
     /// This will be the same on all systems connected to that instance of RakPeer, even if the external system
     /// addresses are different Currently O(log(n)), but this may be improved in the future. If you use this frequently,
     /// you may want to cache the value as it won't change. Returns UNASSIGNED_RAKNET_GUID if system address can't be
-    /// found. If \a input is UNASSIGNED_SYSTEM_ADDRESS, will return your own GUID
+    /// found. If \a input is UNASSIGNED_SYSTEM_ADDRESS, will return your own GUID. The returned reference is only valid
+    /// until the calling thread calls this function again
     /// \pre Call Startup() first, or the function will return UNASSIGNED_RAKNET_GUID
     /// \param[in] input The system address of the system we are connected to
     virtual const RakNetGUID& GetGuidFromSystemAddress(const SystemAddress input) const = 0;
@@ -646,6 +662,27 @@ public:
     /// \param[in] timeoutMS How many ms to wait before simply not sending an unreliable message.
     virtual void SetUnreliableTimeout(RakNet::TimeMS timeoutMS) = 0;
 
+    /// Enables forward error correction for UNRELIABLE and UNRELIABLE_SEQUENCED messages sent on \a orderingChannel.
+    /// Every \a groupSize datagrams carrying such messages are followed by one XOR parity datagram, from which the
+    /// remote system rebuilds a single lost datagram in the group without waiting for a resend. Applies to all current
+    /// and future connections. Parity is only sent once the connection handshake shows the remote system supports it,
+    /// so connections to older versions carry no parity. Parity datagrams count against the congestion window.
+    /// \param[in] orderingChannel The channel passed to Send(). UNRELIABLE messages are not ordered, so for them the
+    /// channel only selects forward error correction.
+    /// \param[in] groupSize 1 to FEC_MAX_GROUP_SIZE. Smaller recovers more losses at the cost of more bandwidth. 0 to
+    /// disable, which is the default.
+    virtual void SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize) = 0;
+
+    /// At high inbound rates, many outgoing datagrams carry nothing but acks. With this set, each connection
+    /// acknowledges every \a datagramsPerAck datagrams, or once the oldest unacknowledged datagram has waited half the
+    /// round trip, capped at \a maxAckDelay. Acks are never sent more often than without this setting. Pending acks are
+    /// also written ahead of outgoing data, instead of in a datagram of their own. Both systems must enable it,
+    /// otherwise acks are sent as before. Applies to all current and future connections. See ACK_ONLY_DATAGRAMS_SENT in
+    /// RakNetStatistics.
+    /// \param[in] datagramsPerAck Datagrams received per ack, for example 4. 0 or 1 to disable, which is the default.
+    /// \param[in] maxAckDelay Longest time to hold back an ack, in milliseconds. Keep it well under the round trip.
+    virtual void SetAckFrequency(unsigned int datagramsPerAck, RakNet::TimeMS maxAckDelay) = 0;
+
     /// Send a message to host, with the IP socket option TTL set to 3
     /// This message will not reach the host, but will open the router.
     /// Used for NAT-Punchthrough
@@ -777,6 +814,68 @@ public:
         DataStructures::List<RakNetStatistics>& statistics
     ) = 0;
 
+    /// \brief Copies the statistics of every connected system, as last published by the network thread.
+    /// \details The network thread publishes the RakNetStatistics of each connected system every
+    /// STATISTICS_SNAPSHOT_INTERVAL_MS, together with its address and guid, and each entry is copied from one of those
+    /// as a whole. Unlike GetStatisticsList(), this never reads connection state the network thread is changing, and
+    /// does not allocate. A system that connects or disconnects during the call may be left out.
+    /// \param[out] addresses SystemAddress for each connected system. Pass 0 if not needed
+    /// \param[out] guids RakNetGUID for each connected system. Pass 0 if not needed
+    /// \param[out] statistics RakNetStatistics for each connected system
+    /// \param[in] maxSystems Length of the arrays
+    /// \return How many systems were written, at most \a maxSystems
+    virtual unsigned int GetStatisticsSnapshots(
+        SystemAddress*    addresses,
+        RakNetGUID*       guids,
+        RakNetStatistics* statistics,
+        unsigned int      maxSystems
+    ) = 0;
+    /// \brief Same as GetStatisticsSnapshots(), for one system
+    /// \return false if \a systemAddress is not connected, or has not been updated since it connected
+    virtual bool GetStatisticsSnapshot(const SystemAddress systemAddress, RakNetStatistics* rns) = 0;
+
+    /// \brief Copies the LatencyHistogram of \a type for one connection, or for every connected system merged.
+    /// \details Read percentiles with LatencyHistogram::GetPercentile(). Like GetStatisticsSnapshot(), this reads copies
+    /// the network thread publishes every STATISTICS_SNAPSHOT_INTERVAL_MS, so it is safe from any thread and lags by up
+    /// to that long. Values are in microseconds, whatever CC_TIME_TYPE_BYTES is.
+    /// \param[in] systemAddress Which connection. UNASSIGNED_SYSTEM_ADDRESS to merge every connected system
+    /// \param[in] type Which latency
+    /// \param[out] histogram Overwritten with the result
+    /// \return false if \a systemAddress is not connected, or LATENCY_HISTOGRAMS is 0
+    virtual bool GetLatencyHistogram(
+        const SystemAddress  systemAddress,
+        LatencyHistogramType type,
+        LatencyHistogram*    histogram
+    ) = 0;
+
+    /// \brief Starts or stops timing the update loop per phase, per plugin and per message identifier.
+    /// \details Read the times, in nanoseconds, with GetUpdatePhaseProfile(), GetPluginProfile() and
+    /// GetMessageProfile(). Each covers the last one to two windows of UPDATE_PROFILE_WINDOW_MS, so a slow tick stays
+    /// readable for at least one window. Starting forgets what was recorded before. While stopped, each timed place
+    /// costs a branch.
+    /// Times are real time, so a thread the operating system switches out while timing counts the time it waited.
+    /// \param[in] enabled true to start, false to stop
+    virtual void SetUpdateProfiling(bool enabled) = 0;
+
+    /// \brief Copies the times of \a phase recorded by SetUpdateProfiling()
+    /// \details Safe to call from any thread, while the network thread is adding to them.
+    /// \return false if SetUpdateProfiling() was never started
+    virtual bool GetUpdatePhaseProfile(UpdateProfilePhase phase, LatencyHistogram* histogram) = 0;
+
+    /// \brief Copies the times of \a call to \a plugin recorded by SetUpdateProfiling()
+    /// \return false if SetUpdateProfiling() was never started, or nothing was recorded for \a plugin since
+    virtual bool GetPluginProfile(
+        PluginInterface2*       plugin,
+        UpdateProfilePluginCall call,
+        LatencyHistogram*       histogram
+    ) = 0;
+
+    /// \brief Copies the times Receive() took to pass messages starting with \a messageId through the plugins, recorded
+    /// by SetUpdateProfiling()
+    /// \details Timestamped messages are counted under the identifier after ID_TIMESTAMP.
+    /// \return false if SetUpdateProfiling() was never started
+    virtual bool GetMessageProfile(unsigned char messageId, LatencyHistogram* histogram) = 0;
+
     /// \Returns how many messages are waiting when you call Receive()
     virtual unsigned int GetReceiveBufferSize(void) = 0;
 
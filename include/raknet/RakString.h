@@ -15,6 +15,7 @@
 #include "Export.h"
 #include "RakNetTypes.h" // int64_t
 #include "stdarg.h"
+#include <atomic>
 #include <stdio.h>
 
 
@@ -32,6 +33,8 @@ class BitStream;
 /// -Reference counting: Suitable to store in lists
 /// -Variadic assignment operator
 /// -Doesn't cause linker errors
+/// Strings shorter than INLINE_STRING_SIZE are stored in the RakString itself and copied by value. Longer strings are
+/// shared between copies with an atomic reference count, and copied when one of them is changed.
 class RAKNET_API RakString {
 public:
     // Constructors
@@ -44,16 +47,16 @@ public:
     RakString(const RakString& rhs);
 
     /// Implicit return of const char*
-    operator const char*() const { return sharedString->c_str; }
+    operator const char*() const { return GetBuffer(); }
 
     /// Same as std::string::c_str
-    const char* C_String(void) const { return sharedString->c_str; }
+    const char* C_String(void) const { return GetBuffer(); }
 
     // Lets you modify the string. Do not make the string longer - however, you can make it shorter, or change the
     // contents. Pointer is only valid in the scope of RakString itself
     char* C_StringUnsafe(void) {
         Clone();
-        return sharedString->c_str;
+        return GetBuffer();
     }
 
     /// Assigment operators
@@ -305,20 +308,27 @@ public:
 
     /// \internal
     struct SharedString {
-        SimpleMutex* refCountMutex;
-        unsigned int refCount;
-        size_t       bytesUsed;
-        char*        bigString;
-        char*        c_str;
-        char         smallString[128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2];
+        std::atomic<unsigned int> refCount;
+        size_t                    bytesUsed;
+        char*                     bigString;
+        char*                     c_str;
+        char                      smallString[128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2];
     };
 
+    /// \internal
+    /// Bytes, including the terminator, stored in the RakString itself before a SharedString is needed
+    static const size_t INLINE_STRING_SIZE = 24;
+
     /// \internal
     RakString(SharedString* _sharedString);
 
     /// \internal
+    /// &emptyString, 0 if the string is in inlineString, otherwise shared with other copies
     SharedString* sharedString;
 
+    /// \internal
+    char inlineString[INLINE_STRING_SIZE];
+
     //	static SimpleMutex poolMutex;
     //	static DataStructures::MemoryPool<SharedString> pool;
     /// \internal
@@ -327,7 +337,8 @@ public:
     // static SharedString *sharedStringFreeList;
     // static unsigned int sharedStringFreeListAllocationCount;
     /// \internal
-    /// List of free objects to reduce memory reallocations
+    /// List of free objects to reduce memory reallocations. Each thread keeps a few of its own, and only comes here in
+    /// batches when it runs out or has too many
     static DataStructures::List<SharedString*> freeList;
 
     static int RakStringComp(RakString const& key, RakString const& data);
@@ -351,9 +362,18 @@ protected:
     void          Free(void);
     unsigned char ToLower(unsigned char c);
     unsigned char ToUpper(unsigned char c);
-    void          Realloc(SharedString* sharedString, size_t bytes);
+    /// Makes room for \a bytes, including the terminator. The string must not be shared
+    void          Realloc(size_t bytes);
+    char*         GetBuffer(void) const { return sharedString ? sharedString->c_str : (char*)inlineString; }
 };
 
+// Inline strings made RakString 32 bytes on 64 bit platforms, up from the size of one pointer. Code built against the
+// older layout must be rebuilt
+static_assert(
+    sizeof(RakString) == sizeof(RakString::SharedString*) + RakString::INLINE_STRING_SIZE,
+    "RakString is a pointer followed by the inline string"
+);
+
 } // namespace RakNet
 
 const RakNet::RakString RAKNET_API operator+(const RakNet::RakString& lhs, const RakNet::RakString& rhs);
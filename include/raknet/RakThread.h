@@ -65,6 +65,14 @@ public:
 #else
     static int Create(void* start_address(void*), void* arglist, int priority = 0);
 #endif
+
+    /// Keeps the calling thread on one core
+    /// \param[in] core Index of the core, counting from 0
+    /// \return false if \a core does not exist or the platform does not support it
+    static bool SetCurrentThreadAffinity(int core);
+
+    /// \return How many cores the process can run on, or 0 if unknown
+    static int GetCoreCount(void);
 };
 
 } // namespace RakNet
@@ -19,6 +19,8 @@
 
 #include "BitStream.h"
 #include "DR_SHA1.h"
+#include "DatagramCipher.h"
+#include "EventTrace.h"
 #include "DS_BPlusTree.h"
 #include "DS_Heap.h"
 #include "DS_LinkedList.h"
@@ -28,6 +30,7 @@
 #include "DS_Queue.h"
 #include "DS_RangeList.h"
 #include "InternalPacket.h"
+#include "LatencyHistogram.h"
 #include "MTUSize.h"
 #include "NativeFeatureIncludes.h"
 #include "PacketPriority.h"
@@ -39,6 +42,7 @@
 #include "Rand.h"
 #include "SecureHandshake.h"
 #include "SocketLayer.h"
+#include <atomic>
 
 #if USE_SLIDING_WINDOW_CONGESTION_CONTROL != 1
 #include "CCRakNetUDT.h"
@@ -53,6 +57,9 @@
 
 #define RESEND_TREE_ORDER 32
 
+/// Most datagrams one forward error correction parity datagram can cover
+#define FEC_MAX_GROUP_SIZE 16
+
 namespace RakNet {
 
 /// Forward declarations
@@ -80,18 +87,20 @@ struct SplitPacketChannel //<SplitPacketChannel>
 int RAKNET_API SplitPacketChannelComp(SplitPacketIdType const& key, SplitPacketChannel* const& data);
 
 // Helper class
+/// Sums a value over the last second in BPS_TRACKER_BUCKET_COUNT fixed buckets, so pushing and reading never allocate
 struct BPSTracker {
     BPSTracker();
     ~BPSTracker();
     void        Reset(const char* file, unsigned int line);
     inline void Push1(CCTimeType time, uint64_t value1) {
-        dataQueue.Push(TimeAndValue2(time, value1), _FILE_AND_LINE_);
-        total1   += value1;
-        lastSec1 += value1;
+        ClearExpired1(time);
+        buckets[currentBucket & (BPS_TRACKER_BUCKET_COUNT - 1)] += value1;
+        total1                                                  += value1;
+        lastSec1                                                += value1;
     }
     //	void Push2(RakNet::TimeUS time, uint64_t value1, uint64_t value2);
     inline uint64_t GetBPS1(CCTimeType time) {
-        (void)time;
+        ClearExpired1(time);
         return lastSec1;
     }
     inline uint64_t GetBPS1Threadsafe(CCTimeType time) {
@@ -103,21 +112,34 @@ struct BPSTracker {
     uint64_t GetTotal1(void) const;
     //	uint64_t GetTotal2(void) const;
 
-    struct TimeAndValue2 {
-        TimeAndValue2();
-        ~TimeAndValue2();
-        TimeAndValue2(CCTimeType t, uint64_t v1);
-        //	TimeAndValue2(RakNet::TimeUS t, uint64_t v1, uint64_t v2);
-        //	uint64_t value1, value2;
-        uint64_t   value1;
-        CCTimeType time;
-    };
+    /// Zeroes the buckets that fell out of the last second
+    inline void ClearExpired1(CCTimeType time) {
+#if CC_TIME_TYPE_BYTES == 8
+        uint64_t bucket = (uint64_t)time * BPS_TRACKER_BUCKET_COUNT / 1000000;
+#else
+        uint64_t bucket = (uint64_t)time * BPS_TRACKER_BUCKET_COUNT / 1000;
+#endif
+        // Times pushed out of order count towards the newest bucket
+        if (bucket <= currentBucket) return;
+        if (bucket - currentBucket >= BPS_TRACKER_BUCKET_COUNT) {
+            memset(buckets, 0, sizeof(buckets));
+            lastSec1 = 0;
+        } else {
+            while (currentBucket != bucket) {
+                uint64_t& expired  = buckets[++currentBucket & (BPS_TRACKER_BUCKET_COUNT - 1)];
+                lastSec1          -= expired;
+                expired            = 0;
+            }
+        }
+        currentBucket = bucket;
+    }
+    //	void ClearExpired2(RakNet::TimeUS time);
 
     uint64_t total1, lastSec1;
     //	uint64_t total2, lastSec2;
-    DataStructures::Queue<TimeAndValue2> dataQueue;
-    void                                 ClearExpired1(CCTimeType time);
-    //	void ClearExpired2(RakNet::TimeUS time);
+    uint64_t buckets[BPS_TRACKER_BUCKET_COUNT];
+    // Time in 1 / BPS_TRACKER_BUCKET_COUNT seconds of the bucket being added to
+    uint64_t currentBucket;
 };
 
 /// Datagram reliable, ordered, unordered and sequenced sends.  Flow control.  Message splitting, reassembly, and
@@ -223,6 +245,29 @@ public:
     /// \return A pointer to a static struct, filled out with current statistical information.
     RakNetStatistics* GetStatistics(RakNetStatistics* rns);
 
+    /// Publishes the statistics for GetStatisticsSnapshot(), with the \a systemAddress and \a guid of the connection, if
+    /// none were published since Reset() or the last were STATISTICS_SNAPSHOT_INTERVAL_MS ago. The latency histograms
+    /// are published with them, for GetLatencyHistogramSnapshot(). Call from the thread that calls Update()
+    void UpdateStatisticsSnapshot(RakNet::TimeMS timeMs, const SystemAddress& systemAddress, RakNetGUID guid);
+
+    /// Copies the statistics last published by UpdateStatisticsSnapshot() into \a rns, and the address and guid they
+    /// were published with into \a systemAddress and \a guid unless those are 0
+    /// Unlike GetStatistics(), safe to call from any thread while Update() runs, and never torn.
+    /// \return false if nothing has been published since the last Reset()
+    bool GetStatisticsSnapshot(RakNetStatistics* rns, SystemAddress* systemAddress = 0, RakNetGUID* guid = 0) const;
+
+#if LATENCY_HISTOGRAMS == 1
+    /// Copies this connection's histogram of \a type, as last published by UpdateStatisticsSnapshot(), into \a histogram,
+    /// and the address it was published with into \a systemAddress unless that is 0
+    /// Like GetStatisticsSnapshot(), safe to call from any thread while Update() runs, and never torn.
+    /// \return false if nothing has been published since the last Reset()
+    bool GetLatencyHistogramSnapshot(
+        LatencyHistogramType type,
+        LatencyHistogram*    histogram,
+        SystemAddress*       systemAddress = 0
+    ) const;
+#endif
+
     /// Are we waiting for any data to be sent out or be processed by the player?
     bool IsOutgoingDataWaiting(void);
     bool AreAcksWaiting(void);
@@ -236,6 +281,18 @@ public:
 
     void SetSplitMessageProgressInterval(int interval);
     void SetUnreliableTimeout(RakNet::TimeMS timeoutMS);
+
+    /// Protects unreliable and unreliable sequenced messages on \a orderingChannel with XOR parity datagrams
+    /// Only takes effect once SetRemoteSupportsFEC() is called.
+    /// \param[in] groupSize Protected datagrams per parity datagram, 1 to FEC_MAX_GROUP_SIZE. 0 to disable.
+    void SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize);
+    /// Called once the connection handshake shows the remote system can recover from parity datagrams. Older
+    /// versions would read a parity datagram as messages.
+    void SetRemoteSupportsFEC(bool supported) { remoteSupportsFEC = supported; }
+
+    /// Acknowledge every \a datagramsPerAck datagrams, or after at most \a maxAckDelay, and carry acks on outgoing data
+    /// Only takes effect once the remote system has enabled it as well. \a datagramsPerAck 0 or 1 to disable.
+    void SetAckFrequency(unsigned int datagramsPerAck, RakNet::TimeMS maxAckDelay);
     /// Has a lot of time passed since the last ack
     bool       AckTimeout(RakNet::Time curTime);
     CCTimeType GetNextSendTime(void) const;
@@ -444,8 +501,11 @@ private:
 
     DataStructures::MemoryPool<InternalPacket> internalPacketPool;
     // DataStructures::BPlusTree<DatagramSequenceNumberType, InternalPacket*, RESEND_TREE_ORDER> resendTree;
-    InternalPacket* resendBuffer[RESEND_BUFFER_ARRAY_LENGTH];
-    InternalPacket* resendLinkedListHead;
+    // RESEND_BUFFER_ARRAY_LENGTH entries, allocated on the first reliable send and freed again once the connection is
+    // idle with nothing in flight
+    InternalPacket** resendBuffer;
+    void             AllocateResendBuffer(void);
+    InternalPacket*  resendLinkedListHead;
     InternalPacket* unreliableLinkedListHead;
     void            RemoveFromUnreliableLinkedList(InternalPacket* internalPacket);
     void            AddToUnreliableLinkedList(InternalPacket* internalPacket);
@@ -491,6 +551,67 @@ private:
     //	unsigned int *receivedPackets;
     RakNetStatistics statistics;
 
+    // What GetStatisticsSnapshot() reads. All zero, and so not published, after Reset()
+    struct StatisticsSnapshot {
+        RakNetStatistics statistics;
+        SystemAddress    systemAddress;
+        RakNetGUID       guid;
+        bool             published;
+    };
+
+    // Written as a sequence lock by WriteSequenced(). Pass 0 to clear
+    void PublishStatisticsSnapshot(const StatisticsSnapshot* snapshot);
+    std::atomic<uint64_t> statisticsSnapshot[(sizeof(StatisticsSnapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    std::atomic<uint32_t> statisticsSnapshotSequence;
+    RakNet::TimeMS        lastStatisticsSnapshot;
+    bool                  statisticsSnapshotPublished;
+
+#if LATENCY_HISTOGRAMS == 1
+    LatencyHistogram latencyHistograms[LATENCY_HISTOGRAM_TYPE_COUNT];
+
+    // Histograms count microseconds, while CCTimeType is milliseconds when CC_TIME_TYPE_BYTES is 4
+    inline void RecordLatency(LatencyHistogramType type, CCTimeType elapsed) {
+#if CC_TIME_TYPE_BYTES == 8
+        latencyHistograms[type].Record(elapsed);
+#else
+        latencyHistograms[type].Record((uint64_t)elapsed * 1000);
+#endif
+    }
+
+    // What GetLatencyHistogramSnapshot() reads, one per type, each a sequence lock like statisticsSnapshot. All zero,
+    // and so not published, after Reset()
+    struct LatencyHistogramSnapshot {
+        LatencyHistogram histogram;
+        SystemAddress    systemAddress;
+        bool             published;
+    };
+    static const unsigned int LATENCY_HISTOGRAM_SNAPSHOT_WORDS =
+        (sizeof(LatencyHistogramSnapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Pass 0 to clear
+    void PublishLatencyHistogramSnapshots(const SystemAddress* systemAddress);
+    std::atomic<uint64_t> latencyHistogramSnapshots[LATENCY_HISTOGRAM_TYPE_COUNT][LATENCY_HISTOGRAM_SNAPSHOT_WORDS];
+    std::atomic<uint32_t> latencyHistogramSnapshotSequences[LATENCY_HISTOGRAM_TYPE_COUNT];
+#endif
+
+    // Traces EVENT_TRACE_CONGESTION_WINDOW if the window changed since the last time it was traced
+    inline void TraceCongestionWindow(const SystemAddress& systemAddress) {
+#if EVENT_TRACE == 1
+        if (IsEventTraceEnabled() == false || congestionManager.GetCWNDBytes() == tracedCWNDBytes) return;
+        TraceEvent(
+            EVENT_TRACE_CONGESTION_WINDOW,
+            systemAddress,
+            congestionManager.GetCWNDBytes(),
+            tracedCWNDBytes,
+            congestionManager.GetBytesPerSecondLimitByCongestionControl()
+        );
+        tracedCWNDBytes = congestionManager.GetCWNDBytes();
+#else
+        (void)systemAddress;
+#endif
+    }
+    uint32_t tracedCWNDBytes;
+
     // Algorithm for blending ordered and sequenced on the same channel:
     // 1. Each ordered message transmits OrderingIndexType orderedWriteIndex. There are NUMBER_OF_ORDERED_STREAMS
     // independent values of these. The value
@@ -513,16 +634,23 @@ private:
     //    ordered index For an empty heap, the heap weight should start at the lowest value based on the next expected
     //    ordering index, to avoid variable overflow
 
-    // Sender increments this by 1 for every ordered message sent
-    OrderingIndexType orderedWriteIndex[NUMBER_OF_ORDERED_STREAMS];
-    // Sender increments by 1 for every sequenced message sent. Resets to 0 when an ordered message is sent
-    OrderingIndexType sequencedWriteIndex[NUMBER_OF_ORDERED_STREAMS];
-    // Next expected index for ordered messages.
-    OrderingIndexType orderedReadIndex[NUMBER_OF_ORDERED_STREAMS];
-    // Highest value received for sequencedWriteIndex for the current value of orderedReadIndex on the same channel.
-    OrderingIndexType highestSequencedReadIndex[NUMBER_OF_ORDERED_STREAMS];
-    DataStructures::Heap<reliabilityHeapWeightType, InternalPacket*, false> orderingHeaps[NUMBER_OF_ORDERED_STREAMS];
-    OrderingIndexType                                                       heapIndexOffsets[NUMBER_OF_ORDERED_STREAMS];
+    struct OrderingChannel {
+        // Sender increments this by 1 for every ordered message sent
+        OrderingIndexType orderedWriteIndex;
+        // Sender increments by 1 for every sequenced message sent. Resets to 0 when an ordered message is sent
+        OrderingIndexType sequencedWriteIndex;
+        // Next expected index for ordered messages.
+        OrderingIndexType orderedReadIndex;
+        // Highest value received for sequencedWriteIndex for the current value of orderedReadIndex on the same
+        // channel.
+        OrderingIndexType                                                       highestSequencedReadIndex;
+        DataStructures::Heap<reliabilityHeapWeightType, InternalPacket*, false> orderingHeap;
+        OrderingIndexType                                                       heapIndexOffset;
+    };
+    // Allocated the first time a sequenced or ordered message is sent or received on that channel, since most
+    // connections only ever use a few of the NUMBER_OF_ORDERED_STREAMS channels
+    OrderingChannel* orderingChannels[NUMBER_OF_ORDERED_STREAMS];
+    OrderingChannel* GetOrderingChannel(unsigned char orderingChannel);
 
 
     //	CCTimeType histogramStart;
@@ -652,6 +780,98 @@ private:
     unsigned int GetMaxDatagramSizeExcludingMessageHeaderBytes(void);
     BitSize_t    GetMaxDatagramSizeExcludingMessageHeaderBits(void);
 
+    // Ack frequency. Negotiated by a flag in every ack, so both systems must enable it before acks are delayed or
+    // written ahead of data
+    bool IsAckFrequencyActive(void) const { return ackFrequencyDatagrams > 1 && remoteUsesAckFrequency; }
+    bool ShouldSendDelayedACKs(CCTimeType time) const;
+    void WritePiggybackedACKs(unsigned int datagramPayloadBytes, CCTimeType time, BitStream& updateBitStream);
+
+    unsigned int ackFrequencyDatagrams;
+    CCTimeType   ackFrequencyMaxDelay;
+    bool         remoteUsesAckFrequency;
+    unsigned int datagramsSinceLastAck;
+    CCTimeType   timeOfOldestUnsentAck;
+
+    // Once a connection has had nothing in flight and no user data in either direction for a whole check interval,
+    // the buffers it grew while busy are freed. They are allocated again on first use.
+    bool IsIdle(void) const;
+    void ReleaseIdleMemory(void);
+
+    CCTimeType nextIdleMemoryReleaseTime;
+    uint64_t   userBytesAtLastIdleCheck;
+
+    // Forward error correction. Datagrams carrying unreliable messages on a channel with a group size are XORed
+    // together, and one parity datagram per group lets the remote system rebuild a single lost datagram
+    struct FECSendGroup {
+        DatagramSequenceNumberType firstDatagramNumber;
+        // Bit n is set if firstDatagramNumber+n is in the group
+        uint32_t     memberMask;
+        unsigned int memberCount;
+        // Smallest group size of the channels sent in the group so far
+        unsigned int  groupSize;
+        CCTimeType    firstSendTime;
+        uint16_t      lengthXor;
+        uint16_t      parityLength;
+        unsigned char parity[MAXIMUM_MTU_SIZE];
+    };
+    struct FECReceivedDatagram {
+        DatagramSequenceNumberType datagramNumber;
+        bool                       isValid;
+        // Rebuilt from parity, so the original is dropped if it arrives late
+        bool                       wasRecovered;
+        uint16_t                   length;
+        uint16_t                   allocated;
+        unsigned char*             data;
+    };
+    bool IsFECProtected(const InternalPacket* internalPacket) const {
+        return fecEnabled && remoteSupportsFEC
+            && (internalPacket->reliability == UNRELIABLE || internalPacket->reliability == UNRELIABLE_SEQUENCED
+                || internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
+            && fecGroupSizeByChannel[internalPacket->orderingChannel] != 0;
+    }
+    void AddToFECSendGroup(
+        DatagramSequenceNumberType datagramNumber,
+        const unsigned char*       payload,
+        unsigned int               payloadLength,
+        unsigned int               groupSize,
+        CCTimeType                 time
+    );
+    void SendFECParity(
+        RakNetSocket2* s,
+        SystemAddress& systemAddress,
+        CCTimeType     time,
+        RakNetRandom*  rnr,
+        BitStream&     updateBitStream,
+        int            budget
+    );
+    void StoreFECProtectedDatagram(
+        DatagramSequenceNumberType datagramNumber,
+        const unsigned char*       payload,
+        unsigned int               payloadLength
+    );
+    void RecoverFromFECParity(
+        RakNet::BitStream*                       parityData,
+        SystemAddress&                           systemAddress,
+        DataStructures::List<PluginInterface2*>& messageHandlerList,
+        int                                      MTUSize,
+        RakNetSocket2*                           s,
+        RakNetRandom*                            rnr,
+        CCTimeType                               timeRead,
+        BitStream&                               updateBitStream
+    );
+    bool                                     WasRecoveredByFEC(DatagramSequenceNumberType datagramNumber) const;
+    unsigned char                            fecGroupSizeByChannel[NUMBER_OF_ORDERED_STREAMS];
+    bool                                     fecEnabled;
+    bool                                     remoteSupportsFEC;
+    bool                                     datagramSoFarHasFECMessage;
+    bool                                     isReceivingNestedDatagram;
+    FECSendGroup*                            fecOpenGroup;
+    DataStructures::List<FECSendGroup*>      fecClosedGroups;
+    DataStructures::MemoryPool<FECSendGroup> fecSendGroupPool;
+    // Indexed by datagramNumber % FEC_RECEIVE_HISTORY_LENGTH. Allocated when the first protected datagram arrives
+    FECReceivedDatagram* fecReceiveHistory;
+    void                 FreeFECReceiveHistory(void);
+
     // ourOffset refers to a section within externallyAllocatedPtr. Do not deallocate externallyAllocatedPtr until all
     // references are lost
     void AllocInternalPacketData(
@@ -684,6 +904,25 @@ protected:
     cat::AuthenticatedEncryption auth_enc;
     bool                         useSecurity;
 #endif // LIBCAT_SECURITY
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+public:
+    /// Starts encrypting every datagram to and from this system. Call once, right after Reset(), before anything is
+    /// sent. Lowers the MTU by DatagramCipher::OVERHEAD_BYTES.
+    /// \return false if the keys could not be derived, in which case the connection should be dropped
+    bool InitializeDatagramCipher(
+        DatagramCipherSuite  suite,
+        const unsigned char* privateKey,
+        const unsigned char* publicKey,
+        const unsigned char* remotePublicKey,
+        bool                 weInitiatedTheConnection
+    );
+    bool IsDatagramCipherActive(void) const { return datagramCipher != 0 && datagramCipher->IsActive(); }
+
+protected:
+    // Only allocated for connections that negotiated encryption
+    DatagramCipher* datagramCipher;
+#endif // RAKNET_DATAGRAM_ENCRYPTION
 };
 
 } // namespace RakNet
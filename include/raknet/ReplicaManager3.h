@@ -20,6 +20,7 @@
 #define __REPLICA_MANAGER_3
 
 #include "BitStream.h"
+#include "BitStreamArena.h"
 #include "DS_OrderedList.h"
 #include "DS_Queue.h"
 #include "NetworkIDObject.h"
@@ -404,6 +405,8 @@ protected:
     RakNet::Time lastAutoSerializeOccurance;
     bool         autoCreateConnections, autoDestroyConnections;
     Replica3*    currentlyDeallocatingReplica;
+    // Storage for the serialization streams built in Update(), reset every autoserialize tick
+    RakNet::BitStreamArena serializeArena;
     // Set on the first call to ReferenceInternal(), and should never be changed after that
     // Used to lookup in Replica3LSRComp. I don't want to rely on GetNetworkID() in case it changes at runtime
     uint32_t nextReferenceIndex;
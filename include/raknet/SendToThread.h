@@ -13,42 +13,61 @@
 
 #include "RakNetDefines.h"
 
-#ifdef USE_THREADED_SEND
-
 #include "DS_ThreadsafeAllocatingQueue.h"
-#include "InternalPacket.h"
-#include "SocketLayer.h"
-#include "ThreadPool.h"
+#include "RakNetSocket2.h"
+#include "RakThread.h"
+#include "SignaledEvent.h"
+#include "SimpleMutex.h"
+#include <atomic>
 
 namespace RakNet {
+/// Sends datagrams from a thread per socket, so the thread that built them does not wait on the system call.
+/// RakPeer routes every datagram through here when USE_THREADED_SEND is defined.
 class SendToThread {
 public:
     SendToThread();
     ~SendToThread();
 
     struct SendToThreadBlock {
-        SOCKET         s;
-        SystemAddress  systemAddress;
-        unsigned short remotePortRakNetWasStartedOn_PS3;
-        unsigned int   extraSocketOptions;
-        char           data[MAXIMUM_MTU_SIZE];
-        unsigned short dataWriteOffset;
+        RakNetSocket2*     s;
+        SystemAddress      systemAddress;
+        char               data[MAXIMUM_MTU_SIZE];
+        unsigned short     dataWriteOffset;
+        /// \internal
+        SendToThreadBlock* next;
     };
 
     static SendToThreadBlock* AllocateBlock(void);
+    /// Queues \a threadedSend for the thread of \a threadedSend->s, starting one if the socket does not have one yet.
+    /// Sends it right away if SEND_TO_THREAD_MAX_SOCKETS sockets already have a thread.
     static void               ProcessBlock(SendToThreadBlock* threadedSend);
+    /// Sends everything queued for \a s and stops its thread. Call before deleting the socket
+    static void               RemoveSocket(RakNetSocket2* s);
 
     static void                                                         AddRef(void);
     static void                                                         Deref(void);
     static DataStructures::ThreadsafeAllocatingQueue<SendToThreadBlock> objectQueue;
 
 protected:
-    static int                                                refCount;
-    static ThreadPool<SendToThreadBlock*, SendToThreadBlock*> threadPool;
+    struct SocketThread {
+        std::atomic<RakNetSocket2*>     socket;
+        /// Pushed by any thread, taken all at once by the send thread, so newest first
+        std::atomic<SendToThreadBlock*> pending;
+        std::atomic<bool>               sleeping;
+        std::atomic<bool>               running;
+        std::atomic<bool>               active;
+        SignaledEvent                   event;
+    };
+
+    static void SendBlocks(RakNetSocket2* s, SendToThreadBlock* blocks);
+    static RAK_THREAD_DECLARATION(SendLoop);
+
+    static int          refCount;
+    static SocketThread socketThreads[SEND_TO_THREAD_MAX_SOCKETS];
+    // Held while starting or stopping a thread in socketThreads
+    static SimpleMutex  socketThreadsMutex;
 };
 } // namespace RakNet
 
 
-#endif
-
 #endif
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file SlabAllocator.h
+/// \brief Optional size class allocator for rakMalloc_Ex and the other hooks in RakMemoryOverride.h.
+///
+
+
+#ifndef __SLAB_ALLOCATOR_H
+#define __SLAB_ALLOCATOR_H
+
+#include "Export.h"
+#include "NativeTypes.h"
+#include <stddef.h>
+
+namespace RakNet {
+/// Most size classes there can be. They run from 16 bytes to SLAB_ALLOCATOR_MAX_SIZE, four to each power of two, with
+/// extra classes for sizeof(InternalPacket) and sizeof(Packet)
+static const unsigned int SLAB_ALLOCATOR_CLASS_COUNT = 38;
+/// Allocations larger than this go to malloc
+static const size_t       SLAB_ALLOCATOR_MAX_SIZE    = 16384;
+/// Slabs are carved into chunks of one size class
+static const size_t       SLAB_ALLOCATOR_SLAB_SIZE   = 65536;
+
+struct RAKNET_API SlabAllocatorClassStatistics {
+    /// Bytes in each chunk. 0 if the class is not used
+    size_t   chunkSize;
+    /// Chunks handed out over the lifetime of the allocator
+    uint64_t allocations;
+    uint64_t frees;
+    /// Slabs carved for this class. Slabs are never returned
+    size_t   slabs;
+};
+
+struct RAKNET_API SlabAllocatorStatistics {
+    SlabAllocatorClassStatistics classes[SLAB_ALLOCATOR_CLASS_COUNT];
+    /// Allocations above SLAB_ALLOCATOR_MAX_SIZE, or made after the reserved address space ran out, passed to malloc
+    uint64_t                     mallocAllocations;
+    /// Bytes in slabs handed out so far
+    size_t                       slabBytes;
+    /// Address space reserved, SLAB_ALLOCATOR_RESERVED_SIZE
+    size_t                       reservedBytes;
+    /// True if the reserved address space was marked for transparent huge pages
+    bool                         hugePages;
+};
+
+/// \brief Routes rakMalloc, rakRealloc, rakFree and their _Ex versions to a size class allocator.
+/// \details Allocations of up to SLAB_ALLOCATOR_MAX_SIZE bytes are served from per thread free lists, one per size
+/// class, so the common case takes no lock. Threads exchange chunks with a shared list for each class in batches, so
+/// memory freed on a different thread than it was allocated on costs one lock per batch. Slabs come from address
+/// space reserved up front, which on Linux is marked for transparent huge pages if \a useHugePages is true.
+/// Call once, before RakNet allocates anything, as memory already allocated with malloc cannot be told apart. There
+/// is no way to switch back, for the same reason. Replaces UseRaknetFixedHeap() and any SetMalloc() functions.
+/// \return false if the address space could not be reserved, in which case the allocation hooks are not changed
+RAKNET_API bool UseSlabAllocator(bool useHugePages = true);
+
+/// Returns true once UseSlabAllocator() has succeeded
+RAKNET_API bool IsSlabAllocatorEnabled(void);
+
+/// Fills in \a statistics. The counts of threads that are still allocating may be a little behind
+RAKNET_API void GetSlabAllocatorStatistics(SlabAllocatorStatistics* statistics);
+
+void RAKNET_API* _SlabMalloc(size_t size);
+void RAKNET_API* _SlabRealloc(void* p, size_t size);
+void RAKNET_API  _SlabFree(void* p);
+void RAKNET_API* _SlabMalloc_Ex(size_t size, const char* file, unsigned int line);
+void RAKNET_API* _SlabRealloc_Ex(void* p, size_t size, const char* file, unsigned int line);
+void RAKNET_API  _SlabFree_Ex(void* p, const char* file, unsigned int line);
+
+} // namespace RakNet
+
+#endif
@@ -17,6 +17,8 @@
 #include "RakThread.h"
 #include "SignaledEvent.h"
 #include "SimpleMutex.h"
+#include <atomic>
+#include <thread>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -30,11 +32,90 @@ public:
     virtual void* PerThreadFactory(void* context)                         = 0;
     virtual void  PerThreadDestructor(void* factoryResult, void* context) = 0;
 };
+/// Times a ThreadPool thread with nothing to do yields before waiting on its event
+static const int THREAD_POOL_IDLE_YIELDS = 32;
+
+/// \internal
+/// \brief Bounded queue of input that any thread can push to and pop from without locking.
+/// \details Each ThreadPool worker owns one and takes its input from there first, stealing from the others once its own
+/// is empty. Every slot carries a sequence number saying whether it is free to write or ready to read, so a pop never
+/// sees input that is still being written.
+template <class InputType, class OutputType>
+struct ThreadPoolWorkerQueue {
+    typedef OutputType (*WorkerThreadCallback)(InputType, bool*, void*);
+
+    static const unsigned int QUEUE_SIZE = 256;
+
+    struct Slot {
+        std::atomic<unsigned int> sequence;
+        WorkerThreadCallback      callback;
+        InputType                 inputData;
+    };
+
+    ThreadPoolWorkerQueue() {
+        slots = RakNet::OP_NEW_ARRAY<Slot>(QUEUE_SIZE, _FILE_AND_LINE_);
+        for (unsigned int i = 0; i < QUEUE_SIZE; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+    ~ThreadPoolWorkerQueue() { RakNet::OP_DELETE_ARRAY(slots, _FILE_AND_LINE_); }
+
+    /// Returns false if the queue is full
+    bool Push(WorkerThreadCallback callback, const InputType& inputData) {
+        unsigned int position = tail.load(std::memory_order_relaxed);
+        Slot*        slot;
+        while (1) {
+            slot           = &slots[position & (QUEUE_SIZE - 1)];
+            int difference = (int)(slot->sequence.load(std::memory_order_acquire) - position);
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) return false;
+            else position = tail.load(std::memory_order_relaxed);
+        }
+        slot->callback  = callback;
+        slot->inputData = inputData;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Returns false if the queue is empty
+    bool Pop(WorkerThreadCallback& callback, InputType& inputData) {
+        unsigned int position = head.load(std::memory_order_relaxed);
+        Slot*        slot;
+        while (1) {
+            slot           = &slots[position & (QUEUE_SIZE - 1)];
+            int difference = (int)(slot->sequence.load(std::memory_order_acquire) - (position + 1));
+            if (difference == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) return false;
+            else position = head.load(std::memory_order_relaxed);
+        }
+        callback  = slot->callback;
+        inputData = slot->inputData;
+        // Free to write again once the tail comes round
+        slot->sequence.store(position + QUEUE_SIZE, std::memory_order_release);
+        return true;
+    }
+
+    /// Inaccurate while other threads push or pop
+    bool IsEmpty(void) const { return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed); }
+
+    Slot* slots;
+    // Popping and pushing threads each write one of these, so keep them on separate cache lines
+    char                      headPadding[64];
+    std::atomic<unsigned int> head;
+    char                      tailPadding[64];
+    std::atomic<unsigned int> tail;
+    char                      endPadding[64];
+};
+
 /// A simple class to create worker threads that processes a queue of functions with data.
 /// This class does not allocate or deallocate memory.  It is up to the user to handle memory management.
 /// InputType and OutputType are stored directly in a queue.  For large structures, if you plan to delete from the
 /// middle of the queue, you might wish to store pointers rather than the structures themselves so the array can shift
 /// efficiently.
+/// Each thread has a queue of its own that AddInput() fills in turn, and a thread that runs out of input steals from
+/// the others, so threads only share a lock when a queue is full or input is added before StartThreads().
 template <class InputType, class OutputType>
 struct RAKNET_API ThreadPool {
     ThreadPool();
@@ -53,6 +134,12 @@ struct RAKNET_API ThreadPool {
     // Alternate form of _perThreadDataFactory, _perThreadDataDestructor
     void SetThreadDataInterface(ThreadDataInterface* tdi, void* context);
 
+    /// Keeps each thread on one core, from the next call to StartThreads()
+    /// Thread i runs on core (firstCore + i * coreStride) modulo the number of cores.
+    /// \param[in] firstCore Core of the first thread. Pass -1, the default, to let the OS move threads around
+    /// \param[in] coreStride Cores between threads, for instance 2 to skip hyperthreads
+    void SetCoreAffinity(int firstCore, int coreStride = 1);
+
     /// Stops all threads
     void StopThreads(void);
 
@@ -69,6 +156,16 @@ struct RAKNET_API ThreadPool {
         InputType inputData
     );
 
+    /// Same as calling AddInput() \a count times, but wakes the threads once
+    /// \param[in] workerThreadCallback The function to call from the thread for each input
+    /// \param[in] inputData \a count parameters, each passed to one call of \a workerThreadCallback
+    /// \param[in] count Number of elements in \a inputData
+    void AddInputs(
+        OutputType (*workerThreadCallback)(InputType, bool* returnOutput, void* perThreadData),
+        const InputType* inputData,
+        unsigned int     count
+    );
+
     /// Adds to the output queue
     /// Use it if you want to inject output into the same queue that the system uses. Normally you would not use this.
     /// Consider it a convenience function.
@@ -104,6 +201,8 @@ struct RAKNET_API ThreadPool {
 
     /// Lock the input buffer before calling the functions InputSize, InputAtIndex, and RemoveInputAtIndex
     /// It is only necessary to lock the input or output while the threads are running
+    /// Input waiting in the threads' own queues is moved to the input buffer first, so these see everything no thread
+    /// has taken yet. Input added while the buffer is locked goes to the threads' queues and is not seen
     void LockInput(void);
 
     /// Unlock the input buffer after you are done with the functions InputSize, GetInputAtIndex, and RemoveInputAtIndex
@@ -159,21 +258,41 @@ struct RAKNET_API ThreadPool {
     void Resume(void);
 
 protected:
+    typedef OutputType (*WorkerThreadCallback)(InputType, bool*, void*);
+
+    // Takes input for a thread, from its own queue, then inputQueue, then the other threads' queues
+    bool TakeInput(int workerIndex, WorkerThreadCallback& callback, InputType& inputData);
+    // Signals quitAndIncomingDataEvents if any thread is waiting on it
+    void WakeWorker(void);
+    // Moves input left in the threads' own queues to the end of inputQueue. Call with inputQueueMutex locked
+    void DrainWorkerQueues(void);
+
     // It is valid to cancel input before it is processed.  To do so, lock the inputQueue with inputQueueMutex,
     // Scan the list, and remove the item you don't want.
-    RakNet::SimpleMutex inputQueueMutex, outputQueueMutex, workingThreadCountMutex, runThreadsMutex;
+    RakNet::SimpleMutex inputQueueMutex, outputQueueMutex, runThreadsMutex;
 
     void* (*perThreadDataFactory)();
     void (*perThreadDataDestructor)(void*);
 
     // inputFunctionQueue & inputQueue are paired arrays so if you delete from one at a particular index you must delete
     // from the other at the same index
-    DataStructures::Queue<OutputType (*)(InputType, bool*, void*)> inputFunctionQueue;
-    DataStructures::Queue<InputType>                               inputQueue;
-    DataStructures::Queue<OutputType>                              outputQueue;
+    DataStructures::Queue<WorkerThreadCallback> inputFunctionQueue;
+    DataStructures::Queue<InputType>            inputQueue;
+    DataStructures::Queue<OutputType>           outputQueue;
+    // inputQueue.Size(), readable without locking inputQueueMutex
+    std::atomic<unsigned int>                   inputQueueSize;
+
+    // One queue per thread. Allocated by StartThreads() and kept until the pool is destroyed
+    ThreadPoolWorkerQueue<InputType, OutputType>* workerQueues;
+    int                                           workerQueueCount;
+    // Queues AddInput() fills, 0 while the threads are stopped
+    std::atomic<int>                              activeWorkerQueues;
+    std::atomic<unsigned int>                     nextWorkerQueue;
 
     ThreadDataInterface* threadDataInterface;
     void*                tdiContext;
+    int                  affinityFirstCore;
+    int                  affinityCoreStride;
 
 
     template <class ThreadInputType, class ThreadOutputType>
@@ -188,13 +307,21 @@ protected:
     */
 
     /// \internal
-    bool runThreads;
+    std::atomic<bool> runThreads;
+    /// \internal
+    std::atomic<bool> paused;
+    /// \internal
+    std::atomic<int>  numThreadsRunning;
     /// \internal
-    int numThreadsRunning;
+    std::atomic<int>  numThreadsWorking;
     /// \internal
-    int numThreadsWorking;
+    /// Threads about to wait, or waiting, on quitAndIncomingDataEvents
+    std::atomic<int>  numThreadsSleeping;
     /// \internal
-    RakNet::SimpleMutex numThreadsRunningMutex;
+    /// Set while quitAndIncomingDataEvents is signalled and no thread has woken from it yet
+    std::atomic<bool> wakePending;
+    /// \internal
+    std::atomic<int>  nextWorkerIndex;
 
     RakNet::SignaledEvent quitAndIncomingDataEvents;
 
@@ -237,7 +364,15 @@ void* WorkerThread( void* arguments )
     ThreadInputType  inputData;
     ThreadOutputType callbackOutput;
 
-    userCallback = 0;
+    int workerIndex = threadPool->nextWorkerIndex++;
+    if (threadPool->affinityFirstCore >= 0) {
+        int coreCount = RakNet::RakThread::GetCoreCount();
+        if (coreCount > 0) {
+            RakNet::RakThread::SetCurrentThreadAffinity(
+                (threadPool->affinityFirstCore + workerIndex * threadPool->affinityCoreStride) % coreCount
+            );
+        }
+    }
 
     void* perThreadData;
     if (threadPool->perThreadDataFactory) perThreadData = threadPool->perThreadDataFactory();
@@ -245,77 +380,82 @@ void* WorkerThread( void* arguments )
         perThreadData = threadPool->threadDataInterface->PerThreadFactory(threadPool->tdiContext);
     else perThreadData = 0;
 
-    // Increase numThreadsRunning
-    threadPool->numThreadsRunningMutex.Lock();
     ++threadPool->numThreadsRunning;
-    threadPool->numThreadsRunningMutex.Unlock();
-
-    while (1) {
-        // #ifdef _WIN32
-        if (userCallback == 0) { threadPool->quitAndIncomingDataEvents.WaitOnEvent(1000); }
-        // #else
-        // 		if (userCallback==0)
-        // 			RakSleep(30);
-        // #endif
-
-        threadPool->runThreadsMutex.Lock();
-        if (threadPool->runThreads == false) {
-            threadPool->runThreadsMutex.Unlock();
-            break;
-        }
-        threadPool->runThreadsMutex.Unlock();
 
-        threadPool->workingThreadCountMutex.Lock();
+    int idleYields = 0;
+    while (threadPool->runThreads) {
+        // Counted as working before checking paused, so Pause() either sees this thread or this thread sees Pause()
         ++threadPool->numThreadsWorking;
-        threadPool->workingThreadCountMutex.Unlock();
-
-        // Read input data
-        userCallback = 0;
-        threadPool->inputQueueMutex.Lock();
-        if (threadPool->inputFunctionQueue.Size()) {
-            userCallback = threadPool->inputFunctionQueue.Pop();
-            inputData    = threadPool->inputQueue.Pop();
-        }
-        threadPool->inputQueueMutex.Unlock();
+        if (threadPool->paused == false && threadPool->TakeInput(workerIndex, userCallback, inputData)) {
+            // Pass the wakeup on if there is more than this thread can take
+            if (threadPool->numThreadsSleeping.load(std::memory_order_relaxed) > 0 && threadPool->HasInputFast())
+                threadPool->WakeWorker();
 
-        if (userCallback) {
             callbackOutput = userCallback(inputData, &returnOutput, perThreadData);
             if (returnOutput) {
                 threadPool->outputQueueMutex.Lock();
                 threadPool->outputQueue.Push(callbackOutput, _FILE_AND_LINE_);
                 threadPool->outputQueueMutex.Unlock();
             }
-        }
 
-        threadPool->workingThreadCountMutex.Lock();
+            --threadPool->numThreadsWorking;
+            idleYields = 0;
+            continue;
+        }
         --threadPool->numThreadsWorking;
-        threadPool->workingThreadCountMutex.Unlock();
-    }
 
-    // Decrease numThreadsRunning
-    threadPool->numThreadsRunningMutex.Lock();
-    --threadPool->numThreadsRunning;
-    threadPool->numThreadsRunningMutex.Unlock();
+        // Input tends to arrive in bursts, and waking from the event costs more than a few yields
+        if (idleYields < THREAD_POOL_IDLE_YIELDS) {
+            idleYields++;
+            std::this_thread::yield();
+            continue;
+        }
+        idleYields = 0;
+
+        // Counted as sleeping before looking for input again, so AddInput() either sees this thread or this thread sees
+        // the input
+        ++threadPool->numThreadsSleeping;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (threadPool->runThreads && (threadPool->paused || threadPool->HasInputFast() == false))
+            threadPool->quitAndIncomingDataEvents.WaitOnEvent(1000);
+        --threadPool->numThreadsSleeping;
+        // This thread looks for input before waiting again, so another signal is only needed after this
+        threadPool->wakePending = false;
+    }
 
     if (threadPool->perThreadDataDestructor) threadPool->perThreadDataDestructor(perThreadData);
     else if (threadPool->threadDataInterface)
         threadPool->threadDataInterface->PerThreadDestructor(perThreadData, threadPool->tdiContext);
 
+    // Last use of threadPool, which StopThreads() may destroy as soon as this reaches 0
+    --threadPool->numThreadsRunning;
 
     return 0;
 }
 template <class InputType, class OutputType>
 ThreadPool<InputType, OutputType>::ThreadPool() {
     runThreads          = false;
+    paused              = false;
     numThreadsRunning   = 0;
     threadDataInterface = 0;
     tdiContext          = 0;
     numThreadsWorking   = 0;
+    numThreadsSleeping  = 0;
+    wakePending         = false;
+    nextWorkerIndex     = 0;
+    inputQueueSize      = 0;
+    workerQueues        = 0;
+    workerQueueCount    = 0;
+    activeWorkerQueues  = 0;
+    nextWorkerQueue     = 0;
+    affinityFirstCore   = -1;
+    affinityCoreStride  = 1;
 }
 template <class InputType, class OutputType>
 ThreadPool<InputType, OutputType>::~ThreadPool() {
     StopThreads();
     Clear();
+    RakNet::OP_DELETE_ARRAY(workerQueues, _FILE_AND_LINE_);
 }
 template <class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::StartThreads(
@@ -343,11 +483,24 @@ bool ThreadPool<InputType, OutputType>::StartThreads(
     perThreadDataFactory    = _perThreadDataFactory;
     perThreadDataDestructor = _perThreadDataDestructor;
 
+    if (numThreads > workerQueueCount) {
+        inputQueueMutex.Lock();
+        DrainWorkerQueues();
+        inputQueueMutex.Unlock();
+        RakNet::OP_DELETE_ARRAY(workerQueues, _FILE_AND_LINE_);
+        workerQueues =
+            RakNet::OP_NEW_ARRAY<ThreadPoolWorkerQueue<InputType, OutputType>>(numThreads, _FILE_AND_LINE_);
+        workerQueueCount = numThreads;
+    }
+    activeWorkerQueues = numThreads;
+
     runThreadsMutex.Lock();
     runThreads = true;
     runThreadsMutex.Unlock();
 
+    paused            = false;
     numThreadsWorking = 0;
+    nextWorkerIndex   = 0;
     unsigned threadId = 0;
     (void)threadId;
     int i;
@@ -363,13 +516,7 @@ bool ThreadPool<InputType, OutputType>::StartThreads(
         }
     }
     // Wait for number of threads running to increase to numThreads
-    bool done = false;
-    while (done == false) {
-        RakSleep(50);
-        numThreadsRunningMutex.Lock();
-        if (numThreadsRunning == numThreads) done = true;
-        numThreadsRunningMutex.Unlock();
-    }
+    while (numThreadsRunning != numThreads) RakSleep(1);
 
     return true;
 }
@@ -379,6 +526,11 @@ void ThreadPool<InputType, OutputType>::SetThreadDataInterface(ThreadDataInterfa
     tdiContext          = context;
 }
 template <class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::SetCoreAffinity(int firstCore, int coreStride) {
+    affinityFirstCore  = firstCore;
+    affinityCoreStride = coreStride;
+}
+template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::StopThreads(void) {
     runThreadsMutex.Lock();
     if (runThreads == false) {
@@ -388,20 +540,23 @@ void ThreadPool<InputType, OutputType>::StopThreads(void) {
 
     runThreads = false;
     runThreadsMutex.Unlock();
+    activeWorkerQueues = 0;
+    // Pairs with the fence in AddInputs()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
     // Wait for number of threads running to decrease to 0
-    bool done = false;
-    while (done == false) {
+    while (numThreadsRunning != 0) {
         quitAndIncomingDataEvents.SetEvent();
-
-        RakSleep(50);
-        numThreadsRunningMutex.Lock();
-        if (numThreadsRunning == 0) done = true;
-        numThreadsRunningMutex.Unlock();
+        RakSleep(1);
     }
 
     quitAndIncomingDataEvents.CloseEvent();
 
+    // Leave unprocessed input where InputSize() and GetInputAtIndex() can find it
+    inputQueueMutex.Lock();
+    DrainWorkerQueues();
+    inputQueueMutex.Unlock();
+
     // #if defined(SN_TARGET_PSP2)
     // 	RakNet::RakThread::DeallocRuntime(runtime);
     // 	runtime=0;
@@ -412,12 +567,91 @@ void ThreadPool<InputType, OutputType>::AddInput(
     OutputType (*workerThreadCallback)(InputType, bool* returnOutput, void* perThreadData),
     InputType inputData
 ) {
-    inputQueueMutex.Lock();
-    inputQueue.Push(inputData, _FILE_AND_LINE_);
-    inputFunctionQueue.Push(workerThreadCallback, _FILE_AND_LINE_);
-    inputQueueMutex.Unlock();
+    AddInputs(workerThreadCallback, &inputData, 1);
+}
+template <class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::AddInputs(
+    OutputType (*workerThreadCallback)(InputType, bool* returnOutput, void* perThreadData),
+    const InputType* inputData,
+    unsigned int     count
+) {
+    unsigned int i          = 0;
+    unsigned int queueCount = (unsigned int)activeWorkerQueues.load(std::memory_order_acquire);
+    if (queueCount > 0) {
+        unsigned int queueIndex = nextWorkerQueue.fetch_add(count, std::memory_order_relaxed);
+        for (; i < count; i++, queueIndex++) {
+            if (workerQueues[queueIndex % queueCount].Push(workerThreadCallback, inputData[i]) == false) break;
+        }
+    }
+
+    // StopThreads() may have drained the queues between the load above and the pushes. Either it sees this input, or
+    // this sees it has stopped and moves the input to inputQueue itself
+    if (i > 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (activeWorkerQueues.load(std::memory_order_relaxed) == 0) {
+            inputQueueMutex.Lock();
+            DrainWorkerQueues();
+            inputQueueMutex.Unlock();
+        }
+    }
+
+    // Not started yet, or the queues are full
+    if (i < count) {
+        inputQueueMutex.Lock();
+        for (; i < count; i++) {
+            inputQueue.Push(inputData[i], _FILE_AND_LINE_);
+            inputFunctionQueue.Push(workerThreadCallback, _FILE_AND_LINE_);
+        }
+        inputQueueSize.store(inputQueue.Size(), std::memory_order_relaxed);
+        inputQueueMutex.Unlock();
+    }
+
+    WakeWorker();
+}
+template <class InputType, class OutputType>
+bool ThreadPool<InputType, OutputType>::TakeInput(
+    int                   workerIndex,
+    WorkerThreadCallback& callback,
+    InputType&            inputData
+) {
+    int queueCount = activeWorkerQueues.load(std::memory_order_acquire);
+    if (workerIndex < queueCount && workerQueues[workerIndex].Pop(callback, inputData)) return true;
+
+    if (inputQueueSize.load(std::memory_order_relaxed) > 0) {
+        inputQueueMutex.Lock();
+        if (inputQueue.Size() > 0) {
+            callback  = inputFunctionQueue.Pop();
+            inputData = inputQueue.Pop();
+            inputQueueSize.store(inputQueue.Size(), std::memory_order_relaxed);
+            inputQueueMutex.Unlock();
+            return true;
+        }
+        inputQueueMutex.Unlock();
+    }
 
-    quitAndIncomingDataEvents.SetEvent();
+    for (int i = 1; i < queueCount; i++) {
+        if (workerQueues[(workerIndex + i) % queueCount].Pop(callback, inputData)) return true;
+    }
+    return false;
+}
+template <class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::WakeWorker(void) {
+    // Pairs with the fence in WorkerThread, so either the worker sees the new input or this sees the worker
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numThreadsSleeping.load(std::memory_order_relaxed) > 0 && wakePending.exchange(true) == false)
+        quitAndIncomingDataEvents.SetEvent();
+}
+template <class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::DrainWorkerQueues(void) {
+    WorkerThreadCallback callback;
+    InputType            inputData;
+    for (int i = 0; i < workerQueueCount; i++) {
+        while (workerQueues[i].Pop(callback, inputData)) {
+            inputQueue.Push(inputData, _FILE_AND_LINE_);
+            inputFunctionQueue.Push(callback, _FILE_AND_LINE_);
+        }
+    }
+    inputQueueSize.store(inputQueue.Size(), std::memory_order_relaxed);
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::AddOutput(OutputType outputData) {
@@ -439,7 +673,11 @@ bool ThreadPool<InputType, OutputType>::HasOutput(void) {
 }
 template <class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasInputFast(void) {
-    return inputQueue.IsEmpty() == false;
+    if (inputQueueSize.load(std::memory_order_relaxed) > 0) return true;
+    for (int i = 0; i < workerQueueCount; i++) {
+        if (workerQueues[i].IsEmpty() == false) return true;
+    }
+    return false;
 }
 template <class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasInput(void) {
@@ -447,7 +685,11 @@ bool ThreadPool<InputType, OutputType>::HasInput(void) {
     inputQueueMutex.Lock();
     res = inputQueue.IsEmpty() == false;
     inputQueueMutex.Unlock();
-    return res;
+    if (res) return true;
+    for (int i = 0; i < workerQueueCount; i++) {
+        if (workerQueues[i].IsEmpty() == false) return true;
+    }
+    return false;
 }
 template <class InputType, class OutputType>
 OutputType ThreadPool<InputType, OutputType>::GetOutput(void) {
@@ -464,22 +706,28 @@ void ThreadPool<InputType, OutputType>::Clear(void) {
     if (runThreads) {
         runThreadsMutex.Unlock();
         inputQueueMutex.Lock();
+        DrainWorkerQueues();
         inputFunctionQueue.Clear(_FILE_AND_LINE_);
         inputQueue.Clear(_FILE_AND_LINE_);
+        inputQueueSize = 0;
         inputQueueMutex.Unlock();
 
         outputQueueMutex.Lock();
         outputQueue.Clear(_FILE_AND_LINE_);
         outputQueueMutex.Unlock();
     } else {
+        runThreadsMutex.Unlock();
+        DrainWorkerQueues();
         inputFunctionQueue.Clear(_FILE_AND_LINE_);
         inputQueue.Clear(_FILE_AND_LINE_);
+        inputQueueSize = 0;
         outputQueue.Clear(_FILE_AND_LINE_);
     }
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::LockInput(void) {
     inputQueueMutex.Lock();
+    DrainWorkerQueues();
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::UnlockInput(void) {
@@ -497,6 +745,7 @@ template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::RemoveInputAtIndex(unsigned index) {
     inputQueue.RemoveAtIndex(index);
     inputFunctionQueue.RemoveAtIndex(index);
+    inputQueueSize.store(inputQueue.Size(), std::memory_order_relaxed);
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::LockOutput(void) {
@@ -520,8 +769,10 @@ void ThreadPool<InputType, OutputType>::RemoveOutputAtIndex(unsigned index) {
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::ClearInput(void) {
+    DrainWorkerQueues();
     inputQueue.Clear(_FILE_AND_LINE_);
     inputFunctionQueue.Clear(_FILE_AND_LINE_);
+    inputQueueSize = 0;
 }
 
 template <class InputType, class OutputType>
@@ -546,9 +797,7 @@ bool ThreadPool<InputType, OutputType>::IsWorking(void) {
     if (HasInputFast() && HasInput()) return true;
 
     // Need to check is working again, in case the thread was between the first and second checks
-    workingThreadCountMutex.Lock();
     isWorking = numThreadsWorking != 0;
-    workingThreadCountMutex.Unlock();
 
     return isWorking;
 }
@@ -560,23 +809,20 @@ int ThreadPool<InputType, OutputType>::NumThreadsWorking(void) {
 
 template <class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::WasStarted(void) {
-    bool b;
-    runThreadsMutex.Lock();
-    b = runThreads;
-    runThreadsMutex.Unlock();
-    return b;
+    return runThreads;
 }
 template <class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::Pause(void) {
     if (WasStarted() == false) return false;
 
-    workingThreadCountMutex.Lock();
-    while (numThreadsWorking > 0) { RakSleep(30); }
+    paused = true;
+    while (numThreadsWorking > 0) { RakSleep(1); }
     return true;
 }
 template <class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::Resume(void) {
-    workingThreadCountMutex.Unlock();
+    paused = false;
+    WakeWorker();
 }
 
 #ifdef _MSC_VER
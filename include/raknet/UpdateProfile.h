@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file UpdateProfile.h
+/// \brief Optional accounting of the time RakPeer's update loop spends per phase, per plugin and per message
+/// identifier, for finding what made a tick slow.
+///
+
+
+#ifndef __UPDATE_PROFILE_H
+#define __UPDATE_PROFILE_H
+
+#include "DS_List.h"
+#include "Export.h"
+#include "LatencyHistogram.h"
+#include "NativeTypes.h"
+#include "RakNetDefines.h"
+#include "SimpleMutex.h"
+#include <chrono>
+
+namespace RakNet {
+
+class PluginInterface2;
+
+/// Parts of the update loop timed by RakPeer while RakPeer::SetUpdateProfiling() is on
+enum UpdateProfilePhase {
+    /// All of one RakPeer::RunUpdateCycle(), including the phases below it
+    UPDATE_PHASE_CYCLE,
+
+    /// Datagrams received since the last cycle, up to being handed to the ReliabilityLayer of their connection
+    UPDATE_PHASE_BUFFERED_DATAGRAMS,
+
+    /// Send(), CloseConnection() and the other calls queued for the network thread
+    UPDATE_PHASE_BUFFERED_COMMANDS,
+
+    /// Connect() attempts still waiting for a reply, sending and retrying their requests
+    UPDATE_PHASE_CONNECTION_REQUESTS,
+
+    /// ReliabilityLayer::Update() of every connection, with the handling of the messages it returns
+    UPDATE_PHASE_CONNECTIONS,
+
+    /// PluginInterface2::Update() of every plugin, once per RakPeer::Receive()
+    UPDATE_PHASE_PLUGIN_UPDATE,
+
+    /// One message passed through the plugins by RakPeer::Receive(), whether or not a plugin kept it
+    UPDATE_PHASE_PLUGIN_RECEIVE,
+
+    UPDATE_PHASE_COUNT
+};
+
+/// Plugin calls timed for each plugin
+enum UpdateProfilePluginCall {
+    /// PluginInterface2::Update(), once per RakPeer::Receive()
+    UPDATE_PLUGIN_UPDATE,
+
+    /// PluginInterface2::OnReceive(), once per message
+    UPDATE_PLUGIN_ON_RECEIVE,
+
+    UPDATE_PLUGIN_CALL_COUNT
+};
+
+/// \brief LatencyHistogram of the values recorded in the last one to two windows of UPDATE_PROFILE_WINDOW_MS
+/// \details Values are forgotten a window at a time, so a spike stays readable for at least one full window.
+class RAKNET_API RollingLatencyHistogram {
+public:
+    RollingLatencyHistogram();
+
+    /// Forgets every value recorded, starting a new window at \a nowNs
+    void Reset(uint64_t nowNs);
+
+    /// Counts \a value, recorded at \a nowNs as returned by UpdateProfiler::GetTimeNS()
+    inline void Record(uint64_t value, uint64_t nowNs) {
+        if (nowNs - windowStart >= (uint64_t)UPDATE_PROFILE_WINDOW_MS * 1000000) Roll(nowNs);
+        current.Record(value);
+    }
+
+    /// Overwrites \a histogram with the values of the windows still kept at \a nowNs
+    void Read(LatencyHistogram* histogram, uint64_t nowNs) const;
+
+protected:
+    void Roll(uint64_t nowNs);
+
+    LatencyHistogram current;
+    LatencyHistogram previous;
+    uint64_t         windowStart;
+};
+
+/// \internal
+/// \brief The histograms RakPeer records into while profiling, in nanoseconds.
+/// \details Phases are recorded by the thread that calls RunUpdateCycle(), plugins and messages by the one that calls
+/// Receive(), and read by any thread. Each phase is recorded and read under a mutex of its own, so the two recording
+/// threads do not wait on each other. Plugins and messages share one, as their histograms are allocated and freed while
+/// profiling.
+class RAKNET_API UpdateProfiler {
+public:
+    UpdateProfiler();
+    ~UpdateProfiler();
+
+    /// Monotonic nanoseconds. Unlike GetTimeUS(), never replaced by SetTimeSourceUS(), so time spent is real time
+    static inline uint64_t GetTimeNS(void) {
+        std::chrono::steady_clock::duration now = std::chrono::steady_clock::now().time_since_epoch();
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    /// \brief Forgets everything recorded
+    /// \details Safe while recording.
+    void Reset(void);
+
+    inline void RecordPhase(UpdateProfilePhase phase, uint64_t startNs, uint64_t endNs) {
+        phaseMutexes[phase].Lock();
+        phases[phase].Record(endNs - startNs, endNs);
+        phaseMutexes[phase].Unlock();
+    }
+    void RecordPlugin(PluginInterface2* plugin, UpdateProfilePluginCall call, uint64_t startNs, uint64_t endNs);
+    void RecordMessage(unsigned char messageId, uint64_t startNs, uint64_t endNs);
+
+    /// Forgets \a plugin, which is being detached
+    void RemovePlugin(PluginInterface2* plugin);
+
+    void ReadPhase(UpdateProfilePhase phase, LatencyHistogram* histogram) const;
+    /// \return false if nothing was recorded for \a plugin
+    bool ReadPlugin(PluginInterface2* plugin, UpdateProfilePluginCall call, LatencyHistogram* histogram) const;
+    void ReadMessage(unsigned char messageId, LatencyHistogram* histogram) const;
+
+protected:
+    struct PluginProfile {
+        PluginInterface2*       plugin;
+        RollingLatencyHistogram calls[UPDATE_PLUGIN_CALL_COUNT];
+    };
+
+    // Returns plugins.Size() if \a plugin has no profile
+    unsigned int FindPlugin(PluginInterface2* plugin) const;
+
+    RollingLatencyHistogram              phases[UPDATE_PHASE_COUNT];
+    // Each guards the phase of the same index
+    mutable SimpleMutex                  phaseMutexes[UPDATE_PHASE_COUNT];
+    // Guards messages and plugins
+    mutable SimpleMutex                  receiveMutex;
+    // Allocated the first time each identifier is received, as most never are
+    RollingLatencyHistogram*             messages[256];
+    DataStructures::List<PluginProfile*> plugins;
+};
+
+} // namespace RakNet
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief In-process network of simulated links and a virtual clock, for tests that must give the same result on every
+/// run
+///
+
+
+#ifndef __VIRTUAL_NETWORK_H
+#define __VIRTUAL_NETWORK_H
+
+#include "DS_Hash.h"
+#include "DS_Heap.h"
+#include "DS_MemoryPool.h"
+#include "Export.h"
+#include "RakNetSocket2.h"
+#include "RakNetTime.h"
+#include "Rand.h"
+
+namespace RakNet {
+
+class VirtualNetwork;
+
+/// \brief How one system's link to the VirtualNetwork treats the datagrams that system sends
+/// \details The defaults are a link with no limits, no delay and no loss
+struct RAKNET_API VirtualLinkSettings {
+    VirtualLinkSettings();
+
+    /// Bits per second the link sends, counting UDP_HEADER_SIZE per datagram. 0 for no limit
+    uint64_t bitsPerSecond;
+
+    /// Datagrams that would wait longer than this for the link are dropped, as by a router with a full buffer. 0 for no
+    /// limit
+    RakNet::TimeUS maximumQueueDelay;
+
+    /// One way delay added to every datagram
+    RakNet::TimeUS latency;
+
+    /// Up to this much more delay, at random. Datagrams still arrive in the order they were sent
+    RakNet::TimeUS jitter;
+
+    /// Chance, from 0 to 1, that a datagram is lost
+    float lossRate;
+
+    /// Chance, from 0 to 1, that a datagram is held back by reorderDelay, so the ones sent after it can overtake it
+    float          reorderRate;
+    RakNet::TimeUS reorderDelay;
+
+    /// Datagrams larger than this, counting UDP_HEADER_SIZE, are dropped, as with the don't fragment bit set.
+    /// Payloads over MAXIMUM_MTU_SIZE are dropped whatever this is set to
+    int mtu;
+};
+
+/// Datagram counts of a VirtualNetwork
+struct RAKNET_API VirtualNetworkStatistics {
+    uint64_t datagramsSent;
+    uint64_t datagramsDelivered;
+    uint64_t bytesDelivered;
+    /// Dropped by VirtualLinkSettings::lossRate
+    uint64_t datagramsLost;
+    /// Dropped by VirtualLinkSettings::maximumQueueDelay
+    uint64_t datagramsQueueDropped;
+    /// Dropped by VirtualLinkSettings::mtu, or for being larger than MAXIMUM_MTU_SIZE
+    uint64_t datagramsMTUDropped;
+    /// Sent to an address nothing was bound to when they arrived
+    uint64_t datagramsUnreachable;
+};
+
+/// \brief RakNetSocket2 bound to a VirtualNetwork.
+/// \details RakPeer::Startup() creates these for a SocketDescriptor with SocketDescriptor::virtualNetwork set.
+class RAKNET_API RNS2_Virtual : public RakNetSocket2 {
+public:
+    RNS2_Virtual();
+    virtual ~RNS2_Virtual();
+
+    /// \param[in] hostAddress IPv4 address to take, or 0 or an empty string for the next free one
+    /// \param[in] port Port to take, or 0 for the next free one
+    RNS2BindResult
+    Bind(VirtualNetwork* _network, const char* hostAddress, unsigned short port, RNS2EventHandler* _eventHandler);
+    RNS2SendResult  Send(RNS2_SendParameters* sendParameters, const char* file, unsigned int line);
+    VirtualNetwork* GetNetwork(void) const;
+
+protected:
+    friend class VirtualNetwork;
+
+    VirtualNetwork*     network;
+    VirtualLinkSettings linkSettings;
+    bool                hasLinkSettings;
+    /// When the link has sent everything queued on it so far
+    RakNet::TimeUS      linkFreeTime;
+    /// Latest arrival time given so far, so jitter does not reorder
+    RakNet::TimeUS      lastArrivalTime;
+};
+
+/// \brief Links RakPeer instances in one process through simulated links and a virtual clock
+/// \details Datagrams sent on an RNS2_Virtual are held with the time VirtualLinkSettings gives them, and handed to the
+/// receiving socket by AdvanceTime(). Losses, jitter and reordering come from a generator seeded in the constructor, so
+/// a run gives the same result every time.
+///
+/// RakPeer does not start its network thread on a VirtualNetwork. Drive every peer from one thread instead:
+/// \code
+/// network.UseAsClock(true);
+/// while (running) {
+///     network.AdvanceTime(1000);
+///     for (i = 0; i < peerCount; i++) {
+///         peers[i]->RunUpdateCycle(updateBitStream);
+///         for (packet = peers[i]->Receive(); packet; ...)
+///     }
+/// }
+/// \endcode
+/// Pass 0 as the block duration of RakPeer::Shutdown(), which otherwise waits on a clock that is not advancing.
+/// RakPeer GUIDs also come from the network, so a peer gets the same GUID on every run.
+class RAKNET_API VirtualNetwork {
+public:
+    /// \param[in] seed Seeds the generator for losses, jitter, reordering and GUIDs
+    VirtualNetwork(unsigned int seed = 0);
+    ~VirtualNetwork();
+
+    /// Settings of systems without their own, including ones bound later
+    void                       SetDefaultLinkSettings(const VirtualLinkSettings& settings);
+    const VirtualLinkSettings& GetDefaultLinkSettings(void) const;
+
+    /// \brief Settings of the link of the system bound to \a systemAddress, for the datagrams it sends
+    /// \return false if nothing is bound to \a systemAddress
+    bool SetLinkSettings(const SystemAddress& systemAddress, const VirtualLinkSettings& settings);
+
+    /// \brief Makes GetTimeUS() and the rest return this network's clock, or the system clock again for false
+    /// \details Only one network can be the clock at a time. The destructor restores the system clock.
+    void UseAsClock(bool enabled);
+
+    /// The virtual clock. Starts at 1 second, so no time RakPeer keeps is 0 by accident
+    RakNet::TimeUS GetTime(void) const;
+
+    /// \brief Moves the clock forward by \a elapsed, handing every datagram due by then to the socket it was sent to
+    /// \details Datagrams are handed over in the order they arrive, with the clock set to their arrival time.
+    void AdvanceTime(RakNet::TimeUS elapsed);
+
+    /// Returns when the next datagram in flight arrives, or 0 if there are none
+    RakNet::TimeUS GetNextArrivalTime(void) const;
+
+    /// Returns how many datagrams are in flight
+    unsigned int GetDatagramsInFlight(void) const;
+
+    const VirtualNetworkStatistics& GetStatistics(void) const;
+
+    /// \internal
+    bool           Bind(RNS2_Virtual* socket, const char* hostAddress, unsigned short port);
+    /// \internal
+    void           Unbind(RNS2_Virtual* socket);
+    /// \internal
+    RNS2SendResult Send(RNS2_Virtual* socket, RNS2_SendParameters* sendParameters);
+    /// \internal
+    uint64_t       GenerateGUID(void);
+
+protected:
+    struct Datagram {
+        char           data[MAXIMUM_MTU_SIZE];
+        int            length;
+        SystemAddress  sender;
+        SystemAddress  receiver;
+        RakNet::TimeUS arrivalTime;
+    };
+
+    /// Orders datagrams that arrive at the same time by when they were sent
+    struct ArrivalKey {
+        RakNet::TimeUS time;
+        uint64_t       sequence;
+
+        bool operator<(const ArrivalKey& rhs) const {
+            return time < rhs.time || (time == rhs.time && sequence < rhs.sequence);
+        }
+        bool operator>(const ArrivalKey& rhs) const { return rhs < *this; }
+        bool operator<=(const ArrivalKey& rhs) const { return !(rhs < *this); }
+        bool operator>=(const ArrivalKey& rhs) const { return !(*this < rhs); }
+    };
+
+    static RakNet::TimeUS ReadClock(void);
+    void                  Deliver(Datagram* datagram);
+
+    static VirtualNetwork* clockNetwork;
+
+    RakNet::TimeUS           currentTime;
+    uint64_t                 nextSequence;
+    uint32_t                 nextHostAddress;
+    unsigned short           nextPort;
+    VirtualLinkSettings      defaultLinkSettings;
+    VirtualNetworkStatistics statistics;
+    RakNetRandom             random;
+
+    DataStructures::Hash<SystemAddress, RNS2_Virtual*, 4096, SystemAddress::ToInteger> sockets;
+    DataStructures::Heap<ArrivalKey, Datagram*, false>                                 inFlight;
+    DataStructures::MemoryPool<Datagram>                                               datagramPool;
+};
+
+} // namespace RakNet
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "AllocationTracker.h"
+#include "GetTime.h"
+#include "RakMemoryOverride.h"
+#include "RakNetDefines.h"
+#include "RakSleep.h"
+#include "RakThread.h"
+#include "SignaledEvent.h"
+#include <atomic>
+#include <stdint.h>
+
+using namespace RakNet;
+
+// Keeps the block after it aligned as the wrapped allocator aligned the header
+static const size_t       ALLOCATION_HEADER_SIZE = 16;
+// Where allocations go once every site is in use
+static const unsigned int OTHER_SITES_INDEX      = ALLOCATION_TRACKER_MAX_SITES;
+// DumpAllocationSites() sorts on the stack, so it writes no more than this many sites
+static const unsigned int MAX_DUMPED_SITES       = 64;
+
+struct AllocationHeader {
+    size_t       size;
+    unsigned int site;
+};
+static_assert(sizeof(AllocationHeader) <= ALLOCATION_HEADER_SIZE, "AllocationHeader must fit in the header");
+
+enum AllocationSiteState { SITE_EMPTY, SITE_CLAIMED, SITE_READY };
+
+// file and line are written once, while the site is SITE_CLAIMED, and only read once it is SITE_READY
+struct AllocationSite {
+    std::atomic<int>      state;
+    const char*           file;
+    unsigned int          line;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> frees;
+    std::atomic<int64_t>  liveBytes;
+    std::atomic<int64_t>  highWaterBytes;
+};
+
+static AllocationSite sites[ALLOCATION_TRACKER_MAX_SITES + 1];
+static bool           allocationTrackingEnabled;
+
+// The allocator that was installed when tracking started, which still does the work
+static void* (*wrappedMalloc)(size_t size);
+static void* (*wrappedRealloc)(void* p, size_t size);
+static void (*wrappedFree)(void* p);
+static void* (*wrappedMalloc_Ex)(size_t size, const char* file, unsigned int line);
+static void* (*wrappedRealloc_Ex)(void* p, size_t size, const char* file, unsigned int line);
+static void (*wrappedFree_Ex)(void* p, const char* file, unsigned int line);
+
+static SignaledEvent     dumpEvent;
+static std::atomic<bool> dumpThreadRunning;
+static std::atomic<bool> dumpThreadActive;
+static FILE*             dumpFile;
+static RakNet::TimeMS    dumpIntervalMs;
+static unsigned int      dumpMaxSites;
+
+static unsigned int FindSite(const char* file, unsigned int line) {
+    if (file == 0) file = "";
+
+    size_t hash = ((size_t)(uintptr_t)file >> 3) * 31 + line;
+    hash       ^= hash >> 15;
+    hash       *= 2654435761u;
+    for (unsigned int probe = 0; probe < ALLOCATION_TRACKER_MAX_SITES; probe++) {
+        AllocationSite& site  = sites[(hash + probe) & (ALLOCATION_TRACKER_MAX_SITES - 1)];
+        int             state = site.state.load(std::memory_order_acquire);
+        if (state == SITE_EMPTY) {
+            if (site.state.compare_exchange_strong(state, SITE_CLAIMED, std::memory_order_acquire)) {
+                site.file = file;
+                site.line = line;
+                site.state.store(SITE_READY, std::memory_order_release);
+                return (unsigned int)(&site - sites);
+            }
+        }
+        // Another thread is filling in this site, which takes a couple of stores
+        while (state == SITE_CLAIMED) state = site.state.load(std::memory_order_acquire);
+        if (site.file == file && site.line == line) return (unsigned int)(&site - sites);
+    }
+    return OTHER_SITES_INDEX;
+}
+
+static void CountAllocation(unsigned int siteIndex, size_t size) {
+    AllocationSite& site = sites[siteIndex];
+    site.allocations.fetch_add(1, std::memory_order_relaxed);
+    int64_t liveBytes      = site.liveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+    int64_t highWaterBytes = site.highWaterBytes.load(std::memory_order_relaxed);
+    // A failed exchange reloads highWaterBytes, in case another thread raised it first
+    while (liveBytes > highWaterBytes) {
+        if (site.highWaterBytes.compare_exchange_weak(highWaterBytes, liveBytes, std::memory_order_relaxed)) break;
+    }
+}
+
+static void CountFree(unsigned int siteIndex, size_t size) {
+    AllocationSite& site = sites[siteIndex];
+    site.frees.fetch_add(1, std::memory_order_relaxed);
+    site.liveBytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+}
+
+// Fills in the header of a new block and returns the memory after it
+static void* TrackBlock(char* block, size_t size, const char* file, unsigned int line) {
+    AllocationHeader* header = (AllocationHeader*)block;
+    header->size             = size;
+    header->site             = FindSite(file, line);
+    CountAllocation(header->site, size);
+    return block + ALLOCATION_HEADER_SIZE;
+}
+
+static void* TrackedMalloc_Ex(size_t size, const char* file, unsigned int line) {
+    char* block = (char*)wrappedMalloc_Ex(size + ALLOCATION_HEADER_SIZE, file, line);
+    if (block == 0) return 0;
+    return TrackBlock(block, size, file, line);
+}
+
+static void* TrackedRealloc_Ex(void* p, size_t size, const char* file, unsigned int line) {
+    if (p == 0) return TrackedMalloc_Ex(size, file, line);
+
+    char*            block     = (char*)p - ALLOCATION_HEADER_SIZE;
+    AllocationHeader oldHeader = *(AllocationHeader*)block;
+    block                      = (char*)wrappedRealloc_Ex(block, size + ALLOCATION_HEADER_SIZE, file, line);
+    // The old block is untouched if realloc fails
+    if (block == 0) return 0;
+    CountFree(oldHeader.site, oldHeader.size);
+    return TrackBlock(block, size, file, line);
+}
+
+static void TrackedFree_Ex(void* p, const char* file, unsigned int line) {
+    if (p == 0) return;
+
+    char*             block  = (char*)p - ALLOCATION_HEADER_SIZE;
+    AllocationHeader* header = (AllocationHeader*)block;
+    CountFree(header->site, header->size);
+    wrappedFree_Ex(block, file, line);
+}
+
+static void* TrackedMalloc(size_t size) {
+    char* block = (char*)wrappedMalloc(size + ALLOCATION_HEADER_SIZE);
+    if (block == 0) return 0;
+    return TrackBlock(block, size, "", 0);
+}
+
+static void* TrackedRealloc(void* p, size_t size) {
+    if (p == 0) return TrackedMalloc(size);
+
+    char*            block     = (char*)p - ALLOCATION_HEADER_SIZE;
+    AllocationHeader oldHeader = *(AllocationHeader*)block;
+    block                      = (char*)wrappedRealloc(block, size + ALLOCATION_HEADER_SIZE);
+    if (block == 0) return 0;
+    CountFree(oldHeader.site, oldHeader.size);
+    return TrackBlock(block, size, "", 0);
+}
+
+static void TrackedFree(void* p) {
+    if (p == 0) return;
+
+    char*             block  = (char*)p - ALLOCATION_HEADER_SIZE;
+    AllocationHeader* header = (AllocationHeader*)block;
+    CountFree(header->site, header->size);
+    wrappedFree(block);
+}
+
+bool RakNet::UseAllocationTracking(void) {
+    if (allocationTrackingEnabled) return false;
+
+    sites[OTHER_SITES_INDEX].file = "(other sites)";
+    sites[OTHER_SITES_INDEX].line = 0;
+    sites[OTHER_SITES_INDEX].state.store(SITE_READY, std::memory_order_release);
+
+    wrappedMalloc     = GetMalloc();
+    wrappedRealloc    = GetRealloc();
+    wrappedFree       = GetFree();
+    wrappedMalloc_Ex  = GetMalloc_Ex();
+    wrappedRealloc_Ex = GetRealloc_Ex();
+    wrappedFree_Ex    = GetFree_Ex();
+    SetMalloc(TrackedMalloc);
+    SetRealloc(TrackedRealloc);
+    SetFree(TrackedFree);
+    SetMalloc_Ex(TrackedMalloc_Ex);
+    SetRealloc_Ex(TrackedRealloc_Ex);
+    SetFree_Ex(TrackedFree_Ex);
+    allocationTrackingEnabled = true;
+    return true;
+}
+
+bool RakNet::IsAllocationTrackingEnabled(void) { return allocationTrackingEnabled; }
+
+static void ReadSite(const AllocationSite& site, AllocationSiteStatistics* statistics) {
+    statistics->file           = site.file;
+    statistics->line           = site.line;
+    statistics->allocations    = site.allocations.load(std::memory_order_relaxed);
+    statistics->frees          = site.frees.load(std::memory_order_relaxed);
+    statistics->liveBytes      = site.liveBytes.load(std::memory_order_relaxed);
+    statistics->highWaterBytes = site.highWaterBytes.load(std::memory_order_relaxed);
+}
+
+unsigned int RakNet::GetAllocationSiteStatistics(AllocationSiteStatistics* statistics, unsigned int maxSites) {
+    unsigned int siteCount = 0;
+    unsigned int copied    = 0;
+    for (unsigned int i = 0; i <= ALLOCATION_TRACKER_MAX_SITES; i++) {
+        if (sites[i].state.load(std::memory_order_acquire) != SITE_READY) continue;
+        if (sites[i].allocations.load(std::memory_order_relaxed) == 0) continue;
+        siteCount++;
+
+        AllocationSiteStatistics site;
+        ReadSite(sites[i], &site);
+        // Insertion sort into the caller's array, dropping whatever falls off the end
+        unsigned int index = copied;
+        while (index > 0 && statistics[index - 1].liveBytes < site.liveBytes) {
+            if (index < maxSites) statistics[index] = statistics[index - 1];
+            index--;
+        }
+        if (index < maxSites) statistics[index] = site;
+        if (copied < maxSites) copied++;
+    }
+    return siteCount;
+}
+
+void RakNet::DumpAllocationSites(FILE* fp, unsigned int maxSites) {
+    AllocationSiteStatistics statistics[MAX_DUMPED_SITES];
+    if (maxSites > MAX_DUMPED_SITES) maxSites = MAX_DUMPED_SITES;
+    unsigned int siteCount = GetAllocationSiteStatistics(statistics, maxSites);
+    if (maxSites > siteCount) maxSites = siteCount;
+
+    int64_t liveBytes = 0;
+    for (unsigned int i = 0; i <= ALLOCATION_TRACKER_MAX_SITES; i++)
+        liveBytes += sites[i].liveBytes.load(std::memory_order_relaxed);
+
+    fprintf(
+        fp,
+        "Allocation sites at %u ms: %lld bytes live from %u sites\n",
+        (unsigned int)RakNet::GetTimeMS(),
+        (long long)liveBytes,
+        siteCount
+    );
+    fprintf(fp, "  %12s %12s %12s %12s  %s\n", "live bytes", "high water", "live count", "allocations", "site");
+    for (unsigned int i = 0; i < maxSites; i++) {
+        fprintf(
+            fp,
+            "  %12lld %12lld %12lld %12llu  %s:%u\n",
+            (long long)statistics[i].liveBytes,
+            (long long)statistics[i].highWaterBytes,
+            (long long)(statistics[i].allocations - statistics[i].frees),
+            (unsigned long long)statistics[i].allocations,
+            statistics[i].file,
+            statistics[i].line
+        );
+    }
+    fflush(fp);
+}
+
+static RAK_THREAD_DECLARATION(AllocationSiteDumpLoop) {
+    (void)arguments;
+
+    while (dumpThreadRunning) {
+        dumpEvent.WaitOnEvent((int)dumpIntervalMs);
+        if (dumpThreadRunning == false) break;
+        DumpAllocationSites(dumpFile, dumpMaxSites);
+    }
+    dumpThreadActive = false;
+    return 0;
+}
+
+bool RakNet::StartAllocationSiteDump(FILE* fp, RakNet::TimeMS intervalMs, unsigned int maxSites) {
+    if (allocationTrackingEnabled == false) return false;
+    StopAllocationSiteDump();
+
+    dumpFile          = fp;
+    dumpIntervalMs    = intervalMs;
+    dumpMaxSites      = maxSites;
+    dumpThreadRunning = true;
+    dumpThreadActive  = true;
+    dumpEvent.InitEvent();
+    if (RakNet::RakThread::Create(AllocationSiteDumpLoop, 0) != 0) {
+        dumpThreadRunning = false;
+        dumpThreadActive  = false;
+        dumpEvent.CloseEvent();
+        return false;
+    }
+    return true;
+}
+
+void RakNet::StopAllocationSiteDump(void) {
+    if (dumpThreadActive == false) return;
+
+    dumpThreadRunning = false;
+    dumpEvent.SetEvent();
+    while (dumpThreadActive) RakSleep(1);
+    dumpEvent.CloseEvent();
+}
@@ -0,0 +1,654 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+
+#include "NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_PacketLogger == 1
+
+#include "AsyncPacketFileLogger.h"
+#include "GetTime.h"
+#include "InternalPacket.h"
+#include "MessageIdentifiers.h"
+#include "RakAssert.h"
+#include "RakPeerInterface.h"
+#include "RakSleep.h"
+#include "SocketIncludes.h"
+#include <string.h>
+
+using namespace RakNet;
+
+static_assert(
+    (ASYNC_PACKET_LOGGER_QUEUE_RECORDS & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)) == 0,
+    "ASYNC_PACKET_LOGGER_QUEUE_RECORDS must be a power of two"
+);
+
+static const uint32_t PACKET_LOG_MAGIC   = 0x4c50524b;
+static const uint32_t PACKET_LOG_VERSION = 1;
+
+// Records the writer thread takes from the queue before each fwrite
+static const unsigned int PACKET_LOG_BATCH_RECORDS = 64;
+
+// How long the writer thread sleeps when the queue is empty, unless the queue fills up a quarter
+static const int PACKET_LOG_WRITER_SLEEP_MS = 100;
+
+// Longest text kept, as PacketFileLogger formats lines into 1024 bytes. Longer text is cut and ends in "..."
+static const size_t PACKET_LOG_MAX_TEXT_LENGTH = 1023;
+static const size_t PACKET_LOG_TEXT_CHUNK      = sizeof(PacketLogRecord::text);
+// Records the longest text takes, with its terminator
+static const uint32_t PACKET_LOG_MAX_TEXT_RECORDS =
+    (uint32_t)((PACKET_LOG_MAX_TEXT_LENGTH + PACKET_LOG_TEXT_CHUNK) / PACKET_LOG_TEXT_CHUNK);
+
+struct PacketLogFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+};
+
+static void SetRecordAddress(
+    const SystemAddress& systemAddress,
+    uint8_t              address[16],
+    uint16_t&            port,
+    uint8_t&             ipVersion
+) {
+    port      = systemAddress.GetPortNetworkOrder();
+    ipVersion = systemAddress.GetIPVersion();
+#if RAKNET_SUPPORT_IPV6 == 1
+    if (ipVersion == 6) {
+        memcpy(address, &systemAddress.address.addr6.sin6_addr, 16);
+        return;
+    }
+#endif
+    memcpy(address, &systemAddress.address.addr4.sin_addr, 4);
+    memset(address + 4, 0, 12);
+}
+static void GetRecordAddress(
+    SystemAddress& systemAddress,
+    const uint8_t  address[16],
+    uint16_t       port,
+    uint8_t        ipVersion
+) {
+#if RAKNET_SUPPORT_IPV6 == 1
+    if (ipVersion == 6) {
+        memset(&systemAddress.address.addr6, 0, sizeof(systemAddress.address.addr6));
+        systemAddress.address.addr6.sin6_family = AF_INET6;
+        memcpy(&systemAddress.address.addr6.sin6_addr, address, 16);
+        systemAddress.SetPortNetworkOrder(port);
+        return;
+    }
+#else
+    (void)ipVersion;
+#endif
+    systemAddress.address.addr4.sin_family = AF_INET;
+    memcpy(&systemAddress.address.addr4.sin_addr, address, 4);
+    systemAddress.SetPortNetworkOrder(port);
+}
+// IPv4 addresses as they are, IPv6 addresses hashed, with the port in the low 16 bits
+static uint64_t GetFilterKey(const SystemAddress& systemAddress, bool withPort) {
+    uint64_t port = withPort ? systemAddress.GetPort() : 0;
+#if RAKNET_SUPPORT_IPV6 == 1
+    if (systemAddress.GetIPVersion() == 6) {
+        // FNV-1a
+        const unsigned char* bytes = (const unsigned char*)&systemAddress.address.addr6.sin6_addr;
+        uint64_t             hash  = 14695981039346656037ULL;
+        for (unsigned int i = 0; i < 16; i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return ((uint64_t)1 << 63) | ((hash & 0x7FFFFFFFFFFFULL) << 16) | port;
+    }
+#endif
+    return ((uint64_t)systemAddress.address.addr4.sin_addr.s_addr << 16) | port;
+}
+static void InitRecord(
+    PacketLogRecord&     record,
+    PacketLogRecordType  type,
+    uint64_t             time,
+    const SystemAddress& local,
+    const SystemAddress& remote
+) {
+    record.time                  = time;
+    record.reliableMessageNumber = 0;
+    record.frame                 = 0;
+    record.bitLength             = 0;
+    record.splitPacketId         = (unsigned int)-1;
+    record.splitPacketIndex      = (unsigned int)-1;
+    record.splitPacketCount      = (unsigned int)-1;
+    record.orderingIndex         = (unsigned int)-1;
+    SetRecordAddress(local, record.localAddress, record.localPort, record.localIPVersion);
+    SetRecordAddress(remote, record.remoteAddress, record.remotePort, record.remoteIPVersion);
+    record.type              = (uint8_t)type;
+    record.messageIdentifier = 0;
+    record.isSend            = 0;
+    record.timestamped       = 0;
+    record.text[0]           = 0;
+}
+// Joins the text of \a record and of the PACKET_LOG_TEXT_CONTINUATION records after it in \a binaryLog
+static void ReadRecordText(FILE* binaryLog, const PacketLogRecord& record, char text[PACKET_LOG_MAX_TEXT_LENGTH + 1]) {
+    char   joined[PACKET_LOG_MAX_TEXT_RECORDS * PACKET_LOG_TEXT_CHUNK + 1];
+    size_t length = PACKET_LOG_TEXT_CHUNK;
+    memcpy(joined, record.text, PACKET_LOG_TEXT_CHUNK);
+    PacketLogRecord continuation;
+    for (uint32_t i = 0; i < record.frame && i + 1 < PACKET_LOG_MAX_TEXT_RECORDS; i++) {
+        if (fread(&continuation, sizeof(continuation), 1, binaryLog) != 1) break;
+        if (continuation.type != PACKET_LOG_TEXT_CONTINUATION) {
+            // Not part of this text, so leave it for the caller
+            fseek(binaryLog, -(long)sizeof(continuation), SEEK_CUR);
+            break;
+        }
+        memcpy(joined + length, continuation.text, PACKET_LOG_TEXT_CHUNK);
+        length += PACKET_LOG_TEXT_CHUNK;
+    }
+    joined[length] = 0;
+    length         = strlen(joined);
+    if (length > PACKET_LOG_MAX_TEXT_LENGTH) length = PACKET_LOG_MAX_TEXT_LENGTH;
+    memcpy(text, joined, length);
+    text[length] = 0;
+}
+
+STATIC_FACTORY_DEFINITIONS(AsyncPacketFileLogger, AsyncPacketFileLogger);
+
+AsyncPacketFileLogger::AsyncPacketFileLogger() {
+    packetLogFile      = 0;
+    queue              = 0;
+    enqueuePosition    = 0;
+    dequeuePosition    = 0;
+    droppedRecords     = 0;
+    sleeping           = false;
+    wakePending        = false;
+    running            = false;
+    active             = false;
+    addressFilterCount = 0;
+}
+AsyncPacketFileLogger::~AsyncPacketFileLogger() {
+    StopLog();
+    if (queue) RakNet::OP_DELETE_ARRAY(queue, _FILE_AND_LINE_);
+}
+bool AsyncPacketFileLogger::StartLog(const char* filenamePrefix) {
+    char filename[256];
+    if (filenamePrefix) sprintf(filename, "%s_%i.bin", filenamePrefix, (int)RakNet::GetTimeMS());
+    else sprintf(filename, "PacketLog_%i.bin", (int)RakNet::GetTimeMS());
+    FILE* fp = fopen(filename, "wb");
+    if (fp == 0) return false;
+    return StartLog(fp);
+}
+bool AsyncPacketFileLogger::StartLog(FILE* fp) {
+    StopLog();
+
+    packetLogFile = fp;
+    PacketLogFileHeader header;
+    header.magic      = PACKET_LOG_MAGIC;
+    header.version    = PACKET_LOG_VERSION;
+    header.recordSize = sizeof(PacketLogRecord);
+    header.reserved   = 0;
+    fwrite(&header, sizeof(header), 1, packetLogFile);
+
+    // Kept until the destructor, as a hook may still be writing to it after StopLog() returns. Whatever it writes then
+    // goes to the next file
+    if (queue == 0) {
+        queue = RakNet::OP_NEW_ARRAY<QueueSlot>(ASYNC_PACKET_LOGGER_QUEUE_RECORDS, _FILE_AND_LINE_);
+        for (uint32_t i = 0; i < ASYNC_PACKET_LOGGER_QUEUE_RECORDS; i++)
+            queue[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    droppedRecords = 0;
+    sleeping       = false;
+    wakePending    = false;
+    active         = true;
+    writerEvent.InitEvent();
+    running.store(true, std::memory_order_release);
+    if (RakThread::Create(WriteLoop, this) != 0) {
+        running = false;
+        active  = false;
+        writerEvent.CloseEvent();
+        fclose(packetLogFile);
+        packetLogFile = 0;
+        return false;
+    }
+    return true;
+}
+void AsyncPacketFileLogger::StopLog(void) {
+    if (packetLogFile == 0) return;
+
+    running = false;
+    while (active) {
+        writerEvent.SetEvent();
+        RakSleep(1);
+    }
+    writerEvent.CloseEvent();
+    fclose(packetLogFile);
+    packetLogFile = 0;
+}
+void AsyncPacketFileLogger::SetAddressFilter(const SystemAddress* addresses, unsigned int count) {
+    if (count > MAX_FILTER_ADDRESSES) count = MAX_FILTER_ADDRESSES;
+    for (unsigned int i = 0; i < count; i++)
+        addressFilter[i].store(GetFilterKey(addresses[i], addresses[i].GetPort() != 0), std::memory_order_relaxed);
+    addressFilterCount.store(count, std::memory_order_release);
+}
+unsigned int AsyncPacketFileLogger::GetDroppedRecordCount(void) const { return droppedRecords; }
+bool         AsyncPacketFileLogger::IsLogged(const SystemAddress& remoteSystemAddress) const {
+    unsigned int count = addressFilterCount.load(std::memory_order_acquire);
+    if (count == 0) return true;
+
+    uint64_t withPort    = GetFilterKey(remoteSystemAddress, true);
+    uint64_t withoutPort = GetFilterKey(remoteSystemAddress, false);
+    for (unsigned int i = 0; i < count; i++) {
+        uint64_t key = addressFilter[i].load(std::memory_order_relaxed);
+        if (key == withPort || key == withoutPort) return true;
+    }
+    return false;
+}
+AsyncPacketFileLogger::QueueSlot* AsyncPacketFileLogger::Reserve(uint32_t& position, uint32_t count) {
+    // Bounded queue of Dmitry Vyukov. A slot's sequence equals the position that may write it, and position + 1 once
+    // written. Nothing else writes a free slot until enqueuePosition moves past it, so all \a count are taken at once
+    position = enqueuePosition.load(std::memory_order_relaxed);
+    while (1) {
+        int32_t  difference = 0;
+        uint32_t free       = 0;
+        for (; free < count; free++) {
+            QueueSlot* slot = &queue[(position + free) & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)];
+            difference      = (int32_t)(slot->sequence.load(std::memory_order_acquire) - (position + free));
+            if (difference != 0) break;
+        }
+        if (free == count) {
+            if (enqueuePosition.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                return &queue[position & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)];
+        } else if (difference < 0) {
+            // Not read yet since the last pass
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        } else position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+}
+void AsyncPacketFileLogger::Commit(QueueSlot* slot, uint32_t position) {
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // The writer thread wakes by itself every PACKET_LOG_WRITER_SLEEP_MS. Only hurry it once the queue starts filling
+    if (sleeping.load(std::memory_order_relaxed)
+        && position - dequeuePosition.load(std::memory_order_relaxed) >= ASYNC_PACKET_LOGGER_QUEUE_RECORDS / 4
+        && wakePending.exchange(true) == false)
+        writerEvent.SetEvent();
+}
+void AsyncPacketFileLogger::QueueText(
+    PacketLogRecordType  type,
+    uint64_t             time,
+    const SystemAddress& local,
+    const SystemAddress& remote,
+    BitSize_t            bitLength,
+    const char*          text
+) {
+    char   cutText[PACKET_LOG_MAX_TEXT_LENGTH + 1];
+    size_t length = strlen(text);
+    if (length > PACKET_LOG_MAX_TEXT_LENGTH) {
+        memcpy(cutText, text, PACKET_LOG_MAX_TEXT_LENGTH - 3);
+        strcpy(cutText + PACKET_LOG_MAX_TEXT_LENGTH - 3, "...");
+        text   = cutText;
+        length = PACKET_LOG_MAX_TEXT_LENGTH;
+    }
+
+    // With the terminator
+    uint32_t count = (uint32_t)((length + PACKET_LOG_TEXT_CHUNK) / PACKET_LOG_TEXT_CHUNK);
+    uint32_t position;
+    if (Reserve(position, count) == 0) return;
+    for (uint32_t i = 0; i < count; i++) {
+        QueueSlot* slot = &queue[(position + i) & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)];
+        if (i == 0) {
+            InitRecord(slot->record, type, time, local, remote);
+            slot->record.bitLength = bitLength;
+            slot->record.frame     = count - 1;
+        } else
+            InitRecord(
+                slot->record,
+                PACKET_LOG_TEXT_CONTINUATION,
+                time,
+                UNASSIGNED_SYSTEM_ADDRESS,
+                UNASSIGNED_SYSTEM_ADDRESS
+            );
+        size_t offset = i * PACKET_LOG_TEXT_CHUNK;
+        size_t bytes  = length - offset < PACKET_LOG_TEXT_CHUNK ? length - offset : PACKET_LOG_TEXT_CHUNK;
+        memcpy(slot->record.text, text + offset, bytes);
+        if (bytes < PACKET_LOG_TEXT_CHUNK) slot->record.text[bytes] = 0;
+        Commit(slot, position + i);
+    }
+}
+RAK_THREAD_DECLARATION(RakNet::AsyncPacketFileLogger::WriteLoop) {
+    AsyncPacketFileLogger* logger = (AsyncPacketFileLogger*)arguments;
+    PacketLogRecord        batch[PACKET_LOG_BATCH_RECORDS];
+    uint32_t               droppedWritten = 0;
+
+    while (1) {
+        uint32_t dropped = logger->droppedRecords.load(std::memory_order_relaxed);
+        if (dropped != droppedWritten) {
+            PacketLogRecord record;
+            InitRecord(
+                record,
+                PACKET_LOG_DROPPED,
+                RakNet::GetTimeMS(),
+                UNASSIGNED_SYSTEM_ADDRESS,
+                UNASSIGNED_SYSTEM_ADDRESS
+            );
+            record.reliableMessageNumber = dropped - droppedWritten;
+            fwrite(&record, sizeof(record), 1, logger->packetLogFile);
+            droppedWritten = dropped;
+        }
+
+        uint32_t     position = logger->dequeuePosition.load(std::memory_order_relaxed);
+        unsigned int count    = 0;
+        for (; count < PACKET_LOG_BATCH_RECORDS; count++, position++) {
+            QueueSlot* slot = &logger->queue[position & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)];
+            if (slot->sequence.load(std::memory_order_acquire) != position + 1) break;
+            batch[count] = slot->record;
+            slot->sequence.store(position + ASYNC_PACKET_LOGGER_QUEUE_RECORDS, std::memory_order_release);
+        }
+        logger->dequeuePosition.store(position, std::memory_order_relaxed);
+        if (count > 0) {
+            fwrite(batch, sizeof(PacketLogRecord), count, logger->packetLogFile);
+            continue;
+        }
+
+        // Only stops once the queue is empty
+        if (logger->running == false) break;
+
+        fflush(logger->packetLogFile);
+        logger->sleeping    = true;
+        logger->wakePending = false;
+        QueueSlot* next     = &logger->queue[position & (ASYNC_PACKET_LOGGER_QUEUE_RECORDS - 1)];
+        if (next->sequence.load() != position + 1 && logger->running)
+            logger->writerEvent.WaitOnEvent(PACKET_LOG_WRITER_SLEEP_MS);
+        logger->sleeping = false;
+    }
+
+    fflush(logger->packetLogFile);
+    logger->active = false;
+    return 0;
+}
+void AsyncPacketFileLogger::OnDirectSocketSend(
+    const char*     data,
+    const BitSize_t bitsUsed,
+    SystemAddress   remoteSystemAddress
+) {
+    if (logDirectMessages == false || running.load(std::memory_order_acquire) == false
+        || IsLogged(remoteSystemAddress) == false)
+        return;
+
+    uint32_t   position;
+    QueueSlot* slot = Reserve(position);
+    if (slot == 0) return;
+    InitRecord(
+        slot->record,
+        PACKET_LOG_RAW_SEND,
+        RakNet::GetTimeMS(),
+        mRakPeerInterface->GetExternalID(remoteSystemAddress),
+        remoteSystemAddress
+    );
+    slot->record.messageIdentifier = data[0];
+    slot->record.bitLength         = bitsUsed;
+    Commit(slot, position);
+}
+void AsyncPacketFileLogger::OnDirectSocketReceive(
+    const char*     data,
+    const BitSize_t bitsUsed,
+    SystemAddress   remoteSystemAddress
+) {
+    if (logDirectMessages == false || running.load(std::memory_order_acquire) == false
+        || IsLogged(remoteSystemAddress) == false)
+        return;
+
+    uint32_t   position;
+    QueueSlot* slot = Reserve(position);
+    if (slot == 0) return;
+    InitRecord(
+        slot->record,
+        PACKET_LOG_RAW_RECEIVE,
+        RakNet::GetTime(),
+        mRakPeerInterface->GetInternalID(UNASSIGNED_SYSTEM_ADDRESS),
+        remoteSystemAddress
+    );
+    slot->record.messageIdentifier = data[0];
+    slot->record.bitLength         = bitsUsed;
+    Commit(slot, position);
+}
+void AsyncPacketFileLogger::OnReliabilityLayerNotification(
+    const char*     errorMessage,
+    const BitSize_t bitsUsed,
+    SystemAddress   remoteSystemAddress,
+    bool            isError
+) {
+    RakAssert(isError == false);
+    if (running.load(std::memory_order_acquire) == false || IsLogged(remoteSystemAddress) == false) return;
+
+    QueueText(
+        isError ? PACKET_LOG_RELIABILITY_ERROR : PACKET_LOG_RELIABILITY_WARNING,
+        RakNet::GetTime(),
+        mRakPeerInterface->GetInternalID(UNASSIGNED_SYSTEM_ADDRESS),
+        remoteSystemAddress,
+        bitsUsed,
+        errorMessage
+    );
+}
+void AsyncPacketFileLogger::OnInternalPacket(
+    InternalPacket* internalPacket,
+    unsigned        frameNumber,
+    SystemAddress   remoteSystemAddress,
+    RakNet::TimeMS  time,
+    int             isSend
+) {
+    if (running.load(std::memory_order_acquire) == false || IsLogged(remoteSystemAddress) == false) return;
+
+    uint32_t   position;
+    QueueSlot* slot = Reserve(position);
+    if (slot == 0) return;
+    PacketLogRecord& record = slot->record;
+    InitRecord(
+        record,
+        PACKET_LOG_INTERNAL_PACKET,
+        time,
+        mRakPeerInterface->GetExternalID(remoteSystemAddress),
+        remoteSystemAddress
+    );
+    if (internalPacket->reliability == UNRELIABLE || internalPacket->reliability == UNRELIABLE_SEQUENCED
+        || internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
+        record.reliableMessageNumber = (unsigned int)-1;
+    else record.reliableMessageNumber = internalPacket->reliableMessageNumber;
+    record.frame            = frameNumber;
+    record.bitLength        = internalPacket->dataBitLength;
+    record.splitPacketId    = internalPacket->splitPacketId;
+    record.splitPacketIndex = internalPacket->splitPacketIndex;
+    record.splitPacketCount = internalPacket->splitPacketCount;
+    record.orderingIndex    = internalPacket->orderingIndex;
+    record.isSend           = (uint8_t)isSend;
+    if (internalPacket->data[0] == ID_TIMESTAMP) {
+        record.timestamped       = 1;
+        record.messageIdentifier = internalPacket->data[1 + sizeof(RakNet::Time)];
+    } else record.messageIdentifier = internalPacket->data[0];
+    Commit(slot, position);
+}
+void AsyncPacketFileLogger::OnAck(unsigned int messageNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time) {
+    if (running.load(std::memory_order_acquire) == false || IsLogged(remoteSystemAddress) == false) return;
+
+    uint32_t   position;
+    QueueSlot* slot = Reserve(position);
+    if (slot == 0) return;
+    InitRecord(
+        slot->record,
+        PACKET_LOG_ACK,
+        time,
+        mRakPeerInterface->GetExternalID(remoteSystemAddress),
+        remoteSystemAddress
+    );
+    slot->record.reliableMessageNumber = messageNumber;
+    Commit(slot, position);
+}
+void AsyncPacketFileLogger::OnPushBackPacket(
+    const char*     data,
+    const BitSize_t bitsUsed,
+    SystemAddress   remoteSystemAddress
+) {
+    if (running.load(std::memory_order_acquire) == false || IsLogged(remoteSystemAddress) == false) return;
+
+    uint32_t   position;
+    QueueSlot* slot = Reserve(position);
+    if (slot == 0) return;
+    InitRecord(
+        slot->record,
+        PACKET_LOG_PUSH_BACK,
+        RakNet::GetTimeMS(),
+        mRakPeerInterface->GetExternalID(remoteSystemAddress),
+        remoteSystemAddress
+    );
+    slot->record.messageIdentifier = data[0];
+    slot->record.bitLength         = bitsUsed;
+    Commit(slot, position);
+}
+void AsyncPacketFileLogger::AddToLog(const char* str) {
+    if (running.load(std::memory_order_acquire) == false) return;
+
+    QueueText(PACKET_LOG_TEXT, RakNet::GetTimeMS(), UNASSIGNED_SYSTEM_ADDRESS, UNASSIGNED_SYSTEM_ADDRESS, 0, str);
+}
+bool AsyncPacketFileLogger::WriteTextLog(FILE* binaryLog, FILE* out) {
+    const char* sendTypes[] = {
+        "Rcv",
+        "Snd",
+        "Err1",
+        "Err2",
+        "Err3",
+        "Err4",
+        "Err5",
+        "Err6",
+    };
+
+    PacketLogFileHeader header;
+    if (fread(&header, sizeof(header), 1, binaryLog) != 1 || header.magic != PACKET_LOG_MAGIC
+        || header.version != PACKET_LOG_VERSION || header.recordSize != sizeof(PacketLogRecord))
+        return false;
+
+    // What LogHeader() writes through PacketFileLogger::WriteLog()
+    fprintf(
+        out,
+        "%s\n",
+        "Clock,S|R,Typ,Reliable#,Frm #,PktID,BitLn,Time     ,Local IP:Port   "
+        ",RemoteIP:Port,SPID,SPIN,SPCO,OI,Suffix,Miscellaneous\n"
+    );
+
+    PacketLogRecord record;
+    char            text[PACKET_LOG_MAX_TEXT_LENGTH + 1];
+    while (fread(&record, sizeof(record), 1, binaryLog) == 1) {
+        if (record.type == PACKET_LOG_RELIABILITY_ERROR || record.type == PACKET_LOG_RELIABILITY_WARNING
+            || record.type == PACKET_LOG_TEXT)
+            ReadRecordText(binaryLog, record, text);
+
+        SystemAddress local, remote;
+        GetRecordAddress(local, record.localAddress, record.localPort, record.localIPVersion);
+        GetRecordAddress(remote, record.remoteAddress, record.remotePort, record.remoteIPVersion);
+        char str1[64], str2[62];
+        local.ToString(true, str1);
+        remote.ToString(true, str2);
+        char localtime[128];
+        GetLocalTime(localtime);
+
+        // Room for the longest text and the rest of the line
+        char str[PACKET_LOG_MAX_TEXT_LENGTH + 1024];
+        switch (record.type) {
+        case PACKET_LOG_RAW_SEND:
+        case PACKET_LOG_RAW_RECEIVE:
+            FormatLine(
+                str,
+                record.type == PACKET_LOG_RAW_SEND ? "Snd" : "Rcv",
+                "Raw",
+                0,
+                0,
+                record.messageIdentifier,
+                record.bitLength,
+                record.time,
+                local,
+                remote,
+                (unsigned int)-1,
+                (unsigned int)-1,
+                (unsigned int)-1,
+                (unsigned int)-1
+            );
+            break;
+        case PACKET_LOG_INTERNAL_PACKET:
+            FormatLine(
+                str,
+                sendTypes[record.isSend & 7],
+                record.timestamped ? "Tms" : "Nrm",
+                record.reliableMessageNumber,
+                record.frame,
+                record.messageIdentifier,
+                record.bitLength,
+                record.time,
+                local,
+                remote,
+                record.splitPacketId,
+                record.splitPacketIndex,
+                record.splitPacketCount,
+                record.orderingIndex
+            );
+            break;
+        case PACKET_LOG_ACK:
+            sprintf(
+                str,
+                "%s,Rcv,Ack,%i,,,,%" PRINTF_64_BIT_MODIFIER "u,%s,%s,,,,,,",
+                localtime,
+                record.reliableMessageNumber,
+                (unsigned long long)record.time,
+                str1,
+                str2
+            );
+            break;
+        case PACKET_LOG_PUSH_BACK:
+            sprintf(
+                str,
+                "%s,Lcl,PBP,,,%s,%i,%" PRINTF_64_BIT_MODIFIER "u,%s,%s,,,,,,",
+                localtime,
+                IDTOString(record.messageIdentifier),
+                record.bitLength,
+                (unsigned long long)record.time,
+                str1,
+                str2
+            );
+            break;
+        case PACKET_LOG_RELIABILITY_ERROR:
+        case PACKET_LOG_RELIABILITY_WARNING:
+            FormatLine(
+                str,
+                record.type == PACKET_LOG_RELIABILITY_ERROR ? "RcvErr" : "RcvWrn",
+                text,
+                0,
+                0,
+                "",
+                record.bitLength,
+                record.time,
+                local,
+                remote,
+                (unsigned int)-1,
+                (unsigned int)-1,
+                (unsigned int)-1,
+                (unsigned int)-1
+            );
+            break;
+        case PACKET_LOG_TEXT:
+            strcpy(str, text);
+            break;
+        case PACKET_LOG_DROPPED:
+            sprintf(
+                str,
+                "%s,Lcl,Dropped,,,,,%" PRINTF_64_BIT_MODIFIER "u,,,,,,,,%u records dropped",
+                localtime,
+                (unsigned long long)record.time,
+                record.reliableMessageNumber
+            );
+            break;
+        default:
+            continue;
+        }
+        fprintf(out, "%s\n", str);
+    }
+    return true;
+}
+
+#endif // _RAKNET_SUPPORT_*
@@ -17,6 +17,8 @@
 #else
 
 #include "BitStream.h"
+#include "BitStreamArena.h"
+#include <bit>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +50,14 @@
 #define _copysign copysign
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITSTREAM_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BITSTREAM_NEON 1
+#endif
+
 using namespace RakNet;
 
 #ifdef _MSC_VER
@@ -69,6 +79,7 @@ BitStream::BitStream() {
 #endif
     // memset(data, 0, 32);
     copyData = true;
+    arena    = 0;
 }
 
 BitStream::BitStream(const unsigned int initialBytesToAllocate) {
@@ -86,6 +97,7 @@ BitStream::BitStream(const unsigned int initialBytesToAllocate) {
 #endif
     // memset(data, 0, initialBytesToAllocate);
     copyData = true;
+    arena    = 0;
 }
 
 BitStream::BitStream(unsigned char* _data, const unsigned int lengthInBytes, bool _copyData) {
@@ -93,6 +105,7 @@ BitStream::BitStream(unsigned char* _data, const unsigned int lengthInBytes, boo
     readOffset            = 0;
     copyData              = _copyData;
     numberOfBitsAllocated = lengthInBytes << 3;
+    arena                 = 0;
 
     if (copyData) {
         if (lengthInBytes > 0) {
@@ -120,7 +133,7 @@ void BitStream::SetNumberOfBitsAllocated(const BitSize_t lengthInBits) {
 }
 
 BitStream::~BitStream() {
-    if (copyData && numberOfBitsAllocated > (BITSTREAM_STACK_ALLOCATION_SIZE << 3))
+    if (copyData && arena == 0 && data != (unsigned char*)stackData)
         rakFree_Ex(
             data,
             _FILE_AND_LINE_
@@ -348,6 +361,65 @@ bool BitStream::ReadAlignedBytesSafeAlloc(
     return ReadAlignedBytes((unsigned char*)*outByteArray, inputLength);
 }
 
+static inline uint64_t Load64BE(const unsigned char* p) {
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+         | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+static inline void Store64BE(unsigned char* p, uint64_t v) {
+    p[0] = (unsigned char)(v >> 56);
+    p[1] = (unsigned char)(v >> 48);
+    p[2] = (unsigned char)(v >> 40);
+    p[3] = (unsigned char)(v >> 32);
+    p[4] = (unsigned char)(v >> 24);
+    p[5] = (unsigned char)(v >> 16);
+    p[6] = (unsigned char)(v >> 8);
+    p[7] = (unsigned char)v;
+}
+
+// out[i] = (in[i] << shift) | (in[i + 1] >> (8 - shift)) for i in [0, count), with shift in 1..7. Reads count + 1
+// bytes of in. Unaligned reads shift by the read offset, unaligned writes by 8 minus the write offset
+static void ShiftBytesLeft(unsigned char* out, const unsigned char* in, size_t count, unsigned int shift) {
+#if defined(BITSTREAM_SSE2)
+    // SSE2 has no byte shifts, so shift 16 bit lanes and mask off what crossed into the neighbouring byte
+    const __m128i highMask = _mm_set1_epi8((char)(unsigned char)(0xFF << shift));
+    const __m128i lowMask  = _mm_set1_epi8((char)(unsigned char)(0xFF >> (8 - shift)));
+    const __m128i leftBy   = _mm_cvtsi32_si128((int)shift);
+    const __m128i rightBy  = _mm_cvtsi32_si128((int)(8 - shift));
+    while (count >= 16) {
+        __m128i current = _mm_loadu_si128((const __m128i*)in);
+        __m128i next    = _mm_loadu_si128((const __m128i*)(in + 1));
+        __m128i high    = _mm_and_si128(_mm_sll_epi16(current, leftBy), highMask);
+        __m128i low     = _mm_and_si128(_mm_srl_epi16(next, rightBy), lowMask);
+        _mm_storeu_si128((__m128i*)out, _mm_or_si128(high, low));
+        in    += 16;
+        out   += 16;
+        count -= 16;
+    }
+#elif defined(BITSTREAM_NEON)
+    const int8x16_t leftBy  = vdupq_n_s8((int8_t)shift);
+    const int8x16_t rightBy = vdupq_n_s8((int8_t)shift - 8);
+    while (count >= 16) {
+        uint8x16_t high = vshlq_u8(vld1q_u8(in), leftBy);
+        uint8x16_t low  = vshlq_u8(vld1q_u8(in + 1), rightBy);
+        vst1q_u8(out, vorrq_u8(high, low));
+        in    += 16;
+        out   += 16;
+        count -= 16;
+    }
+#endif
+    while (count >= 8) {
+        Store64BE(out, (Load64BE(in) << shift) | (uint64_t)(in[8] >> (8 - shift)));
+        in    += 8;
+        out   += 8;
+        count -= 8;
+    }
+    while (count > 0) {
+        *out++ = (unsigned char)((in[0] << shift) | (in[1] >> (8 - shift)));
+        in++;
+        count--;
+    }
+}
+
 // Write numberToWrite bits from the input source
 void BitStream::WriteBits(
     const unsigned char* inByteArray,
@@ -368,46 +440,46 @@ void BitStream::WriteBits(
         return;
     }
 
-    unsigned char        dataByte;
-    const unsigned char* inputPtr = inByteArray;
-
-    // Faster to put the while at the top surprisingly enough
-    while (numberOfBitsToWrite > 0)
-    // do
-    {
-        dataByte = *(inputPtr++);
-
-        if (numberOfBitsToWrite < 8
-            && rightAlignedBits) // rightAlignedBits means in the case of a partial byte, the bits are aligned from the
-                                 // right (bit 0) rather than the left (as in the normal internal representation)
-            dataByte <<=
-                8 - numberOfBitsToWrite; // shift left to get the bits on the left, as in our internal representation
-
-        // Writing to a new byte each time
-        if (numberOfBitsUsedMod8 == 0) *(data + (numberOfBitsUsed >> 3)) = dataByte;
-        else {
-            // Copy over the new data.
-            *(data + (numberOfBitsUsed >> 3)) |= dataByte >> (numberOfBitsUsedMod8); // First half
-
-            if (8 - (numberOfBitsUsedMod8) < 8
-                && 8 - (numberOfBitsUsedMod8)
-                       < numberOfBitsToWrite) // If we didn't write it all out in the first half (8 -
-                                              // (numberOfBitsUsed%8) is the number we wrote in the first half)
-            {
-                *(data + (numberOfBitsUsed >> 3) + 1) =
-                    (unsigned char)(dataByte << (8 - (numberOfBitsUsedMod8))); // Second half (overlaps byte boundary)
-            }
-        }
-
-        if (numberOfBitsToWrite >= 8) {
-            numberOfBitsUsed    += 8;
-            numberOfBitsToWrite -= 8;
-        } else {
-            numberOfBitsUsed    += numberOfBitsToWrite;
-            numberOfBitsToWrite  = 0;
-        }
+    unsigned char*     dest       = data + (numberOfBitsUsed >> 3);
+    const BitSize_t    wholeBytes = numberOfBitsToWrite >> 3;
+    const unsigned int tailBits   = (unsigned int)(numberOfBitsToWrite & 7);
+    // The partial last byte, moved to the high bits as in our internal representation, with the unused bits cleared
+    unsigned char      tailByte   = 0;
+    if (tailBits != 0) {
+        tailByte = inByteArray[wholeBytes];
+        if (rightAlignedBits) tailByte = (unsigned char)(tailByte << (8 - tailBits));
+        tailByte &= (unsigned char)(0xFF << (8 - tailBits));
+    }
+    // Bits already written to the first byte
+    const unsigned char keptBits = (unsigned char)(*dest & ~(0xFF >> numberOfBitsUsedMod8));
+
+    if (numberOfBitsToWrite <= 8) {
+        // Flags and small enums, the most common case, touch at most two bytes
+        const unsigned char inputByte   = wholeBytes ? inByteArray[0] : tailByte;
+        const unsigned int  accumulator = ((unsigned int)keptBits << 8)
+                                       | ((unsigned int)inputByte << (8 - numberOfBitsUsedMod8));
+        dest[0] = (unsigned char)(accumulator >> 8);
+        if (numberOfBitsUsedMod8 + numberOfBitsToWrite > 8) dest[1] = (unsigned char)accumulator;
+    } else if (numberOfBitsToWrite <= 56) {
+        // Fits in one accumulator along with up to 7 bits of offset, most significant bit first
+        uint64_t accumulator = 0;
+        for (BitSize_t i = 0; i < wholeBytes; i++) accumulator |= (uint64_t)inByteArray[i] << (56 - 8 * i);
+        accumulator  |= (uint64_t)tailByte << (56 - 8 * wholeBytes);
+        accumulator >>= numberOfBitsUsedMod8;
+        accumulator  |= (uint64_t)keptBits << 56;
+        const BitSize_t destBytes = BITS_TO_BYTES(numberOfBitsUsedMod8 + numberOfBitsToWrite);
+        for (BitSize_t i = 0; i < destBytes; i++) dest[i] = (unsigned char)(accumulator >> (56 - 8 * i));
+    } else if (numberOfBitsUsedMod8 == 0) {
+        memcpy(dest, inByteArray, (size_t)wholeBytes);
+        dest[wholeBytes] = tailByte;
+    } else {
+        const unsigned int shift = 8 - (unsigned int)numberOfBitsUsedMod8;
+        dest[0]                  = (unsigned char)(keptBits | (inByteArray[0] >> numberOfBitsUsedMod8));
+        ShiftBytesLeft(dest + 1, inByteArray, (size_t)wholeBytes - 1, shift);
+        dest[wholeBytes] = (unsigned char)((inByteArray[wholeBytes - 1] << shift) | (tailByte >> numberOfBitsUsedMod8));
+        if (numberOfBitsUsedMod8 + tailBits > 8) dest[wholeBytes + 1] = (unsigned char)(tailByte << shift);
     }
-    // } while(numberOfBitsToWrite>0);
+    numberOfBitsUsed += numberOfBitsToWrite;
 }
 
 // Set the stream to some initial data.  For internal use
@@ -491,41 +563,40 @@ bool BitStream::ReadBits(unsigned char* inOutByteArray, BitSize_t numberOfBitsTo
         return true;
     }
 
-
-    BitSize_t offset = 0;
-
-    memset(inOutByteArray, 0, (size_t)BITS_TO_BYTES(numberOfBitsToRead));
-
-    while (numberOfBitsToRead > 0) {
-        *(inOutByteArray + offset) |= *(data + (readOffset >> 3)) << (readOffsetMod8); // First half
-
-        if (readOffsetMod8 > 0
-            && numberOfBitsToRead
-                   > 8 - (readOffsetMod8)) // If we have a second half, we didn't read enough bytes in the first half
-            *(inOutByteArray + offset) |=
-                *(data + (readOffset >> 3) + 1) >> (8 - (readOffsetMod8)); // Second half (overlaps byte boundary)
-
-        if (numberOfBitsToRead >= 8) {
-            numberOfBitsToRead -= 8;
-            readOffset         += 8;
-            offset++;
-        } else {
-            int neg = (int)numberOfBitsToRead - 8;
-
-            if (neg < 0) // Reading a partial byte for the last byte, shift right so the data is aligned on the right
-            {
-
-                if (alignBitsToRight) *(inOutByteArray + offset) >>= -neg;
-
-                readOffset += 8 + neg;
-            } else readOffset += 8;
-
-            offset++;
-
-            numberOfBitsToRead = 0;
+    const unsigned char* source      = data + (readOffset >> 3);
+    const BitSize_t      wholeBytes  = numberOfBitsToRead >> 3;
+    const unsigned int   tailBits    = (unsigned int)(numberOfBitsToRead & 7);
+    // Only bytes holding bits inside the read are touched
+    const BitSize_t      sourceBytes = BITS_TO_BYTES(readOffsetMod8 + numberOfBitsToRead);
+    unsigned char        tailByte    = 0;
+
+    if (numberOfBitsToRead <= 56) {
+        // Fits in one accumulator along with up to 7 bits of offset, most significant bit first
+        uint64_t accumulator = 0;
+        for (BitSize_t i = 0; i < sourceBytes; i++) accumulator |= (uint64_t)source[i] << (56 - 8 * i);
+        accumulator <<= readOffsetMod8;
+        for (BitSize_t i = 0; i < wholeBytes; i++) inOutByteArray[i] = (unsigned char)(accumulator >> (56 - 8 * i));
+        tailByte = (unsigned char)(accumulator >> (56 - 8 * wholeBytes));
+    } else if (readOffsetMod8 == 0) {
+        memcpy(inOutByteArray, source, (size_t)wholeBytes);
+        if (tailBits != 0) tailByte = source[wholeBytes];
+    } else {
+        ShiftBytesLeft(inOutByteArray, source, (size_t)wholeBytes, (unsigned int)readOffsetMod8);
+        if (tailBits != 0) {
+            tailByte = (unsigned char)(source[wholeBytes] << readOffsetMod8);
+            if (sourceBytes > wholeBytes + 1)
+                tailByte |= (unsigned char)(source[wholeBytes + 1] >> (8 - readOffsetMod8));
         }
     }
 
+    if (tailBits != 0) {
+        // Reading a partial byte for the last byte, shift right so the data is aligned on the right
+        tailByte &= (unsigned char)(0xFF << (8 - tailBits));
+        if (alignBitsToRight) tailByte >>= 8 - tailBits;
+        inOutByteArray[wholeBytes] = tailByte;
+    }
+
+    readOffset += numberOfBitsToRead;
     return true;
 }
 
@@ -592,6 +663,69 @@ bool BitStream::ReadCompressed(unsigned char* inOutByteArray, const unsigned int
     return true;
 }
 
+// Unsigned LEB128: 7 bits per byte, least significant group first, high bit set on all but the last byte
+void BitStream::WriteVarInt64(uint64_t value) {
+    unsigned char encoded[10];
+    unsigned int  length = 0;
+    while (value >= 0x80) {
+        encoded[length++]   = (unsigned char)(value | 0x80);
+        value             >>= 7;
+    }
+    encoded[length++] = (unsigned char)value;
+    WriteBits(encoded, length * 8, true);
+}
+
+bool BitStream::ReadVarInt64(uint64_t& value, const unsigned int maxBytes) {
+    const unsigned char* source         = data + (readOffset >> 3);
+    const unsigned int   readOffsetMod8 = (unsigned int)(readOffset & 7);
+
+    if (readOffset + 64 <= numberOfBitsUsed) {
+        // Load the next 8 stream bytes at once, the first in the low byte, and find the terminator without branching
+        // per byte. When unaligned, source[8] is still inside the stream
+        uint64_t word = Load64BE(source);
+        if (readOffsetMod8 != 0) word = (word << readOffsetMod8) | (uint64_t)(source[8] >> (8 - readOffsetMod8));
+        word = std::byteswap(word);
+
+        const uint64_t terminators = ~word & 0x8080808080808080ULL;
+        if (terminators != 0) {
+            const unsigned int length = ((unsigned int)std::countr_zero(terminators) >> 3) + 1;
+            if (length > maxBytes) return false;
+            if (length < 8) word &= ((uint64_t)1 << (length * 8)) - 1;
+
+            // Drop the continuation bits and close the gaps, doubling the group width each step
+            word &= 0x7F7F7F7F7F7F7F7FULL;
+            word  = (word & 0x007F007F007F007FULL) | ((word & 0x7F007F007F007F00ULL) >> 1);
+            word  = (word & 0x00003FFF00003FFFULL) | ((word & 0x3FFF00003FFF0000ULL) >> 2);
+            word  = (word & 0x000000000FFFFFFFULL) | ((word & 0x0FFFFFFF00000000ULL) >> 4);
+
+            value       = word;
+            readOffset += length * 8;
+            return true;
+        }
+        // Longer than 8 bytes, only possible for values of 57 bits or more
+    }
+
+    uint64_t  result = 0;
+    BitSize_t offset = readOffset;
+    for (unsigned int i = 0; i < maxBytes; i++) {
+        if (offset + 8 > numberOfBitsUsed) return false;
+        const unsigned char* byte    = data + (offset >> 3);
+        unsigned char        encoded = (unsigned char)(byte[0] << readOffsetMod8);
+        if (readOffsetMod8 != 0) encoded |= (unsigned char)(byte[1] >> (8 - readOffsetMod8));
+        // The tenth byte only has room for the top bit of a 64 bit value
+        if (i == 9 && (encoded & 0x7F) > 1) return false;
+
+        result |= (uint64_t)(encoded & 0x7F) << (7 * i);
+        offset += 8;
+        if ((encoded & 0x80) == 0) {
+            value      = result;
+            readOffset = offset;
+            return true;
+        }
+    }
+    return false;
+}
+
 // Reallocates (if necessary) in preparation of writing numberOfBitsToWrite
 void BitStream::AddBitsAndReallocate(const BitSize_t numberOfBitsToWrite) {
     BitSize_t newNumberOfBitsAllocated = numberOfBitsToWrite + numberOfBitsUsed;
@@ -613,30 +747,61 @@ void BitStream::AddBitsAndReallocate(const BitSize_t numberOfBitsToWrite) {
         if (newNumberOfBitsAllocated - (numberOfBitsToWrite + numberOfBitsUsed) > 1048576)
             newNumberOfBitsAllocated = numberOfBitsToWrite + numberOfBitsUsed + 1048576;
 
-        //		BitSize_t newByteOffset = BITS_TO_BYTES( numberOfBitsAllocated );
-        // Use realloc and free so we are more efficient than delete and new for resizing
-        BitSize_t amountToAllocate = BITS_TO_BYTES(newNumberOfBitsAllocated);
-        if (data == (unsigned char*)stackData) {
-            if (amountToAllocate > BITSTREAM_STACK_ALLOCATION_SIZE) {
-                data = (unsigned char*)rakMalloc_Ex((size_t)amountToAllocate, _FILE_AND_LINE_);
-                RakAssert(data);
-
-                // need to copy the stack data over to our new memory area too
-                memcpy((void*)data, (void*)stackData, (size_t)BITS_TO_BYTES(numberOfBitsAllocated));
-            }
-        } else {
-            data = (unsigned char*)rakRealloc_Ex(data, (size_t)amountToAllocate, _FILE_AND_LINE_);
-        }
+        Reallocate(newNumberOfBitsAllocated);
 
 #ifdef _DEBUG
         RakAssert(data); // Make sure realloc succeeded
 #endif
-        //  memset(data+newByteOffset, 0,  ((newNumberOfBitsAllocated-1)>>3) - ((numberOfBitsAllocated-1)>>3)); // Set
-        //  the new data block to 0
     }
 
     if (newNumberOfBitsAllocated > numberOfBitsAllocated) numberOfBitsAllocated = newNumberOfBitsAllocated;
 }
+void BitStream::Reserve(const BitSize_t numberOfBitsToWrite) {
+    BitSize_t newNumberOfBitsAllocated = numberOfBitsUsed + numberOfBitsToWrite;
+    if (BITS_TO_BYTES(newNumberOfBitsAllocated) <= BITS_TO_BYTES(numberOfBitsAllocated)) return;
+
+    RakAssert(copyData == true);
+    Reallocate(newNumberOfBitsAllocated);
+    if (newNumberOfBitsAllocated > numberOfBitsAllocated) numberOfBitsAllocated = newNumberOfBitsAllocated;
+}
+void BitStream::Reallocate(const BitSize_t newNumberOfBitsAllocated) {
+    // Use realloc and free so we are more efficient than delete and new for resizing
+    BitSize_t amountToAllocate = BITS_TO_BYTES(newNumberOfBitsAllocated);
+    if (data == (unsigned char*)stackData) {
+        if (amountToAllocate > BITSTREAM_STACK_ALLOCATION_SIZE) {
+            if (arena) data = (unsigned char*)arena->Allocate((size_t)amountToAllocate);
+            else data = (unsigned char*)rakMalloc_Ex((size_t)amountToAllocate, _FILE_AND_LINE_);
+            RakAssert(data);
+
+            // need to copy the stack data over to our new memory area too
+            memcpy((void*)data, (void*)stackData, (size_t)BITS_TO_BYTES(numberOfBitsAllocated));
+        }
+    } else if (arena) {
+        data = (unsigned char*)arena->Reallocate(
+            data,
+            (size_t)BITS_TO_BYTES(numberOfBitsAllocated),
+            (size_t)amountToAllocate
+        );
+    } else {
+        data = (unsigned char*)rakRealloc_Ex(data, (size_t)amountToAllocate, _FILE_AND_LINE_);
+    }
+}
+void BitStream::SetArena(BitStreamArena* _arena) {
+    RakAssert(copyData == true);
+    if (_arena == arena) return;
+
+    if (data != (unsigned char*)stackData) {
+        // Storage from the old owner can't be grown or freed by the new one, so move what was written
+        size_t         bytesAllocated = (size_t)BITS_TO_BYTES(numberOfBitsAllocated);
+        unsigned char* newData;
+        if (_arena) newData = (unsigned char*)_arena->Allocate(bytesAllocated);
+        else newData = (unsigned char*)rakMalloc_Ex(bytesAllocated, _FILE_AND_LINE_);
+        if (data) memcpy(newData, data, (size_t)BITS_TO_BYTES(numberOfBitsUsed));
+        if (arena == 0) rakFree_Ex(data, _FILE_AND_LINE_);
+        data = newData;
+    }
+    arena = _arena;
+}
 BitSize_t BitStream::GetNumberOfBitsAllocated(void) const { return numberOfBitsAllocated; }
 void      BitStream::PadWithZeroToByteLength(unsigned int bytes) {
     if (GetNumberOfBytesUsed() < bytes) {
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "BitStreamArena.h"
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include "RakNetDefines.h"
+#include <string.h>
+
+using namespace RakNet;
+
+// Allocations are rounded up to this so every stream starts on a word boundary
+static const size_t ARENA_ALIGNMENT = 16;
+
+static inline size_t AlignArenaSize(size_t numberOfBytes) {
+    return (numberOfBytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+BitStreamArena::BitStreamArena(size_t initialBytesToAllocate) {
+    blocks               = 0;
+    blockOffset          = 0;
+    lastAllocation       = 0;
+    initialBlockSize     = initialBytesToAllocate ? initialBytesToAllocate : BITSTREAM_ARENA_BLOCK_SIZE;
+    bytesUsed            = 0;
+    bytesAllocated       = 0;
+    blockAllocationCount = 0;
+    if (initialBytesToAllocate) AddBlock(initialBytesToAllocate);
+}
+
+BitStreamArena::~BitStreamArena() { Clear(); }
+
+unsigned char* BitStreamArena::GetBlockData(Block* block) {
+    return (unsigned char*)block + AlignArenaSize(sizeof(Block));
+}
+
+void BitStreamArena::AddBlock(size_t minimumCapacity) {
+    // Double each time so a tick that outgrows the arena needs few blocks
+    size_t capacity = blocks ? blocks->capacity * 2 : initialBlockSize;
+    if (capacity < minimumCapacity) capacity = minimumCapacity;
+    capacity = AlignArenaSize(capacity);
+
+    Block* block = (Block*)rakMalloc_Ex(AlignArenaSize(sizeof(Block)) + capacity, _FILE_AND_LINE_);
+    RakAssert(block);
+    block->next      = blocks;
+    block->capacity  = capacity;
+    blocks           = block;
+    blockOffset      = 0;
+    bytesAllocated  += capacity;
+    blockAllocationCount++;
+}
+
+void* BitStreamArena::Allocate(size_t numberOfBytes) {
+    numberOfBytes = AlignArenaSize(numberOfBytes);
+    if (blocks == 0 || blockOffset + numberOfBytes > blocks->capacity) AddBlock(numberOfBytes);
+
+    void* allocation  = GetBlockData(blocks) + blockOffset;
+    blockOffset      += numberOfBytes;
+    bytesUsed        += numberOfBytes;
+    lastAllocation    = allocation;
+    return allocation;
+}
+
+void* BitStreamArena::Reallocate(void* block, size_t oldNumberOfBytes, size_t newNumberOfBytes) {
+    if (block == 0) return Allocate(newNumberOfBytes);
+
+    if (block == lastAllocation) {
+        size_t offset = (size_t)((unsigned char*)block - GetBlockData(blocks));
+        if (offset + AlignArenaSize(newNumberOfBytes) <= blocks->capacity) {
+            bytesUsed   += offset + AlignArenaSize(newNumberOfBytes) - blockOffset;
+            blockOffset  = offset + AlignArenaSize(newNumberOfBytes);
+            return block;
+        }
+    }
+
+    void* allocation = Allocate(newNumberOfBytes);
+    memcpy(allocation, block, oldNumberOfBytes < newNumberOfBytes ? oldNumberOfBytes : newNumberOfBytes);
+    return allocation;
+}
+
+void BitStreamArena::Reset(void) {
+    if (blocks && blocks->next) {
+        // Everything this tick used fits in one block next time
+        size_t capacity = bytesUsed;
+        Clear();
+        AddBlock(capacity);
+    }
+    blockOffset    = 0;
+    bytesUsed      = 0;
+    lastAllocation = 0;
+}
+
+void BitStreamArena::Clear(void) {
+    while (blocks) {
+        Block* next = blocks->next;
+        rakFree_Ex(blocks, _FILE_AND_LINE_);
+        blocks = next;
+    }
+    blockOffset    = 0;
+    bytesUsed      = 0;
+    bytesAllocated = 0;
+    lastAllocation = 0;
+}
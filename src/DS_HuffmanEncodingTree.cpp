@@ -19,7 +19,10 @@
 
 using namespace RakNet;
 
-HuffmanEncodingTree::HuffmanEncodingTree() { root = 0; }
+HuffmanEncodingTree::HuffmanEncodingTree() {
+    root        = 0;
+    decodeTable = 0;
+}
 
 HuffmanEncodingTree::~HuffmanEncodingTree() { FreeMemory(); }
 
@@ -46,7 +49,10 @@ void HuffmanEncodingTree::FreeMemory(void) {
     // Delete the encoding table
     for (int i = 0; i < 256; i++) rakFree_Ex(encodingTable[i].encoding, _FILE_AND_LINE_);
 
-    root = 0;
+    rakFree_Ex(decodeTable, _FILE_AND_LINE_);
+
+    root        = 0;
+    decodeTable = 0;
 }
 
 
@@ -135,6 +141,11 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable(unsigned int frequencyTable
 
         // Write to the bitstream in the reverse order that we stored the path, which gives us the correct order from
         // the root to the leaf
+        encodingTable[counter].code = 0;
+        if (tempPathLength <= 64)
+            for (int i = tempPathLength - 1; i >= 0; i--)
+                encodingTable[counter].code = (encodingTable[counter].code << 1) | (tempPath[i] ? 1 : 0);
+
         while (tempPathLength-- > 0) {
             if (tempPath[tempPathLength]) // Write 1's and 0's because writing a bool will write the BitStream
                                           // TYPE_CHECKING validation bits if that is defined along with the actual data
@@ -150,20 +161,61 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable(unsigned int frequencyTable
         // Reset the bitstream for the next iteration
         bitStream.Reset();
     }
+
+    GenerateDecodeTable();
+}
+
+void HuffmanEncodingTree::GenerateDecodeTable(void) {
+    decodeTable =
+        (DecodeTableEntry*)rakMalloc_Ex(sizeof(DecodeTableEntry) * ((size_t)1 << DECODE_TABLE_BITS), _FILE_AND_LINE_);
+
+    // Follow each possible run of bits down the tree until it reaches a leaf or the run is used up
+    for (unsigned int bits = 0; bits < (1u << DECODE_TABLE_BITS); bits++) {
+        HuffmanEncodingTreeNode* node   = root;
+        unsigned int             length = 0;
+        while (node->left && length < DECODE_TABLE_BITS) {
+            if (bits & (1u << (DECODE_TABLE_BITS - 1 - length))) node = node->right;
+            else node = node->left;
+            length++;
+        }
+
+        DecodeTableEntry& entry = decodeTable[bits];
+        entry.node              = node;
+        entry.value             = node->value;
+        entry.bitLength         = node->left ? 0 : (unsigned char)length;
+    }
+}
+
+// Writes codes packed most significant bit first into \a codes
+static void WriteCodes(RakNet::BitStream* output, uint64_t codes, unsigned int numberOfBits) {
+    unsigned char buffer[8];
+    for (int i = 0; i < 8; i++) buffer[i] = (unsigned char)(codes >> (56 - 8 * i));
+    output->WriteBits(buffer, numberOfBits, false);
 }
 
 // Pass an array of bytes to array and a preallocated BitStream to receive the output
 void HuffmanEncodingTree::EncodeArray(unsigned char* input, size_t sizeInBytes, RakNet::BitStream* output) {
-    unsigned counter;
+    unsigned     counter;
+    uint64_t     codes     = 0;
+    unsigned int codesBits = 0;
 
-    // For each input byte, Write out the corresponding series of 1's and 0's that give the encoded representation
+    // For each input byte, Write out the corresponding series of 1's and 0's that give the encoded representation.
+    // Codes are gathered into a word and written together
     for (counter = 0; counter < sizeInBytes; counter++) {
-        output->WriteBits(
-            encodingTable[input[counter]].encoding,
-            encodingTable[input[counter]].bitLength,
-            false
-        ); // Data is left aligned
+        const CharacterEncoding& character = encodingTable[input[counter]];
+        if (codesBits + character.bitLength > 64) {
+            if (codesBits > 0) WriteCodes(output, codes, codesBits);
+            codes     = 0;
+            codesBits = 0;
+        }
+        if (character.bitLength > 64) {
+            output->WriteBits(character.encoding, character.bitLength, false); // Data is left aligned
+            continue;
+        }
+        codes     |= character.code << (64 - codesBits - character.bitLength);
+        codesBits += character.bitLength;
     }
+    if (codesBits > 0) WriteCodes(output, codes, codesBits);
 
     // Byte align the output so the unassigned remaining bits don't equate to some actual value
     if (output->GetNumberOfBitsUsed() % 8 != 0) {
@@ -186,66 +238,114 @@ void HuffmanEncodingTree::EncodeArray(unsigned char* input, size_t sizeInBytes,
     }
 }
 
+// Reads a range of bits most significant first through a word, never touching bytes past the end of the range
+struct HuffmanBitReader {
+    const unsigned char* nextByte;
+    const unsigned char* lastByte;
+    uint64_t             buffer;
+    unsigned int         bufferedBits;
+    BitSize_t            remaining;
+
+    HuffmanBitReader(const unsigned char* input, BitSize_t bitOffset, BitSize_t numberOfBits) {
+        nextByte     = input + (bitOffset >> 3);
+        lastByte     = input + BITS_TO_BYTES(bitOffset + numberOfBits);
+        buffer       = 0;
+        bufferedBits = 0;
+        remaining    = numberOfBits;
+        Refill();
+        buffer       <<= bitOffset & 7;
+        bufferedBits  -= (unsigned int)(bitOffset & 7);
+    }
+
+    void Refill(void) {
+        while (bufferedBits <= 56 && nextByte < lastByte) {
+            buffer       |= (uint64_t)*nextByte++ << (56 - bufferedBits);
+            bufferedBits += 8;
+        }
+    }
+
+    // Bits past the end of the buffer read as 0
+    unsigned int Peek(unsigned int numberOfBits) const { return (unsigned int)(buffer >> (64 - numberOfBits)); }
+
+    void Consume(unsigned int numberOfBits) {
+        buffer       <<= numberOfBits;
+        bufferedBits  -= numberOfBits;
+        remaining     -= numberOfBits;
+    }
+};
+
+size_t HuffmanEncodingTree::DecodeBits(
+    const unsigned char* input,
+    BitSize_t&           bitOffset,
+    const BitSize_t      endOffset,
+    unsigned char*       output,
+    size_t               outputSize
+) const {
+    HuffmanBitReader reader(input, bitOffset, endOffset - bitOffset);
+    size_t           outputWriteIndex = 0;
+
+    while (outputWriteIndex < outputSize && reader.remaining > 0) {
+        reader.Refill();
+        const DecodeTableEntry& entry = decodeTable[reader.Peek(DECODE_TABLE_BITS)];
+
+        if (entry.bitLength != 0) {
+            // A code that runs past the end is the padding EncodeArray() adds
+            if (entry.bitLength > reader.remaining) break;
+            reader.Consume(entry.bitLength);
+            output[outputWriteIndex++] = entry.value;
+            continue;
+        }
+
+        // Longer than the table, so go on down the tree a bit at a time from where the table ended
+        if (reader.remaining < DECODE_TABLE_BITS) break;
+        reader.Consume(DECODE_TABLE_BITS);
+        HuffmanEncodingTreeNode* node = entry.node;
+        while (node->left && reader.remaining > 0) {
+            reader.Refill();
+            if (reader.Peek(1)) node = node->right;
+            else node = node->left;
+            reader.Consume(1);
+        }
+        if (node->left) break;
+        output[outputWriteIndex++] = node->value;
+    }
+
+    // Whatever is left after a break can't complete a code
+    if (outputWriteIndex < outputSize) bitOffset = endOffset;
+    else bitOffset = endOffset - reader.remaining;
+    return outputWriteIndex;
+}
+
 unsigned HuffmanEncodingTree::DecodeArray(
     RakNet::BitStream* input,
     BitSize_t          sizeInBits,
     size_t             maxCharsToWrite,
     unsigned char*     output
 ) {
-    HuffmanEncodingTreeNode* currentNode;
-
-    unsigned outputWriteIndex;
-    outputWriteIndex = 0;
-    currentNode      = root;
+    if (sizeInBits > input->GetNumberOfUnreadBits()) sizeInBits = input->GetNumberOfUnreadBits();
 
-    // For each bit, go left if it is a 0 and right if it is a 1.  When we reach a leaf, that gives us the desired value
-    // and we restart from the root
+    BitSize_t       bitOffset = input->GetReadOffset();
+    const BitSize_t endOffset = bitOffset + sizeInBits;
+    size_t          decoded   = DecodeBits(input->GetData(), bitOffset, endOffset, output, maxCharsToWrite);
 
-    for (unsigned counter = 0; counter < sizeInBits; counter++) {
-        if (input->ReadBit() == false) // left!
-            currentNode = currentNode->left;
-        else currentNode = currentNode->right;
+    // Characters that didn't fit are still counted
+    unsigned char discarded[256];
+    while (bitOffset < endOffset) decoded += DecodeBits(input->GetData(), bitOffset, endOffset, discarded, 256);
 
-        if (currentNode->left == 0 && currentNode->right == 0) // Leaf
-        {
-
-            if (outputWriteIndex < maxCharsToWrite) output[outputWriteIndex] = currentNode->value;
-
-            outputWriteIndex++;
-
-            currentNode = root;
-        }
-    }
-
-    return outputWriteIndex;
+    input->IgnoreBits(sizeInBits);
+    return (unsigned)decoded;
 }
 
 // Pass an array of encoded bytes to array and a preallocated BitStream to receive the output
 void HuffmanEncodingTree::DecodeArray(unsigned char* input, BitSize_t sizeInBits, RakNet::BitStream* output) {
-    HuffmanEncodingTreeNode* currentNode;
-
     if (sizeInBits <= 0) return;
 
-    RakNet::BitStream bitStream(input, BITS_TO_BYTES(sizeInBits), false);
-
-    currentNode = root;
-
-    // For each bit, go left if it is a 0 and right if it is a 1.  When we reach a leaf, that gives us the desired value
-    // and we restart from the root
-    for (unsigned counter = 0; counter < sizeInBits; counter++) {
-        if (bitStream.ReadBit() == false) // left!
-            currentNode = currentNode->left;
-        else currentNode = currentNode->right;
-
-        if (currentNode->left == 0 && currentNode->right == 0) // Leaf
-        {
-            output->WriteBits(
-                &(currentNode->value),
-                sizeof(char) * 8,
-                true
-            ); // Use WriteBits instead of Write(char) because we want to avoid TYPE_CHECKING
-            currentNode = root;
-        }
+    BitSize_t     bitOffset = 0;
+    unsigned char decoded[256];
+    while (bitOffset < sizeInBits) {
+        size_t count = DecodeBits(input, bitOffset, sizeInBits, decoded, 256);
+        // Use WriteBits instead of Write(char) because we want to avoid TYPE_CHECKING
+        if (count > 0) output->WriteBits(decoded, (BitSize_t)(count * 8), true);
     }
 }
 
@@ -0,0 +1,1135 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DatagramCipher.h"
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+
+#include "RakAssert.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include "WindowsIncludes.h"
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <stdlib.h> // arc4random_buf
+#elif defined(__linux__)
+#include <errno.h>
+#include <sys/random.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DATAGRAM_CIPHER_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define DATAGRAM_CIPHER_TARGET_AES
+#else
+#include <cpuid.h>
+#define DATAGRAM_CIPHER_TARGET_AES __attribute__((target("aes,pclmul,ssse3")))
+#endif
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DATAGRAM_CIPHER_SSE2 1
+#endif
+#endif
+
+using namespace RakNet;
+
+static inline uint32_t Load32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static inline void Store32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+static inline void Store32BE(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+static inline void Store64(unsigned char* p, uint64_t v) {
+    Store32(p, (uint32_t)v);
+    Store32(p + 4, (uint32_t)(v >> 32));
+}
+static inline uint32_t Rotl32(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+// Volatile so the compiler cannot drop the wipe of a buffer that is about to go out of scope
+static void SecureZero(void* p, size_t n) {
+    volatile unsigned char* v = (volatile unsigned char*)p;
+    while (n--) *v++ = 0;
+}
+
+static bool ConstantTimeEqual(const unsigned char* a, const unsigned char* b, int n) {
+    unsigned char diff = 0;
+    for (int i = 0; i < n; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Secure random source
+//-------------------------------------------------------------------------------------------------------
+static bool FillSecureRandom(unsigned char* out, unsigned int bytes) {
+#if defined(_WIN32)
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, out, bytes, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(out, bytes);
+    return true;
+#else
+#if defined(__linux__)
+    unsigned int done = 0;
+    while (done < bytes) {
+        ssize_t r = getrandom(out + done, bytes - done, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += (unsigned int)r;
+    }
+    if (done == bytes) return true;
+#endif
+    FILE* fp = fopen("/dev/urandom", "rb");
+    if (fp == 0) return false;
+    size_t got = fread(out, 1, bytes, fp);
+    fclose(fp);
+    return got == bytes;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------------
+// SHA-256 / HMAC / HKDF, only used to turn the X25519 shared secret into session keys
+//-------------------------------------------------------------------------------------------------------
+namespace {
+struct Sha256 {
+    uint32_t      state[8];
+    uint64_t      totalBytes;
+    unsigned char block[64];
+    unsigned int  blockUsed;
+};
+} // namespace
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t Rotr32(uint32_t v, int n) { return (v >> n) | (v << (32 - n)); }
+
+static void Sha256Compress(Sha256& ctx, const unsigned char* p) {
+    uint32_t w[64];
+    int      i;
+    for (i = 0; i < 16; i++)
+        w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) | ((uint32_t)p[i * 4 + 2] << 8)
+             | (uint32_t)p[i * 4 + 3];
+    for (; i < 64; i++) {
+        uint32_t s0 = Rotr32(w[i - 15], 7) ^ Rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = Rotr32(w[i - 2], 17) ^ Rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx.state[0], b = ctx.state[1], c = ctx.state[2], d = ctx.state[3];
+    uint32_t e = ctx.state[4], f = ctx.state[5], g = ctx.state[6], h = ctx.state[7];
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + (Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+        uint32_t t2 = (Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h           = g;
+        g           = f;
+        f           = e;
+        e           = d + t1;
+        d           = c;
+        c           = b;
+        b           = a;
+        a           = t1 + t2;
+    }
+    ctx.state[0] += a;
+    ctx.state[1] += b;
+    ctx.state[2] += c;
+    ctx.state[3] += d;
+    ctx.state[4] += e;
+    ctx.state[5] += f;
+    ctx.state[6] += g;
+    ctx.state[7] += h;
+}
+
+static void Sha256Init(Sha256& ctx) {
+    static const uint32_t iv[8] =
+        {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx.state, iv, sizeof(iv));
+    ctx.totalBytes = 0;
+    ctx.blockUsed  = 0;
+}
+
+static void Sha256Update(Sha256& ctx, const unsigned char* data, unsigned int length) {
+    ctx.totalBytes += length;
+    while (length > 0) {
+        unsigned int n = 64 - ctx.blockUsed;
+        if (n > length) n = length;
+        memcpy(ctx.block + ctx.blockUsed, data, n);
+        ctx.blockUsed += n;
+        data          += n;
+        length        -= n;
+        if (ctx.blockUsed == 64) {
+            Sha256Compress(ctx, ctx.block);
+            ctx.blockUsed = 0;
+        }
+    }
+}
+
+static void Sha256Final(Sha256& ctx, unsigned char* out) {
+    uint64_t      bits = ctx.totalBytes * 8;
+    unsigned char pad  = 0x80;
+    Sha256Update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx.blockUsed != 56) Sha256Update(ctx, &pad, 1);
+    unsigned char lengthBytes[8];
+    Store32BE(lengthBytes, (uint32_t)(bits >> 32));
+    Store32BE(lengthBytes + 4, (uint32_t)bits);
+    Sha256Update(ctx, lengthBytes, 8);
+    for (int i = 0; i < 8; i++) Store32BE(out + i * 4, ctx.state[i]);
+    SecureZero(&ctx, sizeof(ctx));
+}
+
+static void HmacSha256(
+    const unsigned char* key,
+    unsigned int         keyLength,
+    const unsigned char* data1,
+    unsigned int         data1Length,
+    const unsigned char* data2,
+    unsigned int         data2Length,
+    unsigned char*       out
+) {
+    RakAssert(keyLength <= 64);
+    unsigned char pad[64];
+    Sha256        ctx;
+    int           i;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (i = 0; i < (int)keyLength; i++) pad[i] ^= key[i];
+    Sha256Init(ctx);
+    Sha256Update(ctx, pad, 64);
+    Sha256Update(ctx, data1, data1Length);
+    Sha256Update(ctx, data2, data2Length);
+    unsigned char inner[32];
+    Sha256Final(ctx, inner);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (i = 0; i < (int)keyLength; i++) pad[i] ^= key[i];
+    Sha256Init(ctx);
+    Sha256Update(ctx, pad, 64);
+    Sha256Update(ctx, inner, 32);
+    Sha256Final(ctx, out);
+
+    SecureZero(pad, sizeof(pad));
+    SecureZero(inner, sizeof(inner));
+}
+
+// RFC 5869 with SHA-256. outLength must be a multiple of 32
+static void HkdfSha256(
+    const unsigned char* secret,
+    unsigned int         secretLength,
+    const unsigned char* info,
+    unsigned int         infoLength,
+    unsigned char*       out,
+    unsigned int         outLength
+) {
+    static const unsigned char salt[] = "RakNet datagram cipher v1";
+    unsigned char              prk[32];
+    HmacSha256(salt, sizeof(salt) - 1, secret, secretLength, 0, 0, prk);
+
+    unsigned char block[32 + 64 + 1];
+    unsigned int  previous = 0;
+    RakAssert(infoLength <= 64);
+    for (unsigned int offset = 0, counter = 1; offset < outLength; offset += 32, counter++) {
+        memcpy(block + previous, info, infoLength);
+        block[previous + infoLength] = (unsigned char)counter;
+        HmacSha256(prk, 32, block, previous + infoLength + 1, 0, 0, out + offset);
+        memcpy(block, out + offset, 32);
+        previous = 32;
+    }
+    SecureZero(prk, sizeof(prk));
+    SecureZero(block, sizeof(block));
+}
+
+//-------------------------------------------------------------------------------------------------------
+// X25519 (RFC 7748). Field elements are ten signed limbs of alternately 26 and 25 bits.
+//-------------------------------------------------------------------------------------------------------
+typedef int32_t Fe[10];
+
+static const int feLimbBits[10]     = {26, 25, 26, 25, 26, 25, 26, 25, 26, 25};
+static const int feLimbPosition[10] = {0, 26, 51, 77, 102, 128, 153, 179, 204, 230};
+
+static inline void FeCarryLimb(int64_t* t, int i) {
+    int64_t c  = t[i] >> feLimbBits[i];
+    t[i]      -= c * ((int64_t)1 << feLimbBits[i]);
+    if (i == 9) t[0] += 19 * c;
+    else t[i + 1] += c;
+}
+
+// Carries 64 bit limb sums back down to 26/25 bits. Two interleaved chains halve the dependency length. Products are
+// formed in 64 bits, limbs are stored in 32.
+static void FeCarry(Fe h, int64_t* t) {
+    FeCarryLimb(t, 0);
+    FeCarryLimb(t, 4);
+    FeCarryLimb(t, 1);
+    FeCarryLimb(t, 5);
+    FeCarryLimb(t, 2);
+    FeCarryLimb(t, 6);
+    FeCarryLimb(t, 3);
+    FeCarryLimb(t, 7);
+    FeCarryLimb(t, 4);
+    FeCarryLimb(t, 8);
+    FeCarryLimb(t, 9);
+    FeCarryLimb(t, 0);
+    for (int i = 0; i < 10; i++) h[i] = (int32_t)t[i];
+}
+
+static void FeAdd(Fe h, const Fe f, const Fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) t[i] = (int64_t)f[i] + g[i];
+    FeCarry(h, t);
+}
+
+static void FeSub(Fe h, const Fe f, const Fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) t[i] = (int64_t)f[i] - g[i];
+    FeCarry(h, t);
+}
+
+static void FeMul(Fe h, const Fe f, const Fe g) {
+    // Limb k collects f[i] * g[k - i], wrapping past limb 9 with a factor of 19. Odd by odd products need an extra
+    // factor of 2 from the half bit radix, which happens exactly when i is odd and k is even.
+    int32_t gx[20], fd[10];
+    for (int j = 0; j < 10; j++) {
+        gx[j]      = 19 * g[j];
+        gx[j + 10] = g[j];
+        fd[j]      = (j & 1) ? 2 * f[j] : f[j];
+    }
+    int64_t t[10];
+    for (int k = 0; k < 10; k++) {
+        const int32_t* fk  = (k & 1) ? f : fd;
+        int64_t        sum = 0;
+        for (int i = 0; i < 10; i++) sum += (int64_t)fk[i] * gx[k - i + 10];
+        t[k] = sum;
+    }
+    FeCarry(h, t);
+}
+
+static void FeSquareTimes(Fe h, const Fe f, int n) {
+    FeMul(h, f, f);
+    for (int i = 1; i < n; i++) FeMul(h, h, h);
+}
+
+static void FeMulSmall(Fe h, const Fe f, int32_t n) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) t[i] = (int64_t)f[i] * n;
+    FeCarry(h, t);
+}
+
+static void FeInvert(Fe out, const Fe z) {
+    // z^(p-2) with p-2 = (2^250 - 1) * 2^5 + 11
+    Fe z2, z9, z11, t0, t1, t2;
+    FeMul(z2, z, z);
+    FeSquareTimes(t0, z2, 2);
+    FeMul(z9, t0, z);
+    FeMul(z11, z9, z2);
+    FeMul(t0, z11, z11);
+    FeMul(t0, t0, z9); // 2^5 - 1
+    FeSquareTimes(t1, t0, 5);
+    FeMul(t0, t1, t0); // 2^10 - 1
+    FeSquareTimes(t1, t0, 10);
+    FeMul(t1, t1, t0); // 2^20 - 1
+    FeSquareTimes(t2, t1, 20);
+    FeMul(t1, t2, t1); // 2^40 - 1
+    FeSquareTimes(t1, t1, 10);
+    FeMul(t0, t1, t0); // 2^50 - 1
+    FeSquareTimes(t1, t0, 50);
+    FeMul(t1, t1, t0); // 2^100 - 1
+    FeSquareTimes(t2, t1, 100);
+    FeMul(t1, t2, t1); // 2^200 - 1
+    FeSquareTimes(t1, t1, 50);
+    FeMul(t0, t1, t0); // 2^250 - 1
+    FeSquareTimes(t0, t0, 5);
+    FeMul(out, t0, z11);
+}
+
+static void FeConditionalSwap(Fe p, Fe q, int32_t b) {
+    int32_t mask = -b;
+    for (int i = 0; i < 10; i++) {
+        int32_t t  = mask & (p[i] ^ q[i]);
+        p[i]      ^= t;
+        q[i]      ^= t;
+    }
+}
+
+static void FeFromBytes(Fe h, const unsigned char* s) {
+    for (int i = 0; i < 10; i++) {
+        int      byte = feLimbPosition[i] >> 3;
+        uint64_t v    = 0;
+        for (int k = 0; k < 5 && byte + k < 32; k++) v |= (uint64_t)s[byte + k] << (8 * k);
+        h[i] = (int32_t)((v >> (feLimbPosition[i] & 7)) & (((uint64_t)1 << feLimbBits[i]) - 1));
+    }
+}
+
+static void FeToBytes(unsigned char* s, const Fe f) {
+    Fe      h;
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) t[i] = f[i];
+    FeCarry(h, t);
+
+    // Subtract p if h >= p. q is 1 exactly when h + 19 overflows 2^255
+    int32_t q = (19 * h[9] + ((int32_t)1 << 24)) >> 25;
+    for (int i = 0; i < 10; i++) q = (h[i] + q) >> feLimbBits[i];
+    h[0] += 19 * q;
+    for (int i = 0; i < 9; i++) {
+        int32_t c  = h[i] >> feLimbBits[i];
+        h[i]      -= c * ((int32_t)1 << feLimbBits[i]);
+        h[i + 1]  += c;
+    }
+    h[9] &= ((int32_t)1 << 25) - 1;
+
+    memset(s, 0, 32);
+    for (int i = 0; i < 10; i++) {
+        int      byte = feLimbPosition[i] >> 3;
+        uint64_t v    = (uint64_t)h[i] << (feLimbPosition[i] & 7);
+        for (int k = 0; k < 5 && byte + k < 32; k++) s[byte + k] |= (unsigned char)(v >> (8 * k));
+    }
+}
+
+static void X25519(unsigned char* out, const unsigned char* scalar, const unsigned char* point) {
+    unsigned char z[32];
+    memcpy(z, scalar, 32);
+    z[31] = (z[31] & 127) | 64;
+    z[0] &= 248;
+
+    Fe x, a, b, c, d, e, f;
+    FeFromBytes(x, point);
+    for (int i = 0; i < 10; i++) {
+        a[i] = d[i] = c[i] = 0;
+        b[i]               = x[i];
+    }
+    a[0] = d[0] = 1;
+
+    for (int i = 254; i >= 0; --i) {
+        int32_t r = (z[i >> 3] >> (i & 7)) & 1;
+        FeConditionalSwap(a, b, r);
+        FeConditionalSwap(c, d, r);
+        FeAdd(e, a, c);
+        FeSub(a, a, c);
+        FeAdd(c, b, d);
+        FeSub(b, b, d);
+        FeMul(d, e, e);
+        FeMul(f, a, a);
+        FeMul(a, c, a);
+        FeMul(c, b, e);
+        FeAdd(e, a, c);
+        FeSub(a, a, c);
+        FeMul(b, a, a);
+        FeSub(c, d, f);
+        FeMulSmall(a, c, 121665);
+        FeAdd(a, a, d);
+        FeMul(c, c, a);
+        FeMul(a, d, f);
+        FeMul(d, b, x);
+        FeMul(b, e, e);
+        FeConditionalSwap(a, b, r);
+        FeConditionalSwap(c, d, r);
+    }
+    FeInvert(c, c);
+    FeMul(a, a, c);
+    FeToBytes(out, a);
+    SecureZero(z, sizeof(z));
+}
+
+//-------------------------------------------------------------------------------------------------------
+// ChaCha20 (RFC 8439)
+//-------------------------------------------------------------------------------------------------------
+#define CHACHA_QUARTER_ROUND(a, b, c, d)                                                                               \
+    a += b;                                                                                                            \
+    d  = Rotl32(d ^ a, 16);                                                                                            \
+    c += d;                                                                                                            \
+    b  = Rotl32(b ^ c, 12);                                                                                            \
+    a += b;                                                                                                            \
+    d  = Rotl32(d ^ a, 8);                                                                                             \
+    c += d;                                                                                                            \
+    b  = Rotl32(b ^ c, 7);
+
+static void ChaChaBlock(const uint32_t* input, unsigned char* out) {
+    uint32_t x[16];
+    int      i;
+    for (i = 0; i < 16; i++) x[i] = input[i];
+    for (i = 0; i < 10; i++) {
+        CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+        CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+        CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+        CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+        CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+        CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+        CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+        CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+    }
+    for (i = 0; i < 16; i++) Store32(out + i * 4, x[i] + input[i]);
+}
+
+#ifdef DATAGRAM_CIPHER_SSE2
+#define CHACHA_ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define CHACHA_QUARTER_ROUND_SSE2(a, b, c, d)                                                                          \
+    a = _mm_add_epi32(a, b);                                                                                           \
+    d = CHACHA_ROTL_SSE2(_mm_xor_si128(d, a), 16);                                                                     \
+    c = _mm_add_epi32(c, d);                                                                                           \
+    b = CHACHA_ROTL_SSE2(_mm_xor_si128(b, c), 12);                                                                     \
+    a = _mm_add_epi32(a, b);                                                                                           \
+    d = CHACHA_ROTL_SSE2(_mm_xor_si128(d, a), 8);                                                                      \
+    c = _mm_add_epi32(c, d);                                                                                           \
+    b = CHACHA_ROTL_SSE2(_mm_xor_si128(b, c), 7);
+
+// XORs four consecutive keystream blocks into data. Each register holds one state word for all four blocks.
+static void ChaChaXor4Blocks(uint32_t* input, unsigned char* data) {
+    __m128i x[16], orig[16];
+    int     i;
+    for (i = 0; i < 16; i++) x[i] = _mm_set1_epi32((int)input[i]);
+    x[12] = _mm_add_epi32(x[12], _mm_set_epi32(3, 2, 1, 0));
+    for (i = 0; i < 16; i++) orig[i] = x[i];
+
+    for (i = 0; i < 10; i++) {
+        CHACHA_QUARTER_ROUND_SSE2(x[0], x[4], x[8], x[12])
+        CHACHA_QUARTER_ROUND_SSE2(x[1], x[5], x[9], x[13])
+        CHACHA_QUARTER_ROUND_SSE2(x[2], x[6], x[10], x[14])
+        CHACHA_QUARTER_ROUND_SSE2(x[3], x[7], x[11], x[15])
+        CHACHA_QUARTER_ROUND_SSE2(x[0], x[5], x[10], x[15])
+        CHACHA_QUARTER_ROUND_SSE2(x[1], x[6], x[11], x[12])
+        CHACHA_QUARTER_ROUND_SSE2(x[2], x[7], x[8], x[13])
+        CHACHA_QUARTER_ROUND_SSE2(x[3], x[4], x[9], x[14])
+    }
+
+    // Transpose each group of four words from word-major to block-major and XOR into the data
+    for (i = 0; i < 16; i += 4) {
+        __m128i a  = _mm_add_epi32(x[i], orig[i]);
+        __m128i b  = _mm_add_epi32(x[i + 1], orig[i + 1]);
+        __m128i c  = _mm_add_epi32(x[i + 2], orig[i + 2]);
+        __m128i d  = _mm_add_epi32(x[i + 3], orig[i + 3]);
+        __m128i t0 = _mm_unpacklo_epi32(a, b);
+        __m128i t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b);
+        __m128i t3 = _mm_unpackhi_epi32(c, d);
+        __m128i blockWords[4];
+        blockWords[0] = _mm_unpacklo_epi64(t0, t1);
+        blockWords[1] = _mm_unpackhi_epi64(t0, t1);
+        blockWords[2] = _mm_unpacklo_epi64(t2, t3);
+        blockWords[3] = _mm_unpackhi_epi64(t2, t3);
+        for (int block = 0; block < 4; block++) {
+            __m128i* p = (__m128i*)(data + block * 64 + i * 4);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), blockWords[block]));
+        }
+    }
+    input[12] += 4;
+}
+#endif // DATAGRAM_CIPHER_SSE2
+
+static void ChaChaSetup(uint32_t* input, const unsigned char* key, uint32_t counter, const unsigned char* nonce) {
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) input[4 + i] = Load32(key + i * 4);
+    input[12] = counter;
+    input[13] = Load32(nonce);
+    input[14] = Load32(nonce + 4);
+    input[15] = Load32(nonce + 8);
+}
+
+static void ChaChaXor(uint32_t* input, unsigned char* data, unsigned int length) {
+#ifdef DATAGRAM_CIPHER_SSE2
+    while (length >= 256) {
+        ChaChaXor4Blocks(input, data);
+        data   += 256;
+        length -= 256;
+    }
+#endif
+    unsigned char keystream[64];
+    while (length > 0) {
+        ChaChaBlock(input, keystream);
+        input[12]++;
+        unsigned int n = length < 64 ? length : 64;
+        for (unsigned int i = 0; i < n; i++) data[i] ^= keystream[i];
+        data   += n;
+        length -= n;
+    }
+    SecureZero(keystream, sizeof(keystream));
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Poly1305 (RFC 8439), 26-bit limbs so it only needs 32x32->64 multiplies
+//-------------------------------------------------------------------------------------------------------
+namespace {
+struct Poly1305 {
+    uint32_t r[5], h[5], pad[4];
+};
+} // namespace
+
+static void Poly1305Init(Poly1305& st, const unsigned char* key) {
+    st.r[0] = (Load32(key + 0)) & 0x3ffffff;
+    st.r[1] = (Load32(key + 3) >> 2) & 0x3ffff03;
+    st.r[2] = (Load32(key + 6) >> 4) & 0x3ffc0ff;
+    st.r[3] = (Load32(key + 9) >> 6) & 0x3f03fff;
+    st.r[4] = (Load32(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 5; i++) st.h[i] = 0;
+    for (int i = 0; i < 4; i++) st.pad[i] = Load32(key + 16 + i * 4);
+}
+
+static void Poly1305Blocks(Poly1305& st, const unsigned char* m, unsigned int length, uint32_t hibit) {
+    const uint32_t r0 = st.r[0], r1 = st.r[1], r2 = st.r[2], r3 = st.r[3], r4 = st.r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t       h0 = st.h[0], h1 = st.h[1], h2 = st.h[2], h3 = st.h[3], h4 = st.h[4];
+
+    while (length >= 16) {
+        h0 += (Load32(m + 0)) & 0x3ffffff;
+        h1 += (Load32(m + 3) >> 2) & 0x3ffffff;
+        h2 += (Load32(m + 6) >> 4) & 0x3ffffff;
+        h3 += (Load32(m + 9) >> 6) & 0x3ffffff;
+        h4 += (Load32(m + 12) >> 8) | hibit;
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c   = (uint32_t)(d0 >> 26);
+        h0  = (uint32_t)d0 & 0x3ffffff;
+        d1 += c;
+        c   = (uint32_t)(d1 >> 26);
+        h1  = (uint32_t)d1 & 0x3ffffff;
+        d2 += c;
+        c   = (uint32_t)(d2 >> 26);
+        h2  = (uint32_t)d2 & 0x3ffffff;
+        d3 += c;
+        c   = (uint32_t)(d3 >> 26);
+        h3  = (uint32_t)d3 & 0x3ffffff;
+        d4 += c;
+        c   = (uint32_t)(d4 >> 26);
+        h4  = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5;
+        c   = h0 >> 26;
+        h0 &= 0x3ffffff;
+        h1 += c;
+
+        m      += 16;
+        length -= 16;
+    }
+
+    st.h[0] = h0;
+    st.h[1] = h1;
+    st.h[2] = h2;
+    st.h[3] = h3;
+    st.h[4] = h4;
+}
+
+// Absorbs data zero padded to a multiple of 16 bytes, as the AEAD construction requires
+static void Poly1305UpdatePadded(Poly1305& st, const unsigned char* m, unsigned int length) {
+    unsigned int full = length & ~15u;
+    Poly1305Blocks(st, m, full, 1 << 24);
+    if (full < length) {
+        unsigned char last[16] = {0};
+        memcpy(last, m + full, length - full);
+        Poly1305Blocks(st, last, 16, 1 << 24);
+    }
+}
+
+static void Poly1305Finish(Poly1305& st, unsigned char* mac) {
+    uint32_t h0 = st.h[0], h1 = st.h[1], h2 = st.h[2], h3 = st.h[3], h4 = st.h[4];
+    uint32_t c;
+    c   = h1 >> 26;
+    h1 &= 0x3ffffff;
+    h2 += c;
+    c   = h2 >> 26;
+    h2 &= 0x3ffffff;
+    h3 += c;
+    c   = h3 >> 26;
+    h3 &= 0x3ffffff;
+    h4 += c;
+    c   = h4 >> 26;
+    h4 &= 0x3ffffff;
+    h0 += c * 5;
+    c   = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += c;
+
+    // g = h + -p
+    uint32_t g0 = h0 + 5;
+    c           = g0 >> 26;
+    g0         &= 0x3ffffff;
+    uint32_t g1 = h1 + c;
+    c           = g1 >> 26;
+    g1         &= 0x3ffffff;
+    uint32_t g2 = h2 + c;
+    c           = g2 >> 26;
+    g2         &= 0x3ffffff;
+    uint32_t g3 = h3 + c;
+    c           = g3 >> 26;
+    g3         &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1 << 26);
+
+    // Select h if h < p, else g
+    uint32_t mask  = (g4 >> 31) - 1;
+    g0            &= mask;
+    g1            &= mask;
+    g2            &= mask;
+    g3            &= mask;
+    g4            &= mask;
+    mask           = ~mask;
+    h0             = (h0 & mask) | g0;
+    h1             = (h1 & mask) | g1;
+    h2             = (h2 & mask) | g2;
+    h3             = (h3 & mask) | g3;
+    h4             = (h4 & mask) | g4;
+
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
+    uint64_t f;
+    f = (uint64_t)h0 + st.pad[0];
+    Store32(mac + 0, (uint32_t)f);
+    f = (uint64_t)h1 + st.pad[1] + (f >> 32);
+    Store32(mac + 4, (uint32_t)f);
+    f = (uint64_t)h2 + st.pad[2] + (f >> 32);
+    Store32(mac + 8, (uint32_t)f);
+    f = (uint64_t)h3 + st.pad[3] + (f >> 32);
+    Store32(mac + 12, (uint32_t)f);
+
+    SecureZero(&st, sizeof(st));
+}
+
+static void ChaChaPolyTag(const unsigned char* polyKey, const unsigned char* ciphertext, unsigned int length, unsigned char* tag) {
+    Poly1305 st;
+    Poly1305Init(st, polyKey);
+    Poly1305UpdatePadded(st, ciphertext, length);
+    unsigned char lengths[16];
+    Store64(lengths, 0); // No additional data
+    Store64(lengths + 8, length);
+    Poly1305Blocks(st, lengths, 16, 1 << 24);
+    Poly1305Finish(st, tag);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// AES-256-GCM using AES-NI and carry-less multiply. GHASH works on byte reversed blocks and folds four blocks per
+// reduction using H^1..H^4.
+//-------------------------------------------------------------------------------------------------------
+#ifdef DATAGRAM_CIPHER_X86
+
+static bool CpuHasAesAndClmul(void) {
+    unsigned int ecx;
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    ecx = (unsigned int)info[2];
+#else
+    unsigned int eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+    const unsigned int pclmul = 1u << 1, ssse3 = 1u << 9, aes = 1u << 25;
+    return (ecx & (pclmul | ssse3 | aes)) == (pclmul | ssse3 | aes);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i ByteSwap128(__m128i v) {
+    return _mm_shuffle_epi8(v, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i AesKeyAssist1(__m128i temp1, __m128i temp2) {
+    temp2        = _mm_shuffle_epi32(temp2, 0xff);
+    __m128i temp = _mm_slli_si128(temp1, 0x4);
+    temp1        = _mm_xor_si128(temp1, temp);
+    temp         = _mm_slli_si128(temp, 0x4);
+    temp1        = _mm_xor_si128(temp1, temp);
+    temp         = _mm_slli_si128(temp, 0x4);
+    temp1        = _mm_xor_si128(temp1, temp);
+    return _mm_xor_si128(temp1, temp2);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i AesKeyAssist2(__m128i temp1, __m128i temp3) {
+    __m128i temp2 = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(temp1, 0x0), 0xaa);
+    __m128i temp  = _mm_slli_si128(temp3, 0x4);
+    temp3         = _mm_xor_si128(temp3, temp);
+    temp          = _mm_slli_si128(temp, 0x4);
+    temp3         = _mm_xor_si128(temp3, temp);
+    temp          = _mm_slli_si128(temp, 0x4);
+    temp3         = _mm_xor_si128(temp3, temp);
+    return _mm_xor_si128(temp3, temp2);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i AesEncryptBlock(const __m128i* rk, __m128i v) {
+    v = _mm_xor_si128(v, rk[0]);
+    for (int i = 1; i < 14; i++) v = _mm_aesenc_si128(v, rk[i]);
+    return _mm_aesenclast_si128(v, rk[14]);
+}
+
+// Unreduced 256 bit carry-less product, accumulated into lo:hi
+DATAGRAM_CIPHER_TARGET_AES static inline void GhashMultiplyAccumulate(__m128i a, __m128i b, __m128i& lo, __m128i& hi) {
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    lo          = _mm_xor_si128(lo, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x00), _mm_slli_si128(mid, 8)));
+    hi          = _mm_xor_si128(hi, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x11), _mm_srli_si128(mid, 8)));
+}
+
+// Shift the bit reflected product left by one and reduce modulo x^128 + x^7 + x^2 + x + 1
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i GhashReduce(__m128i lo, __m128i hi) {
+    __m128i t7 = _mm_srli_epi32(lo, 31);
+    __m128i t8 = _mm_srli_epi32(hi, 31);
+    lo         = _mm_slli_epi32(lo, 1);
+    hi         = _mm_slli_epi32(hi, 1);
+    __m128i t9 = _mm_srli_si128(t7, 12);
+    t8         = _mm_slli_si128(t8, 4);
+    t7         = _mm_slli_si128(t7, 4);
+    lo         = _mm_or_si128(lo, t7);
+    hi         = _mm_or_si128(_mm_or_si128(hi, t8), t9);
+
+    t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+
+    __m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    t2         = _mm_xor_si128(t2, t8);
+    lo         = _mm_xor_si128(lo, t2);
+    return _mm_xor_si128(hi, lo);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static inline __m128i GhashMultiply(__m128i a, __m128i b) {
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    GhashMultiplyAccumulate(a, b, lo, hi);
+    return GhashReduce(lo, hi);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static void AesGcmExpandKey(const unsigned char* key, unsigned char* schedule) {
+    __m128i* rk    = (__m128i*)schedule;
+    __m128i  temp1 = _mm_loadu_si128((const __m128i*)key);
+    __m128i  temp3 = _mm_loadu_si128((const __m128i*)(key + 16));
+    rk[0]          = temp1;
+    rk[1]          = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x01));
+    rk[2]          = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[3]          = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x02));
+    rk[4]          = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[5]          = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x04));
+    rk[6]          = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[7]          = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x08));
+    rk[8]          = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[9]          = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x10));
+    rk[10]         = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[11]         = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x20));
+    rk[12]         = temp1;
+    temp3          = AesKeyAssist2(temp1, temp3);
+    rk[13]         = temp3;
+    temp1          = AesKeyAssist1(temp1, _mm_aeskeygenassist_si128(temp3, 0x40));
+    rk[14]         = temp1;
+
+    // Hash key powers, stored byte reversed
+    __m128i h = ByteSwap128(AesEncryptBlock(rk, _mm_setzero_si128()));
+    rk[15]    = h;
+    rk[16]    = GhashMultiply(rk[15], h);
+    rk[17]    = GhashMultiply(rk[16], h);
+    rk[18]    = GhashMultiply(rk[17], h);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static __m128i AesGcmGhash(const __m128i* rk, const unsigned char* data, unsigned int length) {
+    __m128i x = _mm_setzero_si128();
+    while (length >= 64) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        __m128i b0 = _mm_xor_si128(x, ByteSwap128(_mm_loadu_si128((const __m128i*)data)));
+        GhashMultiplyAccumulate(b0, rk[18], lo, hi);
+        GhashMultiplyAccumulate(ByteSwap128(_mm_loadu_si128((const __m128i*)(data + 16))), rk[17], lo, hi);
+        GhashMultiplyAccumulate(ByteSwap128(_mm_loadu_si128((const __m128i*)(data + 32))), rk[16], lo, hi);
+        GhashMultiplyAccumulate(ByteSwap128(_mm_loadu_si128((const __m128i*)(data + 48))), rk[15], lo, hi);
+        x       = GhashReduce(lo, hi);
+        data   += 64;
+        length -= 64;
+    }
+    while (length > 0) {
+        unsigned char block[16] = {0};
+        unsigned int  n         = length < 16 ? length : 16;
+        memcpy(block, data, n);
+        x       = GhashMultiply(_mm_xor_si128(x, ByteSwap128(_mm_loadu_si128((const __m128i*)block))), rk[15]);
+        data   += n;
+        length -= n;
+    }
+    return x;
+}
+
+DATAGRAM_CIPHER_TARGET_AES static void AesGcmCtr(const __m128i* rk, __m128i counterBlock, unsigned char* data, unsigned int length) {
+    // The 32 bit big endian block counter is the low lane once byte reversed
+    __m128i       counter = ByteSwap128(counterBlock);
+    const __m128i one     = _mm_set_epi32(0, 0, 0, 1);
+    while (length >= 64) {
+        __m128i c0 = ByteSwap128(counter = _mm_add_epi32(counter, one));
+        __m128i c1 = ByteSwap128(counter = _mm_add_epi32(counter, one));
+        __m128i c2 = ByteSwap128(counter = _mm_add_epi32(counter, one));
+        __m128i c3 = ByteSwap128(counter = _mm_add_epi32(counter, one));
+        c0         = _mm_xor_si128(c0, rk[0]);
+        c1         = _mm_xor_si128(c1, rk[0]);
+        c2         = _mm_xor_si128(c2, rk[0]);
+        c3         = _mm_xor_si128(c3, rk[0]);
+        for (int r = 1; r < 14; r++) {
+            c0 = _mm_aesenc_si128(c0, rk[r]);
+            c1 = _mm_aesenc_si128(c1, rk[r]);
+            c2 = _mm_aesenc_si128(c2, rk[r]);
+            c3 = _mm_aesenc_si128(c3, rk[r]);
+        }
+        __m128i* p = (__m128i*)data;
+        _mm_storeu_si128(p + 0, _mm_xor_si128(_mm_loadu_si128(p + 0), _mm_aesenclast_si128(c0, rk[14])));
+        _mm_storeu_si128(p + 1, _mm_xor_si128(_mm_loadu_si128(p + 1), _mm_aesenclast_si128(c1, rk[14])));
+        _mm_storeu_si128(p + 2, _mm_xor_si128(_mm_loadu_si128(p + 2), _mm_aesenclast_si128(c2, rk[14])));
+        _mm_storeu_si128(p + 3, _mm_xor_si128(_mm_loadu_si128(p + 3), _mm_aesenclast_si128(c3, rk[14])));
+        data   += 64;
+        length -= 64;
+    }
+    while (length > 0) {
+        counter = _mm_add_epi32(counter, one);
+        unsigned char keystream[16];
+        _mm_storeu_si128((__m128i*)keystream, AesEncryptBlock(rk, ByteSwap128(counter)));
+        unsigned int n = length < 16 ? length : 16;
+        for (unsigned int i = 0; i < n; i++) data[i] ^= keystream[i];
+        data   += n;
+        length -= n;
+    }
+}
+
+DATAGRAM_CIPHER_TARGET_AES static void AesGcmTag(const __m128i* rk, __m128i j0, const unsigned char* ciphertext, unsigned int length, unsigned char* tag) {
+    __m128i x = AesGcmGhash(rk, ciphertext, length);
+    // Length block: 64 bit bit-lengths of the (empty) additional data and the ciphertext, byte reversed
+    x = GhashMultiply(_mm_xor_si128(x, _mm_set_epi64x(0, (long long)length * 8)), rk[15]);
+    _mm_storeu_si128((__m128i*)tag, _mm_xor_si128(ByteSwap128(x), AesEncryptBlock(rk, j0)));
+}
+
+DATAGRAM_CIPHER_TARGET_AES static __m128i AesGcmInitialCounter(const unsigned char* nonce) {
+    unsigned char j0[16];
+    memcpy(j0, nonce, 12);
+    Store32BE(j0 + 12, 1);
+    return _mm_loadu_si128((const __m128i*)j0);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static void AesGcmSeal(const unsigned char* schedule, const unsigned char* nonce, unsigned char* data, unsigned int length, unsigned char* tag) {
+    const __m128i* rk = (const __m128i*)schedule;
+    __m128i        j0 = AesGcmInitialCounter(nonce);
+    AesGcmCtr(rk, j0, data, length);
+    AesGcmTag(rk, j0, data, length, tag);
+}
+
+DATAGRAM_CIPHER_TARGET_AES static bool AesGcmOpen(const unsigned char* schedule, const unsigned char* nonce, unsigned char* data, unsigned int length, const unsigned char* tag) {
+    const __m128i* rk = (const __m128i*)schedule;
+    __m128i        j0 = AesGcmInitialCounter(nonce);
+    unsigned char  expected[16];
+    AesGcmTag(rk, j0, data, length, expected);
+    if (!ConstantTimeEqual(expected, tag, 16)) return false;
+    AesGcmCtr(rk, j0, data, length);
+    return true;
+}
+
+#endif // DATAGRAM_CIPHER_X86
+
+//-------------------------------------------------------------------------------------------------------
+DatagramCipher::DatagramCipher() {
+    suite = DCS_NONE;
+    Clear();
+}
+//-------------------------------------------------------------------------------------------------------
+DatagramCipher::~DatagramCipher() { Clear(); }
+//-------------------------------------------------------------------------------------------------------
+unsigned char DatagramCipher::GetSupportedSuites(void) {
+    unsigned char suites = 1 << DCS_CHACHA20_POLY1305;
+#ifdef DATAGRAM_CIPHER_X86
+    static const bool hasAes = CpuHasAesAndClmul();
+    if (hasAes) suites |= 1 << DCS_AES_256_GCM;
+#endif
+    return suites;
+}
+//-------------------------------------------------------------------------------------------------------
+DatagramCipherSuite DatagramCipher::ChooseSuite(unsigned char remoteSuites) {
+    unsigned char common = GetSupportedSuites() & remoteSuites;
+    if (common & (1 << DCS_AES_256_GCM)) return DCS_AES_256_GCM;
+    if (common & (1 << DCS_CHACHA20_POLY1305)) return DCS_CHACHA20_POLY1305;
+    return DCS_NONE;
+}
+//-------------------------------------------------------------------------------------------------------
+bool DatagramCipher::GenerateKeyPair(unsigned char* publicKey, unsigned char* privateKey) {
+    static const unsigned char basePoint[32] = {9};
+    if (!FillSecureRandom(privateKey, PRIVATE_KEY_BYTES)) return false;
+    X25519(publicKey, privateKey, basePoint);
+    return true;
+}
+//-------------------------------------------------------------------------------------------------------
+bool DatagramCipher::Initialize(
+    DatagramCipherSuite  _suite,
+    const unsigned char* privateKey,
+    const unsigned char* publicKey,
+    const unsigned char* remotePublicKey,
+    bool                 weInitiatedTheConnection
+) {
+    Clear();
+    if (_suite == DCS_NONE || (GetSupportedSuites() & (1 << _suite)) == 0) return false;
+
+    unsigned char shared[32];
+    X25519(shared, privateKey, remotePublicKey);
+    // A low order remote point gives an all zero secret, RFC 7748 section 6.1
+    unsigned char zero[32] = {0};
+    if (ConstantTimeEqual(shared, zero, 32)) return false;
+
+    // Transcript is initiator key then responder key, so both ends derive the same material
+    unsigned char info[PUBLIC_KEY_BYTES * 2];
+    memcpy(info, weInitiatedTheConnection ? publicKey : remotePublicKey, PUBLIC_KEY_BYTES);
+    memcpy(info + PUBLIC_KEY_BYTES, weInitiatedTheConnection ? remotePublicKey : publicKey, PUBLIC_KEY_BYTES);
+
+    // initiator key, responder key, initiator salt + responder salt
+    unsigned char material[96];
+    HkdfSha256(shared, sizeof(shared), info, sizeof(info), material, sizeof(material));
+    SecureZero(shared, sizeof(shared));
+
+    const unsigned char* initiatorKey = material;
+    const unsigned char* responderKey = material + 32;
+    const unsigned char* sendMaterial = weInitiatedTheConnection ? initiatorKey : responderKey;
+    const unsigned char* recvMaterial = weInitiatedTheConnection ? responderKey : initiatorKey;
+    memcpy(sendKey.nonceSalt, material + 64 + (weInitiatedTheConnection ? 0 : 4), 4);
+    memcpy(receiveKey.nonceSalt, material + 64 + (weInitiatedTheConnection ? 4 : 0), 4);
+
+#ifdef DATAGRAM_CIPHER_X86
+    if (_suite == DCS_AES_256_GCM) {
+        AesGcmExpandKey(sendMaterial, sendKey.schedule);
+        AesGcmExpandKey(recvMaterial, receiveKey.schedule);
+    } else
+#endif
+    {
+        memcpy(sendKey.schedule, sendMaterial, 32);
+        memcpy(receiveKey.schedule, recvMaterial, 32);
+    }
+    SecureZero(material, sizeof(material));
+
+    suite = _suite;
+    return true;
+}
+//-------------------------------------------------------------------------------------------------------
+void DatagramCipher::Clear(void) {
+    suite = DCS_NONE;
+    SecureZero(&sendKey, sizeof(sendKey));
+    SecureZero(&receiveKey, sizeof(receiveKey));
+    sendCounter            = 0;
+    highestReceivedCounter = 0;
+    receivedCounterWindow  = 0;
+}
+//-------------------------------------------------------------------------------------------------------
+void DatagramCipher::Seal(DirectionKey& key, uint64_t counter, unsigned char* buffer, unsigned int length, unsigned char* tag) {
+    unsigned char nonce[12];
+    memcpy(nonce, key.nonceSalt, 4);
+    Store64(nonce + 4, counter);
+
+#ifdef DATAGRAM_CIPHER_X86
+    if (suite == DCS_AES_256_GCM) {
+        AesGcmSeal(key.schedule, nonce, buffer, length, tag);
+        return;
+    }
+#endif
+
+    uint32_t      input[16];
+    unsigned char polyKey[64];
+    ChaChaSetup(input, key.schedule, 0, nonce);
+    ChaChaBlock(input, polyKey);
+    input[12] = 1;
+    ChaChaXor(input, buffer, length);
+    ChaChaPolyTag(polyKey, buffer, length, tag);
+    SecureZero(input, sizeof(input));
+    SecureZero(polyKey, sizeof(polyKey));
+}
+//-------------------------------------------------------------------------------------------------------
+bool DatagramCipher::Open(DirectionKey& key, uint64_t counter, unsigned char* buffer, unsigned int length, const unsigned char* tag) {
+    unsigned char nonce[12];
+    memcpy(nonce, key.nonceSalt, 4);
+    Store64(nonce + 4, counter);
+
+#ifdef DATAGRAM_CIPHER_X86
+    if (suite == DCS_AES_256_GCM) return AesGcmOpen(key.schedule, nonce, buffer, length, tag);
+#endif
+
+    uint32_t      input[16];
+    unsigned char polyKey[64];
+    unsigned char expected[TAG_BYTES];
+    ChaChaSetup(input, key.schedule, 0, nonce);
+    ChaChaBlock(input, polyKey);
+    ChaChaPolyTag(polyKey, buffer, length, expected);
+    SecureZero(polyKey, sizeof(polyKey));
+    bool valid = ConstantTimeEqual(expected, tag, TAG_BYTES);
+    if (valid) {
+        input[12] = 1;
+        ChaChaXor(input, buffer, length);
+    }
+    SecureZero(input, sizeof(input));
+    return valid;
+}
+//-------------------------------------------------------------------------------------------------------
+unsigned int DatagramCipher::Encrypt(unsigned char* buffer, unsigned int length) {
+    RakAssert(IsActive());
+    uint64_t counter = sendCounter++;
+    Store32(buffer + length, (uint32_t)counter);
+    Seal(sendKey, counter, buffer, length, buffer + length + COUNTER_BYTES);
+    return length + OVERHEAD_BYTES;
+}
+//-------------------------------------------------------------------------------------------------------
+bool DatagramCipher::Decrypt(unsigned char* buffer, unsigned int& length) {
+    if (!IsActive() || length < (unsigned int)OVERHEAD_BYTES) return false;
+    unsigned int payloadLength = length - OVERHEAD_BYTES;
+
+    // Only the low 32 bits of the counter are sent. Pick the full value closest to what we expect next.
+    const uint64_t window    = (uint64_t)1 << 32;
+    uint64_t       expected  = highestReceivedCounter + 1;
+    uint64_t       counter   = (expected & ~(window - 1)) | Load32(buffer + payloadLength);
+    if (counter + window / 2 <= expected) counter += window;
+    else if (counter > expected + window / 2 && counter >= window) counter -= window;
+
+    // Replay window of the last 64 counters
+    if (counter <= highestReceivedCounter && (receivedCounterWindow != 0 || counter != 0)) {
+        uint64_t age = highestReceivedCounter - counter;
+        if (age >= 64 || (receivedCounterWindow & ((uint64_t)1 << age))) return false;
+    }
+
+    if (!Open(receiveKey, counter, buffer, payloadLength, buffer + payloadLength + COUNTER_BYTES)) return false;
+
+    if (counter > highestReceivedCounter || receivedCounterWindow == 0) {
+        uint64_t shift         = counter - highestReceivedCounter;
+        receivedCounterWindow  = shift >= 64 ? 0 : receivedCounterWindow << shift;
+        receivedCounterWindow |= 1;
+        highestReceivedCounter = counter;
+    } else {
+        receivedCounterWindow |= (uint64_t)1 << (highestReceivedCounter - counter);
+    }
+
+    length = payloadLength;
+    return true;
+}
+
+#endif // RAKNET_DATAGRAM_ENCRYPTION
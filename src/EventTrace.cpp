@@ -0,0 +1,302 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "EventTrace.h"
+#include "DS_List.h"
+#include "GetTime.h"
+#include "RakMemoryOverride.h"
+#include "RakNetTypes.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+static const uint32_t     EVENT_TRACE_MAGIC        = 0x4b52544e; // "NTRK" when read in the other byte order
+static const uint32_t     EVENT_TRACE_VERSION      = 1;
+static const unsigned int EVENT_TRACE_RECORD_WORDS = sizeof(EventTraceRecord) / sizeof(uint64_t);
+// EventTraceRecord::thread is a byte
+static const unsigned int EVENT_TRACE_MAX_BUFFERS  = 256;
+// Set in EventTraceRecord::type when the address is SystemAddress::ToInteger() of an IPv6 address
+static const uint8_t      EVENT_TRACE_HASHED_IPV6  = 0x80;
+// DumpEventTrace() copies this many events at a time
+static const unsigned int EVENT_TRACE_DUMP_CHUNK   = 64;
+
+static_assert(
+    (EVENT_TRACE_RING_EVENTS & (EVENT_TRACE_RING_EVENTS - 1)) == 0,
+    "EVENT_TRACE_RING_EVENTS must be a power of two"
+);
+static_assert(EVENT_TRACE_TYPE_COUNT < EVENT_TRACE_HASHED_IPV6, "EventTraceType must leave EVENT_TRACE_HASHED_IPV6");
+
+struct EventTraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+};
+
+// Only the thread that owns a buffer writes events to it. Events are stored as atomic words so DumpEventTrace() can
+// copy an event while it is being written over, and tell by reserved that it was
+struct EventTraceBuffer {
+    std::atomic<uint64_t>     words[EVENT_TRACE_RING_EVENTS][EVENT_TRACE_RECORD_WORDS];
+    // Events started. Event i goes in slot i % EVENT_TRACE_RING_EVENTS
+    std::atomic<uint64_t>     reserved;
+    // Events finished. Never ahead of reserved
+    std::atomic<uint64_t>     written;
+    // eventTraceGeneration when the first event of this trace was written
+    std::atomic<unsigned int> generation;
+    std::atomic<bool>         owned;
+    uint8_t                   index;
+    EventTraceBuffer*         next;
+};
+
+// Gives the buffer back for another thread when the thread exits
+struct EventTraceThread {
+    EventTraceBuffer* buffer;
+    ~EventTraceThread() {
+        if (buffer) buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+std::atomic<bool> RakNet::eventTraceEnabled(false);
+// Pushed to the front and kept for the life of the process
+static std::atomic<EventTraceBuffer*> eventTraceBuffers(0);
+static std::atomic<unsigned int>      eventTraceBufferCount(0);
+// Incremented by StartEventTrace(), so each thread drops its old events before writing its first new one
+static std::atomic<unsigned int>      eventTraceGeneration(1);
+static thread_local EventTraceThread  eventTraceThread;
+
+static EventTraceBuffer* ClaimEventTraceBuffer(void) {
+    for (EventTraceBuffer* buffer = eventTraceBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        bool owned = false;
+        if (buffer->owned.load(std::memory_order_relaxed) == false
+            && buffer->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+            return buffer;
+    }
+
+    unsigned int index = eventTraceBufferCount.fetch_add(1);
+    if (index >= EVENT_TRACE_MAX_BUFFERS) {
+        eventTraceBufferCount.fetch_sub(1);
+        return 0;
+    }
+    EventTraceBuffer* buffer = RakNet::OP_NEW<EventTraceBuffer>(_FILE_AND_LINE_);
+    buffer->reserved         = 0;
+    buffer->written          = 0;
+    buffer->generation       = 0;
+    buffer->owned            = true;
+    buffer->index            = (uint8_t)index;
+    buffer->next             = eventTraceBuffers.load(std::memory_order_relaxed);
+    while (eventTraceBuffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release) == false) {}
+    return buffer;
+}
+
+void RakNet::StartEventTrace(void) {
+    eventTraceGeneration.fetch_add(1);
+    eventTraceEnabled.store(true);
+}
+void RakNet::StopEventTrace(void) { eventTraceEnabled.store(false); }
+void RakNet::TraceEvent(
+    EventTraceType       type,
+    const SystemAddress& systemAddress,
+    uint32_t             value1,
+    uint32_t             value2,
+    uint64_t             value3
+) {
+    EventTraceBuffer* buffer = eventTraceThread.buffer;
+    if (buffer == 0) {
+        buffer = eventTraceThread.buffer = ClaimEventTraceBuffer();
+        if (buffer == 0) return;
+    }
+
+    unsigned int generation = eventTraceGeneration.load(std::memory_order_relaxed);
+    if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+        buffer->reserved.store(0, std::memory_order_relaxed);
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+
+    EventTraceRecord record;
+    record.timeUs = RakNet::GetTimeUS();
+    record.value1 = value1;
+    record.value2 = value2;
+    record.value3 = value3;
+    record.port   = systemAddress.GetPort();
+    record.type   = (uint8_t)type;
+    record.thread = buffer->index;
+    if (systemAddress.GetIPVersion() == 4) record.address = systemAddress.address.addr4.sin_addr.s_addr;
+    else {
+        record.address  = (uint32_t)SystemAddress::ToInteger(systemAddress);
+        record.type    |= EVENT_TRACE_HASHED_IPV6;
+    }
+    uint64_t words[EVENT_TRACE_RECORD_WORDS];
+    memcpy(words, &record, sizeof(record));
+
+    uint64_t               event = buffer->written.load(std::memory_order_relaxed);
+    std::atomic<uint64_t>* slot  = buffer->words[event & (EVENT_TRACE_RING_EVENTS - 1)];
+    buffer->reserved.store(event + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned int i = 0; i < EVENT_TRACE_RECORD_WORDS; i++) slot[i].store(words[i], std::memory_order_relaxed);
+    buffer->written.store(event + 1, std::memory_order_release);
+}
+int RakNet::DumpEventTrace(FILE* fp) {
+    EventTraceFileHeader header;
+    header.magic      = EVENT_TRACE_MAGIC;
+    header.version    = EVENT_TRACE_VERSION;
+    header.recordSize = sizeof(EventTraceRecord);
+    header.reserved   = 0;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) return -1;
+
+    unsigned int     generation = eventTraceGeneration.load(std::memory_order_relaxed);
+    int              count      = 0;
+    EventTraceRecord chunk[EVENT_TRACE_DUMP_CHUNK];
+    for (EventTraceBuffer* buffer = eventTraceBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        if (buffer->generation.load(std::memory_order_acquire) != generation) continue;
+
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t event   = written > EVENT_TRACE_RING_EVENTS ? written - EVENT_TRACE_RING_EVENTS : 0;
+        while (event < written) {
+            uint64_t     first = event;
+            unsigned int size  = 0;
+            for (; event < written && size < EVENT_TRACE_DUMP_CHUNK; event++, size++) {
+                std::atomic<uint64_t>* slot = buffer->words[event & (EVENT_TRACE_RING_EVENTS - 1)];
+                uint64_t               words[EVENT_TRACE_RECORD_WORDS];
+                for (unsigned int i = 0; i < EVENT_TRACE_RECORD_WORDS; i++)
+                    words[i] = slot[i].load(std::memory_order_relaxed);
+                memcpy(&chunk[size], words, sizeof(EventTraceRecord));
+            }
+
+            // Leave out whatever the owner started writing over while copying
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t     reserved = buffer->reserved.load(std::memory_order_relaxed);
+            unsigned int skip     = 0;
+            if (buffer->generation.load(std::memory_order_relaxed) != generation) skip = size;
+            else if (reserved > EVENT_TRACE_RING_EVENTS && reserved - EVENT_TRACE_RING_EVENTS > first) {
+                uint64_t overwritten = reserved - EVENT_TRACE_RING_EVENTS - first;
+                skip                 = overwritten < size ? (unsigned int)overwritten : size;
+            }
+            if (size > skip) {
+                if (fwrite(chunk + skip, sizeof(EventTraceRecord), size - skip, fp) != size - skip) return -1;
+                count += (int)(size - skip);
+            }
+        }
+    }
+    return count;
+}
+int RakNet::DumpEventTrace(const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == 0) return -1;
+    int count = DumpEventTrace(fp);
+    if (fclose(fp) != 0) count = -1;
+    return count;
+}
+// A record read back from a file, with its position there. DumpEventTrace() writes each thread's events in the order
+// they were recorded, so the position orders the events a thread recorded in the same microsecond
+struct SortedEventTraceRecord {
+    EventTraceRecord record;
+    unsigned int     position;
+};
+static int EventTraceRecordComp(const void* a, const void* b) {
+    const SortedEventTraceRecord* left  = (const SortedEventTraceRecord*)a;
+    const SortedEventTraceRecord* right = (const SortedEventTraceRecord*)b;
+    if (left->record.timeUs != right->record.timeUs) return left->record.timeUs < right->record.timeUs ? -1 : 1;
+    if (left->record.thread != right->record.thread) return left->record.thread < right->record.thread ? -1 : 1;
+    // qsort is not stable, and positions are unique
+    return left->position < right->position ? -1 : (left->position > right->position ? 1 : 0);
+}
+const char* RakNet::EventTraceTypeToString(EventTraceType type) {
+    static const char* names[EVENT_TRACE_TYPE_COUNT] = {
+        "unknown",
+        "datagram_sent",
+        "datagram_received",
+        "ack_received",
+        "nak_received",
+        "message_resent",
+        "split_packet_assembled",
+        "congestion_window",
+        "connection_opened",
+        "connection_closed",
+    };
+    if ((unsigned int)type >= EVENT_TRACE_TYPE_COUNT) return names[0];
+    return names[type];
+}
+bool RakNet::DecodeEventTrace(FILE* in, FILE* out, bool csv) {
+    // What value1, value2 and value3 are called for each EventTraceType. 0 if unused
+    static const char* valueNames[EVENT_TRACE_TYPE_COUNT][3] = {
+        {"value1",       "value2",        "value3"   },
+        {"number",       "bytes",         "messages" },
+        {"number",       "bytes",         0          },
+        {"number",       0,               "rtt_us"   },
+        {"number",       0,               0          },
+        {"message",      "times_sent",    "bytes"    },
+        {"split_id",     "split_count",   "bytes"    },
+        {"cwnd",         "previous_cwnd", "bps_limit"},
+        {"incoming",     0,               0          },
+        {"connect_mode", 0,               0          },
+    };
+
+    EventTraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != EVENT_TRACE_MAGIC
+        || header.version != EVENT_TRACE_VERSION || header.recordSize != sizeof(EventTraceRecord))
+        return false;
+
+    DataStructures::List<SortedEventTraceRecord> records;
+    SortedEventTraceRecord                       sorted;
+    for (sorted.position = 0; fread(&sorted.record, sizeof(sorted.record), 1, in) == 1; sorted.position++)
+        records.Insert(sorted, _FILE_AND_LINE_);
+    if (records.Size() > 1) qsort(&records[0], records.Size(), sizeof(SortedEventTraceRecord), EventTraceRecordComp);
+
+    if (csv) fprintf(out, "time_us,thread,event,address,port,value1,value2,value3\n");
+    for (unsigned int i = 0; i < records.Size(); i++) {
+        const EventTraceRecord& r    = records[i].record;
+        unsigned int            type = r.type & ~EVENT_TRACE_HASHED_IPV6;
+        if (type >= EVENT_TRACE_TYPE_COUNT) type = 0;
+
+        char address[32];
+        if (r.type & EVENT_TRACE_HASHED_IPV6) sprintf(address, "ipv6#%08x", r.address);
+        else {
+            const unsigned char* bytes = (const unsigned char*)&r.address;
+            sprintf(address, "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        }
+
+        if (csv) {
+            fprintf(
+                out,
+                "%" PRINTF_64_BIT_MODIFIER "u,%u,%s,%s,%u,%u,%u,%" PRINTF_64_BIT_MODIFIER "u\n",
+                (unsigned long long)r.timeUs,
+                r.thread,
+                EventTraceTypeToString((EventTraceType)type),
+                address,
+                r.port,
+                r.value1,
+                r.value2,
+                (unsigned long long)r.value3
+            );
+            continue;
+        }
+
+        // Seconds since the first event
+        uint64_t elapsed = r.timeUs - records[0].record.timeUs;
+        fprintf(
+            out,
+            "%6" PRINTF_64_BIT_MODIFIER "u.%06u thread %-3u %-22s %s:%u",
+            (unsigned long long)(elapsed / 1000000),
+            (unsigned int)(elapsed % 1000000),
+            r.thread,
+            EventTraceTypeToString((EventTraceType)type),
+            address,
+            r.port
+        );
+        if (valueNames[type][0]) fprintf(out, " %s=%u", valueNames[type][0], r.value1);
+        if (valueNames[type][1]) fprintf(out, " %s=%u", valueNames[type][1], r.value2);
+        if (valueNames[type][2])
+            fprintf(out, " %s=%" PRINTF_64_BIT_MODIFIER "u", valueNames[type][2], (unsigned long long)r.value3);
+        fprintf(out, "\n");
+    }
+    return true;
+}
@@ -40,6 +40,8 @@ RakNet::TimeUS initialTime;
 
 static bool initialized = false;
 
+static RakNet::TimeSourceUS timeSource = 0;
+
 #if defined(GET_TIME_SPIKE_LIMIT) && GET_TIME_SPIKE_LIMIT > 0
 #include "SimpleMutex.h"
 RakNet::TimeUS lastNormalizedReturnedValue = 0;
@@ -135,8 +137,10 @@ RakNet::TimeUS GetTimeUS_Linux(void) {
 }
 #endif
 
-RakNet::TimeUS RakNet::GetTimeUS(void) {
+void RakNet::SetTimeSourceUS(TimeSourceUS source) { timeSource = source; }
 
+RakNet::TimeUS RakNet::GetTimeUS(void) {
+    if (timeSource) return timeSource();
 
 #if defined(_WIN32)
     return GetTimeUS_Windows();
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "GracePeriod.h"
+
+using namespace RakNet;
+
+GracePeriod::GracePeriod() {
+    phase.store(0, std::memory_order_relaxed);
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+    running = false;
+}
+unsigned int GracePeriod::EnterRead(void) const {
+    for (;;) {
+        unsigned int entered = phase.load(std::memory_order_seq_cst);
+        readers[entered & 1].fetch_add(1, std::memory_order_seq_cst);
+        // If Start() moved on in between, Poll() may already have seen the old counter empty, so count again in the new
+        // phase. Seeing the phase unchanged also means seeing everything made unreachable before the last Start()
+        if (phase.load(std::memory_order_seq_cst) == entered) return entered;
+        readers[entered & 1].fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+void GracePeriod::LeaveRead(unsigned int entered) const {
+    // Release, so the reads are done before Poll() sees the counter drop
+    readers[entered & 1].fetch_sub(1, std::memory_order_release);
+}
+void GracePeriod::Start(void) {
+    phase.fetch_add(1, std::memory_order_seq_cst);
+    running = true;
+}
+bool GracePeriod::Poll(void) {
+    if (running == false) return true;
+    unsigned int previous = phase.load(std::memory_order_relaxed) - 1;
+    if (readers[previous & 1].load(std::memory_order_seq_cst) != 0) return false;
+    running = false;
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "LatencyHistogram.h"
+#include <math.h>
+#include <string.h>
+
+using namespace RakNet;
+
+static_assert(
+    LATENCY_HISTOGRAM_SUB_BUCKET_BITS >= 2 && LATENCY_HISTOGRAM_SUB_BUCKET_BITS <= 16,
+    "LATENCY_HISTOGRAM_SUB_BUCKET_BITS must be between 2 and 16"
+);
+
+LatencyHistogram::LatencyHistogram() { Reset(); }
+void LatencyHistogram::Reset(void) {
+    memset(counts, 0, sizeof(counts));
+    totalCount = 0;
+    sum        = 0;
+    minimum    = (uint64_t)-1;
+    maximum    = 0;
+}
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    if (other.totalCount == 0) return;
+
+    for (unsigned int i = 0; i < BUCKET_COUNT; i++) counts[i] += other.counts[i];
+    totalCount += other.totalCount;
+    sum        += other.sum;
+    if (other.minimum < minimum) minimum = other.minimum;
+    if (other.maximum > maximum) maximum = other.maximum;
+}
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    if (totalCount == 0) return 0;
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+    uint64_t target = (uint64_t)ceil(percentile / 100.0 * (double)totalCount);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            uint64_t highest = GetBucketHighestValue(i);
+            return highest < maximum ? highest : maximum;
+        }
+    }
+    // Only if a bucket wrapped
+    return maximum;
+}
+uint64_t LatencyHistogram::GetBucketLowestValue(unsigned int index) {
+    if (index < 2 * SUB_BUCKET_HALF_COUNT) return index;
+
+    unsigned int shift = index / SUB_BUCKET_HALF_COUNT - 1;
+    return (uint64_t)(index % SUB_BUCKET_HALF_COUNT + SUB_BUCKET_HALF_COUNT) << shift;
+}
+uint64_t LatencyHistogram::GetBucketHighestValue(unsigned int index) {
+    if (index == BUCKET_COUNT - 1) return (uint64_t)-1;
+    return GetBucketLowestValue(index + 1) - 1;
+}
@@ -12,6 +12,7 @@
 #include "NativeFeatureIncludes.h"
 #if _RAKNET_SUPPORT_RPC4Plugin == 1
 
+#include "BitStreamArena.h"
 #include "DS_Queue.h"
 #include "MessageIdentifiers.h"
 #include "PacketizedTCP.h"
@@ -35,6 +36,10 @@ struct GlobalRegistration {
 static GlobalRegistration globalRegistrationBuffer[RPC4_GLOBAL_REGISTRATION_MAX_FUNCTIONS];
 static unsigned int       globalRegistrationIndex = 0;
 
+// Storage for the message built by RPC4::Call(), reset at the start of each call. One per thread, so calls made from
+// several threads at once do not write over each other's messages
+static thread_local RakNet::BitStreamArena callArena;
+
 RPC4GlobalRegistration::RPC4GlobalRegistration(
     const char* uniqueID,
     void (*functionPointer)(RakNet::BitStream* userData, Packet* packet)
@@ -264,6 +269,7 @@ void RPC4::CallLoopback(const char* uniqueID, RakNet::BitStream* bitStream) {
     if (bitStream) {
         bitStream->ResetReadPointer();
         out.AlignWriteToByteBoundary();
+        out.Reserve(bitStream->GetNumberOfBitsUsed());
         out.Write(bitStream);
     }
     if (mRakPeerInterface) p = AllocatePacketUnified(out.GetNumberOfBytesUsed());
@@ -290,7 +296,9 @@ void RPC4::Call(
     const AddressOrGUID systemIdentifier,
     bool                broadcast
 ) {
+    callArena.Reset();
     RakNet::BitStream out;
+    out.SetArena(&callArena);
     out.Write((MessageID)ID_RPC_PLUGIN);
     out.Write((MessageID)ID_RPC4_CALL);
     out.WriteCompressed(uniqueID);
@@ -298,6 +306,7 @@ void RPC4::Call(
     if (bitStream) {
         bitStream->ResetReadPointer();
         out.AlignWriteToByteBoundary();
+        out.Reserve(bitStream->GetNumberOfBitsUsed());
         out.Write(bitStream);
     }
     SendUnified(&out, priority, reliability, orderingChannel, systemIdentifier, broadcast);
@@ -319,6 +328,7 @@ bool RPC4::CallBlocking(
     if (bitStream) {
         bitStream->ResetReadPointer();
         out.AlignWriteToByteBoundary();
+        out.Reserve(bitStream->GetNumberOfBitsUsed());
         out.Write(bitStream);
     }
     RakAssert(returnData);
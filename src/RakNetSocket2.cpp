@@ -63,7 +63,7 @@ void     RakNetSocket2::SetRecvEventHandler(RNS2EventHandler* _eventHandler) { e
 RNS2Type RakNetSocket2::GetSocketType(void) const { return socketType; }
 void     RakNetSocket2::SetSocketType(RNS2Type t) { socketType = t; }
 bool     RakNetSocket2::IsBerkleySocket(void) const {
-    return socketType != RNS2T_CHROME && socketType != RNS2T_WINDOWS_STORE_8;
+    return socketType != RNS2T_CHROME && socketType != RNS2T_WINDOWS_STORE_8 && socketType != RNS2T_VIRTUAL;
 }
 SystemAddress RakNetSocket2::GetBoundAddress(void) const { return boundAddress; }
 
@@ -107,6 +107,14 @@ void RakNetSocket2::GetMyIP(SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_I
 unsigned int      RakNetSocket2::GetUserConnectionSocketIndex(void) const { return userConnectionSocketIndex; }
 void              RakNetSocket2::SetUserConnectionSocketIndex(unsigned int i) { userConnectionSocketIndex = i; }
 RNS2EventHandler* RakNetSocket2::GetEventHandler(void) const { return eventHandler; }
+void RakNetSocket2::SendMultiple(
+    RNS2_SendParameters* sendParameters,
+    unsigned int         count,
+    const char*          file,
+    unsigned int         line
+) {
+    for (unsigned int i = 0; i < count; i++) Send(&sendParameters[i], file, line);
+}
 
 void RakNetSocket2::DomainNameToIP(const char* domainName, char ip[65]) {
 #if defined(WINDOWS_STORE_RT)
@@ -409,6 +417,74 @@ RNS2BindResult RNS2_Linux::Bind(RNS2_BerkleyBindParameters* bindParameters, cons
 RNS2SendResult RNS2_Linux::Send(RNS2_SendParameters* sendParameters, const char* file, unsigned int line) {
     return Send_Windows_Linux_360NoVDP(rns2Socket, sendParameters, file, line);
 }
+void RNS2_Linux::SendMultiple(
+    RNS2_SendParameters* sendParameters,
+    unsigned int         count,
+    const char*          file,
+    unsigned int         line
+) {
+#if defined(__linux__) && !defined(ANDROID)
+    static const unsigned int MAX_MESSAGES = 64;
+    mmsghdr                   messages[MAX_MESSAGES];
+    iovec                     buffers[MAX_MESSAGES];
+
+    while (count > 0) {
+        unsigned int batch;
+        for (batch = 0; batch < count && batch < MAX_MESSAGES; batch++) {
+            RNS2_SendParameters* sp = &sendParameters[batch];
+            // The TTL is an option of the socket, so Send() handles those one at a time
+            if (sp->ttl > 0) break;
+
+            memset(&messages[batch], 0, sizeof(messages[batch]));
+            buffers[batch].iov_base            = sp->data;
+            buffers[batch].iov_len             = (size_t)sp->length;
+            messages[batch].msg_hdr.msg_iov    = &buffers[batch];
+            messages[batch].msg_hdr.msg_iovlen = 1;
+            if (sp->systemAddress.address.addr4.sin_family == AF_INET) {
+                messages[batch].msg_hdr.msg_name    = &sp->systemAddress.address.addr4;
+                messages[batch].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            } else {
+#if RAKNET_SUPPORT_IPV6 == 1
+                messages[batch].msg_hdr.msg_name    = &sp->systemAddress.address.addr6;
+                messages[batch].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+#else
+                break;
+#endif
+            }
+        }
+
+        if (batch == 0) {
+            Send(sendParameters, file, line);
+            sendParameters++;
+            count--;
+            continue;
+        }
+
+        unsigned int sent = 0;
+        while (sent < batch) {
+            int result = sendmmsg(rns2Socket, messages + sent, batch - sent, 0);
+            if (result > 0) {
+                sent += (unsigned int)result;
+            } else if (result < 0 && errno == EINTR) {
+                continue;
+            } else {
+                // Like Send(), give up on the datagram that failed and carry on with the rest
+                RAKNET_DEBUG_PRINTF(
+                    "sendmmsg failed with code %i for char %i and length %i.\n",
+                    errno,
+                    sendParameters[sent].data[0],
+                    sendParameters[sent].length
+                );
+                sent++;
+            }
+        }
+        sendParameters += batch;
+        count          -= batch;
+    }
+#else
+    RakNetSocket2::SendMultiple(sendParameters, count, file, line);
+#endif
+}
 void RNS2_Linux::GetMyIP(SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS]) {
     return GetMyIP_Windows_Linux(addresses);
 }
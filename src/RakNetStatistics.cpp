@@ -153,5 +153,23 @@ void RakNet::StatisticsToString(RakNetStatistics* s, char* buffer, int verbosity
             );
             strcat(buffer, buff2);
         }
+        if (s->runningTotal[ACK_ONLY_DATAGRAMS_SENT] != 0) {
+            char buff2[128];
+            sprintf(
+                buff2,
+                "Ack only datagrams sent per second   %" PRINTF_64_BIT_MODIFIER "u\n",
+                (long long unsigned int)s->valueOverLastSecond[ACK_ONLY_DATAGRAMS_SENT]
+            );
+            strcat(buffer, buff2);
+        }
+        if (s->datagramsRecoveredByFEC != 0) {
+            char buff2[128];
+            sprintf(
+                buff2,
+                "Datagrams recovered by FEC           %" PRINTF_64_BIT_MODIFIER "u\n",
+                (long long unsigned int)s->datagramsRecoveredByFEC
+            );
+            strcat(buffer, buff2);
+        }
     }
 }
@@ -88,6 +88,7 @@ SocketDescriptor::SocketDescriptor() {
     remotePortRakNetWasStartedOn_PS3_PSP2 = 0;
     extraSocketOptions                    = 0;
     socketFamily                          = AF_INET;
+    virtualNetwork                        = 0;
 }
 SocketDescriptor::SocketDescriptor(unsigned short _port, const char* _hostAddress) {
 #ifdef __native_client__
@@ -101,6 +102,7 @@ SocketDescriptor::SocketDescriptor(unsigned short _port, const char* _hostAddres
     else hostAddress[0] = 0;
     extraSocketOptions = 0;
     socketFamily       = AF_INET;
+    virtualNetwork     = 0;
 }
 
 // Defaults to not in peer to peer mode for NetworkIDs.  This only sends the localSystemAddress portion in the BitStream
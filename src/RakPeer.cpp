@@ -32,6 +32,7 @@
 
 #include "DR_SHA1.h"
 #include "DS_HuffmanEncodingTree.h"
+#include "EventTrace.h"
 #include "GetTime.h"
 #include "MessageIdentifiers.h"
 #include "NetworkIDManager.h"
@@ -47,6 +48,7 @@
 #include "StringCompressor.h"
 #include "StringTable.h"
 #include "SuperFastHash.h"
+#include "VirtualNetwork.h"
 #include "WSAStartupSingleton.h"
 #include "gettimeofday.h"
 #include <ctype.h> // toupper
@@ -69,6 +71,13 @@ RAK_THREAD_DECLARATION(RecvFromLoop);
 RAK_THREAD_DECLARATION(UDTConnect);
 } // namespace RakNet
 #define REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE 8
+// How often the network thread looks for pages of remoteSystemList to free, and how many sweeps in a row a page must be
+// found unused first. The delay keeps late lookups of a system that just disconnected working
+#define REMOTE_SYSTEM_PAGE_SWEEP_INTERVAL_MS 1000
+#define REMOTE_SYSTEM_PAGE_IDLE_SWEEPS       10
+// Bits of the byte appended to ID_CONNECTION_REQUEST_ACCEPTED and ID_NEW_INCOMING_CONNECTION, for what the sender can
+// receive. Older versions neither append nor read it, so each side only uses what the other has announced
+#define CONNECTION_FEATURE_FEC 0x01
 
 #if !defined(__APPLE__) && !defined(__APPLE_CC__)
 #include <stdlib.h> // malloc
@@ -205,14 +214,17 @@ RakPeer::RakPeer() {
     maximumIncomingConnections = 0;
     maximumNumberOfPeers       = 0;
     // remoteSystemListSize=0;
-    remoteSystemList     = 0;
-    activeSystemList     = 0;
-    activeSystemListSize = 0;
-    remoteSystemLookup   = 0;
+    remoteSystemPageIdleSweeps    = 0;
+    nextRemoteSystemPageSweepTime = 0;
+    activeSystemListSize          = 0;
+    remoteSystemLookup            = 0;
+    remoteSystemLookupSize        = 0;
     bytesSentPerSecond = bytesReceivedPerSecond = 0;
     endThreads                                  = true;
     isMainLoopThreadActive                      = false;
     incomingDatagramEventHandler                = 0;
+    updateProfiler.store(0, std::memory_order_relaxed);
+    updateProfiling.store(false, std::memory_order_relaxed);
 
 
     // isRecvfromThreadActive=false;
@@ -228,12 +240,15 @@ RakPeer::RakPeer() {
     incomingPasswordLength       = 0;
     splitMessageProgressInterval = 0;
     // unreliableTimeout=0;
-    unreliableTimeout    = 1000;
-    maxOutgoingBPS       = 0;
-    firstExternalID      = UNASSIGNED_SYSTEM_ADDRESS;
-    myGuid               = UNASSIGNED_RAKNET_GUID;
-    userUpdateThreadPtr  = 0;
-    userUpdateThreadData = 0;
+    unreliableTimeout     = 1000;
+    ackFrequencyDatagrams = 0;
+    ackFrequencyMaxDelay  = 0;
+    maxOutgoingBPS        = 0;
+    firstExternalID       = UNASSIGNED_SYSTEM_ADDRESS;
+    myGuid                = UNASSIGNED_RAKNET_GUID;
+    userUpdateThreadPtr   = 0;
+    userUpdateThreadData  = 0;
+    memset(forwardErrorCorrectionGroupSize, 0, sizeof(forwardErrorCorrectionGroupSize));
 
 #ifdef _DEBUG
     // Wait longer to disconnect in debug so I don't get disconnected while tracing
@@ -262,6 +277,8 @@ RakPeer::RakPeer() {
 
     quitAndDataEvents.InitEvent();
     limitConnectionFrequencyFromTheSameIP = false;
+    datagramEncryptionEnabled             = false;
+    datagramEncryptionRequired            = false;
     ResetSendReceipt();
 }
 
@@ -280,6 +297,9 @@ RakPeer::~RakPeer() {
 
     quitAndDataEvents.CloseEvent();
 
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    if (profiler) RakNet::OP_DELETE(profiler, _FILE_AND_LINE_);
+
 #if LIBCAT_SECURITY == 1
     // Encryption and security
     CAT_AUDIT_PRINTF(
@@ -363,12 +383,38 @@ StartupResult RakPeer::Startup(
 
     if (maxConnections <= 0) return INVALID_MAX_CONNECTIONS;
 
+    // Sockets on a VirtualNetwork are driven by the caller, so they cannot share a RakPeer with real ones
+    VirtualNetwork* virtualNetwork = socketDescriptors[0].virtualNetwork;
+    uint32_t        i;
+    for (i = 1; i < socketDescriptorCount; i++) {
+        if ((socketDescriptors[i].virtualNetwork != 0) != (virtualNetwork != 0)) return INVALID_SOCKET_DESCRIPTORS;
+    }
+
     DerefAllSockets();
 
+    // Peers on a VirtualNetwork take their GUID from it, so it is unique and the same on every run
+    if (virtualNetwork) myGuid.g = virtualNetwork->GenerateGUID();
 
-    uint32_t i;
     // Go through all socket descriptors and precreate sockets on the specified addresses
     for (i = 0; i < socketDescriptorCount; i++) {
+        if (socketDescriptors[i].virtualNetwork) {
+            RNS2_Virtual* virtualSocket = RakNet::OP_NEW<RNS2_Virtual>(_FILE_AND_LINE_);
+            virtualSocket->SetUserConnectionSocketIndex(i);
+            RNS2BindResult br = virtualSocket->Bind(
+                socketDescriptors[i].virtualNetwork,
+                socketDescriptors[i].hostAddress,
+                socketDescriptors[i].port,
+                this
+            );
+            if (br != BR_SUCCESS) {
+                RakNetSocket2Allocator::DeallocRNS2(virtualSocket);
+                DerefAllSockets();
+                return SOCKET_PORT_ALREADY_IN_USE;
+            }
+            socketList.Push(virtualSocket, _FILE_AND_LINE_);
+            continue;
+        }
+
         /*
         const char *addrToBind;
         if (socketDescriptors[i].hostAddress[0]==0)
@@ -518,6 +564,12 @@ socketDescriptors[i].socketFamily ); #endif
     }
     // #endif
 
+    // The real interfaces are not reachable from a VirtualNetwork
+    if (virtualNetwork) {
+        ipList[0] = socketList[0]->GetBoundAddress();
+        for (i = 1; i < MAXIMUM_NUMBER_OF_INTERNAL_IDS; i++) ipList[i] = UNASSIGNED_SYSTEM_ADDRESS;
+    }
+
 
     if (maximumNumberOfPeers == 0) {
         // Don't allow more incoming connections than we have peers.
@@ -530,38 +582,13 @@ socketDescriptors[i].socketFamily ); #endif
         // remoteSystemListSize = maxConnections;// * 11 / 10 + 1;
 
         // remoteSystemList in Single thread
-        // remoteSystemList = RakNet::OP_NEW<RemoteSystemStruct[ remoteSystemListSize ]>( _FILE_AND_LINE_ );
-        remoteSystemList = RakNet::OP_NEW_ARRAY<RemoteSystemStruct>(maximumNumberOfPeers, _FILE_AND_LINE_);
-
-        remoteSystemLookup = RakNet::OP_NEW_ARRAY<RemoteSystemIndex*>(
-            (unsigned int)maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE,
-            _FILE_AND_LINE_
-        );
-
-        activeSystemList = RakNet::OP_NEW_ARRAY<RemoteSystemStruct*>(maximumNumberOfPeers, _FILE_AND_LINE_);
-
-        for (i = 0; i < maximumNumberOfPeers; i++)
-        // for ( i = 0; i < remoteSystemListSize; i++ )
-        {
-            // remoteSystemList in Single thread
-            remoteSystemList[i].isActive                = false;
-            remoteSystemList[i].systemAddress           = UNASSIGNED_SYSTEM_ADDRESS;
-            remoteSystemList[i].guid                    = UNASSIGNED_RAKNET_GUID;
-            remoteSystemList[i].myExternalSystemAddress = UNASSIGNED_SYSTEM_ADDRESS;
-            remoteSystemList[i].connectMode             = RemoteSystemStruct::NO_ACTION;
-            remoteSystemList[i].MTUSize                 = defaultMTUSize;
-            remoteSystemList[i].remoteSystemIndex       = (SystemIndex)i;
-#ifdef _DEBUG
-            remoteSystemList[i].reliabilityLayer.ApplyNetworkSimulator(_packetloss, _minExtraPing, _extraPingVariance);
-#endif
-
-            // All entries in activeSystemList have valid pointers all the time.
-            activeSystemList[i] = &remoteSystemList[i];
-        }
-
-        for (unsigned int j = 0; j < (unsigned int)maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE; j++) {
-            remoteSystemLookup[j] = 0;
-        }
+        // Only the page directories are allocated here. Slots are allocated by AllocateRemoteSystemPage() as
+        // connections arrive
+        remoteSystemList.Init(maximumNumberOfPeers, _FILE_AND_LINE_);
+        activeSystemList.Init(maximumNumberOfPeers, _FILE_AND_LINE_);
+        remoteSystemPageIdleSweeps = RakNet::OP_NEW_ARRAY<unsigned char>(remoteSystemList.PageCount(), _FILE_AND_LINE_);
+        memset(remoteSystemPageIdleSweeps, 0, remoteSystemList.PageCount());
+        nextRemoteSystemPageSweepTime = RakNet::GetTimeMS() + REMOTE_SYSTEM_PAGE_SWEEP_INTERVAL_MS;
     }
 
     // For histogram statistics
@@ -577,7 +604,8 @@ socketDescriptors[i].socketFamily ); #endif
         ClearBufferedPackets();
         ClearSocketQueryOutput();
 
-        if (isMainLoopThreadActive == false) {
+        // On a VirtualNetwork, the caller runs RunUpdateCycle() instead
+        if (isMainLoopThreadActive == false && virtualNetwork == 0) {
 #if RAKPEER_USER_THREADED != 1
 
             int errorCode;
@@ -631,7 +659,7 @@ socketDescriptors[i].socketFamily ); #endif
 
 #if RAKPEER_USER_THREADED != 1
         // Wait for the threads to activate.  When they are active they will set these variables to true
-        while (isMainLoopThreadActive == false) RakSleep(10);
+        while (isMainLoopThreadActive == false && virtualNetwork == 0) RakSleep(10);
 #endif // RAKPEER_USER_THREADED!=1
     }
 
@@ -785,6 +813,29 @@ bool RakPeer::IsInSecurityExceptionList(const char* ip) {
     return false;
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetDatagramEncryption(bool enabled, bool required) {
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    datagramEncryptionEnabled  = enabled;
+    datagramEncryptionRequired = enabled && required;
+#else
+    (void)enabled;
+    (void)required;
+#endif
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::IsDatagramEncryptionActive(const AddressOrGUID systemIdentifier) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    RemoteSystemStruct* remoteSystem = GetRemoteSystem(systemIdentifier, false, true);
+    return remoteSystem != 0 && remoteSystem->reliabilityLayer.IsDatagramCipherActive();
+#else
+    (void)systemIdentifier;
+    return false;
+#endif
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Description:
 // Sets how many incoming connections are allowed.  If this is less than the number of players currently connected, no
@@ -964,14 +1015,16 @@ void RakPeer::Shutdown(
     //	SystemAddress systemAddress;
     RakNet::TimeMS time;
     // unsigned short systemListSize = remoteSystemListSize; // This is done for threading reasons
-    unsigned int systemListSize = maximumNumberOfPeers;
+    unsigned int        systemListSize = remoteSystemList.Size();
+    RemoteSystemStruct* remoteSystem;
 
     if (blockDuration > 0) {
         for (i = 0; i < systemListSize; i++) {
             // remoteSystemList in user thread
-            if (remoteSystemList[i].isActive)
+            remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->isActive)
                 NotifyAndFlagForShutdown(
-                    remoteSystemList[i].systemAddress,
+                    remoteSystem->systemAddress,
                     false,
                     orderingChannel,
                     disconnectionNotificationPriority
@@ -984,7 +1037,8 @@ void RakPeer::Shutdown(
             anyActive = false;
             for (j = 0; j < systemListSize; j++) {
                 // remoteSystemList in user thread
-                if (remoteSystemList[j].isActive) {
+                remoteSystem = remoteSystemList.GetPointer(j);
+                if (remoteSystem && remoteSystem->isActive) {
                     anyActive = true;
                     break;
                 }
@@ -1058,14 +1112,19 @@ void RakPeer::Shutdown(
     //	char c=0;
     //	unsigned int socketIndex;
     // remoteSystemList in Single thread
+    // The network thread has stopped, so no more pages are added or removed
+    systemListSize = remoteSystemList.Size();
     for (i = 0; i < systemListSize; i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem == 0) continue;
+
         // Reserve this reliability layer for ourselves
-        remoteSystemList[i].isActive = false;
+        remoteSystem->isActive = false;
 
         // Remove any remaining packets
-        RakAssert(remoteSystemList[i].MTUSize <= MAXIMUM_MTU_SIZE);
-        remoteSystemList[i].reliabilityLayer.Reset(false, remoteSystemList[i].MTUSize, false);
-        remoteSystemList[i].rakNetSocket = 0;
+        RakAssert(remoteSystem->MTUSize <= MAXIMUM_MTU_SIZE);
+        remoteSystem->reliabilityLayer.Reset(false, remoteSystem->MTUSize, false);
+        remoteSystem->rakNetSocket = 0;
     }
 
 
@@ -1105,11 +1164,13 @@ void RakPeer::Shutdown(
 
 
     // Clear out the reliability layer list in case we want to reallocate it in a successive call to Init.
-    RemoteSystemStruct* temp = remoteSystemList;
-    remoteSystemList         = 0;
-    RakNet::OP_DELETE_ARRAY(temp, _FILE_AND_LINE_);
-    RakNet::OP_DELETE_ARRAY(activeSystemList, _FILE_AND_LINE_);
-    activeSystemList = 0;
+    FreeRetiredRemoteSystemPages();
+    remoteSystemList.Clear(_FILE_AND_LINE_);
+    activeSystemList.Clear(_FILE_AND_LINE_);
+    if (remoteSystemPageIdleSweeps) {
+        RakNet::OP_DELETE_ARRAY(remoteSystemPageIdleSweeps, _FILE_AND_LINE_);
+        remoteSystemPageIdleSweeps = 0;
+    }
 
     ClearRemoteSystemLookup();
 
@@ -1140,7 +1201,7 @@ inline bool RakPeer::IsActive(void) const { return endThreads == false; }
 bool RakPeer::GetConnectionList(SystemAddress* remoteSystems, unsigned short* numberOfSystems) const {
     if (numberOfSystems == 0) return false;
 
-    if (remoteSystemList == 0 || endThreads == true) {
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) {
         if (numberOfSystems) *numberOfSystems = 0;
         return false;
     }
@@ -1214,7 +1275,7 @@ uint32_t RakPeer::Send(
 
     if (data == 0 || length < 0) return 0;
 
-    if (remoteSystemList == 0 || endThreads == true) return 0;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return 0;
 
     if (broadcast == false && systemIdentifier.IsUndefined()) return 0;
 
@@ -1281,7 +1342,7 @@ uint32_t RakPeer::Send(
 
     if (bitStream->GetNumberOfBytesUsed() == 0) return 0;
 
-    if (remoteSystemList == 0 || endThreads == true) return 0;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return 0;
 
     if (broadcast == false && systemIdentifier.IsUndefined()) return 0;
 
@@ -1361,7 +1422,7 @@ uint32_t RakPeer::SendList(
 
     if (data == 0 || lengths == 0) return 0;
 
-    if (remoteSystemList == 0 || endThreads == true) return 0;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return 0;
 
     if (numParameters == 0) return 0;
 
@@ -1451,8 +1512,11 @@ Packet* RakPeer::Receive(void) {
 #endif
     */
 
-    for (i = 0; i < pluginListTS.Size(); i++) { pluginListTS[i]->Update(); }
-    for (i = 0; i < pluginListNTS.Size(); i++) { pluginListNTS[i]->Update(); }
+    if (updateProfiling.load(std::memory_order_acquire)) ProfilePluginUpdates();
+    else {
+        for (i = 0; i < pluginListTS.Size(); i++) { pluginListTS[i]->Update(); }
+        for (i = 0; i < pluginListNTS.Size(); i++) { pluginListNTS[i]->Update(); }
+    }
 
     do {
         packetReturnMutex.Lock();
@@ -1461,6 +1525,13 @@ Packet* RakPeer::Receive(void) {
         packetReturnMutex.Unlock();
         if (packet == 0) return 0;
 
+        // Taken now, as a plugin may deallocate the packet. Zero while SetUpdateProfiling() is off
+        bool          profiling      = updateProfiling.load(std::memory_order_acquire);
+        uint64_t      messageStartNs = profiling ? UpdateProfiler::GetTimeNS() : 0;
+        unsigned char messageId      = packet->data[0];
+        if (messageId == ID_TIMESTAMP && packet->length > sizeof(unsigned char) + sizeof(RakNet::Time))
+            messageId = packet->data[sizeof(unsigned char) + sizeof(RakNet::Time)];
+
         //		unsigned char msgId;
         if ((packet->length >= sizeof(unsigned char) + sizeof(RakNet::Time))
             && ((unsigned char)packet->data[0] == ID_TIMESTAMP)) {
@@ -1481,7 +1552,8 @@ Packet* RakPeer::Receive(void) {
         CallPluginCallbacks(pluginListNTS, packet);
 
         for (i = 0; i < pluginListTS.Size(); i++) {
-            pluginResult = pluginListTS[i]->OnReceive(packet);
+            if (messageStartNs) pluginResult = ProfileOnReceive(pluginListTS[i], packet);
+            else pluginResult = pluginListTS[i]->OnReceive(packet);
             if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE) {
                 DeallocatePacket(packet);
                 packet = 0; // Will do the loop again and get another packet
@@ -1493,7 +1565,8 @@ Packet* RakPeer::Receive(void) {
         }
 
         for (i = 0; i < pluginListNTS.Size(); i++) {
-            pluginResult = pluginListNTS[i]->OnReceive(packet);
+            if (messageStartNs) pluginResult = ProfileOnReceive(pluginListNTS[i], packet);
+            else pluginResult = pluginListNTS[i]->OnReceive(packet);
             if (pluginResult == RR_STOP_PROCESSING_AND_DEALLOCATE) {
                 DeallocatePacket(packet);
                 packet = 0; // Will do the loop again and get another packet
@@ -1504,6 +1577,7 @@ Packet* RakPeer::Receive(void) {
             }
         }
 
+        if (messageStartNs) RecordMessageProfile(messageId, messageStartNs);
     } while (packet == 0);
 
 #ifdef _DEBUG
@@ -1626,6 +1700,7 @@ void RakPeer::CancelConnectionAttempt(const SystemAddress target) {
 #pragma warning(disable : 4702) // warning C4702: unreachable code
 #endif
 ConnectionState RakPeer::GetConnectionState(const AddressOrGUID systemIdentifier) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (systemIdentifier.systemAddress != UNASSIGNED_SYSTEM_ADDRESS) {
         unsigned int i = 0;
         requestedConnectionQueueMutex.Lock();
@@ -1647,9 +1722,11 @@ ConnectionState RakPeer::GetConnectionState(const AddressOrGUID systemIdentifier
 
     if (index == -1) return IS_NOT_CONNECTED;
 
-    if (remoteSystemList[index].isActive == false) return IS_DISCONNECTED;
+    RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(index);
+    if (remoteSystem == 0) return IS_NOT_CONNECTED;
+    if (remoteSystem->isActive == false) return IS_DISCONNECTED;
 
-    switch (remoteSystemList[index].connectMode) {
+    switch (remoteSystem->connectMode) {
     case RemoteSystemStruct::DISCONNECT_ASAP:
         return IS_DISCONNECTING;
     case RemoteSystemStruct::DISCONNECT_ASAP_SILENTLY:
@@ -1683,6 +1760,7 @@ ConnectionState RakPeer::GetConnectionState(const AddressOrGUID systemIdentifier
 // An integer from 0 to the maximum number of peers -1, or -1 if that player is not found
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetIndexFromSystemAddress(const SystemAddress systemAddress) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     return GetIndexFromSystemAddress(systemAddress, false);
 }
 
@@ -1697,14 +1775,16 @@ int RakPeer::GetIndexFromSystemAddress(const SystemAddress systemAddress) const
 // A valid systemAddress or UNASSIGNED_SYSTEM_ADDRESS if no such player at that index
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 SystemAddress RakPeer::GetSystemAddressFromIndex(unsigned int index) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     // remoteSystemList in user thread
     // if ( index >= 0 && index < remoteSystemListSize )
-    if (index < maximumNumberOfPeers)
-        if (remoteSystemList[index].isActive
-            && remoteSystemList[index].connectMode
+    RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(index);
+    if (remoteSystem)
+        if (remoteSystem->isActive
+            && remoteSystem->connectMode
                    == RakPeer::RemoteSystemStruct::CONNECTED) // Don't give the user players that aren't fully
                                                               // connected, since sends will fail
-            return remoteSystemList[index].systemAddress;
+            return remoteSystem->systemAddress;
 
     return UNASSIGNED_SYSTEM_ADDRESS;
 }
@@ -1715,14 +1795,16 @@ SystemAddress RakPeer::GetSystemAddressFromIndex(unsigned int index) {
 // \return The RakNetGUID
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RakNetGUID RakPeer::GetGUIDFromIndex(unsigned int index) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     // remoteSystemList in user thread
     // if ( index >= 0 && index < remoteSystemListSize )
-    if (index < maximumNumberOfPeers)
-        if (remoteSystemList[index].isActive
-            && remoteSystemList[index].connectMode
+    RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(index);
+    if (remoteSystem)
+        if (remoteSystem->isActive
+            && remoteSystem->connectMode
                    == RakPeer::RemoteSystemStruct::CONNECTED) // Don't give the user players that aren't fully
                                                               // connected, since sends will fail
-            return remoteSystemList[index].guid;
+            return remoteSystem->guid;
 
     return UNASSIGNED_RAKNET_GUID;
 }
@@ -1739,17 +1821,19 @@ void RakPeer::GetSystemList(
     DataStructures::List<SystemAddress>& addresses,
     DataStructures::List<RakNetGUID>&    guids
 ) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     addresses.Clear(false, _FILE_AND_LINE_);
     guids.Clear(false, _FILE_AND_LINE_);
 
-    if (remoteSystemList == 0 || endThreads == true) return;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return;
 
     unsigned int i;
     for (i = 0; i < activeSystemListSize; i++) {
-        if ((activeSystemList[i])->isActive
-            && (activeSystemList[i])->connectMode == RakPeer::RemoteSystemStruct::CONNECTED) {
-            addresses.Push((activeSystemList[i])->systemAddress, _FILE_AND_LINE_);
-            guids.Push((activeSystemList[i])->guid, _FILE_AND_LINE_);
+        RemoteSystemStruct* remoteSystem = GetActiveSystem(i);
+        if (remoteSystem && remoteSystem->isActive
+            && remoteSystem->connectMode == RakPeer::RemoteSystemStruct::CONNECTED) {
+            addresses.Push(remoteSystem->systemAddress, _FILE_AND_LINE_);
+            guids.Push(remoteSystem->guid, _FILE_AND_LINE_);
         }
     }
 }
@@ -2021,6 +2105,7 @@ bool RakPeer::Ping(
 // target - whose time to read
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetAveragePing(const AddressOrGUID systemIdentifier) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     int                 sum, quantity;
     RemoteSystemStruct* remoteSystem = GetRemoteSystem(systemIdentifier, false, false);
 
@@ -2043,6 +2128,7 @@ int RakPeer::GetAveragePing(const AddressOrGUID systemIdentifier) {
 // target - whose time to read
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetLastPing(const AddressOrGUID systemIdentifier) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RemoteSystemStruct* remoteSystem = GetRemoteSystem(systemIdentifier, false, false);
 
     if (remoteSystem == 0) return -1;
@@ -2062,6 +2148,7 @@ int RakPeer::GetLastPing(const AddressOrGUID systemIdentifier) const {
 // target - whose time to read
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetLowestPing(const AddressOrGUID systemIdentifier) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RemoteSystemStruct* remoteSystem = GetRemoteSystem(systemIdentifier, false, false);
 
     if (remoteSystem == 0) return -1;
@@ -2085,6 +2172,7 @@ void RakPeer::SetOccasionalPing(bool doPing) { occasionalPing = doPing; }
 /// Returns 0 if the system is unknown
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RakNet::Time RakPeer::GetClockDifferential(const AddressOrGUID systemIdentifier) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RemoteSystemStruct* remoteSystem = GetRemoteSystem(systemIdentifier, false, false);
     if (remoteSystem == 0) return 0;
     return GetClockDifferentialInt(remoteSystem);
@@ -2149,6 +2237,7 @@ void RakPeer::GetOfflinePingResponse(char** data, unsigned int* length) {
 // Note that unlike in previous versions, this is a struct and is not sequential
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 SystemAddress RakPeer::GetInternalID(const SystemAddress systemAddress, const int index) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS) {
         return ipList[index];
     } else {
@@ -2190,6 +2279,7 @@ void RakPeer::SetInternalID(SystemAddress systemAddress, int index) {
 // target: Which remote system you are referring to for your external ID
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 SystemAddress RakPeer::GetExternalID(const SystemAddress target) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     unsigned      i;
     SystemAddress inactiveExternalId;
 
@@ -2198,11 +2288,12 @@ SystemAddress RakPeer::GetExternalID(const SystemAddress target) const {
     if (target == UNASSIGNED_SYSTEM_ADDRESS) return firstExternalID;
 
     // First check for active connection with this systemAddress
-    for (i = 0; i < maximumNumberOfPeers; i++) {
-        if (remoteSystemList[i].systemAddress == target) {
-            if (remoteSystemList[i].isActive) return remoteSystemList[i].myExternalSystemAddress;
-            else if (remoteSystemList[i].myExternalSystemAddress != UNASSIGNED_SYSTEM_ADDRESS)
-                inactiveExternalId = remoteSystemList[i].myExternalSystemAddress;
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->systemAddress == target) {
+            if (remoteSystem->isActive) return remoteSystem->myExternalSystemAddress;
+            else if (remoteSystem->myExternalSystemAddress != UNASSIGNED_SYSTEM_ADDRESS)
+                inactiveExternalId = remoteSystem->myExternalSystemAddress;
         }
     }
 
@@ -2224,17 +2315,27 @@ SystemAddress RakPeer::GetMyBoundAddress(const int socketIndex) {
 const RakNetGUID& RakPeer::GetGuidFromSystemAddress(const SystemAddress input) const {
     if (input == UNASSIGNED_SYSTEM_ADDRESS) return myGuid;
 
-    if (input.systemIndex != (SystemIndex)-1 && input.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[input.systemIndex].systemAddress == input)
-        return remoteSystemList[input.systemIndex].guid;
+    // The slot may be freed once the read scope ends, so return a copy that lives as long as the reference
+    static thread_local RakNetGUID guid;
+    GracePeriod::ReadScope         readScope(remoteSystemReaders);
+    RemoteSystemStruct*            remoteSystem;
+    if (input.systemIndex != (SystemIndex)-1) {
+        remoteSystem = remoteSystemList.GetPointer(input.systemIndex);
+        if (remoteSystem && remoteSystem->systemAddress == input) {
+            guid = remoteSystem->guid;
+            return guid;
+        }
+    }
 
     unsigned int i;
-    for (i = 0; i < maximumNumberOfPeers; i++) {
-        if (remoteSystemList[i].systemAddress == input) {
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->systemAddress == input) {
             // Set the systemIndex so future lookups will be fast
-            remoteSystemList[i].guid.systemIndex = (SystemIndex)i;
+            remoteSystem->guid.systemIndex = (SystemIndex)i;
 
-            return remoteSystemList[i].guid;
+            guid = remoteSystem->guid;
+            return guid;
         }
     }
 
@@ -2244,19 +2345,23 @@ const RakNetGUID& RakPeer::GetGuidFromSystemAddress(const SystemAddress input) c
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 unsigned int RakPeer::GetSystemIndexFromGuid(const RakNetGUID input) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (input == UNASSIGNED_RAKNET_GUID) return (unsigned int)-1;
 
     if (input == myGuid) return (unsigned int)-1;
 
-    if (input.systemIndex != (SystemIndex)-1 && input.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[input.systemIndex].guid == input)
-        return input.systemIndex;
+    RemoteSystemStruct* remoteSystem;
+    if (input.systemIndex != (SystemIndex)-1) {
+        remoteSystem = remoteSystemList.GetPointer(input.systemIndex);
+        if (remoteSystem && remoteSystem->guid == input) return input.systemIndex;
+    }
 
     unsigned int i;
-    for (i = 0; i < maximumNumberOfPeers; i++) {
-        if (remoteSystemList[i].guid == input) {
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->guid == input) {
             // Set the systemIndex so future lookups will be fast
-            remoteSystemList[i].guid.systemIndex = (SystemIndex)i;
+            remoteSystem->guid.systemIndex = (SystemIndex)i;
 
             return i;
         }
@@ -2268,21 +2373,25 @@ unsigned int RakPeer::GetSystemIndexFromGuid(const RakNetGUID input) const {
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 SystemAddress RakPeer::GetSystemAddressFromGuid(const RakNetGUID input) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (input == UNASSIGNED_RAKNET_GUID) return UNASSIGNED_SYSTEM_ADDRESS;
 
     if (input == myGuid) return GetInternalID(UNASSIGNED_SYSTEM_ADDRESS);
 
-    if (input.systemIndex != (SystemIndex)-1 && input.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[input.systemIndex].guid == input)
-        return remoteSystemList[input.systemIndex].systemAddress;
+    RemoteSystemStruct* remoteSystem;
+    if (input.systemIndex != (SystemIndex)-1) {
+        remoteSystem = remoteSystemList.GetPointer(input.systemIndex);
+        if (remoteSystem && remoteSystem->guid == input) return remoteSystem->systemAddress;
+    }
 
     unsigned int i;
-    for (i = 0; i < maximumNumberOfPeers; i++) {
-        if (remoteSystemList[i].guid == input) {
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->guid == input) {
             // Set the systemIndex so future lookups will be fast
-            remoteSystemList[i].guid.systemIndex = (SystemIndex)i;
+            remoteSystem->guid.systemIndex = (SystemIndex)i;
 
-            return remoteSystemList[i].systemAddress;
+            return remoteSystem->systemAddress;
         }
     }
 
@@ -2292,18 +2401,21 @@ SystemAddress RakPeer::GetSystemAddressFromGuid(const RakNetGUID input) const {
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 bool RakPeer::GetClientPublicKeyFromSystemAddress(const SystemAddress input, char* client_public_key) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
 #if LIBCAT_SECURITY == 1
     if (input == UNASSIGNED_SYSTEM_ADDRESS) return false;
 
     char* copy_source = 0;
 
-    if (input.systemIndex != (SystemIndex)-1 && input.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[input.systemIndex].systemAddress == input) {
-        copy_source = remoteSystemList[input.systemIndex].client_public_key;
+    RemoteSystemStruct* remoteSystem = 0;
+    if (input.systemIndex != (SystemIndex)-1) remoteSystem = remoteSystemList.GetPointer(input.systemIndex);
+    if (remoteSystem && remoteSystem->systemAddress == input) {
+        copy_source = remoteSystem->client_public_key;
     } else {
-        for (unsigned int i = 0; i < maximumNumberOfPeers; i++) {
-            if (remoteSystemList[i].systemAddress == input) {
-                copy_source = remoteSystemList[i].client_public_key;
+        for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+            remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->systemAddress == input) {
+                copy_source = remoteSystem->client_public_key;
                 break;
             }
         }
@@ -2333,14 +2445,14 @@ bool RakPeer::GetClientPublicKeyFromSystemAddress(const SystemAddress input, cha
 // \param[in] time Time, in MS
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::SetTimeoutTime(RakNet::TimeMS timeMS, const SystemAddress target) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (target == UNASSIGNED_SYSTEM_ADDRESS) {
         defaultTimeoutTime = timeMS;
 
         unsigned i;
-        for (i = 0; i < maximumNumberOfPeers; i++) {
-            if (remoteSystemList[i].isActive) {
-                if (remoteSystemList[i].isActive) remoteSystemList[i].reliabilityLayer.SetTimeoutTime(timeMS);
-            }
+        for (i = 0; i < remoteSystemList.Size(); i++) {
+            RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->isActive) remoteSystem->reliabilityLayer.SetTimeoutTime(timeMS);
         }
     } else {
         RemoteSystemStruct* remoteSystem = GetRemoteSystemFromSystemAddress(target, false, true);
@@ -2352,6 +2464,7 @@ void RakPeer::SetTimeoutTime(RakNet::TimeMS timeMS, const SystemAddress target)
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 RakNet::TimeMS RakPeer::GetTimeoutTime(const SystemAddress target) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (target == UNASSIGNED_SYSTEM_ADDRESS) {
         return defaultTimeoutTime;
     } else {
@@ -2368,6 +2481,7 @@ RakNet::TimeMS RakPeer::GetTimeoutTime(const SystemAddress target) {
 // Returns the current MTU size
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetMTUSize(const SystemAddress target) const {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     if (target != UNASSIGNED_SYSTEM_ADDRESS) {
         RemoteSystemStruct* rss = GetRemoteSystemFromSystemAddress(target, false, true);
         if (rss) return rss->MTUSize;
@@ -2469,10 +2583,13 @@ bool RakPeer::AdvertiseSystem(
 // returned. Defaults to 0 (never return this notification)
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::SetSplitMessageProgressInterval(int interval) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RakAssert(interval >= 0);
     splitMessageProgressInterval = interval;
-    for (unsigned short i = 0; i < maximumNumberOfPeers; i++)
-        remoteSystemList[i].reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
+    for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem) remoteSystem->reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
+    }
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2487,9 +2604,43 @@ int RakPeer::GetSplitMessageProgressInterval(void) const { return splitMessagePr
 // timeoutMS How many ms to wait before simply not sending an unreliable message.
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::SetUnreliableTimeout(RakNet::TimeMS timeoutMS) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     unreliableTimeout = timeoutMS;
-    for (unsigned short i = 0; i < maximumNumberOfPeers; i++)
-        remoteSystemList[i].reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
+    for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem) remoteSystem->reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Enables forward error correction for UNRELIABLE and UNRELIABLE_SEQUENCED messages on orderingChannel
+// groupSize Protected datagrams per parity datagram, 0 to disable
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    RakAssert(orderingChannel < NUMBER_OF_ORDERED_STREAMS);
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS) return;
+    if (groupSize > FEC_MAX_GROUP_SIZE) groupSize = FEC_MAX_GROUP_SIZE;
+
+    forwardErrorCorrectionGroupSize[orderingChannel] = (unsigned char)groupSize;
+    for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem) remoteSystem->reliabilityLayer.SetForwardErrorCorrection(orderingChannel, groupSize);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Acknowledge every datagramsPerAck datagrams or after maxAckDelay, whichever is first, and carry acks on outgoing data
+// Only used with remote systems that enabled it too
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetAckFrequency(unsigned int datagramsPerAck, RakNet::TimeMS maxAckDelay) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    ackFrequencyDatagrams = datagramsPerAck;
+    ackFrequencyMaxDelay  = maxAckDelay;
+    for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem) remoteSystem->reliabilityLayer.SetAckFrequency(ackFrequencyDatagrams, ackFrequencyMaxDelay);
+    }
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2568,6 +2719,8 @@ void RakPeer::DetachPlugin(PluginInterface2* plugin) {
             pluginListTS.RemoveFromEnd();
         }
     }
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    if (profiler) profiler->RemovePlugin(plugin);
     plugin->OnDetach();
     plugin->SetRakPeerInterface(0);
 }
@@ -2608,7 +2761,17 @@ void RakPeer::ChangeSystemAddress(RakNetGUID guid, const SystemAddress& systemAd
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 Packet* RakPeer::AllocatePacket(unsigned dataSize) { return AllocPacket(dataSize, _FILE_AND_LINE_); }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Peers on a VirtualNetwork have no network thread, so the calling thread owns socketList and remoteSystemList
+static bool IsOnVirtualNetwork(const DataStructures::List<RakNetSocket2*>& socketList) {
+    return socketList.Size() > 0 && socketList[0]->GetSocketType() == RNS2T_VIRTUAL;
+}
 RakNetSocket2* RakPeer::GetSocket(const SystemAddress target) {
+    if (IsOnVirtualNetwork(socketList)) {
+        if (target == UNASSIGNED_SYSTEM_ADDRESS) return socketList[0];
+        RemoteSystemStruct* remoteSystem = GetRemoteSystem(target, true, true);
+        return remoteSystem ? remoteSystem->rakNetSocket : 0;
+    }
+
     // Send a query to the thread to get the socket, and return when we got it
     BufferedCommandStruct* bcs;
     bcs                   = bufferedCommands.Allocate(_FILE_AND_LINE_);
@@ -2640,6 +2803,10 @@ RakNetSocket2* RakPeer::GetSocket(const SystemAddress target) {
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::GetSockets(DataStructures::List<RakNetSocket2*>& sockets) {
     sockets.Clear(false, _FILE_AND_LINE_);
+    if (IsOnVirtualNetwork(socketList)) {
+        sockets = socketList;
+        return;
+    }
 
     // Send a query to the thread to get the socket, and return when we got it
     BufferedCommandStruct* bcs;
@@ -2679,11 +2846,14 @@ void RakPeer::ReleaseSockets(DataStructures::List<RakNetSocket2*>& sockets) { so
 
 #ifdef _DEBUG
 void RakPeer::ApplyNetworkSimulator(float packetloss, unsigned short minExtraPing, unsigned short extraPingVariance) {
-    if (remoteSystemList) {
-        unsigned short i;
-        for (i = 0; i < maximumNumberOfPeers; i++)
-            // for (i=0; i < remoteSystemListSize; i++)
-            remoteSystemList[i].reliabilityLayer.ApplyNetworkSimulator(packetloss, minExtraPing, extraPingVariance);
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    // Pages allocated later pick these up in AllocateRemoteSystemPage()
+    unsigned int i;
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        // for (i=0; i < remoteSystemListSize; i++)
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem)
+            remoteSystem->reliabilityLayer.ApplyNetworkSimulator(packetloss, minExtraPing, extraPingVariance);
     }
 
     _packetloss        = packetloss;
@@ -2786,6 +2956,7 @@ bool RakPeer::SendOutOfBand(
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RakNetStatistics* RakPeer::GetStatistics(const SystemAddress systemAddress, RakNetStatistics* rns) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     static RakNetStatistics staticStatistics;
     RakNetStatistics*       systemStats;
     if (rns == 0) systemStats = &staticStatistics;
@@ -2794,10 +2965,11 @@ RakNetStatistics* RakPeer::GetStatistics(const SystemAddress systemAddress, RakN
     if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS) {
         bool firstWrite = false;
         // Return a crude sum
-        for (unsigned short i = 0; i < maximumNumberOfPeers; i++) {
-            if (remoteSystemList[i].isActive) {
+        for (unsigned int i = 0; i < remoteSystemList.Size(); i++) {
+            RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->isActive) {
                 RakNetStatistics rnsTemp;
-                remoteSystemList[i].reliabilityLayer.GetStatistics(&rnsTemp);
+                remoteSystem->reliabilityLayer.GetStatistics(&rnsTemp);
 
                 if (firstWrite == false) {
                     memcpy(systemStats, &rnsTemp, sizeof(RakNetStatistics));
@@ -2823,33 +2995,151 @@ void RakPeer::GetStatisticsList(
     DataStructures::List<RakNetGUID>&       guids,
     DataStructures::List<RakNetStatistics>& statistics
 ) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     addresses.Clear(false, _FILE_AND_LINE_);
     guids.Clear(false, _FILE_AND_LINE_);
     statistics.Clear(false, _FILE_AND_LINE_);
 
-    if (remoteSystemList == 0 || endThreads == true) return;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return;
 
     unsigned int i;
     for (i = 0; i < activeSystemListSize; i++) {
-        if ((activeSystemList[i])->isActive
-            && (activeSystemList[i])->connectMode == RakPeer::RemoteSystemStruct::CONNECTED) {
-            addresses.Push((activeSystemList[i])->systemAddress, _FILE_AND_LINE_);
-            guids.Push((activeSystemList[i])->guid, _FILE_AND_LINE_);
+        RemoteSystemStruct* remoteSystem = GetActiveSystem(i);
+        if (remoteSystem && remoteSystem->isActive
+            && remoteSystem->connectMode == RakPeer::RemoteSystemStruct::CONNECTED) {
+            addresses.Push(remoteSystem->systemAddress, _FILE_AND_LINE_);
+            guids.Push(remoteSystem->guid, _FILE_AND_LINE_);
             RakNetStatistics rns;
-            (activeSystemList[i])->reliabilityLayer.GetStatistics(&rns);
+            remoteSystem->reliabilityLayer.GetStatistics(&rns);
             statistics.Push(rns, _FILE_AND_LINE_);
         }
     }
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetStatisticsSnapshots(
+    SystemAddress*    addresses,
+    RakNetGUID*       guids,
+    RakNetStatistics* statistics,
+    unsigned int      maxSystems
+) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return 0;
+
+    // Only the slots are read from this thread. Whether a system is connected, and its address and guid, come from the
+    // snapshot the network thread published, which is never torn
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < activeSystemListSize && count < maxSystems; i++) {
+        RemoteSystemStruct* remoteSystem = GetActiveSystem(i);
+        if (remoteSystem
+            && remoteSystem->reliabilityLayer.GetStatisticsSnapshot(
+                &statistics[count],
+                addresses ? &addresses[count] : 0,
+                guids ? &guids[count] : 0
+            ))
+            count++;
+    }
+    return count;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetStatisticsSnapshot(const SystemAddress systemAddress, RakNetStatistics* rns) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    if (endThreads == true) return false;
+    RemoteSystemStruct* remoteSystem = GetRemoteSystemFromSystemAddress(systemAddress, false, true);
+    // The slot may have been given to another system since it was looked up
+    SystemAddress snapshotAddress;
+    return remoteSystem && remoteSystem->reliabilityLayer.GetStatisticsSnapshot(rns, &snapshotAddress)
+        && snapshotAddress == systemAddress;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetLatencyHistogram(
+    const SystemAddress  systemAddress,
+    LatencyHistogramType type,
+    LatencyHistogram*    histogram
+) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+#if LATENCY_HISTOGRAMS == 1
+    if (remoteSystemList.Capacity() == 0 || endThreads == true || (unsigned int)type >= LATENCY_HISTOGRAM_TYPE_COUNT)
+        return false;
+
+    // The network thread keeps adding to the live histograms, so only read the copies it publishes
+    LatencyHistogram snapshot;
+    histogram->Reset();
+    if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS) {
+        for (unsigned int i = 0; i < activeSystemListSize; i++) {
+            RemoteSystemStruct* remoteSystem = GetActiveSystem(i);
+            if (remoteSystem && remoteSystem->isActive
+                && remoteSystem->connectMode == RakPeer::RemoteSystemStruct::CONNECTED
+                && remoteSystem->reliabilityLayer.GetLatencyHistogramSnapshot(type, &snapshot))
+                histogram->Merge(snapshot);
+        }
+        return true;
+    }
+
+    RemoteSystemStruct* remoteSystem = GetRemoteSystemFromSystemAddress(systemAddress, false, true);
+    if (remoteSystem == 0) return false;
+    // The slot may have been reused for another system since the lookup
+    SystemAddress snapshotAddress;
+    if (remoteSystem->reliabilityLayer.GetLatencyHistogramSnapshot(type, &snapshot, &snapshotAddress)
+        && snapshotAddress == systemAddress)
+        histogram->Merge(snapshot);
+    return true;
+#else
+    (void)systemAddress;
+    (void)type;
+    (void)histogram;
+    return false;
+#endif
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 bool RakPeer::GetStatistics(const unsigned int index, RakNetStatistics* rns) {
-    if (index < maximumNumberOfPeers && remoteSystemList[index].isActive) {
-        remoteSystemList[index].reliabilityLayer.GetStatistics(rns);
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(index);
+    if (remoteSystem && remoteSystem->isActive) {
+        remoteSystem->reliabilityLayer.GetStatistics(rns);
         return true;
     }
     return false;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetUpdateProfiling(bool enabled) {
+    if (enabled) {
+        UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+        if (profiler) profiler->Reset();
+        else {
+            profiler = RakNet::OP_NEW<UpdateProfiler>(_FILE_AND_LINE_);
+            UpdateProfiler* expected = 0;
+            // Another thread started profiling first
+            if (updateProfiler.compare_exchange_strong(expected, profiler, std::memory_order_acq_rel) == false)
+                RakNet::OP_DELETE(profiler, _FILE_AND_LINE_);
+        }
+    }
+    updateProfiling.store(enabled, std::memory_order_release);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetUpdatePhaseProfile(UpdateProfilePhase phase, LatencyHistogram* histogram) {
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    if (profiler == 0 || (unsigned int)phase >= UPDATE_PHASE_COUNT) return false;
+    profiler->ReadPhase(phase, histogram);
+    return true;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetPluginProfile(
+    PluginInterface2*       plugin,
+    UpdateProfilePluginCall call,
+    LatencyHistogram*       histogram
+) {
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    if (profiler == 0 || (unsigned int)call >= UPDATE_PLUGIN_CALL_COUNT) return false;
+    return profiler->ReadPlugin(plugin, call, histogram);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetMessageProfile(unsigned char messageId, LatencyHistogram* histogram) {
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    if (profiler == 0) return false;
+    profiler->ReadMessage(messageId, histogram);
+    return true;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::GetReceiveBufferSize(void) {
     unsigned int size;
     packetReturnMutex.Lock();
@@ -2859,46 +3149,58 @@ unsigned int RakPeer::GetReceiveBufferSize(void) {
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetIndexFromSystemAddress(const SystemAddress systemAddress, bool calledFromNetworkThread) const {
-    unsigned i;
+    unsigned            i;
+    RemoteSystemStruct* remoteSystem;
 
     if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS) return -1;
 
-    if (systemAddress.systemIndex != (SystemIndex)-1 && systemAddress.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[systemAddress.systemIndex].systemAddress == systemAddress
-        && remoteSystemList[systemAddress.systemIndex].isActive)
-        return systemAddress.systemIndex;
+    if (systemAddress.systemIndex != (SystemIndex)-1) {
+        remoteSystem = remoteSystemList.GetPointer(systemAddress.systemIndex);
+        if (remoteSystem && remoteSystem->systemAddress == systemAddress && remoteSystem->isActive)
+            return systemAddress.systemIndex;
+    }
 
     if (calledFromNetworkThread) {
         return GetRemoteSystemIndex(systemAddress);
     } else {
         // remoteSystemList in user and network thread
-        for (i = 0; i < maximumNumberOfPeers; i++)
-            if (remoteSystemList[i].isActive && remoteSystemList[i].systemAddress == systemAddress) return i;
+        for (i = 0; i < remoteSystemList.Size(); i++) {
+            remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->isActive && remoteSystem->systemAddress == systemAddress) return i;
+        }
 
         // If no active results found, try previously active results.
-        for (i = 0; i < maximumNumberOfPeers; i++)
-            if (remoteSystemList[i].systemAddress == systemAddress) return i;
+        for (i = 0; i < remoteSystemList.Size(); i++) {
+            remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->systemAddress == systemAddress) return i;
+        }
     }
 
     return -1;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetIndexFromGuid(const RakNetGUID guid) {
-    unsigned i;
+    unsigned            i;
+    RemoteSystemStruct* remoteSystem;
 
     if (guid == UNASSIGNED_RAKNET_GUID) return -1;
 
-    if (guid.systemIndex != (SystemIndex)-1 && guid.systemIndex < maximumNumberOfPeers
-        && remoteSystemList[guid.systemIndex].guid == guid && remoteSystemList[guid.systemIndex].isActive)
-        return guid.systemIndex;
+    if (guid.systemIndex != (SystemIndex)-1) {
+        remoteSystem = remoteSystemList.GetPointer(guid.systemIndex);
+        if (remoteSystem && remoteSystem->guid == guid && remoteSystem->isActive) return guid.systemIndex;
+    }
 
     // remoteSystemList in user and network thread
-    for (i = 0; i < maximumNumberOfPeers; i++)
-        if (remoteSystemList[i].isActive && remoteSystemList[i].guid == guid) return i;
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->isActive && remoteSystem->guid == guid) return i;
+    }
 
     // If no active results found, try previously active results.
-    for (i = 0; i < maximumNumberOfPeers; i++)
-        if (remoteSystemList[i].guid == guid) return i;
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->guid == guid) return i;
+    }
 
     return -1;
 }
@@ -2993,6 +3295,7 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest(
     unsigned       timeBetweenSendConnectionAttemptsMS,
     RakNet::TimeMS timeoutTime
 ) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RakAssert(passwordDataLength <= 256);
     RakAssert(remotePort != 0);
     SystemAddress systemAddress;
@@ -3023,6 +3326,9 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest(
     memcpy(rcs->outgoingPassword, passwordData, passwordDataLength);
     rcs->outgoingPasswordLength = (unsigned char)passwordDataLength;
     rcs->timeoutTime            = timeoutTime;
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    rcs->datagramCipherKeysGenerated = false;
+#endif
 
 #if LIBCAT_SECURITY == 1
     CAT_AUDIT_PRINTF("AUDIT: In SendConnectionRequest()\n");
@@ -3061,6 +3367,7 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest(
     RakNet::TimeMS timeoutTime,
     RakNetSocket2* socket
 ) {
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
     RakAssert(passwordDataLength <= 256);
     SystemAddress systemAddress;
     systemAddress.FromStringExplicitPort(host, remotePort);
@@ -3085,6 +3392,9 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest(
     memcpy(rcs->outgoingPassword, passwordData, passwordDataLength);
     rcs->outgoingPasswordLength = (unsigned char)passwordDataLength;
     rcs->timeoutTime            = timeoutTime;
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    rcs->datagramCipherKeysGenerated = false;
+#endif
     rcs->socket                 = socket;
 
 #if LIBCAT_SECURITY == 1
@@ -3125,31 +3435,34 @@ RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystemFromSystemAddress(
     bool                calledFromNetworkThread,
     bool                onlyActive
 ) const {
-    unsigned i;
+    unsigned            i;
+    RemoteSystemStruct* remoteSystem;
 
     if (systemAddress == UNASSIGNED_SYSTEM_ADDRESS) return 0;
 
     if (calledFromNetworkThread) {
         unsigned int index = GetRemoteSystemIndex(systemAddress);
         if (index != (unsigned int)-1) {
-            if (onlyActive == false || remoteSystemList[index].isActive == true) {
-                RakAssert(remoteSystemList[index].systemAddress == systemAddress);
-                return remoteSystemList + index;
+            remoteSystem = &remoteSystemList[index];
+            if (onlyActive == false || remoteSystem->isActive == true) {
+                RakAssert(remoteSystem->systemAddress == systemAddress);
+                return remoteSystem;
             }
         }
     } else {
-        int deadConnectionIndex = -1;
+        RemoteSystemStruct* deadConnection = 0;
 
         // Active connections take priority.  But if there are no active connections, return the first systemAddress
         // match found
-        for (i = 0; i < maximumNumberOfPeers; i++) {
-            if (remoteSystemList[i].systemAddress == systemAddress) {
-                if (remoteSystemList[i].isActive) return remoteSystemList + i;
-                else if (deadConnectionIndex == -1) deadConnectionIndex = i;
+        for (i = 0; i < remoteSystemList.Size(); i++) {
+            remoteSystem = remoteSystemList.GetPointer(i);
+            if (remoteSystem && remoteSystem->systemAddress == systemAddress) {
+                if (remoteSystem->isActive) return remoteSystem;
+                else if (deadConnection == 0) deadConnection = remoteSystem;
             }
         }
 
-        if (deadConnectionIndex != -1 && onlyActive == false) return remoteSystemList + deadConnectionIndex;
+        if (deadConnection != 0 && onlyActive == false) return deadConnection;
     }
 
     return 0;
@@ -3159,9 +3472,10 @@ RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystemFromGUID(const RakNetGUID g
     if (guid == UNASSIGNED_RAKNET_GUID) return 0;
 
     unsigned i;
-    for (i = 0; i < maximumNumberOfPeers; i++) {
-        if (remoteSystemList[i].guid == guid && (onlyActive == false || remoteSystemList[i].isActive)) {
-            return remoteSystemList + i;
+    for (i = 0; i < remoteSystemList.Size(); i++) {
+        RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(i);
+        if (remoteSystem && remoteSystem->guid == guid && (onlyActive == false || remoteSystem->isActive)) {
+            return remoteSystem;
         }
     }
     return 0;
@@ -3299,6 +3613,7 @@ void RakPeer::OnConnectionRequest(RakPeer::RemoteSystemStruct* remoteSystem, Rak
     for (unsigned int i = 0; i < MAXIMUM_NUMBER_OF_INTERNAL_IDS; i++) bitStream.Write(ipList[i]);
     bitStream.Write(incomingTimestamp);
     bitStream.Write(RakNet::GetTime());
+    bitStream.Write((unsigned char)CONNECTION_FEATURE_FEC);
 
     SendImmediate(
         (char*)bitStream.GetData(),
@@ -3314,6 +3629,12 @@ void RakPeer::OnConnectionRequest(RakPeer::RemoteSystemStruct* remoteSystem, Rak
     );
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ReadConnectionFeatures(RakNet::BitStream* bitStream, RemoteSystemStruct* remoteSystem) {
+    unsigned char features = 0;
+    if (bitStream->GetNumberOfUnreadBits() >= 8) bitStream->Read(features);
+    remoteSystem->reliabilityLayer.SetRemoteSupportsFEC((features & CONNECTION_FEATURE_FEC) != 0);
+}
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::NotifyAndFlagForShutdown(
     const SystemAddress systemAddress,
@@ -3354,15 +3675,17 @@ void RakPeer::NotifyAndFlagForShutdown(
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::GetNumberOfRemoteInitiatedConnections(void) const {
-    if (remoteSystemList == 0 || endThreads == true) return 0;
+    GracePeriod::ReadScope readScope(remoteSystemReaders);
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return 0;
 
     unsigned int numberOfIncomingConnections;
     numberOfIncomingConnections = 0;
     unsigned int i;
     for (i = 0; i < activeSystemListSize; i++) {
-        if ((activeSystemList[i])->isActive
-            && (activeSystemList[i])->connectMode == RakPeer::RemoteSystemStruct::CONNECTED
-            && (activeSystemList[i])->weInitiatedTheConnection == false) {
+        RemoteSystemStruct* remoteSystem = GetActiveSystem(i);
+        if (remoteSystem && remoteSystem->isActive
+            && remoteSystem->connectMode == RakPeer::RemoteSystemStruct::CONNECTED
+            && remoteSystem->weInitiatedTheConnection == false) {
             numberOfIncomingConnections++;
         }
     }
@@ -3389,10 +3712,11 @@ RakPeer::RemoteSystemStruct* RakPeer::AssignSystemAddressToRemoteSystemList(
 
     if (limitConnectionFrequencyFromTheSameIP) {
         if (IsLoopbackAddress(systemAddress, false) == false) {
-            for (i = 0; i < maximumNumberOfPeers; i++) {
-                if (remoteSystemList[i].isActive == true
-                    && remoteSystemList[i].systemAddress.EqualsExcludingPort(systemAddress)
-                    && time >= remoteSystemList[i].connectionTime && time - remoteSystemList[i].connectionTime < 100) {
+            for (i = 0; i < remoteSystemList.Size(); i++) {
+                remoteSystem = remoteSystemList.GetPointer(i);
+                if (remoteSystem && remoteSystem->isActive == true
+                    && remoteSystem->systemAddress.EqualsExcludingPort(systemAddress)
+                    && time >= remoteSystem->connectionTime && time - remoteSystem->connectionTime < 100) {
                     // 4/13/09 Attackers can flood ID_OPEN_CONNECTION_REQUEST and use up all available connection slots
                     // Ignore connection attempts if this IP address connected within the last 100 milliseconds
                     *thisIPConnectedRecently = true;
@@ -3408,10 +3732,16 @@ RakPeer::RemoteSystemStruct* RakPeer::AssignSystemAddressToRemoteSystemList(
 
     *thisIPConnectedRecently = false;
     for (assignedIndex = 0; assignedIndex < maximumNumberOfPeers; assignedIndex++) {
-        if (remoteSystemList[assignedIndex].isActive == false) {
+        remoteSystem = remoteSystemList.GetPointer(assignedIndex);
+        if (remoteSystem == 0) {
+            // Every allocated slot below this is in use
+            remoteSystem = AllocateRemoteSystemPage(remoteSystemList.PageOf(assignedIndex));
+            if (remoteSystem == 0) return 0;
+            remoteSystem += assignedIndex % remoteSystemList.PageSize();
+        }
+        if (remoteSystem->isActive == false) {
             // printf("--- Address %s has become active\n", systemAddress.ToString());
 
-            remoteSystem = remoteSystemList + assignedIndex;
             ReferenceRemoteSystem(systemAddress, assignedIndex);
             remoteSystem->MTUSize = defaultMTUSize;
             remoteSystem->guid    = guid;
@@ -3423,6 +3753,14 @@ RakPeer::RemoteSystemStruct* RakPeer::AssignSystemAddressToRemoteSystemList(
             remoteSystem->reliabilityLayer.Reset(true, remoteSystem->MTUSize, useSecurity);
             remoteSystem->reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
             remoteSystem->reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
+            for (unsigned char orderingChannel = 0; orderingChannel < NUMBER_OF_ORDERED_STREAMS; orderingChannel++) {
+                if (forwardErrorCorrectionGroupSize[orderingChannel] != 0)
+                    remoteSystem->reliabilityLayer.SetForwardErrorCorrection(
+                        orderingChannel,
+                        forwardErrorCorrectionGroupSize[orderingChannel]
+                    );
+            }
+            remoteSystem->reliabilityLayer.SetAckFrequency(ackFrequencyDatagrams, ackFrequencyMaxDelay);
             remoteSystem->reliabilityLayer.SetTimeoutTime(defaultTimeoutTime);
             AddToActiveSystemList(assignedIndex);
             if (incomingRakNetSocket->GetBoundAddress() == bindingAddress) {
@@ -3521,6 +3859,9 @@ ipListFoundIndexStr, incomingRakNetSocket->GetSocketFamily() );
             remoteSystem->connectionTime                     = time;
             remoteSystem->myExternalSystemAddress            = UNASSIGNED_SYSTEM_ADDRESS;
             remoteSystem->lastReliableSend                   = time;
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+            remoteSystem->datagramCipherSuite = DCS_NONE;
+#endif
 
 #ifdef _DEBUG
             int indexLoopupCheck = GetIndexFromSystemAddress(systemAddress, true);
@@ -3563,7 +3904,7 @@ RakNet::Time RakPeer::GetBestClockDifferential(const SystemAddress systemAddress
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::RemoteSystemLookupHashIndex(const SystemAddress& sa) const {
-    return SystemAddress::ToInteger(sa) % ((unsigned int)maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE);
+    return SystemAddress::ToInteger(sa) % remoteSystemLookupSize;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ReferenceRemoteSystem(const SystemAddress& sa, unsigned int remoteSystemListIndex) {
@@ -3640,6 +3981,7 @@ void RakPeer::ReferenceRemoteSystem(const SystemAddress& sa, unsigned int remote
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::DereferenceRemoteSystem(const SystemAddress& sa) {
+    if (remoteSystemLookupSize == 0) return;
     unsigned int       hashIndex = RemoteSystemLookupHashIndex(sa);
     RemoteSystemIndex* cur       = remoteSystemLookup[hashIndex];
     RemoteSystemIndex* last      = 0;
@@ -3659,6 +4001,8 @@ void RakPeer::DereferenceRemoteSystem(const SystemAddress& sa) {
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::GetRemoteSystemIndex(const SystemAddress& sa) const {
+    // Nothing has been allocated yet
+    if (remoteSystemLookupSize == 0) return (unsigned int)-1;
     unsigned int       hashIndex = RemoteSystemLookupHashIndex(sa);
     RemoteSystemIndex* cur       = remoteSystemLookup[hashIndex];
     while (cur != 0) {
@@ -3671,17 +4015,139 @@ unsigned int RakPeer::GetRemoteSystemIndex(const SystemAddress& sa) const {
 RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystem(const SystemAddress& sa) const {
     unsigned int remoteSystemIndex = GetRemoteSystemIndex(sa);
     if (remoteSystemIndex == (unsigned int)-1) return 0;
-    return remoteSystemList + remoteSystemIndex;
+    return &remoteSystemList[remoteSystemIndex];
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ClearRemoteSystemLookup(void) {
     remoteSystemIndexPool.Clear(_FILE_AND_LINE_);
-    RakNet::OP_DELETE_ARRAY(remoteSystemLookup, _FILE_AND_LINE_);
-    remoteSystemLookup = 0;
+    if (remoteSystemLookup) RakNet::OP_DELETE_ARRAY(remoteSystemLookup, _FILE_AND_LINE_);
+    remoteSystemLookup     = 0;
+    remoteSystemLookupSize = 0;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::GrowRemoteSystemLookup(void) {
+    // Keep REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE buckets per allocated slot, doubling so rehashing stays rare
+    unsigned int wantedSize = remoteSystemList.Size() * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE;
+    if (wantedSize <= remoteSystemLookupSize) return;
+    unsigned int newSize = remoteSystemLookupSize * 2;
+    if (newSize < wantedSize) newSize = wantedSize;
+    if (newSize > maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE)
+        newSize = maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE;
+
+    RemoteSystemIndex** oldLookup     = remoteSystemLookup;
+    unsigned int        oldLookupSize = remoteSystemLookupSize;
+    remoteSystemLookup                = RakNet::OP_NEW_ARRAY<RemoteSystemIndex*>(newSize, _FILE_AND_LINE_);
+    remoteSystemLookupSize            = newSize;
+    for (unsigned int i = 0; i < newSize; i++) remoteSystemLookup[i] = 0;
+
+    // Move the existing entries into their new buckets
+    for (unsigned int i = 0; i < oldLookupSize; i++) {
+        RemoteSystemIndex* cur = oldLookup[i];
+        while (cur != 0) {
+            RemoteSystemIndex* next       = cur->next;
+            unsigned int       hashIndex  = RemoteSystemLookupHashIndex(remoteSystemList[cur->index].systemAddress);
+            cur->next                     = remoteSystemLookup[hashIndex];
+            remoteSystemLookup[hashIndex] = cur;
+            cur                           = next;
+        }
+    }
+    if (oldLookup) RakNet::OP_DELETE_ARRAY(oldLookup, _FILE_AND_LINE_);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RakPeer::RemoteSystemStruct* RakPeer::AllocateRemoteSystemPage(unsigned int pageIndex) {
+    RemoteSystemStruct* page = remoteSystemList.NewPage(pageIndex, _FILE_AND_LINE_);
+    if (page == 0) return 0;
+
+    // Slots must be fully initialized before the page is visible to the user thread
+    for (unsigned int i = 0; i < remoteSystemList.PageLength(pageIndex); i++) {
+        page[i].isActive                = false;
+        page[i].systemAddress           = UNASSIGNED_SYSTEM_ADDRESS;
+        page[i].guid                    = UNASSIGNED_RAKNET_GUID;
+        page[i].myExternalSystemAddress = UNASSIGNED_SYSTEM_ADDRESS;
+        page[i].connectMode             = RemoteSystemStruct::NO_ACTION;
+        page[i].MTUSize                 = defaultMTUSize;
+        page[i].remoteSystemIndex       = (SystemIndex)(pageIndex * remoteSystemList.PageSize() + i);
+        page[i].rakNetSocket            = 0;
+#ifdef _DEBUG
+        page[i].reliabilityLayer.ApplyNetworkSimulator(_packetloss, _minExtraPing, _extraPingVariance);
+#endif
+    }
+    remoteSystemList.PublishPage(pageIndex, page);
+    remoteSystemPageIdleSweeps[pageIndex] = 0;
+
+    GrowRemoteSystemLookup();
+    return page;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SweepRemoteSystemPages(RakNet::TimeMS time) {
+    if (time - nextRemoteSystemPageSweepTime > (((RakNet::TimeMS)-1) >> 1)) return;
+    nextRemoteSystemPageSweepTime = time + REMOTE_SYSTEM_PAGE_SWEEP_INTERVAL_MS;
+
+    // Pages removed by the last sweep are freed once no other thread can still be reading them. Until then, wait
+    // rather than start another grace period
+    if (remoteSystemReaders.Poll() == false) return;
+    FreeRetiredRemoteSystemPages();
+
+    unsigned int pageIndex, i;
+    for (pageIndex = 0; pageIndex < remoteSystemList.PageCount(); pageIndex++) {
+        if (remoteSystemList.IsPageAllocated(pageIndex) == false) continue;
+
+        unsigned int        firstIndex = pageIndex * remoteSystemList.PageSize();
+        unsigned int        pageLength = remoteSystemList.PageLength(pageIndex);
+        RemoteSystemStruct* page       = &remoteSystemList[firstIndex];
+        for (i = 0; i < pageLength; i++) {
+            if (page[i].isActive) break;
+        }
+        if (i < pageLength) {
+            remoteSystemPageIdleSweeps[pageIndex] = 0;
+            continue;
+        }
+        if (++remoteSystemPageIdleSweeps[pageIndex] < REMOTE_SYSTEM_PAGE_IDLE_SWEEPS) continue;
+
+        // Nothing may refer to the page once it is gone
+        for (i = 0; i < pageLength; i++) {
+            if (page[i].systemAddress != UNASSIGNED_SYSTEM_ADDRESS
+                && GetRemoteSystemIndex(page[i].systemAddress) == firstIndex + i)
+                DereferenceRemoteSystem(page[i].systemAddress);
+        }
+        retiredRemoteSystemPages.Push(remoteSystemList.UnpublishPage(pageIndex), _FILE_AND_LINE_);
+        remoteSystemPageIdleSweeps[pageIndex] = 0;
+    }
+
+    // Past the pages activeSystemList is using, keep one page of slack
+    unsigned int usedActivePages = activeSystemList.PageOf(activeSystemListSize + activeSystemList.PageSize() - 1);
+    for (pageIndex = usedActivePages + 1; pageIndex < activeSystemList.PageCount(); pageIndex++) {
+        if (activeSystemList.IsPageAllocated(pageIndex))
+            retiredActiveSystemPages.Push(activeSystemList.UnpublishPage(pageIndex), _FILE_AND_LINE_);
+    }
+
+    if (retiredRemoteSystemPages.Size() > 0 || retiredActiveSystemPages.Size() > 0) remoteSystemReaders.Start();
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::FreeRetiredRemoteSystemPages(void) {
+    unsigned int i;
+    for (i = 0; i < retiredRemoteSystemPages.Size(); i++)
+        remoteSystemList.DeletePage(retiredRemoteSystemPages[i], _FILE_AND_LINE_);
+    retiredRemoteSystemPages.Clear(false, _FILE_AND_LINE_);
+    for (i = 0; i < retiredActiveSystemPages.Size(); i++)
+        activeSystemList.DeletePage(retiredActiveSystemPages[i], _FILE_AND_LINE_);
+    retiredActiveSystemPages.Clear(false, _FILE_AND_LINE_);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::AddToActiveSystemList(unsigned int remoteSystemListIndex) {
-    activeSystemList[activeSystemListSize++] = remoteSystemList + remoteSystemListIndex;
+    unsigned int pageIndex = activeSystemList.PageOf(activeSystemListSize);
+    if (activeSystemList.IsPageAllocated(pageIndex) == false) {
+        // Other threads may read past activeSystemListSize, and skip null entries
+        RemoteSystemStruct** page = activeSystemList.NewPage(pageIndex, _FILE_AND_LINE_);
+        for (unsigned int i = 0; i < activeSystemList.PageLength(pageIndex); i++) page[i] = 0;
+        activeSystemList.PublishPage(pageIndex, page);
+    }
+    activeSystemList[activeSystemListSize++] = &remoteSystemList[remoteSystemListIndex];
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RakPeer::RemoteSystemStruct* RakPeer::GetActiveSystem(unsigned int index) const {
+    RemoteSystemStruct* const* entry = activeSystemList.GetPointer(index);
+    return entry ? *entry : 0;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::RemoveFromActiveSystemList(const SystemAddress& sa) {
@@ -3690,6 +4156,8 @@ void RakPeer::RemoveFromActiveSystemList(const SystemAddress& sa) {
         RemoteSystemStruct* rss = activeSystemList[i];
         if (rss->systemAddress == sa) {
             activeSystemList[i] = activeSystemList[activeSystemListSize - 1];
+            // So GetStatisticsSnapshots() does not find the moved system a second time
+            activeSystemList[activeSystemListSize - 1] = 0;
             activeSystemListSize--;
             return;
         }
@@ -3852,7 +4320,7 @@ void RakPeer::CloseConnectionInternal(
 
     if (systemIdentifier.IsUndefined()) return;
 
-    if (remoteSystemList == 0 || endThreads == true) return;
+    if (remoteSystemList.Capacity() == 0 || endThreads == true) return;
 
     SystemAddress target;
     if (systemIdentifier.systemAddress != UNASSIGNED_SYSTEM_ADDRESS) {
@@ -3871,6 +4339,13 @@ void RakPeer::CloseConnectionInternal(
             unsigned int index = GetRemoteSystemIndex(target);
             if (index != (unsigned int)-1) {
                 if (remoteSystemList[index].isActive) {
+                    RAKNET_TRACE_EVENT(
+                        EVENT_TRACE_CONNECTION_CLOSED,
+                        target,
+                        (uint32_t)remoteSystemList[index].connectMode,
+                        0,
+                        0
+                    );
                     RemoveFromActiveSystemList(target);
 
                     // Found the index to stop
@@ -4065,18 +4540,21 @@ bool RakPeer::SendImmediate(
             sendListSize = 1;
         }
     } else {
+        // Only allocated slots can be active
+        unsigned int systemListSize = remoteSystemList.Size();
 #if USE_ALLOCA == 1
-        sendList = (unsigned*)alloca(sizeof(unsigned) * maximumNumberOfPeers);
+        sendList = (unsigned*)alloca(sizeof(unsigned) * systemListSize);
 #else
-        sendList = (unsigned*)rakMalloc_Ex(sizeof(unsigned) * maximumNumberOfPeers, _FILE_AND_LINE_);
+        sendList = (unsigned*)rakMalloc_Ex(sizeof(unsigned) * systemListSize, _FILE_AND_LINE_);
 #endif
 
         // remoteSystemList in network thread
         unsigned int idx;
-        for (idx = 0; idx < maximumNumberOfPeers; idx++) {
+        for (idx = 0; idx < systemListSize; idx++) {
             if (remoteSystemIndex != (unsigned int)-1 && idx == remoteSystemIndex) continue;
 
-            if (remoteSystemList[idx].isActive && remoteSystemList[idx].systemAddress != UNASSIGNED_SYSTEM_ADDRESS)
+            RemoteSystemStruct* remoteSystem = remoteSystemList.GetPointer(idx);
+            if (remoteSystem && remoteSystem->isActive && remoteSystem->systemAddress != UNASSIGNED_SYSTEM_ADDRESS)
                 sendList[sendListSize++] = idx;
         }
     }
@@ -4568,6 +5046,19 @@ bool ProcessOfflineNetworkPacket(
                     uint16_t mtu;
                     bsIn.Read(mtu);
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+                    // Offer our ephemeral key. Older peers stop reading after the guid, so this is ignored by them
+                    bool          offerDatagramCipher = false;
+                    unsigned char cipherPublicKey[DatagramCipher::PUBLIC_KEY_BYTES];
+                    if (rakPeer->datagramEncryptionEnabled) {
+                        if (rcs->datagramCipherKeysGenerated == false)
+                            rcs->datagramCipherKeysGenerated =
+                                DatagramCipher::GenerateKeyPair(rcs->datagramCipherPublicKey, rcs->datagramCipherPrivateKey);
+                        offerDatagramCipher = rcs->datagramCipherKeysGenerated;
+                        memcpy(cipherPublicKey, rcs->datagramCipherPublicKey, sizeof(cipherPublicKey));
+                    }
+#endif
+
                     // Binding address
                     bsOut.Write(rcs->systemAddress);
                     rakPeer->requestedConnectionQueueMutex.Unlock();
@@ -4575,6 +5066,12 @@ bool ProcessOfflineNetworkPacket(
                     bsOut.Write(mtu);
                     // Our guid
                     bsOut.Write(rakPeer->GetGuidFromSystemAddress(UNASSIGNED_SYSTEM_ADDRESS));
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+                    if (offerDatagramCipher) {
+                        bsOut.Write(DatagramCipher::GetSupportedSuites());
+                        bsOut.WriteAlignedBytes(cipherPublicKey, sizeof(cipherPublicKey));
+                    }
+#endif
 
                     for (j = 0; j < rakPeer->pluginListNTS.Size(); j++)
                         rakPeer->pluginListNTS[j]->OnDirectSocketSend(
@@ -4625,6 +5122,18 @@ bool ProcessOfflineNetworkPacket(
             cat::ClientEasyHandshake* client_handshake = 0;
 #endif // LIBCAT_SECURITY
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+            // Only present if we offered a key in ID_OPEN_CONNECTION_REQUEST_2
+            unsigned char serverCipherSuite = DCS_NONE;
+            unsigned char serverCipherPublicKey[DatagramCipher::PUBLIC_KEY_BYTES];
+            if (bs.GetNumberOfUnreadBits() >= 8) {
+                bs.Read(serverCipherSuite);
+                if (serverCipherSuite != DCS_NONE
+                    && bs.ReadAlignedBytes(serverCipherPublicKey, sizeof(serverCipherPublicKey)) == false)
+                    serverCipherSuite = DCS_NONE;
+            }
+#endif
+
             RakPeer::RequestedConnectionStruct* rcs;
             bool                                unlock = true;
             unsigned                            j;
@@ -4666,6 +5175,28 @@ bool ProcessOfflineNetworkPacket(
 
 #endif // LIBCAT_SECURITY
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+                    if (rakPeer->datagramEncryptionRequired
+                        && (serverCipherSuite == DCS_NONE || rcs->datagramCipherKeysGenerated == false)) {
+                        // Server did not agree to encrypt, and we require it
+                        rakPeer->requestedConnectionQueue.RemoveAtIndex(j);
+                        rakPeer->requestedConnectionQueueMutex.Unlock();
+
+                        packet                = rakPeer->AllocPacket(sizeof(char), _FILE_AND_LINE_);
+                        packet->data[0]       = ID_OUR_SYSTEM_REQUIRES_SECURITY;
+                        packet->bitSize       = (sizeof(char) * 8);
+                        packet->systemAddress = rcs->systemAddress;
+                        packet->guid          = guid;
+                        rakPeer->AddPacketToProducer(packet);
+
+#if LIBCAT_SECURITY == 1
+                        RakNet::OP_DELETE(rcs->client_handshake, _FILE_AND_LINE_);
+#endif
+                        RakNet::OP_DELETE(rcs, _FILE_AND_LINE_);
+                        return true;
+                    }
+#endif // RAKNET_DATAGRAM_ENCRYPTION
+
                     rakPeer->requestedConnectionQueueMutex.Unlock();
                     unlock = false;
 
@@ -4742,6 +5273,27 @@ bool ProcessOfflineNetworkPacket(
                             }
 #endif // LIBCAT_SECURITY
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+                            // Must be keyed before ID_CONNECTION_REQUEST below, the first datagram the server expects
+                            // to be encrypted
+                            if (serverCipherSuite != DCS_NONE && rcs->datagramCipherKeysGenerated
+                                && remoteSystem->reliabilityLayer.IsDatagramCipherActive() == false) {
+                                bool keyed = remoteSystem->reliabilityLayer.InitializeDatagramCipher(
+                                    (DatagramCipherSuite)serverCipherSuite,
+                                    rcs->datagramCipherPrivateKey,
+                                    rcs->datagramCipherPublicKey,
+                                    serverCipherPublicKey,
+                                    true
+                                );
+                                memset(rcs->datagramCipherPrivateKey, 0, sizeof(rcs->datagramCipherPrivateKey));
+                                if (keyed == false) {
+                                    rakPeer->DereferenceRemoteSystem(systemAddress);
+                                    remoteSystem = 0;
+                                }
+                            }
+                        }
+                        if (remoteSystem) {
+#endif // RAKNET_DATAGRAM_ENCRYPTION
                             remoteSystem->weInitiatedTheConnection = true;
                             remoteSystem->connectMode              = RakPeer::RemoteSystemStruct::REQUESTED_CONNECTION;
                             if (rcs->timeoutTime != 0) remoteSystem->reliabilityLayer.SetTimeoutTime(rcs->timeoutTime);
@@ -4997,6 +5549,21 @@ bool ProcessOfflineNetworkPacket(
             bs.Read(mtu);
             bs.Read(guid);
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+            // Older clients, or clients with encryption off, end the message at the guid
+            bool                clientOfferedCipher = false;
+            DatagramCipherSuite cipherSuite         = DCS_NONE;
+            unsigned char       clientCipherPublicKey[DatagramCipher::PUBLIC_KEY_BYTES];
+            if (bs.GetNumberOfUnreadBits() >= BYTES_TO_BITS(1 + DatagramCipher::PUBLIC_KEY_BYTES)) {
+                unsigned char clientCipherSuites;
+                // Aligning the read can still run past a truncated trailer, which then counts as no offer
+                clientOfferedCipher = bs.Read(clientCipherSuites)
+                                   && bs.ReadAlignedBytes(clientCipherPublicKey, sizeof(clientCipherPublicKey));
+                if (clientOfferedCipher && rakPeer->datagramEncryptionEnabled)
+                    cipherSuite = DatagramCipher::ChooseSuite(clientCipherSuites);
+            }
+#endif
+
             RakPeer::RemoteSystemStruct* rssFromSA =
                 rakPeer->GetRemoteSystemFromSystemAddress(systemAddress, true, true);
             bool                         IPAddrInUse = rssFromSA != 0 && rssFromSA->isActive;
@@ -5054,6 +5621,13 @@ bool ProcessOfflineNetworkPacket(
                     bsAnswer.WriteAlignedBytes((const unsigned char*)rssFromSA->answer, sizeof(rssFromSA->answer));
                 }
 #endif // LIBCAT_SECURITY
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+                if (clientOfferedCipher) {
+                    bsAnswer.Write(rssFromSA->datagramCipherSuite);
+                    if (rssFromSA->datagramCipherSuite != DCS_NONE)
+                        bsAnswer.WriteAlignedBytes(rssFromSA->datagramCipherPublicKey, DatagramCipher::PUBLIC_KEY_BYTES);
+                }
+#endif
 
                 unsigned int j;
                 for (j = 0; j < rakPeer->pluginListNTS.Size(); j++)
@@ -5090,6 +5664,25 @@ bool ProcessOfflineNetworkPacket(
                 return true;
             }
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+            if (rakPeer->datagramEncryptionRequired && cipherSuite == DCS_NONE) {
+                // Client cannot or will not encrypt, and we require it
+                bsOut.Write((MessageID)ID_CONNECTION_ATTEMPT_FAILED);
+                bsOut.WriteAlignedBytes((const unsigned char*)OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID));
+                bsOut.Write(rakPeer->myGuid);
+                for (i = 0; i < rakPeer->pluginListNTS.Size(); i++)
+                    rakPeer->pluginListNTS[i]
+                        ->OnDirectSocketSend((const char*)bsOut.GetData(), bsOut.GetNumberOfBitsUsed(), systemAddress);
+                RNS2_SendParameters bsp;
+                bsp.data          = (char*)bsOut.GetData();
+                bsp.length        = bsOut.GetNumberOfBytesUsed();
+                bsp.systemAddress = systemAddress;
+                rakNetSocket->Send(&bsp, _FILE_AND_LINE_);
+
+                return true;
+            }
+#endif
+
             if (rakPeer->AllowIncomingConnections() == false) {
                 bsOut.Write((MessageID)ID_NO_FREE_INCOMING_CONNECTIONS);
                 bsOut.WriteAlignedBytes((const unsigned char*)OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID));
@@ -5161,6 +5754,32 @@ bool ProcessOfflineNetworkPacket(
             }
 #endif // LIBCAT_SECURITY
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+            if (cipherSuite != DCS_NONE) {
+                unsigned char cipherPrivateKey[DatagramCipher::PRIVATE_KEY_BYTES];
+                bool          keyed = DatagramCipher::GenerateKeyPair(rssFromSA->datagramCipherPublicKey, cipherPrivateKey)
+                          && rssFromSA->reliabilityLayer.InitializeDatagramCipher(
+                              cipherSuite,
+                              cipherPrivateKey,
+                              rssFromSA->datagramCipherPublicKey,
+                              clientCipherPublicKey,
+                              false
+                          );
+                memset(cipherPrivateKey, 0, sizeof(cipherPrivateKey));
+                if (keyed == false) {
+                    // Unassign this remote system
+                    rakPeer->DereferenceRemoteSystem(systemAddress);
+                    return true;
+                }
+                rssFromSA->datagramCipherSuite = (unsigned char)cipherSuite;
+            }
+            if (clientOfferedCipher) {
+                bsAnswer.Write(rssFromSA->datagramCipherSuite);
+                if (rssFromSA->datagramCipherSuite != DCS_NONE)
+                    bsAnswer.WriteAlignedBytes(rssFromSA->datagramCipherPublicKey, DatagramCipher::PUBLIC_KEY_BYTES);
+            }
+#endif // RAKNET_DATAGRAM_ENCRYPTION
+
             unsigned int j;
             for (j = 0; j < rakPeer->pluginListNTS.Size(); j++)
                 rakPeer->pluginListNTS[j]->OnDirectSocketSend(
@@ -5267,7 +5886,12 @@ unsigned int RakPeer::GenerateSeedFromGuid(void) {
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::DerefAllSockets(void) {
     unsigned int i;
-    for (i = 0; i < socketList.Size(); i++) { delete socketList[i]; }
+    for (i = 0; i < socketList.Size(); i++) {
+#ifdef USE_THREADED_SEND
+        RakNet::SendToThread::RemoveSocket(socketList[i]);
+#endif
+        delete socketList[i];
+    }
     socketList.Clear(false, _FILE_AND_LINE_);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -5350,6 +5974,10 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
     RakNet::TimeUS         timeNS = 0;
     RakNet::Time           timeMS = 0;
 
+    // Zero while SetUpdateProfiling() is off
+    uint64_t cycleStartNs = updateProfiling.load(std::memory_order_acquire) ? UpdateProfiler::GetTimeNS() : 0;
+    uint64_t phaseStartNs = cycleStartNs;
+
     // This is here so RecvFromBlocking actually gets data from the same thread
 
 #if defined(WINDOWS_STORE_RT)
@@ -5388,6 +6016,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
         );
         DeallocRNS2RecvStruct(recvFromStruct, _FILE_AND_LINE_);
     }
+    if (cycleStartNs) phaseStartNs = RecordUpdatePhase(UPDATE_PHASE_BUFFERED_DATAGRAMS, phaseStartNs);
 
     while ((bcs = bufferedCommands.PopInaccurate()) != 0) {
         if (bcs->command == BufferedCommandStruct::BCS_SEND) {
@@ -5452,6 +6081,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
 
         bufferedCommands.Deallocate(bcs, _FILE_AND_LINE_);
     }
+    if (cycleStartNs) phaseStartNs = RecordUpdatePhase(UPDATE_PHASE_BUFFERED_COMMANDS, phaseStartNs);
 
     if (requestedConnectionQueue.IsEmpty() == false) {
         if (timeNS == 0) {
@@ -5580,6 +6210,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
         }
         requestedConnectionQueueMutex.Unlock();
     }
+    if (cycleStartNs) phaseStartNs = RecordUpdatePhase(UPDATE_PHASE_CONNECTION_REQUESTS, phaseStartNs);
 
     // remoteSystemList in network thread
     for (activeSystemListIndex = 0; activeSystemListIndex < activeSystemListSize; ++activeSystemListIndex)
@@ -5632,6 +6263,8 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
             &rnr,
             updateBitStream
         ); // systemAddress only used for the internet simulator test
+        if (remoteSystem->connectMode == RemoteSystemStruct::CONNECTED)
+            remoteSystem->reliabilityLayer.UpdateStatisticsSnapshot(timeMS, systemAddress, remoteSystem->guid);
 
         // Check for failure conditions
         if (remoteSystem->reliabilityLayer.IsDeadConnection()
@@ -5765,6 +6398,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
                                              + sizeof(RakNet::Time) * 2) {
                     if (remoteSystem->connectMode == RemoteSystemStruct::HANDLING_CONNECTION_REQUEST) {
                         remoteSystem->connectMode = RemoteSystemStruct::CONNECTED;
+                        RAKNET_TRACE_EVENT(EVENT_TRACE_CONNECTION_OPENED, systemAddress, 1, 0, 0);
                         PingInternal(systemAddress, true, UNRELIABLE);
 
                         // Update again immediately after this tick so the ping goes out right away
@@ -5782,6 +6416,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
                         inBitStream.Read(sendPingTime);
                         inBitStream.Read(sendPongTime);
                         OnConnectedPong(sendPingTime, sendPongTime, remoteSystem);
+                        ReadConnectionFeatures(&inBitStream, remoteSystem);
 
                         // Overwrite the data in the packet
                         //					NewIncomingConnectionStruct newIncomingConnectionStruct;
@@ -5914,6 +6549,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
                             inBitStream.Read(sendPingTime);
                             inBitStream.Read(sendPongTime);
                             OnConnectedPong(sendPingTime, sendPongTime, remoteSystem);
+                            ReadConnectionFeatures(&inBitStream, remoteSystem);
 
                             // Find a free remote system struct to use
                             //						RakNet::BitStream casBitS(data, byteSize, false);
@@ -5924,6 +6560,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
                             // The remote system told us our external IP, so save it
                             remoteSystem->myExternalSystemAddress = externalID;
                             remoteSystem->connectMode             = RemoteSystemStruct::CONNECTED;
+                            RAKNET_TRACE_EVENT(EVENT_TRACE_CONNECTION_OPENED, systemAddress, 0, 0, 0);
 
                             // Bug: If A connects to B through R, A's firstExternalID is set to R. If A tries to send to
                             // R, sends to loopback because R==firstExternalID Correct fix is to specify in Connect() if
@@ -5951,6 +6588,7 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
                                 outBitStream.Write(ipList[i]);
                             outBitStream.Write(sendPongTime);
                             outBitStream.Write(RakNet::GetTime());
+                            outBitStream.Write((unsigned char)CONNECTION_FEATURE_FEC);
 
                             SendImmediate(
                                 (char*)outBitStream.GetData(),
@@ -6000,7 +6638,11 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
             bitSize = remoteSystem->reliabilityLayer.Receive(&data);
         }
     }
+    if (cycleStartNs) RecordUpdatePhase(UPDATE_PHASE_CONNECTIONS, phaseStartNs);
 
+    SweepRemoteSystemPages(RakNet::GetTimeMS());
+
+    if (cycleStartNs) RecordUpdatePhase(UPDATE_PHASE_CYCLE, cycleStartNs);
     return true;
 }
 
@@ -6008,7 +6650,10 @@ bool RakPeer::RunUpdateCycle(BitStream& updateBitStream) {
 
 void RakPeer::OnRNS2Recv(RNS2RecvStruct* recvStruct) {
     if (incomingDatagramEventHandler) {
-        if (incomingDatagramEventHandler(recvStruct) != true) return;
+        if (incomingDatagramEventHandler(recvStruct) != true) {
+            DeallocRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+            return;
+        }
     }
 
     PushBufferedPacket(recvStruct);
@@ -6152,6 +6797,46 @@ to use WaitForSingleObject instead. --")
     return 0;
 }
 
+void RakPeer::ProfilePluginUpdates(void) {
+    UpdateProfiler* profiler  = updateProfiler.load(std::memory_order_acquire);
+    uint64_t        startNs   = UpdateProfiler::GetTimeNS();
+    uint64_t        callEndNs = startNs;
+    for (unsigned int i = 0; i < pluginListTS.Size(); i++) {
+        uint64_t callStartNs = callEndNs;
+        pluginListTS[i]->Update();
+        callEndNs = UpdateProfiler::GetTimeNS();
+        profiler->RecordPlugin(pluginListTS[i], UPDATE_PLUGIN_UPDATE, callStartNs, callEndNs);
+    }
+    for (unsigned int i = 0; i < pluginListNTS.Size(); i++) {
+        uint64_t callStartNs = callEndNs;
+        pluginListNTS[i]->Update();
+        callEndNs = UpdateProfiler::GetTimeNS();
+        profiler->RecordPlugin(pluginListNTS[i], UPDATE_PLUGIN_UPDATE, callStartNs, callEndNs);
+    }
+    profiler->RecordPhase(UPDATE_PHASE_PLUGIN_UPDATE, startNs, callEndNs);
+}
+
+PluginReceiveResult RakPeer::ProfileOnReceive(PluginInterface2* plugin, Packet* packet) {
+    uint64_t            startNs = UpdateProfiler::GetTimeNS();
+    PluginReceiveResult result  = plugin->OnReceive(packet);
+    updateProfiler.load(std::memory_order_acquire)
+        ->RecordPlugin(plugin, UPDATE_PLUGIN_ON_RECEIVE, startNs, UpdateProfiler::GetTimeNS());
+    return result;
+}
+
+void RakPeer::RecordMessageProfile(unsigned char messageId, uint64_t startNs) {
+    UpdateProfiler* profiler = updateProfiler.load(std::memory_order_acquire);
+    uint64_t        endNs    = UpdateProfiler::GetTimeNS();
+    profiler->RecordPhase(UPDATE_PHASE_PLUGIN_RECEIVE, startNs, endNs);
+    profiler->RecordMessage(messageId, startNs, endNs);
+}
+
+uint64_t RakPeer::RecordUpdatePhase(UpdateProfilePhase phase, uint64_t startNs) {
+    uint64_t endNs = UpdateProfiler::GetTimeNS();
+    updateProfiler.load(std::memory_order_acquire)->RecordPhase(phase, startNs, endNs);
+    return endNs;
+}
+
 void RakPeer::CallPluginCallbacks(DataStructures::List<PluginInterface2*>& pluginList, Packet* packet) {
     for (unsigned int i = 0; i < pluginList.Size(); i++) {
         switch (packet->data[0]) {
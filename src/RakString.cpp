@@ -24,7 +24,7 @@
 using namespace RakNet;
 
 // DataStructures::MemoryPool<RakString::SharedString> RakString::pool;
-RakString::SharedString RakString::emptyString = {0, 0, 0, (char*)"", (char*)""};
+RakString::SharedString RakString::emptyString = {0, 0, (char*)"", (char*)""};
 // RakString::SharedString *RakString::sharedStringFreeList=0;
 // unsigned int RakString::sharedStringFreeListAllocationCount=0;
 DataStructures::List<RakString::SharedString*> RakString::freeList;
@@ -41,6 +41,57 @@ SimpleMutex& GetPoolMutex(void) {
     return poolMutex;
 }
 
+// How many unused SharedStrings each thread keeps for itself. It goes to RakString::freeList for half this many at a
+// time when it runs out, and gives back half when it is full
+static const unsigned int THREAD_FREE_LIST_SIZE = 64;
+
+class RakStringThreadFreeList {
+public:
+    RakStringThreadFreeList() { count = 0; }
+    // Thread exit can come after the shared pool was freed on shutdown, so free these directly
+    ~RakStringThreadFreeList() {
+        while (count > 0) RakNet::OP_DELETE(sharedStrings[--count], _FILE_AND_LINE_);
+    }
+
+    RakString::SharedString* sharedStrings[THREAD_FREE_LIST_SIZE];
+    unsigned int             count;
+};
+
+static thread_local RakStringThreadFreeList threadFreeList;
+
+static RakString::SharedString* AllocateSharedString(void) {
+    RakStringThreadFreeList& freeList = threadFreeList;
+    if (freeList.count == 0) {
+        RakString::LockMutex();
+        while (freeList.count < THREAD_FREE_LIST_SIZE / 2 && RakString::freeList.Size() > 0) {
+            freeList.sharedStrings[freeList.count++] = RakString::freeList[RakString::freeList.Size() - 1];
+            RakString::freeList.RemoveAtIndex(RakString::freeList.Size() - 1);
+        }
+        RakString::UnlockMutex();
+
+        while (freeList.count < THREAD_FREE_LIST_SIZE / 2)
+            freeList.sharedStrings[freeList.count++] = RakNet::OP_NEW<RakString::SharedString>(_FILE_AND_LINE_);
+    }
+    return freeList.sharedStrings[--freeList.count];
+}
+
+// Drops one reference, returning the SharedString to this thread's free list if it was the last
+static void ReleaseSharedString(RakString::SharedString* sharedString) {
+    if (sharedString->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    const size_t smallStringSize = 128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2;
+    if (sharedString->bytesUsed > smallStringSize) rakFree_Ex(sharedString->bigString, _FILE_AND_LINE_);
+
+    RakStringThreadFreeList& freeList = threadFreeList;
+    if (freeList.count == THREAD_FREE_LIST_SIZE) {
+        RakString::LockMutex();
+        while (freeList.count > THREAD_FREE_LIST_SIZE / 2)
+            RakString::freeList.Insert(freeList.sharedStrings[--freeList.count], _FILE_AND_LINE_);
+        RakString::UnlockMutex();
+    }
+    freeList.sharedStrings[freeList.count++] = sharedString;
+}
+
 int RakNet::RakString::RakStringComp(RakString const& key, RakString const& data) { return key.StrCmp(data); }
 
 RakString::RakString() { sharedString = &emptyString; }
@@ -68,33 +119,18 @@ RakString::RakString(const char* format, ...) {
     Assign(format, ap);
 }
 RakString::RakString(const RakString& rhs) {
-    if (rhs.sharedString == &emptyString) {
-        sharedString = &emptyString;
-        return;
-    }
-
-    rhs.sharedString->refCountMutex->Lock();
-    if (rhs.sharedString->refCount == 0) {
-        sharedString = &emptyString;
-    } else {
-        rhs.sharedString->refCount++;
-        sharedString = rhs.sharedString;
-    }
-    rhs.sharedString->refCountMutex->Unlock();
+    sharedString = rhs.sharedString;
+    if (sharedString == 0) memcpy(inlineString, rhs.inlineString, INLINE_STRING_SIZE);
+    else if (sharedString != &emptyString) sharedString->refCount.fetch_add(1, std::memory_order_relaxed);
 }
 RakString::~RakString() { Free(); }
 RakString& RakString::operator=(const RakString& rhs) {
-    Free();
-    if (rhs.sharedString == &emptyString) return *this;
+    if (&rhs == this) return *this;
 
-    rhs.sharedString->refCountMutex->Lock();
-    if (rhs.sharedString->refCount == 0) {
-        sharedString = &emptyString;
-    } else {
-        sharedString = rhs.sharedString;
-        sharedString->refCount++;
-    }
-    rhs.sharedString->refCountMutex->Unlock();
+    Free();
+    sharedString = rhs.sharedString;
+    if (sharedString == 0) memcpy(inlineString, rhs.inlineString, INLINE_STRING_SIZE);
+    else if (sharedString != &emptyString) sharedString->refCount.fetch_add(1, std::memory_order_relaxed);
     return *this;
 }
 RakString& RakString::operator=(const char* str) {
@@ -111,10 +147,23 @@ RakString& RakString::operator=(const char c) {
     buff[1] = 0;
     return operator=((const char*)buff);
 }
-void RakString::Realloc(SharedString* sharedStr, size_t bytes) {
+void RakString::Realloc(size_t bytes) {
+    RakAssert(sharedString != &emptyString);
+    RakAssert(bytes > 0);
+    if (sharedString == 0) {
+        if (bytes <= INLINE_STRING_SIZE) return;
+
+        // Outgrew the inline buffer
+        char inlineCopy[INLINE_STRING_SIZE];
+        memcpy(inlineCopy, inlineString, INLINE_STRING_SIZE);
+        Allocate(GetSizeToAllocate(bytes));
+        memcpy(GetBuffer(), inlineCopy, INLINE_STRING_SIZE);
+        return;
+    }
+
+    SharedString* sharedStr = sharedString;
     if (bytes <= sharedStr->bytesUsed) return;
 
-    RakAssert(bytes > 0);
     size_t       oldBytes = sharedStr->bytesUsed;
     size_t       newBytes;
     const size_t smallStringSize = 128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2;
@@ -134,11 +183,12 @@ RakString& RakString::operator+=(const RakString& rhs) {
 
     if (IsEmpty()) {
         return operator=(rhs);
+    } else if (&rhs == this) {
+        // Realloc may move the buffer being appended
+        RakString copy(rhs);
+        AppendBytes(copy.C_String(), (unsigned int)copy.GetLength());
     } else {
-        Clone();
-        size_t strLen = rhs.GetLength() + GetLength() + 1;
-        Realloc(sharedString, strLen + GetLength());
-        strcat(sharedString->c_str, rhs.C_String());
+        AppendBytes(rhs.C_String(), (unsigned int)rhs.GetLength());
     }
     return *this;
 }
@@ -150,8 +200,8 @@ RakString& RakString::operator+=(const char* str) {
     } else {
         Clone();
         size_t strLen = strlen(str) + GetLength() + 1;
-        Realloc(sharedString, strLen);
-        strcat(sharedString->c_str, str);
+        Realloc(strLen);
+        strcat(GetBuffer(), str);
     }
     return *this;
 }
@@ -166,102 +216,49 @@ RakString& RakString::operator+=(const char c) {
 }
 unsigned char RakString::operator[](const unsigned int position) const {
     RakAssert(position < GetLength());
-    return sharedString->c_str[position];
+    return GetBuffer()[position];
 }
 bool RakString::operator==(const RakString& rhs) const {
-    return strcmp(sharedString->c_str, rhs.sharedString->c_str) == 0;
-}
-bool RakString::operator==(const char* str) const { return strcmp(sharedString->c_str, str) == 0; }
-bool RakString::operator==(char* str) const { return strcmp(sharedString->c_str, str) == 0; }
-bool RakString::operator<(const RakString& right) const { return strcmp(sharedString->c_str, right.C_String()) < 0; }
-bool RakString::operator<=(const RakString& right) const { return strcmp(sharedString->c_str, right.C_String()) <= 0; }
-bool RakString::operator>(const RakString& right) const { return strcmp(sharedString->c_str, right.C_String()) > 0; }
-bool RakString::operator>=(const RakString& right) const { return strcmp(sharedString->c_str, right.C_String()) >= 0; }
+    return strcmp(GetBuffer(), rhs.GetBuffer()) == 0;
+}
+bool RakString::operator==(const char* str) const { return strcmp(GetBuffer(), str) == 0; }
+bool RakString::operator==(char* str) const { return strcmp(GetBuffer(), str) == 0; }
+bool RakString::operator<(const RakString& right) const { return strcmp(GetBuffer(), right.C_String()) < 0; }
+bool RakString::operator<=(const RakString& right) const { return strcmp(GetBuffer(), right.C_String()) <= 0; }
+bool RakString::operator>(const RakString& right) const { return strcmp(GetBuffer(), right.C_String()) > 0; }
+bool RakString::operator>=(const RakString& right) const { return strcmp(GetBuffer(), right.C_String()) >= 0; }
 bool RakString::operator!=(const RakString& rhs) const {
-    return strcmp(sharedString->c_str, rhs.sharedString->c_str) != 0;
+    return strcmp(GetBuffer(), rhs.GetBuffer()) != 0;
 }
-bool                    RakString::operator!=(const char* str) const { return strcmp(sharedString->c_str, str) != 0; }
-bool                    RakString::operator!=(char* str) const { return strcmp(sharedString->c_str, str) != 0; }
+bool                    RakString::operator!=(const char* str) const { return strcmp(GetBuffer(), str) != 0; }
+bool                    RakString::operator!=(char* str) const { return strcmp(GetBuffer(), str) != 0; }
 const RakNet::RakString operator+(const RakNet::RakString& lhs, const RakNet::RakString& rhs) {
     if (lhs.IsEmpty() && rhs.IsEmpty()) { return RakString(&RakString::emptyString); }
-    if (lhs.IsEmpty()) {
-        rhs.sharedString->refCountMutex->Lock();
-        if (rhs.sharedString->refCount == 0) {
-            rhs.sharedString->refCountMutex->Unlock();
-            lhs.sharedString->refCountMutex->Lock();
-            lhs.sharedString->refCount++;
-            lhs.sharedString->refCountMutex->Unlock();
-            return RakString(lhs.sharedString);
-        } else {
-            rhs.sharedString->refCount++;
-            rhs.sharedString->refCountMutex->Unlock();
-            return RakString(rhs.sharedString);
-        }
-        // rhs.sharedString->refCountMutex->Unlock();
-    }
-    if (rhs.IsEmpty()) {
-        lhs.sharedString->refCountMutex->Lock();
-        lhs.sharedString->refCount++;
-        lhs.sharedString->refCountMutex->Unlock();
-        return RakString(lhs.sharedString);
-    }
+    if (lhs.IsEmpty()) return rhs;
+    if (rhs.IsEmpty()) return lhs;
 
-    size_t len1           = lhs.GetLength();
-    size_t len2           = rhs.GetLength();
-    size_t allocatedBytes = len1 + len2 + 1;
-    allocatedBytes        = RakString::GetSizeToAllocate(allocatedBytes);
-    RakString::SharedString* sharedString;
-
-    RakString::LockMutex();
-    // sharedString = RakString::pool.Allocate( _FILE_AND_LINE_ );
-    if (RakString::freeList.Size() == 0) {
-        // RakString::sharedStringFreeList=(RakString::SharedString*)
-        // rakRealloc_Ex(RakString::sharedStringFreeList,(RakString::sharedStringFreeListAllocationCount+1024)*sizeof(RakString::SharedString),
-        // _FILE_AND_LINE_);
-        unsigned i;
-        for (i = 0; i < 128; i++) {
-            //	RakString::freeList.Insert(RakString::sharedStringFreeList+i+RakString::sharedStringFreeListAllocationCount);
-            RakString::SharedString* ss;
-            ss = (RakString::SharedString*)rakMalloc_Ex(sizeof(RakString::SharedString), _FILE_AND_LINE_);
-            ss->refCountMutex = RakNet::OP_NEW<SimpleMutex>(_FILE_AND_LINE_);
-            RakString::freeList.Insert(ss, _FILE_AND_LINE_);
-        }
-        // RakString::sharedStringFreeListAllocationCount+=1024;
-    }
-    sharedString = RakString::freeList[RakString::freeList.Size() - 1];
-    RakString::freeList.RemoveAtIndex(RakString::freeList.Size() - 1);
-    RakString::UnlockMutex();
-
-    const int smallStringSize = 128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2;
-    sharedString->bytesUsed   = allocatedBytes;
-    sharedString->refCount    = 1;
-    if (allocatedBytes <= (size_t)smallStringSize) {
-        sharedString->c_str = sharedString->smallString;
-    } else {
-        sharedString->bigString = (char*)rakMalloc_Ex(sharedString->bytesUsed, _FILE_AND_LINE_);
-        sharedString->c_str     = sharedString->bigString;
-    }
-
-    strcpy(sharedString->c_str, lhs);
-    strcat(sharedString->c_str, rhs);
-
-    return RakString(sharedString);
+    size_t    len1 = lhs.GetLength();
+    size_t    len2 = rhs.GetLength();
+    RakString result;
+    result.AppendBytes(lhs.C_String(), (unsigned int)len1);
+    result.AppendBytes(rhs.C_String(), (unsigned int)len2);
+    return result;
 }
 const char* RakString::ToLower(void) {
     Clone();
 
-    size_t   strLen = strlen(sharedString->c_str);
+    size_t   strLen = strlen(GetBuffer());
     unsigned i;
-    for (i = 0; i < strLen; i++) sharedString->c_str[i] = ToLower(sharedString->c_str[i]);
-    return sharedString->c_str;
+    for (i = 0; i < strLen; i++) GetBuffer()[i] = ToLower(GetBuffer()[i]);
+    return GetBuffer();
 }
 const char* RakString::ToUpper(void) {
     Clone();
 
-    size_t   strLen = strlen(sharedString->c_str);
+    size_t   strLen = strlen(GetBuffer());
     unsigned i;
-    for (i = 0; i < strLen; i++) sharedString->c_str[i] = ToUpper(sharedString->c_str[i]);
-    return sharedString->c_str;
+    for (i = 0; i < strLen; i++) GetBuffer()[i] = ToUpper(GetBuffer()[i]);
+    return GetBuffer();
 }
 void RakString::Set(const char* format, ...) {
     va_list ap;
@@ -270,7 +267,7 @@ void RakString::Set(const char* format, ...) {
     Assign(format, ap);
 }
 bool   RakString::IsEmpty(void) const { return sharedString == &emptyString; }
-size_t RakString::GetLength(void) const { return strlen(sharedString->c_str); }
+size_t RakString::GetLength(void) const { return strlen(GetBuffer()); }
 // http://porg.es/blog/counting-characters-in-utf-8-strings-is-faster
 int porges_strlen2(char* s) {
     int i       = 0;
@@ -301,13 +298,13 @@ int porges_strlen2(char* s) {
     }
     return count;
 }
-size_t RakString::GetLengthUTF8(void) const { return porges_strlen2(sharedString->c_str); }
+size_t RakString::GetLengthUTF8(void) const { return porges_strlen2(GetBuffer()); }
 void   RakString::Replace(unsigned index, unsigned count, unsigned char c) {
     RakAssert(index + count < GetLength());
     Clone();
     unsigned countIndex = 0;
     while (countIndex < count) {
-        sharedString->c_str[index] = c;
+        GetBuffer()[index] = c;
         index++;
         countIndex++;
     }
@@ -315,7 +312,7 @@ void   RakString::Replace(unsigned index, unsigned count, unsigned char c) {
 void RakString::SetChar(unsigned index, unsigned char c) {
     RakAssert(index < GetLength());
     Clone();
-    sharedString->c_str[index] = c;
+    GetBuffer()[index] = c;
 }
 void RakString::SetChar(unsigned index, RakNet::RakString s) {
     RakAssert(index < GetLength());
@@ -332,7 +329,7 @@ WCHAR* RakString::ToWideChar(void) {
     //
     // Special case of NULL or empty input string
     //
-    if ((sharedString->c_str == NULL) || (*sharedString->c_str == '\0')) {
+    if ((GetBuffer() == NULL) || (*GetBuffer() == '\0')) {
         // Return empty string
         return nullptr;
     }
@@ -343,7 +340,7 @@ WCHAR* RakString::ToWideChar(void) {
     int cchUTF16 = ::MultiByteToWideChar(
         CP_UTF8,              // convert from UTF-8
         0,                    // Flags
-        sharedString->c_str,  // source UTF-8 string
+        GetBuffer(),  // source UTF-8 string
         int(GetLength() + 1), // total length of source UTF-8 string,
         // in CHAR's (= bytes), including end-of-string \0
         NULL, // unused - no conversion done in this step
@@ -366,7 +363,7 @@ WCHAR* RakString::ToWideChar(void) {
     int result = ::MultiByteToWideChar(
         CP_UTF8,              // convert from UTF-8
         0,                    // Buffer
-        sharedString->c_str,  // source UTF-8 string
+        GetBuffer(),  // source UTF-8 string
         int(GetLength() + 1), // total length of source UTF-8 string,
         // in CHAR's (= bytes), including end-of-string \0
         pszUTF16, // destination buffer
@@ -393,7 +390,7 @@ void RakString::FromWideChar(const wchar_t* source) {
 
         source,              // Source Unicode string
         -1,                  // -1 means string is zero-terminated
-        sharedString->c_str, // Destination char string
+        GetBuffer(), // Destination char string
         bufSize,             // Size of buffer
         NULL,                // No default character
         NULL
@@ -413,7 +410,7 @@ size_t RakString::Find(const char* stringToFind, size_t pos) {
     size_t iStart   = 0;
 
     for (size_t i = pos; i < len; i++) {
-        if (stringToFind[matchPos] == sharedString->c_str[i]) {
+        if (stringToFind[matchPos] == GetBuffer()[i]) {
             if (matchPos == 0) { iStart = i; }
             matchPos++;
         } else {
@@ -430,14 +427,14 @@ void RakString::TruncateUTF8(unsigned int length) {
     int          i     = 0;
     unsigned int count = 0;
 
-    while (sharedString->c_str[i] != 0) {
+    while (GetBuffer()[i] != 0) {
         if (count == length) {
-            sharedString->c_str[i] = 0;
+            GetBuffer()[i] = 0;
             return;
-        } else if (sharedString->c_str[i] > 0) {
+        } else if (GetBuffer()[i] > 0) {
             i++;
         } else {
-            switch (0xF0 & sharedString->c_str[i]) {
+            switch (0xF0 & GetBuffer()[i]) {
             case 0xE0:
                 i += 3;
                 break;
@@ -466,8 +463,8 @@ RakString RakString::SubStr(unsigned int index, unsigned int count) const {
     if (count < numBytes) numBytes = count;
     copy.Allocate(numBytes + 1);
     size_t i;
-    for (i = 0; i < numBytes; i++) copy.sharedString->c_str[i] = sharedString->c_str[index + i];
-    copy.sharedString->c_str[i] = 0;
+    for (i = 0; i < numBytes; i++) copy.GetBuffer()[i] = GetBuffer()[index + i];
+    copy.GetBuffer()[i] = 0;
     return copy;
 }
 void RakString::Erase(unsigned int index, unsigned int count) {
@@ -476,15 +473,15 @@ void RakString::Erase(unsigned int index, unsigned int count) {
 
     Clone();
     unsigned i;
-    for (i = index; i < len - count; i++) { sharedString->c_str[i] = sharedString->c_str[i + count]; }
-    sharedString->c_str[i] = 0;
+    for (i = index; i < len - count; i++) { GetBuffer()[i] = GetBuffer()[i + count]; }
+    GetBuffer()[i] = 0;
 }
 void RakString::TerminateAtLastCharacter(char c) {
     int i, len = (int)GetLength();
     for (i = len - 1; i >= 0; i--) {
-        if (sharedString->c_str[i] == c) {
+        if (GetBuffer()[i] == c) {
             Clone();
-            sharedString->c_str[i] = 0;
+            GetBuffer()[i] = 0;
             return;
         }
     }
@@ -492,7 +489,7 @@ void RakString::TerminateAtLastCharacter(char c) {
 void RakString::StartAfterLastCharacter(char c) {
     int i, len = (int)GetLength();
     for (i = len - 1; i >= 0; i--) {
-        if (sharedString->c_str[i] == c) {
+        if (GetBuffer()[i] == c) {
             ++i;
             if (i < len) { *this = SubStr(i, (uint32_t)GetLength() - i); }
             return;
@@ -502,10 +499,10 @@ void RakString::StartAfterLastCharacter(char c) {
 void RakString::TerminateAtFirstCharacter(char c) {
     unsigned int i, len = (unsigned int)GetLength();
     for (i = 0; i < len; i++) {
-        if (sharedString->c_str[i] == c) {
+        if (GetBuffer()[i] == c) {
             if (i > 0) {
                 Clone();
-                sharedString->c_str[i] = 0;
+                GetBuffer()[i] = 0;
             }
         }
     }
@@ -513,7 +510,7 @@ void RakString::TerminateAtFirstCharacter(char c) {
 void RakString::StartAfterFirstCharacter(char c) {
     unsigned int i, len = (unsigned int)GetLength();
     for (i = 0; i < len; i++) {
-        if (sharedString->c_str[i] == c) {
+        if (GetBuffer()[i] == c) {
             ++i;
             if (i < len) { *this = SubStr(i, (uint32_t)GetLength() - i); }
             return;
@@ -524,7 +521,7 @@ int RakString::GetCharacterCount(char c) {
     int          count = 0;
     unsigned int i, len = (unsigned int)GetLength();
     for (i = 0; i < len; i++) {
-        if (sharedString->c_str[i] == c) { ++count; }
+        if (GetBuffer()[i] == c) { ++count; }
     }
     return count;
 }
@@ -532,20 +529,20 @@ void RakString::RemoveCharacter(char c) {
     if (c == 0) return;
 
     unsigned int readIndex, writeIndex = 0;
-    for (readIndex = 0; sharedString->c_str[readIndex]; readIndex++) {
-        if (sharedString->c_str[readIndex] != c) sharedString->c_str[writeIndex++] = sharedString->c_str[readIndex];
+    for (readIndex = 0; GetBuffer()[readIndex]; readIndex++) {
+        if (GetBuffer()[readIndex] != c) GetBuffer()[writeIndex++] = GetBuffer()[readIndex];
         else Clone();
     }
-    sharedString->c_str[writeIndex] = 0;
+    GetBuffer()[writeIndex] = 0;
     if (writeIndex == 0) Clear();
 }
-int RakString::StrCmp(const RakString& rhs) const { return strcmp(sharedString->c_str, rhs.C_String()); }
+int RakString::StrCmp(const RakString& rhs) const { return strcmp(GetBuffer(), rhs.C_String()); }
 int RakString::StrNCmp(const RakString& rhs, size_t num) const {
-    return strncmp(sharedString->c_str, rhs.C_String(), num);
+    return strncmp(GetBuffer(), rhs.C_String(), num);
 }
-int  RakString::StrICmp(const RakString& rhs) const { return _stricmp(sharedString->c_str, rhs.C_String()); }
-void RakString::Printf(void) { RAKNET_DEBUG_PRINTF("%s", sharedString->c_str); }
-void RakString::FPrintf(FILE* fp) { fprintf(fp, "%s", sharedString->c_str); }
+int  RakString::StrICmp(const RakString& rhs) const { return _stricmp(GetBuffer(), rhs.C_String()); }
+void RakString::Printf(void) { RAKNET_DEBUG_PRINTF("%s", GetBuffer()); }
+void RakString::FPrintf(FILE* fp) { fprintf(fp, "%s", GetBuffer()); }
 bool RakString::IPAddressMatch(const char* IP) {
     unsigned characterIndex;
 
@@ -557,7 +554,7 @@ bool RakString::IPAddressMatch(const char* IP) {
 #pragma warning(disable : 4127) // warning C4127: conditional expression is constant
 #endif
     while (true) {
-        if (sharedString->c_str[characterIndex] == IP[characterIndex]) {
+        if (GetBuffer()[characterIndex] == IP[characterIndex]) {
             // Equal characters
             if (IP[characterIndex] == 0) {
                 // End of the string and the strings match
@@ -569,13 +566,13 @@ bool RakString::IPAddressMatch(const char* IP) {
         }
 
         else {
-            if (sharedString->c_str[characterIndex] == 0 || IP[characterIndex] == 0) {
+            if (GetBuffer()[characterIndex] == 0 || IP[characterIndex] == 0) {
                 // End of one of the strings
                 break;
             }
 
             // Characters do not match
-            if (sharedString->c_str[characterIndex] == '*') {
+            if (GetBuffer()[characterIndex] == '*') {
                 // Domain is banned.
                 return true;
             }
@@ -590,33 +587,33 @@ bool RakString::IPAddressMatch(const char* IP) {
     return false;
 }
 bool RakString::ContainsNonprintableExceptSpaces(void) const {
-    size_t   strLen = strlen(sharedString->c_str);
+    size_t   strLen = strlen(GetBuffer());
     unsigned i;
     for (i = 0; i < strLen; i++) {
-        if (sharedString->c_str[i] < ' ' || sharedString->c_str[i] > 126) return true;
+        if (GetBuffer()[i] < ' ' || GetBuffer()[i] > 126) return true;
     }
     return false;
 }
 bool RakString::IsEmailAddress(void) const {
     if (IsEmpty()) return false;
-    size_t strLen = strlen(sharedString->c_str);
+    size_t strLen = strlen(GetBuffer());
     if (strLen < 6) // a@b.de
         return false;
-    if (sharedString->c_str[strLen - 4] != '.' && sharedString->c_str[strLen - 3] != '.') // .com, .net., .org, .de
+    if (GetBuffer()[strLen - 4] != '.' && GetBuffer()[strLen - 3] != '.') // .com, .net., .org, .de
         return false;
     unsigned i;
     // Has non-printable?
     for (i = 0; i < strLen; i++) {
-        if (sharedString->c_str[i] <= ' ' || sharedString->c_str[i] > 126) return false;
+        if (GetBuffer()[i] <= ' ' || GetBuffer()[i] > 126) return false;
     }
     int atCount = 0;
     for (i = 0; i < strLen; i++) {
-        if (sharedString->c_str[i] == '@') { atCount++; }
+        if (GetBuffer()[i] == '@') { atCount++; }
     }
     if (atCount != 1) return false;
     int dotCount = 0;
     for (i = 0; i < strLen; i++) {
-        if (sharedString->c_str[i] == '.') { dotCount++; }
+        if (GetBuffer()[i] == '.') { dotCount++; }
     }
     if (dotCount == 0) return false;
 
@@ -625,14 +622,14 @@ bool RakString::IsEmailAddress(void) const {
 }
 RakNet::RakString& RakString::URLEncode(void) {
     RakString result;
-    size_t    strLen = strlen(sharedString->c_str);
-    result.Allocate(strLen * 3);
-    char*         output      = result.sharedString->c_str;
+    size_t    strLen = strlen(GetBuffer());
+    result.Allocate(strLen * 3 + 1);
+    char*         output      = result.GetBuffer();
     unsigned int  outputIndex = 0;
     unsigned      i;
     unsigned char c;
     for (i = 0; i < strLen; i++) {
-        c = sharedString->c_str[i];
+        c = GetBuffer()[i];
         if ((c <= 47) || (c >= 58 && c <= 64) || (c >= 91 && c <= 96) || (c >= 123)) {
             char buff[3];
             Itoa(c, buff, 16);
@@ -651,19 +648,19 @@ RakNet::RakString& RakString::URLEncode(void) {
 }
 RakNet::RakString& RakString::URLDecode(void) {
     RakString result;
-    size_t    strLen = strlen(sharedString->c_str);
-    result.Allocate(strLen);
-    char*        output      = result.sharedString->c_str;
+    size_t    strLen = strlen(GetBuffer());
+    result.Allocate(strLen + 1);
+    char*        output      = result.GetBuffer();
     unsigned int outputIndex = 0;
     char         c;
     char         hexDigits[2];
     char         hexValues[2];
     unsigned int i;
     for (i = 0; i < strLen; i++) {
-        c = sharedString->c_str[i];
+        c = GetBuffer()[i];
         if (c == '%') {
-            hexDigits[0] = sharedString->c_str[++i];
-            hexDigits[1] = sharedString->c_str[++i];
+            hexDigits[0] = GetBuffer()[++i];
+            hexDigits[1] = GetBuffer()[++i];
 
             if (hexDigits[0] == ' ') hexValues[0] = 0;
 
@@ -691,31 +688,31 @@ void RakString::SplitURI(RakNet::RakString& header, RakNet::RakString& domain, R
     domain.Clear();
     path.Clear();
 
-    size_t strLen = strlen(sharedString->c_str);
+    size_t strLen = strlen(GetBuffer());
 
     char         c;
     unsigned int i = 0;
-    if (strncmp(sharedString->c_str, "http://", 7) == 0) i += (unsigned int)strlen("http://");
-    else if (strncmp(sharedString->c_str, "https://", 8) == 0) i += (unsigned int)strlen("https://");
+    if (strncmp(GetBuffer(), "http://", 7) == 0) i += (unsigned int)strlen("http://");
+    else if (strncmp(GetBuffer(), "https://", 8) == 0) i += (unsigned int)strlen("https://");
 
-    if (strncmp(sharedString->c_str, "www.", 4) == 0) i += (unsigned int)strlen("www.");
+    if (strncmp(GetBuffer(), "www.", 4) == 0) i += (unsigned int)strlen("www.");
 
     if (i != 0) {
         header.Allocate(i + 1);
-        strncpy(header.sharedString->c_str, sharedString->c_str, i);
-        header.sharedString->c_str[i] = 0;
+        memcpy(header.GetBuffer(), GetBuffer(), i);
+        header.GetBuffer()[i] = 0;
     }
 
 
     domain.Allocate(strLen - i + 1);
-    char*        domainOutput = domain.sharedString->c_str;
+    char*        domainOutput = domain.GetBuffer();
     unsigned int outputIndex  = 0;
     for (; i < strLen; i++) {
-        c = sharedString->c_str[i];
+        c = GetBuffer()[i];
         if (c == '/') {
             break;
         } else {
-            domainOutput[outputIndex++] = sharedString->c_str[i];
+            domainOutput[outputIndex++] = GetBuffer()[i];
         }
     }
 
@@ -723,8 +720,8 @@ void RakString::SplitURI(RakNet::RakString& header, RakNet::RakString& domain, R
 
     path.Allocate(strLen - header.GetLength() - outputIndex + 1);
     outputIndex      = 0;
-    char* pathOutput = path.sharedString->c_str;
-    for (; i < strLen; i++) { pathOutput[outputIndex++] = sharedString->c_str[i]; }
+    char* pathOutput = path.GetBuffer();
+    for (; i < strLen; i++) { pathOutput[outputIndex++] = GetBuffer()[i]; }
     pathOutput[outputIndex] = 0;
 }
 RakNet::RakString& RakString::SQLEscape(void) {
@@ -732,24 +729,24 @@ RakNet::RakString& RakString::SQLEscape(void) {
     int escapedCharacterCount = 0;
     int index;
     for (index = 0; index < strLen; index++) {
-        if (sharedString->c_str[index] == '\'' || sharedString->c_str[index] == '"'
-            || sharedString->c_str[index] == '\\')
+        if (GetBuffer()[index] == '\'' || GetBuffer()[index] == '"'
+            || GetBuffer()[index] == '\\')
             escapedCharacterCount++;
     }
     if (escapedCharacterCount == 0) return *this;
 
     Clone();
-    Realloc(sharedString, strLen + escapedCharacterCount);
+    Realloc(strLen + escapedCharacterCount + 1);
     int writeIndex, readIndex;
     writeIndex = strLen + escapedCharacterCount;
     readIndex  = strLen;
     while (readIndex >= 0) {
-        if (sharedString->c_str[readIndex] == '\'' || sharedString->c_str[readIndex] == '"'
-            || sharedString->c_str[readIndex] == '\\') {
-            sharedString->c_str[writeIndex--] = sharedString->c_str[readIndex--];
-            sharedString->c_str[writeIndex--] = '\\';
+        if (GetBuffer()[readIndex] == '\'' || GetBuffer()[readIndex] == '"'
+            || GetBuffer()[readIndex] == '\\') {
+            GetBuffer()[writeIndex--] = GetBuffer()[readIndex--];
+            GetBuffer()[writeIndex--] = '\\';
         } else {
-            sharedString->c_str[writeIndex--] = sharedString->c_str[readIndex--];
+            GetBuffer()[writeIndex--] = GetBuffer()[readIndex--];
         }
     }
     return *this;
@@ -898,36 +895,37 @@ RakNet::RakString& RakString::MakeFilePath(void) {
 
     RakNet::RakString fixedString = *this;
     fixedString.Clone();
-    for (int i = 0; fixedString.sharedString->c_str[i]; i++) {
+    for (int i = 0; fixedString.GetBuffer()[i]; i++) {
 #ifdef _WIN32
-        if (fixedString.sharedString->c_str[i] == '/') fixedString.sharedString->c_str[i] = '\\';
+        if (fixedString.GetBuffer()[i] == '/') fixedString.GetBuffer()[i] = '\\';
 #else
-        if (fixedString.sharedString->c_str[i] == '\\') fixedString.sharedString->c_str[i] = '/';
+        if (fixedString.GetBuffer()[i] == '\\') fixedString.GetBuffer()[i] = '/';
 #endif
     }
 
 #ifdef _WIN32
-    if (fixedString.sharedString->c_str[strlen(fixedString.sharedString->c_str) - 1] != '\\') { fixedString += '\\'; }
+    if (fixedString.GetBuffer()[strlen(fixedString.GetBuffer()) - 1] != '\\') { fixedString += '\\'; }
 #else
-    if (fixedString.sharedString->c_str[strlen(fixedString.sharedString->c_str) - 1] != '/') { fixedString += '/'; }
+    if (fixedString.GetBuffer()[strlen(fixedString.GetBuffer()) - 1] != '/') { fixedString += '/'; }
 #endif
 
     if (fixedString != *this) *this = fixedString;
     return *this;
 }
 void RakString::FreeMemory(void) {
+    // Only the calling thread's own free list can be reached from here
+    while (threadFreeList.count > 0)
+        RakNet::OP_DELETE(threadFreeList.sharedStrings[--threadFreeList.count], _FILE_AND_LINE_);
+
     LockMutex();
     FreeMemoryNoMutex();
     UnlockMutex();
 }
 void RakString::FreeMemoryNoMutex(void) {
-    for (unsigned int i = 0; i < freeList.Size(); i++) {
-        RakNet::OP_DELETE(freeList[i]->refCountMutex, _FILE_AND_LINE_);
-        rakFree_Ex(freeList[i], _FILE_AND_LINE_);
-    }
+    for (unsigned int i = 0; i < freeList.Size(); i++) RakNet::OP_DELETE(freeList[i], _FILE_AND_LINE_);
     freeList.Clear(false, _FILE_AND_LINE_);
 }
-void RakString::Serialize(BitStream* bs) const { Serialize(sharedString->c_str, bs); }
+void RakString::Serialize(BitStream* bs) const { Serialize(GetBuffer(), bs); }
 void RakString::Serialize(const char* str, BitStream* bs) {
     unsigned short l = (unsigned short)strlen(str);
     bs->Write(l);
@@ -948,8 +946,8 @@ bool RakString::Deserialize(BitStream* bs) {
     b = bs->Read(l);
     if (l > 0) {
         Allocate(((unsigned int)l) + 1);
-        b = bs->ReadAlignedBytes((unsigned char*)sharedString->c_str, l);
-        if (b) sharedString->c_str[l] = 0;
+        b = bs->ReadAlignedBytes((unsigned char*)GetBuffer(), l);
+        if (b) GetBuffer()[l] = 0;
         else Clear();
     } else bs->AlignReadToByteBoundary();
     return b;
@@ -1003,31 +1001,15 @@ const char* RakString::ToString(uint64_t i) {
 }
 void RakString::Clear(void) { Free(); }
 void RakString::Allocate(size_t len) {
-    RakString::LockMutex();
-    // sharedString = RakString::pool.Allocate( _FILE_AND_LINE_ );
-    if (RakString::freeList.Size() == 0) {
-        // RakString::sharedStringFreeList=(RakString::SharedString*)
-        // rakRealloc_Ex(RakString::sharedStringFreeList,(RakString::sharedStringFreeListAllocationCount+1024)*sizeof(RakString::SharedString),
-        // _FILE_AND_LINE_);
-        unsigned i;
-        for (i = 0; i < 128; i++) {
-            //	RakString::freeList.Insert(RakString::sharedStringFreeList+i+RakString::sharedStringFreeListAllocationCount);
-            //		RakString::freeList.Insert((RakString::SharedString*)rakMalloc_Ex(sizeof(RakString::SharedString),
-            //_FILE_AND_LINE_), _FILE_AND_LINE_);
-
-            RakString::SharedString* ss;
-            ss = (RakString::SharedString*)rakMalloc_Ex(sizeof(RakString::SharedString), _FILE_AND_LINE_);
-            ss->refCountMutex = RakNet::OP_NEW<SimpleMutex>(_FILE_AND_LINE_);
-            RakString::freeList.Insert(ss, _FILE_AND_LINE_);
-        }
-        // RakString::sharedStringFreeListAllocationCount+=1024;
+    if (len <= INLINE_STRING_SIZE) {
+        sharedString = 0;
+        return;
     }
-    sharedString = RakString::freeList[RakString::freeList.Size() - 1];
-    RakString::freeList.RemoveAtIndex(RakString::freeList.Size() - 1);
-    RakString::UnlockMutex();
+
+    sharedString = AllocateSharedString();
 
     const size_t smallStringSize = 128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2;
-    sharedString->refCount       = 1;
+    sharedString->refCount.store(1, std::memory_order_relaxed);
     if (len <= smallStringSize) {
         sharedString->bytesUsed = smallStringSize;
         sharedString->c_str     = sharedString->smallString;
@@ -1045,7 +1027,7 @@ void RakString::Assign(const char* str) {
 
     size_t len = strlen(str) + 1;
     Allocate(len);
-    memcpy(sharedString->c_str, str, len);
+    memcpy(GetBuffer(), str, len);
 }
 void RakString::Assign(const char* str, va_list ap) {
     if (str == 0 || str[0] == 0) {
@@ -1087,22 +1069,20 @@ void RakString::Assign(const char* str, va_list ap) {
     }
 }
 RakNet::RakString RakString::Assign(const char* str, size_t pos, size_t n) {
-    size_t incomingLen = strlen(str);
-
-    Clone();
+    // str may point into this string, so keep the old value alive until it has been copied
+    RakString previous(*this);
+    Free();
 
-    if (str == 0 || str[0] == 0 || pos >= incomingLen) {
-        sharedString = &emptyString;
-        return (*this);
-    }
+    if (str == 0 || str[0] == 0 || pos >= strlen(str)) return (*this);
 
+    size_t incomingLen = strlen(str);
     if (pos + n >= incomingLen) { n = incomingLen - pos; }
     const char* tmpStr = &(str[pos]);
 
     size_t len = n + 1;
     Allocate(len);
-    memcpy(sharedString->c_str, tmpStr, len);
-    sharedString->c_str[n] = 0;
+    memmove(GetBuffer(), tmpStr, n);
+    GetBuffer()[n] = 0;
 
     return (*this);
 }
@@ -1129,54 +1109,31 @@ int           RakString::ReadIntFromSubstring(const char* str, size_t pos, size_
 }
 void RakString::AppendBytes(const char* bytes, unsigned int count) {
     if (IsEmpty()) {
-        Allocate(count);
-        memcpy(sharedString->c_str, bytes, count + 1);
-        sharedString->c_str[count] = 0;
+        Allocate(count + 1);
+        memcpy(GetBuffer(), bytes, count);
+        GetBuffer()[count] = 0;
     } else {
         Clone();
         unsigned int length = (unsigned int)GetLength();
-        Realloc(sharedString, count + length + 1);
-        memcpy(sharedString->c_str + length, bytes, count);
-        sharedString->c_str[length + count] = 0;
+        Realloc(count + length + 1);
+        memcpy(GetBuffer() + length, bytes, count);
+        GetBuffer()[length + count] = 0;
     }
 }
 void RakString::Clone(void) {
     RakAssert(sharedString != &emptyString);
     if (sharedString == &emptyString) { return; }
 
-    // Empty or solo then no point to cloning
-    sharedString->refCountMutex->Lock();
-    if (sharedString->refCount == 1) {
-        sharedString->refCountMutex->Unlock();
-        return;
-    }
+    // Inline or solo then no point to cloning
+    if (sharedString == 0 || sharedString->refCount.load(std::memory_order_acquire) == 1) return;
 
-    sharedString->refCount--;
-    sharedString->refCountMutex->Unlock();
-    Assign(sharedString->c_str);
+    // Copy before letting go, as the other owners may free it as soon as the reference is dropped
+    SharedString* shared = sharedString;
+    Assign(shared->c_str);
+    ReleaseSharedString(shared);
 }
 void RakString::Free(void) {
-    if (sharedString == &emptyString) return;
-    sharedString->refCountMutex->Lock();
-    sharedString->refCount--;
-    if (sharedString->refCount == 0) {
-        sharedString->refCountMutex->Unlock();
-        const size_t smallStringSize = 128 - sizeof(unsigned int) - sizeof(size_t) - sizeof(char*) * 2;
-        if (sharedString->bytesUsed > smallStringSize) rakFree_Ex(sharedString->bigString, _FILE_AND_LINE_);
-        /*
-        poolMutex->Lock();
-        pool.Release(sharedString);
-        poolMutex->Unlock();
-        */
-
-        RakString::LockMutex();
-        RakString::freeList.Insert(sharedString, _FILE_AND_LINE_);
-        RakString::UnlockMutex();
-
-        sharedString = &emptyString;
-    } else {
-        sharedString->refCountMutex->Unlock();
-    }
+    if (sharedString != &emptyString && sharedString != 0) ReleaseSharedString(sharedString);
     sharedString = &emptyString;
 }
 unsigned char RakString::ToLower(unsigned char c) {
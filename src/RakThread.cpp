@@ -27,6 +27,10 @@ using namespace RakNet;
 
 #else
 #include <pthread.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && !defined(ANDROID)
+#include <sched.h>
 #endif
 
 #if defined(_WIN32_WCE) || defined(WINDOWS_PHONE_8) || defined(WINDOWS_STORE_RT)
@@ -83,3 +87,32 @@ int RakThread::Create(void* start_address(void*), void* arglist, int priority)
     RakAssert(res == 0 && "pthread_create in RakThread.cpp failed.") return res;
 #endif
 }
+
+bool RakThread::SetCurrentThreadAffinity(int core) {
+    if (core < 0 || core >= GetCoreCount()) return false;
+
+#if defined(_WIN32) && !defined(_WIN32_WCE) && !defined(WINDOWS_PHONE_8) && !defined(WINDOWS_STORE_RT)
+    if (core >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__) && !defined(ANDROID)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+    return false;
+#endif
+}
+
+int RakThread::GetCoreCount(void) {
+#if defined(_WIN32) && !defined(_WIN32_WCE) && !defined(WINDOWS_PHONE_8) && !defined(WINDOWS_STORE_RT)
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return (int)systemInfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 0;
+#else
+    return 0;
+#endif
+}
@@ -198,10 +198,7 @@ float frandomMT(unsigned int* state, unsigned int*& next, int& left) {
 }
 RakNetRandom::RakNetRandom() { left = -1; }
 RakNetRandom::~RakNetRandom() {}
-void RakNetRandom::SeedMT(unsigned int seed) {
-    printf("%i\n", seed);
-    seedMT(seed, state, next, left);
-}
+void RakNetRandom::SeedMT(unsigned int seed) { seedMT(seed, state, next, left); }
 
 unsigned int RakNetRandom::ReloadMT(void) { return reloadMT(state, next, left); }
 
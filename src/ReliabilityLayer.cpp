@@ -13,6 +13,7 @@
 
 
 #include "ReliabilityLayer.h"
+#include "EventTrace.h"
 #include "GetTime.h"
 #include "MessageIdentifiers.h"
 #include "PluginInterface2.h"
@@ -44,12 +45,23 @@ double Ceil(double d) {
 #if CC_TIME_TYPE_BYTES == 4
 static const CCTimeType MAX_TIME_BETWEEN_PACKETS = 350;   // 350 milliseconds
 static const CCTimeType HISTOGRAM_RESTART_CYCLE  = 10000; // Every 10 seconds reset the histogram
+static const CCTimeType FEC_MAX_GROUP_DELAY      = 50;    // 50 milliseconds
+static const CCTimeType FEC_MAX_PARITY_DELAY     = 200;   // 200 milliseconds
+static const CCTimeType ACK_FREQUENCY_MIN_DELAY  = 10;    // 10 milliseconds, the same as an immediate ack
+static const CCTimeType IDLE_MEMORY_INTERVAL     = 1000;  // 1 second
 #else
 static const CCTimeType MAX_TIME_BETWEEN_PACKETS = 350000; // 350 milliseconds
 // static const CCTimeType HISTOGRAM_RESTART_CYCLE=10000000; // Every 10 seconds reset the histogram
+static const CCTimeType FEC_MAX_GROUP_DELAY     = 50000;   // 50 milliseconds
+static const CCTimeType FEC_MAX_PARITY_DELAY    = 200000;  // 200 milliseconds
+static const CCTimeType ACK_FREQUENCY_MIN_DELAY = 10000;   // 10 milliseconds, the same as an immediate ack
+static const CCTimeType IDLE_MEMORY_INTERVAL    = 1000000; // 1 second
 #endif
 static const int        DEFAULT_HAS_RECEIVED_PACKET_QUEUE_SIZE = 512;
 static const CCTimeType STARTING_TIME_BETWEEN_PACKETS          = MAX_TIME_BETWEEN_PACKETS;
+// First datagram number (3), member mask (4), length xor (2)
+static const unsigned int FEC_PARITY_HEADER_BYTES    = 9;
+static const unsigned int FEC_RECEIVE_HISTORY_LENGTH = 64;
 // static const long double TIME_BETWEEN_PACKETS_INCREASE_MULTIPLIER_DEFAULT=.02;
 // static const long double TIME_BETWEEN_PACKETS_DECREASE_MULTIPLIER_DEFAULT=1.0 / 9.0;
 
@@ -68,18 +80,16 @@ static FILE*        fp           = 0;
 // #define FLIP_SEND_ORDER_TEST
 // #define LOG_TRIVIAL_NOTIFICATIONS
 
-BPSTracker::TimeAndValue2::TimeAndValue2() {}
-BPSTracker::TimeAndValue2::~TimeAndValue2() {}
-BPSTracker::TimeAndValue2::TimeAndValue2(RakNet::TimeUS t, uint64_t v1) : value1(v1), time(t) {}
-// BPSTracker::TimeAndValue2::TimeAndValue2(RakNet::TimeUS t, uint64_t v1, uint64_t v2) : time(t), value1(v1),
-// value2(v2) {}
 BPSTracker::BPSTracker() { Reset(_FILE_AND_LINE_); }
 BPSTracker::~BPSTracker() {}
 // void BPSTracker::Reset(const char *file, unsigned int line) {total1=total2=lastSec1=lastSec2=0;
 // dataQueue.Clear(file,line);}
 void BPSTracker::Reset(const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
     total1 = lastSec1 = 0;
-    dataQueue.Clear(file, line);
+    currentBucket     = 0;
+    memset(buckets, 0, sizeof(buckets));
 }
 // void BPSTracker::Push2(RakNetTimeUS time, uint64_t value1, uint64_t value2)
 // {dataQueue.Push(TimeAndValue2(time,value1,value2),_FILE_AND_LINE_); total1+=value1; lastSec1+=value1; total2+=value2;
@@ -101,19 +111,6 @@ uint64_t BPSTracker::GetTotal1(void) const { return total1; }
 // 		dataQueue.Pop();
 // 	}
 // }
-void BPSTracker::ClearExpired1(RakNet::TimeUS time) {
-    while (dataQueue.IsEmpty() == false &&
-#if CC_TIME_TYPE_BYTES == 8
-           dataQueue.Peek().time + 1000000 < time
-#else
-           dataQueue.Peek().time + 1000 < time
-#endif
-    ) {
-        lastSec1 -= dataQueue.Peek().value1;
-        dataQueue.Pop();
-    }
-}
-
 struct DatagramHeaderFormat {
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
     CCTimeType sourceSystemTime;
@@ -129,7 +126,11 @@ struct DatagramHeaderFormat {
     bool  hasBAndAS;
     bool  isContinuousSend;
     bool  needsBAndAs;
-    bool  isValid; // To differentiate between what I serialized, and offline data
+    bool  isFECProtected;         // Payload is covered by a later parity datagram
+    bool  isFECParity;            // Payload is parity, not messages
+    bool  usesAckFrequency;       // ACK only. Sender delays its own acks, and accepts acks ahead of data
+    bool  hasPiggybackedDatagram; // ACK only. A whole data datagram follows the ack ranges
+    bool  isValid;                // To differentiate between what I serialized, and offline data
 
     static BitSize_t GetDataHeaderBitLength() { return BYTES_TO_BITS(GetDataHeaderByteLength()); }
 
@@ -152,6 +153,8 @@ struct DatagramHeaderFormat {
         if (isACK) {
             b->Write(true);
             b->Write(hasBAndAS);
+            b->Write(usesAckFrequency);
+            b->Write(hasPiggybackedDatagram);
             b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMSLow = (RakNet::TimeMS)sourceSystemTime & 0xFFFFFFFF;
@@ -170,6 +173,8 @@ struct DatagramHeaderFormat {
             b->Write(isPacketPair);
             b->Write(isContinuousSend);
             b->Write(needsBAndAs);
+            b->Write(isFECProtected);
+            b->Write(isFECParity);
             b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMSLow = (RakNet::TimeMS)sourceSystemTime & 0xFFFFFFFF;
@@ -185,10 +190,16 @@ struct DatagramHeaderFormat {
 
         b->Read(isValid);
         b->Read(isACK);
+        isFECProtected         = false;
+        isFECParity            = false;
+        usesAckFrequency       = false;
+        hasPiggybackedDatagram = false;
         if (isACK) {
             isNAK        = false;
             isPacketPair = false;
             b->Read(hasBAndAS);
+            b->Read(usesAckFrequency);
+            b->Read(hasPiggybackedDatagram);
             b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMS;
@@ -207,6 +218,8 @@ struct DatagramHeaderFormat {
                 b->Read(isPacketPair);
                 b->Read(isContinuousSend);
                 b->Read(needsBAndAs);
+                b->Read(isFECProtected);
+                b->Read(isFECParity);
                 b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
                 RakNet::TimeMS timeMS;
@@ -306,11 +319,16 @@ ReliabilityLayer::ReliabilityLayer() {
     if (fp == 0 && 0) { fp = fopen("reliableorderedoutput.txt", "wt"); }
 #endif
 
+    statisticsSnapshotSequence = 0;
+#if LATENCY_HISTOGRAMS == 1
+    for (int i = 0; i < LATENCY_HISTOGRAM_TYPE_COUNT; i++) latencyHistogramSnapshotSequences[i] = 0;
+#endif
     InitializeVariables();
     // int i = sizeof(InternalPacket);
     datagramHistoryMessagePool.SetPageSize(sizeof(MessageNumberNode) * 128);
     internalPacketPool.SetPageSize(sizeof(InternalPacket) * INTERNAL_PACKET_PAGE_SIZE);
     refCountedDataPool.SetPageSize(sizeof(InternalPacketRefCountedData) * 32);
+    fecSendGroupPool.SetPageSize(sizeof(FECSendGroup) * 4);
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -326,6 +344,12 @@ void ReliabilityLayer::Reset(bool resetVariables, int MTUSize, bool _useSecurity
 
     FreeMemory(true); // true because making a memory reset pending in the update cycle causes resets after reconnects.
                       // Instead, just call Reset from a single thread
+    // Readers must not see the statistics of the connection that used this layer before
+    PublishStatisticsSnapshot(0);
+#if LATENCY_HISTOGRAMS == 1
+    PublishLatencyHistogramSnapshots(0);
+#endif
+    statisticsSnapshotPublished = false;
     if (resetVariables) {
         InitializeVariables();
 
@@ -355,14 +379,16 @@ RakNet::TimeMS ReliabilityLayer::GetTimeoutTime(void) { return timeoutTime; }
 // Initialize the variables
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::InitializeVariables(void) {
-    memset(orderedWriteIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
-    memset(sequencedWriteIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
-    memset(orderedReadIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
-    memset(highestSequencedReadIndex, 0, NUMBER_OF_ORDERED_STREAMS * sizeof(OrderingIndexType));
+    memset(orderingChannels, 0, sizeof(orderingChannels));
     memset(&statistics, 0, sizeof(statistics));
-    memset(&heapIndexOffsets, 0, sizeof(heapIndexOffsets));
 
     statistics.connectionStartTime = RakNet::GetTimeUS();
+    lastStatisticsSnapshot         = 0;
+    statisticsSnapshotPublished    = false;
+    tracedCWNDBytes                = 0;
+#if LATENCY_HISTOGRAMS == 1
+    for (int i = 0; i < LATENCY_HISTOGRAM_TYPE_COUNT; i++) latencyHistograms[i].Reset();
+#endif
     splitPacketId                  = 0;
     elapsedTimeSinceLastUpdate     = 0;
     throughputCapCountdown         = 0;
@@ -403,18 +429,39 @@ void ReliabilityLayer::InitializeVariables(void) {
     ackPingIndex = 0;
     ackPingSum   = (CCTimeType)0;
 
-    nextSendTime = lastUpdateTime;
+    nextSendTime              = lastUpdateTime;
+    nextIdleMemoryReleaseTime = lastUpdateTime + IDLE_MEMORY_INTERVAL;
     // nextLowestPingReset=(CCTimeType)0;
     //	continuousSend=false;
 
     //	histogramStart=(CCTimeType)0;
     //	histogramBitsSent=0;
     unacknowledgedBytes     = 0;
+    resendBuffer            = 0;
     resendLinkedListHead    = 0;
     totalUserDataBytesAcked = 0;
 
     datagramHistoryPopCount = 0;
 
+    memset(fecGroupSizeByChannel, 0, sizeof(fecGroupSizeByChannel));
+    fecEnabled                 = false;
+    remoteSupportsFEC          = false;
+    datagramSoFarHasFECMessage = false;
+    isReceivingNestedDatagram  = false;
+    fecOpenGroup               = 0;
+    fecReceiveHistory          = 0;
+
+    ackFrequencyDatagrams  = 0;
+    ackFrequencyMaxDelay   = 0;
+    remoteUsesAckFrequency = false;
+    datagramsSinceLastAck  = 0;
+    timeOfOldestUnsentAck  = 0;
+
+    userBytesAtLastIdleCheck = 0;
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    datagramCipher = 0;
+#endif
+
     InitHeapWeights();
     for (int i = 0; i < NUMBER_OF_PRIORITIES; i++) {
         statistics.messageInSendBuffer[i] = 0;
@@ -459,7 +506,7 @@ void ReliabilityLayer::FreeThreadSafeMemory(void) {
         ReleaseToInternalPacketPool(internalPacket);
     }
 
-    outputQueue.ClearAndForceAllocation(32, _FILE_AND_LINE_);
+    outputQueue.ClearAndForceAllocation(0, _FILE_AND_LINE_);
 
     /*
     for ( i = 0; i < orderingList.Size(); i++ )
@@ -486,16 +533,21 @@ void ReliabilityLayer::FreeThreadSafeMemory(void) {
     */
 
     for (i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++) {
-        for (j = 0; j < orderingHeaps[i].Size(); j++) {
-            FreeInternalPacketData(orderingHeaps[i][j], _FILE_AND_LINE_);
-            ReleaseToInternalPacketPool(orderingHeaps[i][j]);
+        if (orderingChannels[i] == 0) continue;
+        for (j = 0; j < orderingChannels[i]->orderingHeap.Size(); j++) {
+            FreeInternalPacketData(orderingChannels[i]->orderingHeap[j], _FILE_AND_LINE_);
+            ReleaseToInternalPacketPool(orderingChannels[i]->orderingHeap[j]);
         }
-        orderingHeaps[i].Clear(true, _FILE_AND_LINE_);
+        RakNet::OP_DELETE(orderingChannels[i], _FILE_AND_LINE_);
+        orderingChannels[i] = 0;
     }
 
     // resendList.ForEachData(DeleteInternalPacket);
     //	resendTree.Clear(_FILE_AND_LINE_);
-    memset(resendBuffer, 0, sizeof(resendBuffer));
+    if (resendBuffer) {
+        RakNet::OP_DELETE_ARRAY(resendBuffer, _FILE_AND_LINE_);
+        resendBuffer = 0;
+    }
     statistics.messagesInResendBuffer = 0;
     statistics.bytesInResendBuffer    = 0;
 
@@ -536,14 +588,11 @@ void ReliabilityLayer::FreeThreadSafeMemory(void) {
 
     unreliableWithAckReceiptHistory.Clear(false, _FILE_AND_LINE_);
 
+    // Grown on demand by Update()
     packetsToSendThisUpdate.Clear(false, _FILE_AND_LINE_);
-    packetsToSendThisUpdate.Preallocate(512, _FILE_AND_LINE_);
     packetsToDeallocThisUpdate.Clear(false, _FILE_AND_LINE_);
-    packetsToDeallocThisUpdate.Preallocate(512, _FILE_AND_LINE_);
     packetsToSendThisUpdateDatagramBoundaries.Clear(false, _FILE_AND_LINE_);
-    packetsToSendThisUpdateDatagramBoundaries.Preallocate(128, _FILE_AND_LINE_);
     datagramSizesInBytes.Clear(false, _FILE_AND_LINE_);
-    datagramSizesInBytes.Preallocate(128, _FILE_AND_LINE_);
 
     internalPacketPool.Clear(_FILE_AND_LINE_);
 
@@ -574,6 +623,30 @@ void ReliabilityLayer::FreeThreadSafeMemory(void) {
     NAKs.Clear();
 
     unreliableLinkedListHead = 0;
+
+    if (fecOpenGroup) fecSendGroupPool.Release(fecOpenGroup, _FILE_AND_LINE_);
+    fecOpenGroup = 0;
+    for (i = 0; i < fecClosedGroups.Size(); i++) fecSendGroupPool.Release(fecClosedGroups[i], _FILE_AND_LINE_);
+    fecClosedGroups.Clear(false, _FILE_AND_LINE_);
+    fecSendGroupPool.Clear(_FILE_AND_LINE_);
+    FreeFECReceiveHistory();
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    // Destroying the cipher wipes its keys
+    if (datagramCipher) {
+        RakNet::OP_DELETE(datagramCipher, _FILE_AND_LINE_);
+        datagramCipher = 0;
+    }
+#endif
+}
+
+void ReliabilityLayer::FreeFECReceiveHistory(void) {
+    if (fecReceiveHistory == 0) return;
+    for (unsigned int i = 0; i < FEC_RECEIVE_HISTORY_LENGTH; i++) {
+        if (fecReceiveHistory[i].data) rakFree_Ex(fecReceiveHistory[i].data, _FILE_AND_LINE_);
+    }
+    RakNet::OP_DELETE_ARRAY(fecReceiveHistory, _FILE_AND_LINE_);
+    fecReceiveHistory = 0;
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -600,11 +673,12 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 #endif
 
 #if CC_TIME_TYPE_BYTES == 4
-    timeRead /= 1000;
+    // Already converted for the datagram this was nested in or rebuilt from
+    if (isReceivingNestedDatagram == false) timeRead /= 1000;
 #endif
 
 
-    bpsMetrics[(int)ACTUAL_BYTES_RECEIVED].Push1(timeRead, length);
+    if (isReceivingNestedDatagram == false) bpsMetrics[(int)ACTUAL_BYTES_RECEIVED].Push1(timeRead, length);
 
     (void)MTUSize;
 
@@ -630,7 +704,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
     unsigned                   i;
 
 #if LIBCAT_SECURITY == 1
-    if (useSecurity) {
+    if (useSecurity && isReceivingNestedDatagram == false) {
         unsigned int received = length;
 
         if (!auth_enc.Decrypt((cat::u8*)buffer, received)) return false;
@@ -639,6 +713,22 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
     }
 #endif
 
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    // Decrypted in place. Anything that does not authenticate is dropped before it can touch reliability state
+    if (IsDatagramCipherActive() && isReceivingNestedDatagram == false
+        && !datagramCipher->Decrypt((unsigned char*)buffer, length)) {
+        for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size();
+             messageHandlerIndex++)
+            messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification(
+                "Datagram failed authentication",
+                BYTES_TO_BITS(length),
+                systemAddress,
+                true
+            );
+        return false;
+    }
+#endif
+
     RakNet::BitStream socketData(
         (unsigned char*)buffer,
         length,
@@ -749,6 +839,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 if (messageNumberNode) {
                     //	printf("%p Got ack for %i\n", this, datagramNumber.val);
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+#if LATENCY_HISTOGRAMS == 1
+                    RecordLatency(LATENCY_ACK_RTT, rtt);
+#endif
+                    RAKNET_TRACE_EVENT(EVENT_TRACE_ACK_RECEIVED, systemAddress, datagramNumber.val, 0, rtt);
                     congestionManager.OnAck(
                         timeRead,
                         rtt,
@@ -763,6 +857,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                     CCTimeType ping;
                     if (timeRead > whenSent) ping = timeRead - whenSent;
                     else ping = 0;
+#if LATENCY_HISTOGRAMS == 1
+                    RecordLatency(LATENCY_ACK_RTT, ping);
+#endif
+                    RAKNET_TRACE_EVENT(EVENT_TRACE_ACK_RECEIVED, systemAddress, datagramNumber.val, 0, ping);
                     congestionManager.OnAck(
                         timeRead,
                         ping,
@@ -774,6 +872,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                         datagramNumber
                     );
 #endif
+                    TraceCongestionWindow(systemAddress);
                     while (messageNumberNode) {
                         // TESTING1
                         // 						printf("Remove %i on ack for datagramNumber=%i.\n",
@@ -799,6 +898,47 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 // 				}
             }
         }
+
+        remoteUsesAckFrequency = dhf.usesAckFrequency;
+        if (dhf.hasPiggybackedDatagram) {
+            // The rest is a data datagram that was sent along with these acks
+            socketData.AlignReadToByteBoundary();
+            const unsigned int ackBytes = BITS_TO_BYTES(socketData.GetReadOffset());
+            if (ackBytes < length) {
+                // Only one level. Acks carrying acks would let the remote system recurse as deep as it likes
+                RakNet::BitStream    nestedData((unsigned char*)buffer + ackBytes, length - ackBytes, false);
+                DatagramHeaderFormat nestedDhf;
+                nestedDhf.Deserialize(&nestedData);
+                if (isReceivingNestedDatagram || nestedDhf.isValid == false || nestedDhf.isACK || nestedDhf.isNAK) {
+                    for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size();
+                         messageHandlerIndex++)
+                        messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification(
+                            "Piggybacked datagram is not a data datagram",
+                            BYTES_TO_BITS(length),
+                            systemAddress,
+                            true
+                        );
+
+                    return false;
+                }
+
+                const bool wasNested      = isReceivingNestedDatagram;
+                isReceivingNestedDatagram = true;
+                bool result               = HandleSocketReceiveFromConnectedPlayer(
+                    buffer + ackBytes,
+                    length - ackBytes,
+                    systemAddress,
+                    messageHandlerList,
+                    MTUSize,
+                    s,
+                    rnr,
+                    timeRead,
+                    updateBitStream
+                );
+                isReceivingNestedDatagram = wasNested;
+                return result;
+            }
+        }
     } else if (dhf.isNAK) {
         DatagramSequenceNumberType                            messageNumber;
         DataStructures::RangeList<DatagramSequenceNumberType> incomingNAKs;
@@ -835,6 +975,8 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                  messageNumber >= incomingNAKs.ranges[i].minIndex && messageNumber <= incomingNAKs.ranges[i].maxIndex;
                  messageNumber++) {
                 congestionManager.OnNAK(timeRead, messageNumber);
+                RAKNET_TRACE_EVENT(EVENT_TRACE_NAK_RECEIVED, systemAddress, messageNumber.val, 0, 0);
+                TraceCongestionWindow(systemAddress);
 
                 // REMOVEME
                 //				printf("%p NAK %i\n", this, dhf.datagramNumber.val);
@@ -842,7 +984,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
                 CCTimeType         timeSent;
                 MessageNumberNode* messageNumberNode = GetMessageNumberNodeByDatagramIndex(messageNumber, &timeSent);
-                while (messageNumberNode) {
+                while (messageNumberNode && resendBuffer) {
                     // Update timers so resends occur immediately
                     InternalPacket* internalPacket =
                         resendBuffer[messageNumberNode->messageNumber & (uint32_t)RESEND_BUFFER_ARRAY_MASK];
@@ -870,6 +1012,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
             return true;
         }
         if (dhf.isPacketPair) congestionManager.OnGotPacketPair(dhf.datagramNumber, length, timeRead);
+        RAKNET_TRACE_EVENT(EVENT_TRACE_DATAGRAM_RECEIVED, systemAddress, dhf.datagramNumber.val, length, 0);
 
         DatagramHeaderFormat dhfNAK;
         dhfNAK.isNAK = true;
@@ -886,6 +1029,34 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 #else
         SendAcknowledgementPacket(dhf.datagramNumber, 0);
 #endif
+        if (datagramsSinceLastAck++ == 0) timeOfOldestUnsentAck = timeRead;
+
+        // The original of a datagram already rebuilt from parity arrived late. Its unreliable messages were delivered
+        if (dhf.isFECProtected && WasRecoveredByFEC(dhf.datagramNumber)) {
+            receivePacketCount++;
+            return true;
+        }
+        if (dhf.isFECParity) {
+            RecoverFromFECParity(
+                &socketData,
+                systemAddress,
+                messageHandlerList,
+                MTUSize,
+                s,
+                rnr,
+                timeRead,
+                updateBitStream
+            );
+            receivePacketCount++;
+            return true;
+        }
+        if (dhf.isFECProtected) {
+            StoreFECProtectedDatagram(
+                dhf.datagramNumber,
+                (const unsigned char*)buffer + BITS_TO_BYTES(socketData.GetReadOffset()),
+                length - BITS_TO_BYTES(socketData.GetReadOffset())
+            );
+        }
 
         InternalPacket* internalPacket = CreateInternalPacketFromBitStream(&socketData, timeRead);
         if (internalPacket == 0) {
@@ -923,10 +1094,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 // resetReceivedPackets is set from a non-threadsafe function.
                 // We do the actual reset in this function so the data is not modified by multiple threads
                 if (resetReceivedPackets) {
-                    hasReceivedPacketQueue.ClearAndForceAllocation(
-                        DEFAULT_HAS_RECEIVED_PACKET_QUEUE_SIZE,
-                        _FILE_AND_LINE_
-                    );
+                    hasReceivedPacketQueue.ClearAndForceAllocation(0, _FILE_AND_LINE_);
                     receivedPacketsBaseIndex = 0;
                     resetReceivedPackets     = false;
                 }
@@ -1300,8 +1468,10 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
 
                     InsertIntoSplitPacketList(internalPacket, timeRead);
 
-                    internalPacket = BuildPacketFromSplitPacketList(
-                        internalPacket->splitPacketId,
+                    SplitPacketIdType    splitPacketId    = internalPacket->splitPacketId;
+                    SplitPacketIndexType splitPacketCount = internalPacket->splitPacketCount;
+                    internalPacket                        = BuildPacketFromSplitPacketList(
+                        splitPacketId,
                         timeRead,
                         s,
                         systemAddress,
@@ -1324,6 +1494,13 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                         // Don't have all the parts yet
                         goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
                     }
+                    RAKNET_TRACE_EVENT(
+                        EVENT_TRACE_SPLIT_PACKET_ASSEMBLED,
+                        systemAddress,
+                        splitPacketId,
+                        splitPacketCount,
+                        BITS_TO_BYTES(internalPacket->dataBitLength)
+                    );
                 }
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
@@ -1333,6 +1510,7 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                 if (internalPacket->reliability == RELIABLE_SEQUENCED
                     || internalPacket->reliability == UNRELIABLE_SEQUENCED
                     || internalPacket->reliability == RELIABLE_ORDERED) {
+                    OrderingChannel* orderingState = GetOrderingChannel(internalPacket->orderingChannel);
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
 
                     // ___________________
@@ -1360,14 +1538,14 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
 #endif
 
 
-                    if (internalPacket->orderingIndex == orderedReadIndex[internalPacket->orderingChannel]) {
+                    if (internalPacket->orderingIndex == orderingState->orderedReadIndex) {
                         // Has current ordering index
                         if (internalPacket->reliability == RELIABLE_SEQUENCED
                             || internalPacket->reliability == UNRELIABLE_SEQUENCED) {
                             // Is sequenced
                             if (IsOlderOrderedPacket(
                                     internalPacket->sequencingIndex,
-                                    highestSequencedReadIndex[internalPacket->orderingChannel]
+                                    orderingState->highestSequencedReadIndex
                                 )
                                 == false) {
                                 // Expected or highest known value
@@ -1404,8 +1582,11 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                                 // 6/26/2012 - Did not have the +1 in the next statement
                                 // Means a duplicated RELIABLE_SEQUENCED or UNRELIABLE_SEQUENCED packet would be
                                 // returned to the user
-                                highestSequencedReadIndex[internalPacket->orderingChannel] =
+                                orderingState->highestSequencedReadIndex =
                                     internalPacket->sequencingIndex + (OrderingIndexType)1;
+#if LATENCY_HISTOGRAMS == 1
+                                RecordLatency(LATENCY_ORDERING_HOLD, 0);
+#endif
 
                                 // Fallthrough, returned to user below
                             } else {
@@ -1447,6 +1628,9 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                                 timeRead,
                                 BITS_TO_BYTES(internalPacket->dataBitLength)
                             );
+#if LATENCY_HISTOGRAMS == 1
+                            RecordLatency(LATENCY_ORDERING_HOLD, 0);
+#endif
                             outputQueue.Push(internalPacket, _FILE_AND_LINE_);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
@@ -1459,13 +1643,13 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                                     internalPacket->orderingIndex.val,
                                     internalPacket->sequencingIndex
                                 );
-                                if (orderingHeaps[internalPacket->orderingChannel].Size() == 0)
+                                if (orderingState->orderingHeap.Size() == 0)
                                     fprintf(fp, "heap empty\n");
                                 else
                                     fprintf(
                                         fp,
                                         "heap head=%i\n",
-                                        orderingHeaps[internalPacket->orderingChannel].Peek()->orderingIndex.val
+                                        orderingState->orderingHeap.Peek()->orderingIndex.val
                                     );
 
                                 if (receivedPacketNumber < packetNumber) {
@@ -1485,14 +1669,14 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                             }
 #endif
 
-                            orderedReadIndex[internalPacket->orderingChannel]++;
-                            highestSequencedReadIndex[internalPacket->orderingChannel] = 0;
+                            orderingState->orderedReadIndex++;
+                            orderingState->highestSequencedReadIndex = 0;
 
                             // Return off heap until order lost
-                            while (orderingHeaps[internalPacket->orderingChannel].Size() > 0
-                                   && orderingHeaps[internalPacket->orderingChannel].Peek()->orderingIndex
-                                          == orderedReadIndex[internalPacket->orderingChannel]) {
-                                internalPacket = orderingHeaps[internalPacket->orderingChannel].Pop(0);
+                            while (orderingState->orderingHeap.Size() > 0
+                                   && orderingState->orderingHeap.Peek()->orderingIndex
+                                          == orderingState->orderedReadIndex) {
+                                internalPacket = orderingState->orderingHeap.Pop(0);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
                                 BitStream bitStream2(
@@ -1540,41 +1724,45 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                                     timeRead,
                                     BITS_TO_BYTES(internalPacket->dataBitLength)
                                 );
+#if LATENCY_HISTOGRAMS == 1
+                                // Set to when it was pushed on the heap
+                                RecordLatency(
+                                    LATENCY_ORDERING_HOLD,
+                                    timeRead > internalPacket->creationTime ? timeRead - internalPacket->creationTime
+                                                                            : 0
+                                );
+#endif
                                 outputQueue.Push(internalPacket, _FILE_AND_LINE_);
 
                                 if (internalPacket->reliability == RELIABLE_ORDERED) {
-                                    orderedReadIndex[internalPacket->orderingChannel]++;
+                                    orderingState->orderedReadIndex++;
                                 } else {
-                                    highestSequencedReadIndex[internalPacket->orderingChannel] =
-                                        internalPacket->sequencingIndex;
+                                    orderingState->highestSequencedReadIndex = internalPacket->sequencingIndex;
                                 }
                             }
 
                             // Done
                             goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
                         }
-                    } else if (IsOlderOrderedPacket(
-                                   internalPacket->orderingIndex,
-                                   orderedReadIndex[internalPacket->orderingChannel]
-                               )
+                    } else if (IsOlderOrderedPacket(internalPacket->orderingIndex, orderingState->orderedReadIndex)
                                == false) {
                         // internalPacket->_orderingIndex is greater
                         // If a message has a greater ordering index, and is sequenced or ordered, buffer it
                         // Sequenced has a lower heap weight, ordered has max sequenced weight
 
                         // Keep orderedHoleCount count small
-                        if (orderingHeaps[internalPacket->orderingChannel].Size() == 0)
-                            heapIndexOffsets[internalPacket->orderingChannel] =
-                                orderedReadIndex[internalPacket->orderingChannel];
+                        if (orderingState->orderingHeap.Size() == 0)
+                            orderingState->heapIndexOffset = orderingState->orderedReadIndex;
 
                         reliabilityHeapWeightType orderedHoleCount =
-                            internalPacket->orderingIndex - heapIndexOffsets[internalPacket->orderingChannel];
+                            internalPacket->orderingIndex - orderingState->heapIndexOffset;
                         reliabilityHeapWeightType weight = orderedHoleCount * 1048576;
                         if (internalPacket->reliability == RELIABLE_SEQUENCED
                             || internalPacket->reliability == UNRELIABLE_SEQUENCED)
                             weight += internalPacket->sequencingIndex;
                         else weight += (1048576 - 1);
-                        orderingHeaps[internalPacket->orderingChannel].Push(weight, internalPacket, _FILE_AND_LINE_);
+                        internalPacket->creationTime = timeRead;
+                        orderingState->orderingHeap.Push(weight, internalPacket, _FILE_AND_LINE_);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
                         if (packetId == ID_USER_PACKET_ENUM + 1 && fp) {
@@ -1585,7 +1773,7 @@ waitingForOrderedPacketReadIndex[ orderingChannelCopy ] )
                                 type,
                                 weight,
                                 internalPacket->orderingIndex.val,
-                                orderedReadIndex[internalPacket->orderingChannel].val,
+                                orderingState->orderedReadIndex.val,
                                 internalPacket->sequencingIndex
                             );
                             fflush(fp);
@@ -1771,9 +1959,10 @@ bool ReliabilityLayer::Send(
         //		internalPacket->reliability == UNRELIABLE_SEQUENCED_WITH_ACK_RECEIPT
     ) {
         // Assign the sequence stream and index
+        OrderingChannel* orderingState  = GetOrderingChannel(orderingChannel);
         internalPacket->orderingChannel = orderingChannel;
-        internalPacket->orderingIndex   = orderedWriteIndex[orderingChannel];
-        internalPacket->sequencingIndex = sequencedWriteIndex[orderingChannel]++;
+        internalPacket->orderingIndex   = orderingState->orderedWriteIndex;
+        internalPacket->sequencingIndex = orderingState->sequencedWriteIndex++;
 
         // This packet supersedes all other sequenced packets on the same ordering channel
         // Delete all packets in all send lists that are sequenced and on the same ordering channel
@@ -1791,9 +1980,13 @@ bool ReliabilityLayer::Send(
     } else if (internalPacket->reliability == RELIABLE_ORDERED
                || internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT) {
         // Assign the ordering channel and index
-        internalPacket->orderingChannel      = orderingChannel;
-        internalPacket->orderingIndex        = orderedWriteIndex[orderingChannel]++;
-        sequencedWriteIndex[orderingChannel] = 0;
+        OrderingChannel* orderingState     = GetOrderingChannel(orderingChannel);
+        internalPacket->orderingChannel    = orderingChannel;
+        internalPacket->orderingIndex      = orderingState->orderedWriteIndex++;
+        orderingState->sequencedWriteIndex = 0;
+    } else {
+        // Not sent, but lets unordered messages opt in to forward error correction by channel
+        internalPacket->orderingChannel = orderingChannel;
     }
 
     if (splitPacket) // If it uses a secure header it will be generated here
@@ -1938,7 +2131,10 @@ void ReliabilityLayer::Update(
         return;
     }
 
-    if (congestionManager.ShouldSendACKs(time, timeSinceLastTick)) {
+    // With ack frequency on both ends, acks wait to ride on outgoing data, and are only sent alone at the end of the
+    // update if they are due
+    const bool useAckFrequency = IsAckFrequencyActive();
+    if (useAckFrequency == false && congestionManager.ShouldSendACKs(time, timeSinceLastTick)) {
         SendACKs(s, systemAddress, time, rnr, updateBitStream);
     }
 
@@ -1982,6 +2178,13 @@ void ReliabilityLayer::Update(
         lastBpsClear = time;
     }
 
+    if (time - nextIdleMemoryReleaseTime < (((CCTimeType)-1) / 2)) {
+        if (IsIdle()) ReleaseIdleMemory();
+        userBytesAtLastIdleCheck  = bpsMetrics[(int)USER_MESSAGE_BYTES_PUSHED].GetTotal1()
+                                  + bpsMetrics[(int)USER_MESSAGE_BYTES_RECEIVED_PROCESSED].GetTotal1();
+        nextIdleMemoryReleaseTime = time + IDLE_MEMORY_INTERVAL;
+    }
+
     if (unreliableWithAckReceiptHistory.Size() > 0) {
         i = 0;
         while (i < unreliableWithAckReceiptHistory.Size()) {
@@ -2004,6 +2207,8 @@ void ReliabilityLayer::Update(
         }
     }
 
+    // What is left of the congestion window this tick, for parity datagrams
+    int fecParityBudget = 0;
     if (hasDataToSendOrResend == true) {
         InternalPacket* internalPacket;
         //		bool forceSend=false;
@@ -2062,6 +2267,14 @@ void ReliabilityLayer::Update(
                         PushPacket(time, internalPacket, true); // Affects GetNewTransmissionBandwidth()
                         internalPacket->timesSent++;
                         congestionManager.OnResend(time, internalPacket->nextActionTime);
+                        RAKNET_TRACE_EVENT(
+                            EVENT_TRACE_MESSAGE_RESENT,
+                            systemAddress,
+                            internalPacket->reliableMessageNumber.val,
+                            internalPacket->timesSent,
+                            BITS_TO_BYTES(internalPacket->dataBitLength)
+                        );
+                        TraceCongestionWindow(systemAddress);
                         internalPacket->retransmissionTime =
                             congestionManager.GetRTOForRetransmission(internalPacket->timesSent);
                         internalPacket->nextActionTime = internalPacket->retransmissionTime + time;
@@ -2158,7 +2371,11 @@ void ReliabilityLayer::Update(
 
                     internalPacket->headerLength = GetMessageHeaderLengthBits(internalPacket);
                     nextPacketBitLength          = internalPacket->headerLength + internalPacket->dataBitLength;
-                    if (datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits()) {
+                    BitSize_t maxDatagramBits    = GetMaxDatagramSizeExcludingMessageHeaderBits();
+                    // Leave room for the parity header, so the parity of a protected datagram still fits in the MTU
+                    if (datagramSizeSoFar > 0 && (datagramSoFarHasFECMessage || IsFECProtected(internalPacket)))
+                        maxDatagramBits -= BYTES_TO_BITS(FEC_PARITY_HEADER_BYTES);
+                    if (datagramSizeSoFar + nextPacketBitLength > maxDatagramBits) {
                         // Hit MTU. May still push packets if smaller ones exist at a lower priority
                         RakAssert(datagramSizeSoFar != 0);
                         RakAssert(internalPacket->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
@@ -2176,6 +2393,12 @@ void ReliabilityLayer::Update(
 
                     // sendPacketSet[ i ].Pop();
                     outgoingPacketBuffer.Pop(0);
+#if LATENCY_HISTOGRAMS == 1
+                    RecordLatency(
+                        LATENCY_SEND_BUFFER_WAIT,
+                        time > internalPacket->creationTime ? time - internalPacket->creationTime : 0
+                    );
+#endif
                     RakAssert(
                         outgoingPacketBuffer.Size() == 0
                         || outgoingPacketBuffer.Peek()->dataBitLength < BYTES_TO_BITS(MAXIMUM_MTU_SIZE)
@@ -2228,6 +2451,7 @@ void ReliabilityLayer::Update(
                             RakAssert(time - internalPacket->nextActionTime < threshhold);
                         }
                         // resendTree.Insert( internalPacket->reliableMessageNumber, internalPacket);
+                        if (resendBuffer == 0) AllocateResendBuffer();
                         if (resendBuffer[internalPacket->reliableMessageNumber & (uint32_t)RESEND_BUFFER_ARRAY_MASK]
                             != 0) {
                             //								bool overflow = ResendBufferOverflow();
@@ -2270,6 +2494,7 @@ void ReliabilityLayer::Update(
 
                     PushPacket(time, internalPacket, isReliable);
                     internalPacket->timesSent++;
+                    if (IsFECProtected(internalPacket)) datagramSoFarHasFECMessage = true;
 
                     for (unsigned int messageHandlerIndex = 0; messageHandlerIndex < messageHandlerList.Size();
                          messageHandlerIndex++) {
@@ -2330,13 +2555,34 @@ void ReliabilityLayer::Update(
                 msgIndex = packetsToSendThisUpdateDatagramBoundaries[datagramIndex - 1];
                 msgTerm  = packetsToSendThisUpdateDatagramBoundaries[datagramIndex];
             }
+            const unsigned int messageCount = msgTerm - msgIndex;
+
+            // Smallest group size of the protected messages in this datagram, if any
+            unsigned int fecGroupSize = 0;
+            if (fecEnabled) {
+                for (unsigned int fecIndex = msgIndex; fecIndex < msgTerm; fecIndex++) {
+                    if (IsFECProtected(packetsToSendThisUpdate[fecIndex])) {
+                        unsigned int channelGroupSize =
+                            fecGroupSizeByChannel[packetsToSendThisUpdate[fecIndex]->orderingChannel];
+                        if (fecGroupSize == 0 || channelGroupSize < fecGroupSize) fecGroupSize = channelGroupSize;
+                    }
+                }
+            }
+            dhf.isFECProtected = fecGroupSize != 0
+                              && datagramSizesInBytes[datagramIndex] + FEC_PARITY_HEADER_BYTES
+                                     <= GetMaxDatagramSizeExcludingMessageHeaderBytes();
+            dhf.isFECParity    = false;
 
             // More accurate time to reset here
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             dhf.sourceSystemTime = RakNet::GetTimeUS();
 #endif
             updateBitStream.Reset();
+            // Packet pairs are padded to the same size, so only carry acks on datagrams that are not paired
+            if (useAckFrequency && acknowlegements.Size() > 0 && dhf.isPacketPair == false)
+                WritePiggybackedACKs(datagramSizesInBytes[datagramIndex], time, updateBitStream);
             dhf.Serialize(&updateBitStream);
+            const BitSize_t datagramHeaderBits = updateBitStream.GetNumberOfBitsUsed();
             CC_DEBUG_PRINTF_2("S%i ", dhf.datagramNumber.val);
 
             while (msgIndex < msgTerm) {
@@ -2380,6 +2626,24 @@ void ReliabilityLayer::Update(
 
             congestionManager.OnSendBytes(time, UDP_HEADER_SIZE + DatagramHeaderFormat::GetDataHeaderByteLength());
 
+            // Before SendBitStream, which may encrypt in place
+            if (dhf.isFECProtected) {
+                AddToFECSendGroup(
+                    dhf.datagramNumber,
+                    updateBitStream.GetData() + BITS_TO_BYTES(datagramHeaderBits),
+                    updateBitStream.GetNumberOfBytesUsed() - BITS_TO_BYTES(datagramHeaderBits),
+                    fecGroupSize,
+                    time
+                );
+            }
+
+            RAKNET_TRACE_EVENT(
+                EVENT_TRACE_DATAGRAM_SENT,
+                systemAddress,
+                dhf.datagramNumber.val,
+                updateBitStream.GetNumberOfBytesUsed(),
+                messageCount
+            );
             SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
 
             bandwidthExceededStatistic = outgoingPacketBuffer.Size() > 0;
@@ -2401,9 +2665,21 @@ void ReliabilityLayer::Update(
         // 			sendPacketSet[1].IsEmpty()==false ||
         // 			sendPacketSet[2].IsEmpty()==false ||
         // 			sendPacketSet[3].IsEmpty()==false;
+
+        if (retransmissionBandwidth > 0 || transmissionBandwidth > 0)
+            fecParityBudget = transmissionBandwidth - (int)BITS_TO_BYTES(allDatagramSizesSoFar);
+    } else if (fecClosedGroups.Size() > 0 || fecOpenGroup) {
+        fecParityBudget =
+            congestionManager.GetTransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes, false);
     }
 
 
+    if (useAckFrequency && ShouldSendDelayedACKs(time)) SendACKs(s, systemAddress, time, rnr, updateBitStream);
+
+    // After the datagrams above, whose numbers were assigned in order when they were filled
+    if (fecOpenGroup || fecClosedGroups.Size() > 0)
+        SendFECParity(s, systemAddress, time, rnr, updateBitStream, fecParityBudget);
+
     // Keep on top of deleting old unreliable split packets so they don't clog the list.
     // DeleteOldUnreliableSplitPackets( time );
 }
@@ -2425,6 +2701,15 @@ void ReliabilityLayer::SendBitStream(
 
     length = (unsigned int)bitStream->GetNumberOfBytesUsed();
 
+    RakAssert(length <= congestionManager.GetMTU());
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    // Before the simulator below so delayed datagrams are stored already encrypted
+    if (IsDatagramCipherActive()) {
+        bitStream->AddBitsAndReallocate(BYTES_TO_BITS(DatagramCipher::OVERHEAD_BYTES));
+        length = datagramCipher->Encrypt(bitStream->GetData(), length);
+    }
+#endif
 
 #ifdef _DEBUG
     if (packetloss > 0.0) {
@@ -2480,16 +2765,12 @@ void ReliabilityLayer::SendBitStream(
 
     bpsMetrics[(int)ACTUAL_BYTES_SENT].Push1(currentTime, length);
 
-    RakAssert(length <= congestionManager.GetMTU());
-
 #ifdef USE_THREADED_SEND
     SendToThread::SendToThreadBlock* block = SendToThread::AllocateBlock();
     memcpy(block->data, bitStream->GetData(), length);
-    block->dataWriteOffset                  = length;
-    block->extraSocketOptions               = extraSocketOptions;
-    block->remotePortRakNetWasStartedOn_PS3 = remotePortRakNetWasStartedOn_PS3;
-    block->s                                = s;
-    block->systemAddress                    = systemAddress;
+    block->dataWriteOffset = length;
+    block->s               = s;
+    block->systemAddress   = systemAddress;
     SendToThread::ProcessBlock(block);
 #else
     // SocketLayer::SendTo( s, ( char* ) bitStream->GetData(), length, systemAddress, __FILE__, __LINE__  );
@@ -2551,6 +2832,111 @@ void ReliabilityLayer::SetUnreliableTimeout(RakNet::TimeMS timeoutMS) {
 #endif
 }
 
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetForwardErrorCorrection(unsigned char orderingChannel, unsigned int groupSize) {
+    RakAssert(orderingChannel < NUMBER_OF_ORDERED_STREAMS);
+    RakAssert(groupSize <= FEC_MAX_GROUP_SIZE);
+    if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS) return;
+    if (groupSize > FEC_MAX_GROUP_SIZE) groupSize = FEC_MAX_GROUP_SIZE;
+
+    fecGroupSizeByChannel[orderingChannel] = (unsigned char)groupSize;
+    fecEnabled                             = false;
+    for (unsigned int i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++) {
+        if (fecGroupSizeByChannel[i] != 0) fecEnabled = true;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetAckFrequency(unsigned int datagramsPerAck, RakNet::TimeMS maxAckDelay) {
+    ackFrequencyDatagrams = datagramsPerAck;
+#if CC_TIME_TYPE_BYTES == 4
+    ackFrequencyMaxDelay = maxAckDelay;
+#else
+    ackFrequencyMaxDelay = (CCTimeType)maxAckDelay * (CCTimeType)1000;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::IsIdle(void) const {
+    // Anything queued, in flight, or waiting to be acknowledged means the buffers are still in use
+    if (resendLinkedListHead || outgoingPacketBuffer.Size() > 0 || outputQueue.Size() > 0
+        || unreliableWithAckReceiptHistory.Size() > 0 || acknowlegements.Size() > 0 || NAKs.Size() > 0 || fecOpenGroup
+        || fecClosedGroups.Size() > 0)
+        return false;
+
+    return bpsMetrics[(int)USER_MESSAGE_BYTES_PUSHED].GetTotal1()
+               + bpsMetrics[(int)USER_MESSAGE_BYTES_RECEIVED_PROCESSED].GetTotal1()
+           == userBytesAtLastIdleCheck;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::ReleaseIdleMemory(void) {
+    unsigned int i;
+
+    // Every reliable message has been acknowledged, so the history would only be used to time late acks
+    while (datagramHistory.Size()) {
+        RemoveFromDatagramHistory(datagramHistoryPopCount);
+        datagramHistory.Pop();
+        datagramHistoryPopCount++;
+    }
+    datagramHistory.ClearAndForceAllocation(0, _FILE_AND_LINE_);
+
+    if (resendBuffer) {
+        RakNet::OP_DELETE_ARRAY(resendBuffer, _FILE_AND_LINE_);
+        resendBuffer = 0;
+    }
+
+    // The ordering indices must survive for the life of the connection, only the heap storage goes
+    for (i = 0; i < NUMBER_OF_ORDERED_STREAMS; i++) {
+        if (orderingChannels[i] && orderingChannels[i]->orderingHeap.Size() == 0)
+            orderingChannels[i]->orderingHeap.Clear(false, _FILE_AND_LINE_);
+    }
+
+    // Partially reassembled split packets are kept
+    if (splitPacketChannelList.Size() == 0) splitPacketChannelList.Clear(false, _FILE_AND_LINE_);
+    if (hasReceivedPacketQueue.Size() == 0) hasReceivedPacketQueue.ClearAndForceAllocation(0, _FILE_AND_LINE_);
+    FreeFECReceiveHistory();
+
+    outputQueue.ClearAndForceAllocation(0, _FILE_AND_LINE_);
+    outgoingPacketBuffer.Clear(false, _FILE_AND_LINE_);
+    unreliableWithAckReceiptHistory.Clear(false, _FILE_AND_LINE_);
+    fecClosedGroups.Clear(false, _FILE_AND_LINE_);
+    acknowlegements.ranges.Clear(false, _FILE_AND_LINE_);
+    NAKs.ranges.Clear(false, _FILE_AND_LINE_);
+    incomingAcks.ranges.Clear(false, _FILE_AND_LINE_);
+    packetsToSendThisUpdate.Clear(false, _FILE_AND_LINE_);
+    packetsToDeallocThisUpdate.Clear(false, _FILE_AND_LINE_);
+    packetsToSendThisUpdateDatagramBoundaries.Clear(false, _FILE_AND_LINE_);
+    datagramSizesInBytes.Clear(false, _FILE_AND_LINE_);
+
+    internalPacketPool.ReleaseEmptyPages(_FILE_AND_LINE_);
+    refCountedDataPool.ReleaseEmptyPages(_FILE_AND_LINE_);
+    datagramHistoryMessagePool.ReleaseEmptyPages(_FILE_AND_LINE_);
+    fecSendGroupPool.ReleaseEmptyPages(_FILE_AND_LINE_);
+}
+
+//-------------------------------------------------------------------------------------------------------
+ReliabilityLayer::OrderingChannel* ReliabilityLayer::GetOrderingChannel(unsigned char orderingChannel) {
+    RakAssert(orderingChannel < NUMBER_OF_ORDERED_STREAMS);
+    if (orderingChannels[orderingChannel] == 0) {
+        OrderingChannel* channel           = RakNet::OP_NEW<OrderingChannel>(_FILE_AND_LINE_);
+        channel->orderedWriteIndex         = 0;
+        channel->sequencedWriteIndex       = 0;
+        channel->orderedReadIndex          = 0;
+        channel->highestSequencedReadIndex = 0;
+        channel->heapIndexOffset           = 0;
+        orderingChannels[orderingChannel]  = channel;
+    }
+    return orderingChannels[orderingChannel];
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AllocateResendBuffer(void) {
+    RakAssert(resendBuffer == 0);
+    resendBuffer = RakNet::OP_NEW_ARRAY<InternalPacket*>(RESEND_BUFFER_ARRAY_LENGTH, _FILE_AND_LINE_);
+    memset(resendBuffer, 0, sizeof(InternalPacket*) * RESEND_BUFFER_ARRAY_LENGTH);
+}
+
 //-------------------------------------------------------------------------------------------------------
 // This will return true if we should not send at this time
 //-------------------------------------------------------------------------------------------------------
@@ -2628,6 +3014,8 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 
     //	bool deleted;
     //	deleted=resendTree.Delete(messageNumber, internalPacket);
+    // Nothing reliable is in flight
+    if (resendBuffer == 0) return (unsigned)-1;
     internalPacket = resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK];
     // May ask to remove twice, for example resend twice, then second ack
     if (internalPacket && internalPacket->reliableMessageNumber == messageNumber) {
@@ -2637,6 +3025,12 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 
         statistics.messagesInResendBuffer--;
         statistics.bytesInResendBuffer -= BITS_TO_BYTES(internalPacket->dataBitLength);
+#if LATENCY_HISTOGRAMS == 1
+        RecordLatency(
+            LATENCY_RESEND_BUFFER_WAIT,
+            time > internalPacket->firstSendTime ? time - internalPacket->firstSendTime : 0
+        );
+#endif
 
         //		orderingIndex = internalPacket->orderingIndex;
         totalUserDataBytesAcked += (double)BITS_TO_BYTES(internalPacket->headerLength + internalPacket->dataBitLength);
@@ -3530,9 +3924,7 @@ void ReliabilityLayer::InsertPacketIntoResendList(
     bool            firstResend,
     bool            modifyUnacknowledgedBytes
 ) {
-    (void)firstResend;
-    (void)time;
-    (void)internalPacket;
+    if (firstResend) internalPacket->firstSendTime = time;
 
     AddToListTail(internalPacket, modifyUnacknowledgedBytes);
     RakAssert(internalPacket->nextActionTime != 0);
@@ -3589,6 +3981,135 @@ RakNetStatistics* ReliabilityLayer::GetStatistics(RakNetStatistics* rns) {
     return rns;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Sequence lock over \a count words that only one thread writes: the sequence is odd while the words are being written.
+// The words are atomics, so readers that race with a write see stale words rather than undefined behavior, and retry
+//-------------------------------------------------------------------------------------------------------
+static void WriteSequenced(
+    std::atomic<uint32_t>& sequence,
+    std::atomic<uint64_t>* words,
+    const uint64_t*        buffer,
+    unsigned int           count
+) {
+    // Only this thread writes, so the sequence is even here
+    uint32_t before = sequence.load(std::memory_order_relaxed);
+    sequence.store(before + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned int i = 0; i < count; i++) words[i].store(buffer[i], std::memory_order_relaxed);
+    sequence.store(before + 2, std::memory_order_release);
+}
+static void ReadSequenced(
+    const std::atomic<uint32_t>& sequence,
+    const std::atomic<uint64_t>* words,
+    uint64_t*                    buffer,
+    unsigned int                 count
+) {
+    uint32_t before, after;
+    do {
+        before = sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+
+        for (unsigned int i = 0; i < count; i++) buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::UpdateStatisticsSnapshot(
+    RakNet::TimeMS       timeMs,
+    const SystemAddress& systemAddress,
+    RakNetGUID           guid
+) {
+    if (statisticsSnapshotPublished && timeMs - lastStatisticsSnapshot < STATISTICS_SNAPSHOT_INTERVAL_MS) return;
+
+    StatisticsSnapshot snapshot;
+    GetStatistics(&snapshot.statistics);
+    snapshot.systemAddress = systemAddress;
+    snapshot.guid          = guid;
+    snapshot.published     = true;
+    PublishStatisticsSnapshot(&snapshot);
+#if LATENCY_HISTOGRAMS == 1
+    PublishLatencyHistogramSnapshots(&systemAddress);
+#endif
+
+    statisticsSnapshotPublished = true;
+    lastStatisticsSnapshot      = timeMs;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::PublishStatisticsSnapshot(const StatisticsSnapshot* snapshot) {
+    const unsigned int words = sizeof(statisticsSnapshot) / sizeof(statisticsSnapshot[0]);
+    uint64_t           buffer[words];
+    memset(buffer, 0, sizeof(buffer));
+    if (snapshot) memcpy(buffer, (const void*)snapshot, sizeof(StatisticsSnapshot));
+    WriteSequenced(statisticsSnapshotSequence, statisticsSnapshot, buffer, words);
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetStatisticsSnapshot(
+    RakNetStatistics* rns,
+    SystemAddress*    systemAddress,
+    RakNetGUID*       guid
+) const {
+    const unsigned int words = sizeof(statisticsSnapshot) / sizeof(statisticsSnapshot[0]);
+    uint64_t           buffer[words];
+    ReadSequenced(statisticsSnapshotSequence, statisticsSnapshot, buffer, words);
+
+    StatisticsSnapshot snapshot;
+    memcpy((void*)&snapshot, buffer, sizeof(StatisticsSnapshot));
+    if (snapshot.published == false) return false;
+    *rns = snapshot.statistics;
+    if (systemAddress) *systemAddress = snapshot.systemAddress;
+    if (guid) *guid = snapshot.guid;
+    return true;
+}
+
+#if LATENCY_HISTOGRAMS == 1
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::PublishLatencyHistogramSnapshots(const SystemAddress* systemAddress) {
+    uint64_t buffer[LATENCY_HISTOGRAM_SNAPSHOT_WORDS];
+    for (int type = 0; type < LATENCY_HISTOGRAM_TYPE_COUNT; type++) {
+        memset(buffer, 0, sizeof(buffer));
+        if (systemAddress) {
+            LatencyHistogramSnapshot snapshot;
+            snapshot.histogram     = latencyHistograms[type];
+            snapshot.systemAddress = *systemAddress;
+            snapshot.published     = true;
+            memcpy(buffer, (const void*)&snapshot, sizeof(LatencyHistogramSnapshot));
+        }
+        WriteSequenced(
+            latencyHistogramSnapshotSequences[type],
+            latencyHistogramSnapshots[type],
+            buffer,
+            LATENCY_HISTOGRAM_SNAPSHOT_WORDS
+        );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetLatencyHistogramSnapshot(
+    LatencyHistogramType type,
+    LatencyHistogram*    histogram,
+    SystemAddress*       systemAddress
+) const {
+    uint64_t buffer[LATENCY_HISTOGRAM_SNAPSHOT_WORDS];
+    ReadSequenced(
+        latencyHistogramSnapshotSequences[type],
+        latencyHistogramSnapshots[type],
+        buffer,
+        LATENCY_HISTOGRAM_SNAPSHOT_WORDS
+    );
+
+    LatencyHistogramSnapshot snapshot;
+    memcpy((void*)&snapshot, buffer, sizeof(LatencyHistogramSnapshot));
+    if (snapshot.published == false) return false;
+    *histogram = snapshot.histogram;
+    if (systemAddress) *systemAddress = snapshot.systemAddress;
+    return true;
+}
+#endif
+
 //-------------------------------------------------------------------------------------------------------
 // Returns the number of packets in the resend queue, not counting holes
 //-------------------------------------------------------------------------------------------------------
@@ -3619,7 +4140,8 @@ void ReliabilityLayer::ResetPacketsAndDatagrams(void) {
     packetsToSendThisUpdateDatagramBoundaries.Clear(true, _FILE_AND_LINE_);
     datagramsToSendThisUpdateIsPair.Clear(true, _FILE_AND_LINE_);
     datagramSizesInBytes.Clear(true, _FILE_AND_LINE_);
-    datagramSizeSoFar = 0;
+    datagramSizeSoFar          = 0;
+    datagramSoFarHasFECMessage = false;
 }
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::PushPacket(CCTimeType time, InternalPacket* internalPacket, bool isReliable) {
@@ -3654,7 +4176,8 @@ void ReliabilityLayer::PushDatagram(void) {
         datagramsToSendThisUpdateIsPair.Push(false, _FILE_AND_LINE_);
         RakAssert(BITS_TO_BYTES(datagramSizeSoFar) < MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
         datagramSizesInBytes.Push(BITS_TO_BYTES(datagramSizeSoFar), _FILE_AND_LINE_);
-        datagramSizeSoFar = 0;
+        datagramSizeSoFar          = 0;
+        datagramSoFarHasFECMessage = false;
 
         // Disable packet pairs
         /*
@@ -3772,9 +4295,11 @@ void ReliabilityLayer::SendACKs(
         // Send acks
         updateBitStream.Reset();
         DatagramHeaderFormat dhf;
-        dhf.isACK        = true;
-        dhf.isNAK        = false;
-        dhf.isPacketPair = false;
+        dhf.isACK                  = true;
+        dhf.isNAK                  = false;
+        dhf.isPacketPair           = false;
+        dhf.usesAckFrequency       = ackFrequencyDatagrams > 1;
+        dhf.hasPiggybackedDatagram = false;
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
         dhf.sourceSystemTime = time;
 #endif
@@ -3796,11 +4321,67 @@ void ReliabilityLayer::SendACKs(
         acknowlegements.Serialize(&updateBitStream, maxDatagramPayload, true);
         SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
         congestionManager.OnSendAck(time, updateBitStream.GetNumberOfBytesUsed());
+        bpsMetrics[(int)ACK_ONLY_DATAGRAMS_SENT].Push1(time, 1);
 
         // I think this is causing a bug where if the estimated bandwidth is very low for the recipient, only acks ever
         // get sent
         //	congestionManager.OnSendBytes(time,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
     }
+
+    datagramsSinceLastAck = 0;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::WritePiggybackedACKs(
+    unsigned int datagramPayloadBytes,
+    CCTimeType   time,
+    BitStream&   updateBitStream
+) {
+    DatagramHeaderFormat dhf;
+    dhf.isACK                  = true;
+    dhf.isNAK                  = false;
+    dhf.isPacketPair           = false;
+    dhf.hasBAndAS              = false;
+    dhf.usesAckFrequency       = true;
+    dhf.hasPiggybackedDatagram = true;
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+    dhf.sourceSystemTime = nextAckTimeToSend;
+#endif
+    dhf.Serialize(&updateBitStream);
+
+    // Whatever room the data datagram leaves. Worth it only if at least one range fits
+    const unsigned int maxDatagramBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes();
+    const unsigned int usedBytes        = datagramPayloadBytes + updateBitStream.GetNumberOfBytesUsed();
+    const BitSize_t    minRangeBits =
+        BYTES_TO_BITS(sizeof(unsigned short) + sizeof(unsigned char) + sizeof(DatagramSequenceNumberType) * 2);
+    if (usedBytes >= maxDatagramBytes || BYTES_TO_BITS(maxDatagramBytes - usedBytes) < minRangeBits) {
+        updateBitStream.Reset();
+        return;
+    }
+
+    CC_DEBUG_PRINTF_1("AckPiggyback ");
+    acknowlegements.Serialize(&updateBitStream, BYTES_TO_BITS(maxDatagramBytes - usedBytes), true);
+    updateBitStream.AlignWriteToByteBoundary();
+
+    // Counted like the acks SendACKs() sends on their own, whether or not they all fit
+    congestionManager.OnSendAck(time, updateBitStream.GetNumberOfBytesUsed());
+    if (acknowlegements.Size() == 0) datagramsSinceLastAck = 0;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::ShouldSendDelayedACKs(CCTimeType time) const {
+    if (acknowlegements.Size() == 0) return false;
+
+    // Never more often than without ack frequency, which is once every ACK_FREQUENCY_MIN_DELAY at high rates
+    // if ( timeOfOldestUnsentAck + ACK_FREQUENCY_MIN_DELAY > time )
+    if (time - (timeOfOldestUnsentAck + ACK_FREQUENCY_MIN_DELAY) >= (((CCTimeType)-1) / 2)) return false;
+    if (datagramsSinceLastAck >= ackFrequencyDatagrams) return true;
+
+    // The remote system's retransmission timeout is at least twice the round trip, so half the round trip leaves it
+    // time to spare
+    CCTimeType maxDelay = (CCTimeType)(congestionManager.GetRTT() / 2.0);
+    if (maxDelay > ackFrequencyMaxDelay) maxDelay = ackFrequencyMaxDelay;
+
+    // if ( timeOfOldestUnsentAck + maxDelay <= time )
+    return time - (timeOfOldestUnsentAck + maxDelay) < (((CCTimeType)-1) / 2);
 }
 /*
 //-------------------------------------------------------------------------------------------------------
@@ -3895,7 +4476,7 @@ bool ReliabilityLayer::ResendBufferOverflow(void) const {
     int index1 = sendReliableMessageNumberIndex & (uint32_t)RESEND_BUFFER_ARRAY_MASK;
     //	int index2 = (sendReliableMessageNumberIndex+(uint32_t)1) & (uint32_t) RESEND_BUFFER_ARRAY_MASK;
     RakAssert(index1 < RESEND_BUFFER_ARRAY_LENGTH);
-    return resendBuffer[index1] != 0; // || resendBuffer[index2]!=0;
+    return resendBuffer != 0 && resendBuffer[index1] != 0; // || resendBuffer[index2]!=0;
 }
 //-------------------------------------------------------------------------------------------------------
 ReliabilityLayer::MessageNumberNode*
@@ -4030,6 +4611,272 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket* internalPacket, co
     }
 }
 //-------------------------------------------------------------------------------------------------------
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+bool ReliabilityLayer::InitializeDatagramCipher(
+    DatagramCipherSuite  suite,
+    const unsigned char* privateKey,
+    const unsigned char* publicKey,
+    const unsigned char* remotePublicKey,
+    bool                 weInitiatedTheConnection
+) {
+    RakAssert(IsDatagramCipherActive() == false);
+    if (datagramCipher == 0) datagramCipher = RakNet::OP_NEW<DatagramCipher>(_FILE_AND_LINE_);
+    if (!datagramCipher->Initialize(suite, privateKey, publicKey, remotePublicKey, weInitiatedTheConnection)) {
+        RakNet::OP_DELETE(datagramCipher, _FILE_AND_LINE_);
+        datagramCipher = 0;
+        return false;
+    }
+
+    // The counter and tag are appended after the datagram is built, so leave room for them
+    congestionManager.SetMTU(congestionManager.GetMTU() - DatagramCipher::OVERHEAD_BYTES);
+    return true;
+}
+#endif // RAKNET_DATAGRAM_ENCRYPTION
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AddToFECSendGroup(
+    DatagramSequenceNumberType datagramNumber,
+    const unsigned char*       payload,
+    unsigned int               payloadLength,
+    unsigned int               groupSize,
+    CCTimeType                 time
+) {
+    RakAssert(payloadLength <= MAXIMUM_MTU_SIZE);
+
+    // The member mask only reaches 32 datagrams past the first
+    if (fecOpenGroup && (uint32_t)(datagramNumber - fecOpenGroup->firstDatagramNumber) >= 32) {
+        fecClosedGroups.Push(fecOpenGroup, _FILE_AND_LINE_);
+        fecOpenGroup = 0;
+    }
+
+    if (fecOpenGroup == 0) {
+        fecOpenGroup                      = fecSendGroupPool.Allocate(_FILE_AND_LINE_);
+        fecOpenGroup->firstDatagramNumber = datagramNumber;
+        fecOpenGroup->memberMask          = 0;
+        fecOpenGroup->memberCount         = 0;
+        fecOpenGroup->groupSize           = groupSize;
+        fecOpenGroup->firstSendTime       = time;
+        fecOpenGroup->lengthXor           = 0;
+        fecOpenGroup->parityLength        = 0;
+    }
+
+    FECSendGroup* group = fecOpenGroup;
+    if (payloadLength > group->parityLength) {
+        memset(group->parity + group->parityLength, 0, payloadLength - group->parityLength);
+        group->parityLength = (uint16_t)payloadLength;
+    }
+    for (unsigned int i = 0; i < payloadLength; i++) group->parity[i] ^= payload[i];
+    group->lengthXor  ^= (uint16_t)payloadLength;
+    group->memberMask |= (uint32_t)1 << (uint32_t)(datagramNumber - group->firstDatagramNumber);
+    group->memberCount++;
+    if (groupSize < group->groupSize) group->groupSize = groupSize;
+
+    if (group->memberCount >= group->groupSize) {
+        fecClosedGroups.Push(group, _FILE_AND_LINE_);
+        fecOpenGroup = 0;
+    }
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SendFECParity(
+    RakNetSocket2* s,
+    SystemAddress& systemAddress,
+    CCTimeType     time,
+    RakNetRandom*  rnr,
+    BitStream&     updateBitStream,
+    int            budget
+) {
+    // Don't hold back the parity of a group that is filling slowly, or a loss would be recovered too late to matter
+    if (fecOpenGroup && time - fecOpenGroup->firstSendTime >= FEC_MAX_GROUP_DELAY) {
+        fecClosedGroups.Push(fecOpenGroup, _FILE_AND_LINE_);
+        fecOpenGroup = 0;
+    }
+
+    // Parity is charged against the congestion window like data. What does not fit waits for a later tick, until the
+    // datagrams it covers are too old for it to be worth sending
+    unsigned int keptCount = 0;
+    for (unsigned int i = 0; i < fecClosedGroups.Size(); i++) {
+        FECSendGroup* group = fecClosedGroups[i];
+        if (time - group->firstSendTime >= FEC_MAX_PARITY_DELAY) {
+            fecSendGroupPool.Release(group, _FILE_AND_LINE_);
+            continue;
+        }
+        const int parityBytes = (int)(UDP_HEADER_SIZE + DatagramHeaderFormat::GetDataHeaderByteLength()
+                                      + FEC_PARITY_HEADER_BYTES + group->parityLength);
+        if (parityBytes > budget) {
+            fecClosedGroups[keptCount++] = group;
+            continue;
+        }
+        budget -= parityBytes;
+
+        DatagramHeaderFormat dhf;
+        dhf.isACK            = false;
+        dhf.isNAK            = false;
+        dhf.isPacketPair     = false;
+        dhf.isContinuousSend = false;
+        dhf.needsBAndAs      = congestionManager.GetIsInSlowStart();
+        dhf.isFECProtected   = false;
+        dhf.isFECParity      = true;
+        dhf.datagramNumber   = congestionManager.GetAndIncrementNextDatagramSequenceNumber();
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+        dhf.sourceSystemTime = RakNet::GetTimeUS();
+#endif
+        updateBitStream.Reset();
+        dhf.Serialize(&updateBitStream);
+        updateBitStream.Write(group->firstDatagramNumber);
+        updateBitStream.Write(group->memberMask);
+        updateBitStream.Write(group->lengthXor);
+        updateBitStream.WriteAlignedBytes(group->parity, group->parityLength);
+        RakAssert(updateBitStream.GetNumberOfBytesUsed() <= MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
+
+        // Acked like any unreliable datagram, but never resent
+        AddFirstToDatagramHistory(dhf.datagramNumber, time);
+        congestionManager.OnSendBytes(time, UDP_HEADER_SIZE + updateBitStream.GetNumberOfBytesUsed());
+        SendBitStream(s, systemAddress, &updateBitStream, rnr, time);
+
+        fecSendGroupPool.Release(group, _FILE_AND_LINE_);
+    }
+    fecClosedGroups.RemoveFromEnd(fecClosedGroups.Size() - keptCount);
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::StoreFECProtectedDatagram(
+    DatagramSequenceNumberType datagramNumber,
+    const unsigned char*       payload,
+    unsigned int               payloadLength
+) {
+    if (payloadLength > MAXIMUM_MTU_SIZE) return;
+
+    if (fecReceiveHistory == 0) {
+        fecReceiveHistory =
+            RakNet::OP_NEW_ARRAY<FECReceivedDatagram>(FEC_RECEIVE_HISTORY_LENGTH, _FILE_AND_LINE_);
+        for (unsigned int i = 0; i < FEC_RECEIVE_HISTORY_LENGTH; i++) {
+            fecReceiveHistory[i].isValid      = false;
+            fecReceiveHistory[i].wasRecovered = false;
+            fecReceiveHistory[i].length       = 0;
+            fecReceiveHistory[i].allocated    = 0;
+            fecReceiveHistory[i].data         = 0;
+        }
+    }
+
+    FECReceivedDatagram& slot = fecReceiveHistory[(uint32_t)datagramNumber % FEC_RECEIVE_HISTORY_LENGTH];
+    if (slot.allocated < payloadLength) {
+        unsigned char* data = (unsigned char*)rakRealloc_Ex(slot.data, payloadLength, _FILE_AND_LINE_);
+        if (data == 0) {
+            slot.isValid = false;
+            return;
+        }
+        slot.data      = data;
+        slot.allocated = (uint16_t)payloadLength;
+    }
+    memcpy(slot.data, payload, payloadLength);
+    slot.length         = (uint16_t)payloadLength;
+    slot.datagramNumber = datagramNumber;
+    slot.isValid        = true;
+    slot.wasRecovered   = false;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::RecoverFromFECParity(
+    RakNet::BitStream*                       parityData,
+    SystemAddress&                           systemAddress,
+    DataStructures::List<PluginInterface2*>& messageHandlerList,
+    int                                      MTUSize,
+    RakNetSocket2*                           s,
+    RakNetRandom*                            rnr,
+    CCTimeType                               timeRead,
+    BitStream&                               updateBitStream
+) {
+    DatagramSequenceNumberType firstDatagramNumber;
+    uint32_t                   memberMask;
+    uint16_t                   lengthXor;
+    if (parityData->Read(firstDatagramNumber) == false || parityData->Read(memberMask) == false
+        || parityData->Read(lengthXor) == false)
+        return;
+
+    const unsigned char* parity       = parityData->GetData() + BITS_TO_BYTES(parityData->GetReadOffset());
+    const unsigned int   parityLength = BITS_TO_BYTES(parityData->GetNumberOfUnreadBits());
+    if (parityLength > MAXIMUM_MTU_SIZE) return;
+
+    // XOR parity can rebuild exactly one missing member
+    DatagramSequenceNumberType missingDatagramNumber = firstDatagramNumber;
+    unsigned int               missingCount          = 0;
+    unsigned int               bit;
+    for (bit = 0; bit < 32; bit++) {
+        if ((memberMask & ((uint32_t)1 << bit)) == 0) continue;
+
+        DatagramSequenceNumberType datagramNumber = firstDatagramNumber + bit;
+        FECReceivedDatagram*       slot =
+            fecReceiveHistory ? &fecReceiveHistory[(uint32_t)datagramNumber % FEC_RECEIVE_HISTORY_LENGTH] : 0;
+        if (slot && slot->isValid) {
+            if (slot->datagramNumber == datagramNumber) continue;
+
+            // Overwritten by a newer datagram, so we can no longer tell if this one arrived
+            if ((uint32_t)(slot->datagramNumber - datagramNumber) < ((uint32_t)1 << 23)) return;
+        }
+
+        missingDatagramNumber = datagramNumber;
+        if (++missingCount > 1) return;
+    }
+    if (missingCount == 0) return;
+
+    DatagramHeaderFormat dhf;
+    dhf.isACK            = false;
+    dhf.isNAK            = false;
+    dhf.isPacketPair     = false;
+    dhf.isContinuousSend = false;
+    dhf.needsBAndAs      = false;
+    // Stored on arrival like the original, so a repeated parity datagram cannot deliver it twice
+    dhf.isFECProtected = true;
+    dhf.isFECParity    = false;
+    dhf.datagramNumber = missingDatagramNumber;
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+    dhf.sourceSystemTime = 0;
+#endif
+    RakNet::BitStream datagram;
+    dhf.Serialize(&datagram);
+    const unsigned int headerLength = datagram.GetNumberOfBytesUsed();
+    datagram.WriteAlignedBytes(parity, parityLength);
+
+    unsigned char* payload       = datagram.GetData() + headerLength;
+    unsigned int   payloadLength = lengthXor;
+    for (bit = 0; bit < 32; bit++) {
+        if ((memberMask & ((uint32_t)1 << bit)) == 0) continue;
+
+        DatagramSequenceNumberType datagramNumber = firstDatagramNumber + bit;
+        if (datagramNumber == missingDatagramNumber) continue;
+
+        const FECReceivedDatagram& slot = fecReceiveHistory[(uint32_t)datagramNumber % FEC_RECEIVE_HISTORY_LENGTH];
+        if (slot.length > parityLength) return;
+        for (unsigned int i = 0; i < slot.length; i++) payload[i] ^= slot.data[i];
+        payloadLength ^= slot.length;
+    }
+    if (payloadLength > parityLength) return;
+
+    statistics.datagramsRecoveredByFEC++;
+
+    // Processed as if it had just arrived, minus decryption and the received byte count
+    const bool wasNested      = isReceivingNestedDatagram;
+    isReceivingNestedDatagram = true;
+    HandleSocketReceiveFromConnectedPlayer(
+        (const char*)datagram.GetData(),
+        headerLength + payloadLength,
+        systemAddress,
+        messageHandlerList,
+        MTUSize,
+        s,
+        rnr,
+        timeRead,
+        updateBitStream
+    );
+    isReceivingNestedDatagram = wasNested;
+
+    FECReceivedDatagram& slot = fecReceiveHistory[(uint32_t)missingDatagramNumber % FEC_RECEIVE_HISTORY_LENGTH];
+    if (slot.isValid && slot.datagramNumber == missingDatagramNumber) slot.wasRecovered = true;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::WasRecoveredByFEC(DatagramSequenceNumberType datagramNumber) const {
+    if (fecReceiveHistory == 0) return false;
+    const FECReceivedDatagram& slot = fecReceiveHistory[(uint32_t)datagramNumber % FEC_RECEIVE_HISTORY_LENGTH];
+    return slot.isValid && slot.wasRecovered && slot.datagramNumber == datagramNumber;
+}
+//-------------------------------------------------------------------------------------------------------
 unsigned int ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBytes(void) {
     unsigned int val = congestionManager.GetMTU() - DatagramHeaderFormat::GetDataHeaderByteLength();
 
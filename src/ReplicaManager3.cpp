@@ -784,6 +784,9 @@ void ReplicaManager3::Update(void) {
     }
 
     if (time - lastAutoSerializeOccurance >= autoSerializeInterval) {
+        // Every stream from the last tick has been destroyed
+        serializeArena.Reset();
+
         for (index3 = 0; index3 < worldsList.Size(); index3++) {
             world   = worldsList[index3];
             worldId = world->worldId;
@@ -801,7 +804,10 @@ void ReplicaManager3::Update(void) {
             LastSerializationResult*     lsr;
 
             sp.messageTimestamp = 0;
-            for (int i = 0; i < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; i++) sp.pro[i] = defaultSendParameters;
+            for (int i = 0; i < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; i++) {
+                sp.pro[i] = defaultSendParameters;
+                sp.outputBitstream[i].SetArena(&serializeArena);
+            }
             index2 = 0;
             for (_index = 0; _index < world->connectionList.Size(); _index++) {
                 connection               = world->connectionList[_index];
@@ -1381,6 +1387,8 @@ SendSerializeIfChangedResult Connection_RM3::SendSerialize(
 
     RakNet::BitStream out;
     BitSize_t         bitsPerChannel[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+    // Temporary, so it can share storage with the serialization data
+    out.SetArena(serializationData[0].GetArena());
 
     if (sum == 0) {
         memset(bitsPerChannel, 0, sizeof(bitsPerChannel));
@@ -1388,6 +1396,12 @@ SendSerializeIfChangedResult Connection_RM3::SendSerialize(
         return SSICR_DID_NOT_SEND_DATA;
     }
 
+    // The header, then per channel a flag, the compressed length and up to a byte of alignment ahead of the data
+    out.Reserve(
+        sum + BYTES_TO_BITS(sizeof(MessageID) * 2 + sizeof(RakNet::Time) + sizeof(WorldId) + sizeof(NetworkID))
+        + RM3_NUM_OUTPUT_BITSTREAM_CHANNELS * BYTES_TO_BITS(sizeof(BitSize_t) + 2)
+    );
+
     RakAssert(replica->GetNetworkID() != UNASSIGNED_NETWORK_ID);
 
     BitSize_t bitsUsed;
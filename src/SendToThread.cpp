@@ -9,10 +9,8 @@
  */
 
 #include "SendToThread.h"
-#ifdef USE_THREADED_SEND
-#include "GetTime.h"
-#include "InternalPacket.h"
-#include "RakThread.h"
+#include "RakAssert.h"
+#include "RakSleep.h"
 
 #if USE_SLIDING_WINDOW_CONGESTION_CONTROL != 1
 #include "CCRakNetUDT.h"
@@ -22,38 +20,73 @@
 
 using namespace RakNet;
 
-int                                                                            SendToThread::refCount = 0;
-DataStructures::ThreadsafeAllocatingQueue<SendToThread::SendToThreadBlock>     SendToThread::objectQueue;
-ThreadPool<SendToThread::SendToThreadBlock*, SendToThread::SendToThreadBlock*> SendToThread::threadPool;
-
-SendToThread::SendToThreadBlock*
-SendToWorkerThread(SendToThread::SendToThreadBlock* input, bool* returnOutput, void* perThreadData) {
-    (void)perThreadData;
-    *returnOutput = false;
-    //	RakNet::TimeUS *mostRecentTime=(RakNet::TimeUS *)input->data;
-    //	*mostRecentTime=RakNet::GetTimeUS();
-    SocketLayer::SendTo(input->s, input->data, input->dataWriteOffset, input->systemAddress, _FILE_AND_LINE_);
-    SendToThread::objectQueue.Push(input);
+// Datagrams handed to RakNetSocket2::SendMultiple() at once
+static const unsigned int SEND_TO_THREAD_BATCH_SIZE = 64;
+
+int                                                                        SendToThread::refCount = 0;
+DataStructures::ThreadsafeAllocatingQueue<SendToThread::SendToThreadBlock> SendToThread::objectQueue;
+SendToThread::SocketThread SendToThread::socketThreads[SEND_TO_THREAD_MAX_SOCKETS];
+SimpleMutex                SendToThread::socketThreadsMutex;
+
+RAK_THREAD_DECLARATION(RakNet::SendToThread::SendLoop) {
+    SendToThread::SocketThread* socketThread = (SendToThread::SocketThread*)arguments;
+    RakNetSocket2*              s            = socketThread->socket.load(std::memory_order_acquire);
+
+    while (1) {
+        SendToThreadBlock* blocks = socketThread->pending.exchange(0, std::memory_order_acquire);
+        if (blocks == 0) {
+            // Only stops once everything queued has been sent
+            if (socketThread->running == false) break;
+
+            // Announced before looking again, so ProcessBlock() either sees this thread sleeping or this thread sees
+            // the block
+            socketThread->sleeping = true;
+            if (socketThread->pending.load() == 0 && socketThread->running) socketThread->event.WaitOnEvent(1000);
+            socketThread->sleeping = false;
+            continue;
+        }
+
+        // Pushed newest first
+        SendToThreadBlock* oldestFirst = 0;
+        while (blocks) {
+            SendToThreadBlock* next = blocks->next;
+            blocks->next            = oldestFirst;
+            oldestFirst             = blocks;
+            blocks                  = next;
+        }
+        SendBlocks(s, oldestFirst);
+    }
+
+    socketThread->active = false;
     return 0;
 }
+void SendToThread::SendBlocks(RakNetSocket2* s, SendToThreadBlock* blocks) {
+    RNS2_SendParameters sendParameters[SEND_TO_THREAD_BATCH_SIZE];
+    SendToThreadBlock*  batch[SEND_TO_THREAD_BATCH_SIZE];
+    while (blocks) {
+        unsigned int count = 0;
+        for (; blocks && count < SEND_TO_THREAD_BATCH_SIZE; blocks = blocks->next, count++) {
+            sendParameters[count].data          = blocks->data;
+            sendParameters[count].length        = blocks->dataWriteOffset;
+            sendParameters[count].systemAddress = blocks->systemAddress;
+            batch[count]                        = blocks;
+        }
+        s->SendMultiple(sendParameters, count, _FILE_AND_LINE_);
+        for (unsigned int i = 0; i < count; i++) objectQueue.Push(batch[i]);
+    }
+}
 SendToThread::SendToThread() {}
 SendToThread::~SendToThread() {}
 void SendToThread::AddRef(void) {
-    if (++refCount == 1) { threadPool.StartThreads(1, 0); }
+    ++refCount;
 }
 void SendToThread::Deref(void) {
     if (refCount > 0) {
         if (--refCount == 0) {
-            threadPool.StopThreads();
-            RakAssert(threadPool.NumThreadsWorking() == 0);
-
-            unsigned           i;
-            SendToThreadBlock* info;
-            for (i = 0; i < threadPool.InputSize(); i++) {
-                info = threadPool.GetInputAtIndex(i);
-                objectQueue.Push(info);
+            for (unsigned int i = 0; i < SEND_TO_THREAD_MAX_SOCKETS; i++) {
+                RakNetSocket2* s = socketThreads[i].socket.load();
+                if (s) RemoveSocket(s);
             }
-            threadPool.ClearInput();
             objectQueue.Clear(_FILE_AND_LINE_);
         }
     }
@@ -66,6 +99,67 @@ SendToThread::SendToThreadBlock* SendToThread::AllocateBlock(void) {
 }
 void SendToThread::ProcessBlock(SendToThread::SendToThreadBlock* threadedSend) {
     RakAssert(threadedSend->dataWriteOffset > 0 && threadedSend->dataWriteOffset <= MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
-    threadPool.AddInput(SendToWorkerThread, threadedSend);
+
+    SocketThread* socketThread = 0;
+    for (unsigned int i = 0; i < SEND_TO_THREAD_MAX_SOCKETS; i++) {
+        if (socketThreads[i].socket.load(std::memory_order_acquire) == threadedSend->s) {
+            socketThread = &socketThreads[i];
+            break;
+        }
+    }
+
+    if (socketThread == 0) {
+        socketThreadsMutex.Lock();
+        for (unsigned int i = 0; i < SEND_TO_THREAD_MAX_SOCKETS && socketThread == 0; i++) {
+            if (socketThreads[i].socket.load() == threadedSend->s) socketThread = &socketThreads[i];
+        }
+        for (unsigned int i = 0; i < SEND_TO_THREAD_MAX_SOCKETS && socketThread == 0; i++) {
+            if (socketThreads[i].socket.load() != 0) continue;
+
+            socketThreads[i].pending  = 0;
+            socketThreads[i].sleeping = false;
+            socketThreads[i].running  = true;
+            socketThreads[i].active   = true;
+            socketThreads[i].event.InitEvent();
+            socketThreads[i].socket.store(threadedSend->s, std::memory_order_release);
+            if (RakThread::Create(SendLoop, &socketThreads[i]) != 0) {
+                socketThreads[i].socket = 0;
+                socketThreads[i].active = false;
+                socketThreads[i].event.CloseEvent();
+                break;
+            }
+            socketThread = &socketThreads[i];
+        }
+        socketThreadsMutex.Unlock();
+    }
+
+    if (socketThread == 0) {
+        // Every thread is taken
+        threadedSend->next = 0;
+        SendBlocks(threadedSend->s, threadedSend);
+        return;
+    }
+
+    SendToThreadBlock* head = socketThread->pending.load(std::memory_order_relaxed);
+    do {
+        threadedSend->next = head;
+    } while (socketThread->pending.compare_exchange_weak(head, threadedSend) == false);
+
+    // A thread that was already sending takes this block with the ones before it
+    if (head == 0 && socketThread->sleeping) socketThread->event.SetEvent();
+}
+void SendToThread::RemoveSocket(RakNetSocket2* s) {
+    socketThreadsMutex.Lock();
+    for (unsigned int i = 0; i < SEND_TO_THREAD_MAX_SOCKETS; i++) {
+        if (socketThreads[i].socket.load() != s) continue;
+
+        socketThreads[i].running = false;
+        while (socketThreads[i].active) {
+            socketThreads[i].event.SetEvent();
+            RakSleep(1);
+        }
+        socketThreads[i].event.CloseEvent();
+        socketThreads[i].socket = 0;
+    }
+    socketThreadsMutex.Unlock();
 }
-#endif
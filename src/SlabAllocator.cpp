@@ -0,0 +1,435 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "SlabAllocator.h"
+#include "InternalPacket.h"
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include "RakNetDefines.h"
+#include "RakNetTypes.h"
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#if defined(_WIN32)
+#include "WindowsIncludes.h"
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace RakNet;
+
+// Chunk sizes are multiples of this, so every chunk is aligned as malloc would align it
+static const size_t CHUNK_ALIGNMENT = 16;
+// The reserved address space starts on a huge page boundary so whole huge pages can back it
+static const size_t HUGE_PAGE_SIZE  = 2 * 1024 * 1024;
+static const size_t SLAB_COUNT      = SLAB_ALLOCATOR_RESERVED_SIZE / SLAB_ALLOCATOR_SLAB_SIZE;
+// Roughly how many bytes of chunks move between a thread and the shared list at once
+static const size_t BATCH_BYTES     = 32768;
+
+struct FreeChunk {
+    FreeChunk* next;
+};
+
+// Only held while a batch is moved, so it spins rather than sleeps. Has no destructor, so memory can still be freed
+// through it from static destructors at exit
+class SlabSpinLock {
+public:
+    void Lock(void) {
+        while (flag.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+    }
+    void Unlock(void) { flag.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+// Shared state of a size class, guarded by lock
+struct SizeClass {
+    SlabSpinLock lock;
+    FreeChunk*   freeList;
+    // Rest of the slab chunks are being carved from
+    char*        carveNext;
+    char*        carveEnd;
+    size_t       slabs;
+    // Counts of threads that have exited
+    uint64_t     allocations;
+    uint64_t     frees;
+};
+
+enum ThreadCacheState { THREAD_CACHE_UNUSED, THREAD_CACHE_ACTIVE, THREAD_CACHE_DESTROYED };
+
+struct ThreadCache {
+    FreeChunk*            lists[SLAB_ALLOCATOR_CLASS_COUNT];
+    unsigned int          counts[SLAB_ALLOCATOR_CLASS_COUNT];
+    // Only written by the owning thread. Atomic so GetSlabAllocatorStatistics() can read them
+    std::atomic<uint64_t> allocations[SLAB_ALLOCATOR_CLASS_COUNT];
+    std::atomic<uint64_t> frees[SLAB_ALLOCATOR_CLASS_COUNT];
+    ThreadCache*          next;
+    ThreadCache*          prev;
+    ThreadCacheState      state;
+};
+
+// Gives a thread's cached chunks back to the shared lists when the thread exits
+struct ThreadCacheOwner {
+    ThreadCache* cache;
+    ~ThreadCacheOwner();
+};
+
+static SizeClass             sizeClasses[SLAB_ALLOCATOR_CLASS_COUNT];
+static size_t                classSizes[SLAB_ALLOCATOR_CLASS_COUNT];
+static unsigned int          batchSizes[SLAB_ALLOCATOR_CLASS_COUNT];
+static unsigned int          classCount;
+// Size class of each allocation size, in units of CHUNK_ALIGNMENT
+static unsigned char         sizeToClass[SLAB_ALLOCATOR_MAX_SIZE / CHUNK_ALIGNMENT + 1];
+// Size class of each slab handed out
+static unsigned char         slabClasses[SLAB_COUNT];
+static char*                 reservedBase;
+static std::atomic<size_t>   nextSlab;
+static std::atomic<uint64_t> mallocAllocations;
+static bool                  usingHugePages;
+static bool                  slabAllocatorEnabled;
+// Every thread that has allocated, so statistics can be summed
+static SlabSpinLock          threadCacheListLock;
+static ThreadCache*          threadCacheList;
+
+static thread_local ThreadCache      threadCache;
+static thread_local ThreadCacheOwner threadCacheOwner;
+
+static void AddSizeClass(size_t size) {
+    unsigned int index = 0;
+    while (index < classCount && classSizes[index] < size) index++;
+    if (index < classCount && classSizes[index] == size) return;
+    RakAssert(classCount < SLAB_ALLOCATOR_CLASS_COUNT);
+    memmove(classSizes + index + 1, classSizes + index, (classCount - index) * sizeof(size_t));
+    classSizes[index] = size;
+    classCount++;
+}
+
+static inline size_t RoundToChunkSize(size_t size) { return (size + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1); }
+
+static void InitializeSizeClasses(void) {
+    classCount = 0;
+    for (size_t size = CHUNK_ALIGNMENT; size < 64; size += CHUNK_ALIGNMENT) AddSizeClass(size);
+    for (size_t powerOfTwo = 64; powerOfTwo < SLAB_ALLOCATOR_MAX_SIZE; powerOfTwo *= 2) {
+        for (size_t step = 0; step < 4; step++) AddSizeClass(powerOfTwo + step * powerOfTwo / 4);
+    }
+    AddSizeClass(SLAB_ALLOCATOR_MAX_SIZE);
+    // The structures RakNet allocates most get a class of their own
+    AddSizeClass(RoundToChunkSize(sizeof(InternalPacket)));
+    AddSizeClass(RoundToChunkSize(sizeof(Packet)));
+
+    unsigned int sizeClass = 0;
+    for (size_t i = 0; i <= SLAB_ALLOCATOR_MAX_SIZE / CHUNK_ALIGNMENT; i++) {
+        while (classSizes[sizeClass] < i * CHUNK_ALIGNMENT) sizeClass++;
+        sizeToClass[i] = (unsigned char)sizeClass;
+    }
+    for (unsigned int i = 0; i < classCount; i++) {
+        size_t batchSize = BATCH_BYTES / classSizes[i];
+        if (batchSize < 2) batchSize = 2;
+        if (batchSize > 64) batchSize = 64;
+        batchSizes[i] = (unsigned int)batchSize;
+    }
+}
+
+static bool ReserveAddressSpace(bool useHugePages) {
+#if defined(_WIN32)
+    // Large pages on Windows need a privilege most processes do not have, so slabs are committed with normal pages
+    (void)useHugePages;
+    reservedBase   = (char*)VirtualAlloc(0, SLAB_ALLOCATOR_RESERVED_SIZE, MEM_RESERVE, PAGE_READWRITE);
+    usingHugePages = false;
+    return reservedBase != 0;
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    size_t mappedSize = SLAB_ALLOCATOR_RESERVED_SIZE + HUGE_PAGE_SIZE;
+    char*  mapped     = (char*)mmap(0, mappedSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapped == (char*)MAP_FAILED) return false;
+
+    // Trim to a huge page boundary at both ends
+    char*  base = (char*)(((uintptr_t)mapped + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    size_t head = (size_t)(base - mapped);
+    if (head) munmap(mapped, head);
+    if (mappedSize - head > SLAB_ALLOCATOR_RESERVED_SIZE)
+        munmap(base + SLAB_ALLOCATOR_RESERVED_SIZE, mappedSize - head - SLAB_ALLOCATOR_RESERVED_SIZE);
+    reservedBase = base;
+
+    usingHugePages = false;
+#ifdef MADV_HUGEPAGE
+    if (useHugePages) usingHugePages = madvise(reservedBase, SLAB_ALLOCATOR_RESERVED_SIZE, MADV_HUGEPAGE) == 0;
+#else
+    (void)useHugePages;
+#endif
+    return true;
+#endif
+}
+
+// Called with the size class locked. Returns false once the reserved address space is used up
+static bool NewSlab(unsigned int sizeClass) {
+    size_t slab = nextSlab.fetch_add(1, std::memory_order_relaxed);
+    if (slab >= SLAB_COUNT) return false;
+
+    char* slabStart = reservedBase + slab * SLAB_ALLOCATOR_SLAB_SIZE;
+#if defined(_WIN32)
+    if (VirtualAlloc(slabStart, SLAB_ALLOCATOR_SLAB_SIZE, MEM_COMMIT, PAGE_READWRITE) == 0) return false;
+#endif
+    slabClasses[slab]                = (unsigned char)sizeClass;
+    sizeClasses[sizeClass].carveNext = slabStart;
+    sizeClasses[sizeClass].carveEnd =
+        slabStart + SLAB_ALLOCATOR_SLAB_SIZE / classSizes[sizeClass] * classSizes[sizeClass];
+    sizeClasses[sizeClass].slabs++;
+    return true;
+}
+
+// Takes up to maxChunks from the shared list of sizeClass, carving new chunks if it is empty. Returns how many
+static unsigned int TakeChunks(unsigned int sizeClass, unsigned int maxChunks, FreeChunk** list) {
+    SizeClass&   shared = sizeClasses[sizeClass];
+    unsigned int taken  = 0;
+    FreeChunk*   head   = 0;
+    shared.lock.Lock();
+    while (taken < maxChunks && shared.freeList) {
+        FreeChunk* chunk = shared.freeList;
+        shared.freeList  = chunk->next;
+        chunk->next      = head;
+        head             = chunk;
+        taken++;
+    }
+    while (taken < maxChunks) {
+        if (shared.carveNext == shared.carveEnd && NewSlab(sizeClass) == false) break;
+        FreeChunk* chunk  = (FreeChunk*)shared.carveNext;
+        shared.carveNext += classSizes[sizeClass];
+        chunk->next       = head;
+        head              = chunk;
+        taken++;
+    }
+    shared.lock.Unlock();
+    *list = head;
+    return taken;
+}
+
+// Puts the chunks from head to tail on the shared list of sizeClass
+static void GiveChunks(unsigned int sizeClass, FreeChunk* head, FreeChunk* tail) {
+    SizeClass& shared = sizeClasses[sizeClass];
+    shared.lock.Lock();
+    tail->next      = shared.freeList;
+    shared.freeList = head;
+    shared.lock.Unlock();
+}
+
+static inline void Increment(std::atomic<uint64_t>& counter) {
+    // Only the owning thread writes, so this needs no locked instruction
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static void RegisterThreadCache(ThreadCache* cache) {
+    // Touching the owner registers its destructor for this thread
+    threadCacheOwner.cache = cache;
+    threadCacheListLock.Lock();
+    cache->prev = 0;
+    cache->next = threadCacheList;
+    if (threadCacheList) threadCacheList->prev = cache;
+    threadCacheList = cache;
+    threadCacheListLock.Unlock();
+    cache->state = THREAD_CACHE_ACTIVE;
+}
+
+ThreadCacheOwner::~ThreadCacheOwner() {
+    if (cache == 0) return;
+
+    threadCacheListLock.Lock();
+    for (unsigned int i = 0; i < classCount; i++) {
+        if (cache->lists[i]) {
+            FreeChunk* tail = cache->lists[i];
+            while (tail->next) tail = tail->next;
+            GiveChunks(i, cache->lists[i], tail);
+            cache->lists[i]  = 0;
+            cache->counts[i] = 0;
+        }
+        sizeClasses[i].lock.Lock();
+        sizeClasses[i].allocations += cache->allocations[i].load(std::memory_order_relaxed);
+        sizeClasses[i].frees       += cache->frees[i].load(std::memory_order_relaxed);
+        sizeClasses[i].lock.Unlock();
+    }
+    if (cache->prev) cache->prev->next = cache->next;
+    else threadCacheList = cache->next;
+    if (cache->next) cache->next->prev = cache->prev;
+    threadCacheListLock.Unlock();
+
+    // Anything this thread frees from now on, such as from other thread_local destructors, goes to the shared lists
+    cache->state = THREAD_CACHE_DESTROYED;
+}
+
+static inline bool IsSlabChunk(const void* p) {
+    return (uintptr_t)p - (uintptr_t)reservedBase < SLAB_ALLOCATOR_RESERVED_SIZE;
+}
+
+static void* MallocFallback(size_t size) {
+    mallocAllocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size);
+}
+
+// Allocation and free for threads whose cache is already destroyed
+static void* AllocateShared(unsigned int sizeClass) {
+    FreeChunk* chunk;
+    if (TakeChunks(sizeClass, 1, &chunk) == 0) return 0;
+    sizeClasses[sizeClass].lock.Lock();
+    sizeClasses[sizeClass].allocations++;
+    sizeClasses[sizeClass].lock.Unlock();
+    return chunk;
+}
+
+static void FreeShared(unsigned int sizeClass, FreeChunk* chunk) {
+    GiveChunks(sizeClass, chunk, chunk);
+    sizeClasses[sizeClass].lock.Lock();
+    sizeClasses[sizeClass].frees++;
+    sizeClasses[sizeClass].lock.Unlock();
+}
+
+void* RakNet::_SlabMalloc(size_t size) {
+    if (size > SLAB_ALLOCATOR_MAX_SIZE) return MallocFallback(size);
+
+    unsigned int sizeClass = sizeToClass[(size + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT];
+    ThreadCache* cache     = &threadCache;
+    if (cache->state != THREAD_CACHE_ACTIVE) {
+        if (cache->state == THREAD_CACHE_DESTROYED) {
+            void* p = AllocateShared(sizeClass);
+            return p ? p : MallocFallback(size);
+        }
+        RegisterThreadCache(cache);
+    }
+
+    FreeChunk* chunk = cache->lists[sizeClass];
+    if (chunk == 0) {
+        cache->counts[sizeClass] = TakeChunks(sizeClass, batchSizes[sizeClass], &cache->lists[sizeClass]);
+        chunk                    = cache->lists[sizeClass];
+        if (chunk == 0) return MallocFallback(size);
+    }
+    cache->lists[sizeClass] = chunk->next;
+    cache->counts[sizeClass]--;
+    Increment(cache->allocations[sizeClass]);
+    return chunk;
+}
+
+void RakNet::_SlabFree(void* p) {
+    if (p == 0) return;
+    if (IsSlabChunk(p) == false) {
+        free(p);
+        return;
+    }
+
+    unsigned int sizeClass = slabClasses[((char*)p - reservedBase) / SLAB_ALLOCATOR_SLAB_SIZE];
+    FreeChunk*   chunk     = (FreeChunk*)p;
+    ThreadCache* cache     = &threadCache;
+    if (cache->state != THREAD_CACHE_ACTIVE) {
+        if (cache->state == THREAD_CACHE_DESTROYED) {
+            FreeShared(sizeClass, chunk);
+            return;
+        }
+        RegisterThreadCache(cache);
+    }
+
+    // Chunks allocated on other threads land here too, and go back to the shared list with the next batch
+    chunk->next             = cache->lists[sizeClass];
+    cache->lists[sizeClass] = chunk;
+    Increment(cache->frees[sizeClass]);
+    if (++cache->counts[sizeClass] >= 2 * batchSizes[sizeClass]) {
+        FreeChunk* head = cache->lists[sizeClass];
+        FreeChunk* tail = head;
+        for (unsigned int i = 1; i < batchSizes[sizeClass]; i++) tail = tail->next;
+        cache->lists[sizeClass]   = tail->next;
+        cache->counts[sizeClass] -= batchSizes[sizeClass];
+        GiveChunks(sizeClass, head, tail);
+    }
+}
+
+void* RakNet::_SlabRealloc(void* p, size_t size) {
+    if (p == 0) return _SlabMalloc(size);
+    // Memory from malloc stays there, as its size is not known
+    if (IsSlabChunk(p) == false) return realloc(p, size);
+
+    size_t chunkSize = classSizes[slabClasses[((char*)p - reservedBase) / SLAB_ALLOCATOR_SLAB_SIZE]];
+    if (size <= chunkSize) return p;
+    void* newChunk = _SlabMalloc(size);
+    if (newChunk == 0) return 0;
+    memcpy(newChunk, p, chunkSize);
+    _SlabFree(p);
+    return newChunk;
+}
+
+void* RakNet::_SlabMalloc_Ex(size_t size, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+
+    return _SlabMalloc(size);
+}
+
+void* RakNet::_SlabRealloc_Ex(void* p, size_t size, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+
+    return _SlabRealloc(p, size);
+}
+
+void RakNet::_SlabFree_Ex(void* p, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+
+    _SlabFree(p);
+}
+
+bool RakNet::UseSlabAllocator(bool useHugePages) {
+    if (slabAllocatorEnabled) return true;
+
+    InitializeSizeClasses();
+    if (ReserveAddressSpace(useHugePages) == false) return false;
+
+    SetMalloc(_SlabMalloc);
+    SetRealloc(_SlabRealloc);
+    SetFree(_SlabFree);
+    SetMalloc_Ex(_SlabMalloc_Ex);
+    SetRealloc_Ex(_SlabRealloc_Ex);
+    SetFree_Ex(_SlabFree_Ex);
+    slabAllocatorEnabled = true;
+    return true;
+}
+
+bool RakNet::IsSlabAllocatorEnabled(void) { return slabAllocatorEnabled; }
+
+void RakNet::GetSlabAllocatorStatistics(SlabAllocatorStatistics* statistics) {
+    memset(statistics, 0, sizeof(SlabAllocatorStatistics));
+    statistics->mallocAllocations = mallocAllocations.load(std::memory_order_relaxed);
+    statistics->reservedBytes     = slabAllocatorEnabled ? SLAB_ALLOCATOR_RESERVED_SIZE : 0;
+    statistics->hugePages         = usingHugePages;
+    if (slabAllocatorEnabled == false) return;
+
+    size_t slabs          = nextSlab.load(std::memory_order_relaxed);
+    statistics->slabBytes = (slabs < SLAB_COUNT ? slabs : SLAB_COUNT) * SLAB_ALLOCATOR_SLAB_SIZE;
+
+    // Same lock order as a thread exiting, so its counts are seen exactly once
+    threadCacheListLock.Lock();
+    for (unsigned int i = 0; i < classCount; i++) {
+        SlabAllocatorClassStatistics& classStatistics = statistics->classes[i];
+        sizeClasses[i].lock.Lock();
+        classStatistics.chunkSize   = classSizes[i];
+        classStatistics.allocations = sizeClasses[i].allocations;
+        classStatistics.frees       = sizeClasses[i].frees;
+        classStatistics.slabs       = sizeClasses[i].slabs;
+        sizeClasses[i].lock.Unlock();
+        for (ThreadCache* cache = threadCacheList; cache; cache = cache->next) {
+            classStatistics.allocations += cache->allocations[i].load(std::memory_order_relaxed);
+            classStatistics.frees       += cache->frees[i].load(std::memory_order_relaxed);
+        }
+    }
+    threadCacheListLock.Unlock();
+}
@@ -664,6 +664,14 @@ void StatisticsHistoryPlugin::Update(void) {
                 false
             );
 
+            statistics.AddValueByIndex(
+                objectIndex,
+                "RN_ACK_ONLY_DATAGRAMS_SENT",
+                (SHValueType)stats[idx].valueOverLastSecond[ACK_ONLY_DATAGRAMS_SENT],
+                curTime,
+                false
+            );
+
             statistics.AddValueByIndex(
                 objectIndex,
                 "RN_USER_MESSAGE_BYTES_PUSHED",
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "UpdateProfile.h"
+#include "RakMemoryOverride.h"
+
+using namespace RakNet;
+
+static const uint64_t UPDATE_PROFILE_WINDOW_NS = (uint64_t)UPDATE_PROFILE_WINDOW_MS * 1000000;
+
+RollingLatencyHistogram::RollingLatencyHistogram() { windowStart = 0; }
+void RollingLatencyHistogram::Reset(uint64_t nowNs) {
+    current.Reset();
+    previous.Reset();
+    windowStart = nowNs;
+}
+void RollingLatencyHistogram::Read(LatencyHistogram* histogram, uint64_t nowNs) const {
+    histogram->Reset();
+    uint64_t age = nowNs - windowStart;
+    if (age >= 2 * UPDATE_PROFILE_WINDOW_NS) return;
+
+    // Once the current window is over, the previous one would have been forgotten by the next Record()
+    if (age < UPDATE_PROFILE_WINDOW_NS) histogram->Merge(previous);
+    histogram->Merge(current);
+}
+void RollingLatencyHistogram::Roll(uint64_t nowNs) {
+    if (nowNs - windowStart >= 2 * UPDATE_PROFILE_WINDOW_NS) previous.Reset();
+    else previous = current;
+    current.Reset();
+    // Windows stay aligned to the first one, so every window is the same length
+    windowStart = nowNs - (nowNs - windowStart) % UPDATE_PROFILE_WINDOW_NS;
+}
+
+UpdateProfiler::UpdateProfiler() {
+    uint64_t nowNs = GetTimeNS();
+    for (unsigned int i = 0; i < UPDATE_PHASE_COUNT; i++) phases[i].Reset(nowNs);
+    for (unsigned int i = 0; i < 256; i++) messages[i] = 0;
+}
+UpdateProfiler::~UpdateProfiler() {
+    for (unsigned int i = 0; i < 256; i++) {
+        if (messages[i]) RakNet::OP_DELETE(messages[i], _FILE_AND_LINE_);
+    }
+    for (unsigned int i = 0; i < plugins.Size(); i++) RakNet::OP_DELETE(plugins[i], _FILE_AND_LINE_);
+}
+void UpdateProfiler::Reset(void) {
+    uint64_t nowNs = GetTimeNS();
+    for (unsigned int i = 0; i < UPDATE_PHASE_COUNT; i++) {
+        phaseMutexes[i].Lock();
+        phases[i].Reset(nowNs);
+        phaseMutexes[i].Unlock();
+    }
+
+    receiveMutex.Lock();
+    for (unsigned int i = 0; i < 256; i++) {
+        if (messages[i]) messages[i]->Reset(nowNs);
+    }
+    for (unsigned int i = 0; i < plugins.Size(); i++) {
+        for (unsigned int j = 0; j < UPDATE_PLUGIN_CALL_COUNT; j++) plugins[i]->calls[j].Reset(nowNs);
+    }
+    receiveMutex.Unlock();
+}
+void UpdateProfiler::RecordPlugin(
+    PluginInterface2*       plugin,
+    UpdateProfilePluginCall call,
+    uint64_t                startNs,
+    uint64_t                endNs
+) {
+    receiveMutex.Lock();
+    unsigned int index = FindPlugin(plugin);
+    if (index == plugins.Size()) {
+        PluginProfile* profile = RakNet::OP_NEW<PluginProfile>(_FILE_AND_LINE_);
+        profile->plugin        = plugin;
+        for (unsigned int j = 0; j < UPDATE_PLUGIN_CALL_COUNT; j++) profile->calls[j].Reset(startNs);
+        plugins.Insert(profile, _FILE_AND_LINE_);
+    }
+    plugins[index]->calls[call].Record(endNs - startNs, endNs);
+    receiveMutex.Unlock();
+}
+void UpdateProfiler::RecordMessage(unsigned char messageId, uint64_t startNs, uint64_t endNs) {
+    receiveMutex.Lock();
+    if (messages[messageId] == 0) {
+        RollingLatencyHistogram* histogram = RakNet::OP_NEW<RollingLatencyHistogram>(_FILE_AND_LINE_);
+        histogram->Reset(startNs);
+        messages[messageId] = histogram;
+    }
+    messages[messageId]->Record(endNs - startNs, endNs);
+    receiveMutex.Unlock();
+}
+void UpdateProfiler::RemovePlugin(PluginInterface2* plugin) {
+    receiveMutex.Lock();
+    unsigned int index = FindPlugin(plugin);
+    if (index < plugins.Size()) {
+        RakNet::OP_DELETE(plugins[index], _FILE_AND_LINE_);
+        plugins.RemoveAtIndexFast(index);
+    }
+    receiveMutex.Unlock();
+}
+void UpdateProfiler::ReadPhase(UpdateProfilePhase phase, LatencyHistogram* histogram) const {
+    phaseMutexes[phase].Lock();
+    phases[phase].Read(histogram, GetTimeNS());
+    phaseMutexes[phase].Unlock();
+}
+bool UpdateProfiler::ReadPlugin(
+    PluginInterface2*       plugin,
+    UpdateProfilePluginCall call,
+    LatencyHistogram*       histogram
+) const {
+    receiveMutex.Lock();
+    unsigned int index = FindPlugin(plugin);
+    bool         found = index < plugins.Size();
+    if (found) plugins[index]->calls[call].Read(histogram, GetTimeNS());
+    receiveMutex.Unlock();
+    return found;
+}
+void UpdateProfiler::ReadMessage(unsigned char messageId, LatencyHistogram* histogram) const {
+    receiveMutex.Lock();
+    if (messages[messageId]) messages[messageId]->Read(histogram, GetTimeNS());
+    else histogram->Reset();
+    receiveMutex.Unlock();
+}
+unsigned int UpdateProfiler::FindPlugin(PluginInterface2* plugin) const {
+    // Few plugins are attached, so a search is as fast as a lookup
+    unsigned int i;
+    for (i = 0; i < plugins.Size(); i++) {
+        if (plugins[i]->plugin == plugin) break;
+    }
+    return i;
+}
@@ -0,0 +1,256 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "VirtualNetwork.h"
+#include "GetTime.h"
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace RakNet;
+
+// Bytes of IP and UDP header counted with each datagram, as by the congestion control
+static const int VIRTUAL_NETWORK_UDP_HEADER_SIZE = 28;
+
+// Auto assigned addresses are 10.0.0.1 and up
+static const uint32_t       VIRTUAL_NETWORK_FIRST_HOST_ADDRESS = 0x0A000001;
+static const unsigned short VIRTUAL_NETWORK_FIRST_PORT         = 49152;
+
+VirtualNetwork* VirtualNetwork::clockNetwork = 0;
+
+VirtualLinkSettings::VirtualLinkSettings() {
+    bitsPerSecond     = 0;
+    maximumQueueDelay = 0;
+    latency           = 0;
+    jitter            = 0;
+    lossRate          = 0.0f;
+    reorderRate       = 0.0f;
+    reorderDelay      = 0;
+    mtu               = MAXIMUM_MTU_SIZE;
+}
+
+RNS2_Virtual::RNS2_Virtual() {
+    network         = 0;
+    hasLinkSettings = false;
+    linkFreeTime    = 0;
+    lastArrivalTime = 0;
+}
+
+RNS2_Virtual::~RNS2_Virtual() {
+    if (network) network->Unbind(this);
+}
+
+RNS2BindResult RNS2_Virtual::Bind(
+    VirtualNetwork*   _network,
+    const char*       hostAddress,
+    unsigned short    port,
+    RNS2EventHandler* _eventHandler
+) {
+    RakAssert(network == 0);
+    SetSocketType(RNS2T_VIRTUAL);
+    SetRecvEventHandler(_eventHandler);
+    if (_network->Bind(this, hostAddress, port) == false) return BR_FAILED_TO_BIND_SOCKET;
+    network = _network;
+    return BR_SUCCESS;
+}
+
+RNS2SendResult RNS2_Virtual::Send(RNS2_SendParameters* sendParameters, const char* file, unsigned int line) {
+    (void)file;
+    (void)line;
+    if (network == 0) return -1;
+    return network->Send(this, sendParameters);
+}
+
+VirtualNetwork* RNS2_Virtual::GetNetwork(void) const { return network; }
+
+VirtualNetwork::VirtualNetwork(unsigned int seed) {
+    currentTime     = 1000000;
+    nextSequence    = 0;
+    nextHostAddress = VIRTUAL_NETWORK_FIRST_HOST_ADDRESS;
+    nextPort        = VIRTUAL_NETWORK_FIRST_PORT;
+    memset(&statistics, 0, sizeof(statistics));
+    random.SeedMT(seed);
+}
+
+VirtualNetwork::~VirtualNetwork() {
+    if (clockNetwork == this) UseAsClock(false);
+
+    // Sockets still bound outlive the network, so they must not call back into it
+    DataStructures::List<RNS2_Virtual*> boundSockets;
+    DataStructures::List<SystemAddress> boundAddresses;
+    sockets.GetAsList(boundSockets, boundAddresses, _FILE_AND_LINE_);
+    for (unsigned int i = 0; i < boundSockets.Size(); i++) boundSockets[i]->network = 0;
+    sockets.Clear(_FILE_AND_LINE_);
+
+    while (inFlight.Size()) datagramPool.Release(inFlight.Pop(0), _FILE_AND_LINE_);
+    datagramPool.Clear(_FILE_AND_LINE_);
+}
+
+void VirtualNetwork::SetDefaultLinkSettings(const VirtualLinkSettings& settings) { defaultLinkSettings = settings; }
+
+const VirtualLinkSettings& VirtualNetwork::GetDefaultLinkSettings(void) const { return defaultLinkSettings; }
+
+bool VirtualNetwork::SetLinkSettings(const SystemAddress& systemAddress, const VirtualLinkSettings& settings) {
+    RNS2_Virtual** socket = sockets.Peek(systemAddress);
+    if (socket == 0) return false;
+    (*socket)->linkSettings    = settings;
+    (*socket)->hasLinkSettings = true;
+    return true;
+}
+
+void VirtualNetwork::UseAsClock(bool enabled) {
+    if (enabled) {
+        RakAssert(clockNetwork == 0 || clockNetwork == this);
+        clockNetwork = this;
+        SetTimeSourceUS(ReadClock);
+    } else if (clockNetwork == this) {
+        clockNetwork = 0;
+        SetTimeSourceUS(0);
+    }
+}
+
+RakNet::TimeUS VirtualNetwork::ReadClock(void) { return clockNetwork->currentTime; }
+
+RakNet::TimeUS VirtualNetwork::GetTime(void) const { return currentTime; }
+
+void VirtualNetwork::AdvanceTime(RakNet::TimeUS elapsed) {
+    RakNet::TimeUS endTime = currentTime + elapsed;
+    while (inFlight.Size() && inFlight.PeekWeight(0).time <= endTime) {
+        Datagram* datagram = inFlight.Pop(0);
+        currentTime        = datagram->arrivalTime;
+        Deliver(datagram);
+        datagramPool.Release(datagram, _FILE_AND_LINE_);
+    }
+    currentTime = endTime;
+}
+
+RakNet::TimeUS VirtualNetwork::GetNextArrivalTime(void) const {
+    if (inFlight.Size() == 0) return 0;
+    return inFlight.PeekWeight(0).time;
+}
+
+unsigned int VirtualNetwork::GetDatagramsInFlight(void) const { return inFlight.Size(); }
+
+const VirtualNetworkStatistics& VirtualNetwork::GetStatistics(void) const { return statistics; }
+
+bool VirtualNetwork::Bind(RNS2_Virtual* socket, const char* hostAddress, unsigned short port) {
+    SystemAddress address;
+    char          autoAddress[16];
+    if (hostAddress == 0 || hostAddress[0] == 0) {
+        sprintf(
+            autoAddress,
+            "%u.%u.%u.%u",
+            (nextHostAddress >> 24) & 0xFF,
+            (nextHostAddress >> 16) & 0xFF,
+            (nextHostAddress >> 8) & 0xFF,
+            nextHostAddress & 0xFF
+        );
+        nextHostAddress++;
+        hostAddress = autoAddress;
+    }
+    if (address.FromString(hostAddress, 0, 4) == false) return false;
+
+    if (port) address.SetPortHostOrder(port);
+    else {
+        // Try every port in the range once, starting after the last one handed out
+        unsigned int portsTried = 0;
+        do {
+            address.SetPortHostOrder(nextPort);
+            nextPort = nextPort == 65535 ? VIRTUAL_NETWORK_FIRST_PORT : nextPort + 1;
+            portsTried++;
+        } while (sockets.HasData(address) && portsTried < 65536u - VIRTUAL_NETWORK_FIRST_PORT);
+    }
+    if (sockets.HasData(address)) return false;
+
+    socket->boundAddress = address;
+    sockets.Push(address, socket, _FILE_AND_LINE_);
+    return true;
+}
+
+void VirtualNetwork::Unbind(RNS2_Virtual* socket) {
+    // Datagrams already in flight to it are counted as unreachable when they arrive
+    sockets.Remove(socket->GetBoundAddress(), _FILE_AND_LINE_);
+    socket->network = 0;
+}
+
+RNS2SendResult VirtualNetwork::Send(RNS2_Virtual* socket, RNS2_SendParameters* sendParameters) {
+    const VirtualLinkSettings& settings   = socket->hasLinkSettings ? socket->linkSettings : defaultLinkSettings;
+    int                        wireLength = sendParameters->length + VIRTUAL_NETWORK_UDP_HEADER_SIZE;
+
+    statistics.datagramsSent++;
+    // Datagrams carry at most MAXIMUM_MTU_SIZE bytes whatever the link MTU is set to
+    if (wireLength > settings.mtu || sendParameters->length < 0 || sendParameters->length > MAXIMUM_MTU_SIZE) {
+        statistics.datagramsMTUDropped++;
+        return sendParameters->length;
+    }
+
+    // When the link finishes sending it
+    RakNet::TimeUS departureTime = socket->linkFreeTime > currentTime ? socket->linkFreeTime : currentTime;
+    if (settings.maximumQueueDelay && departureTime - currentTime > settings.maximumQueueDelay) {
+        statistics.datagramsQueueDropped++;
+        return sendParameters->length;
+    }
+    if (settings.bitsPerSecond) departureTime += (RakNet::TimeUS)wireLength * 8 * 1000000 / settings.bitsPerSecond;
+    socket->linkFreeTime = departureTime;
+
+    // Lost datagrams still took their time on the link
+    if (settings.lossRate > 0.0f && random.FrandomMT() < settings.lossRate) {
+        statistics.datagramsLost++;
+        return sendParameters->length;
+    }
+
+    RakNet::TimeUS arrivalTime = departureTime + settings.latency;
+    if (settings.jitter) arrivalTime += random.RandomMT() % (settings.jitter + 1);
+    if (arrivalTime < socket->lastArrivalTime) arrivalTime = socket->lastArrivalTime;
+    socket->lastArrivalTime = arrivalTime;
+    if (settings.reorderRate > 0.0f && random.FrandomMT() < settings.reorderRate) arrivalTime += settings.reorderDelay;
+
+    Datagram* datagram = datagramPool.Allocate(_FILE_AND_LINE_);
+    memcpy(datagram->data, sendParameters->data, sendParameters->length);
+    datagram->length      = sendParameters->length;
+    datagram->sender      = socket->GetBoundAddress();
+    datagram->receiver    = sendParameters->systemAddress;
+    datagram->arrivalTime = arrivalTime;
+
+    ArrivalKey key;
+    key.time     = arrivalTime;
+    key.sequence = nextSequence++;
+    inFlight.Push(key, datagram, _FILE_AND_LINE_);
+    return sendParameters->length;
+}
+
+void VirtualNetwork::Deliver(Datagram* datagram) {
+    RNS2_Virtual** socket = sockets.Peek(datagram->receiver);
+    if (socket == 0 || (*socket)->GetEventHandler() == 0) {
+        statistics.datagramsUnreachable++;
+        return;
+    }
+
+    RNS2EventHandler* eventHandler = (*socket)->GetEventHandler();
+    RNS2RecvStruct*   recvStruct   = eventHandler->AllocRNS2RecvStruct(_FILE_AND_LINE_);
+    if (recvStruct == 0) return;
+    memcpy(recvStruct->data, datagram->data, datagram->length);
+    recvStruct->bytesRead     = datagram->length;
+    recvStruct->systemAddress = datagram->sender;
+    recvStruct->timeRead      = currentTime;
+    recvStruct->socket        = *socket;
+    statistics.datagramsDelivered++;
+    statistics.bytesDelivered += datagram->length;
+    eventHandler->OnRNS2Recv(recvStruct);
+}
+
+uint64_t VirtualNetwork::GenerateGUID(void) {
+    uint64_t guid;
+    do {
+        guid = ((uint64_t)random.RandomMT() << 32) | random.RandomMT();
+    } while (guid == 0 || guid == (uint64_t)-1);
+    return guid;
+}
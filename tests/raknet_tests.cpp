@@ -0,0 +1,685 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Regression tests for races and malformed input that the samples do not exercise. Build with
+/// xmake build raknet_tests
+///
+/// Usage:
+///   raknet_tests [test]
+///     Runs every test, or only the one named \a test. Prints one line per test and exits with the number of tests
+///     that failed. Run under a sanitizer to catch the races some of the tests exist for.
+///
+
+#include "DatagramCipher.h"
+#include "GetTime.h"
+#include "MessageIdentifiers.h"
+#include "PluginInterface2.h"
+#include "RakPeer.h"
+#include "RakNetStatistics.h"
+#include "RakPeerInterface.h"
+#include "RakSleep.h"
+#include "ReliabilityLayer.h"
+#include "ThreadPool.h"
+#include "UpdateProfile.h"
+#include "VirtualNetwork.h"
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace RakNet;
+
+typedef bool (*TestFunction)(void);
+
+struct Test {
+    const char*  name;
+    TestFunction function;
+};
+
+// Drains \a peer, counting the connections accepted or made and the ones lost
+static void ReceiveAll(RakPeerInterface* peer, int* connected, int* disconnected) {
+    for (Packet* p = peer->Receive(); p; peer->DeallocatePacket(p), p = peer->Receive()) {
+        switch (p->data[0]) {
+        case ID_NEW_INCOMING_CONNECTION:
+        case ID_CONNECTION_REQUEST_ACCEPTED:
+            if (connected) (*connected)++;
+            break;
+        case ID_DISCONNECTION_NOTIFICATION:
+        case ID_CONNECTION_LOST:
+            if (disconnected) (*disconnected)++;
+            break;
+        }
+    }
+}
+
+// Clients connect and disconnect over and over while another thread reads the server's connections through every
+// API that looks up remote systems from the user thread. Slots must stay valid for as long as the peer is started.
+static bool TestConnectionStateDuringChurn(void) {
+    const unsigned int clientCount = 40;
+    const int          rounds      = 5;
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    SocketDescriptor  serverDescriptor(0, "127.0.0.1");
+    if (server->Startup(64, &serverDescriptor, 1) != RAKNET_STARTED) {
+        RakPeerInterface::DestroyInstance(server);
+        return false;
+    }
+    server->SetMaximumIncomingConnections(64);
+    unsigned short serverPort = server->GetMyBoundAddress().GetPort();
+
+    std::vector<RakPeerInterface*> clients(clientCount);
+    std::vector<SystemAddress>     clientAddresses(clientCount);
+    std::vector<RakNetGUID>        clientGuids(clientCount);
+    bool                           started = true;
+    for (unsigned int i = 0; i < clientCount; i++) {
+        clients[i] = RakPeerInterface::GetInstance();
+        SocketDescriptor clientDescriptor(0, "127.0.0.1");
+        started            = clients[i]->Startup(1, &clientDescriptor, 1) == RAKNET_STARTED && started;
+        clientAddresses[i] = clients[i]->GetMyBoundAddress();
+        clientGuids[i]     = clients[i]->GetMyGUID();
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<int>  reads(0);
+    std::atomic<int>  mismatchedSnapshots(0);
+    std::thread       reader([&]() {
+        DataStructures::List<SystemAddress> addresses;
+        DataStructures::List<RakNetGUID>    guids;
+        SystemAddress                       snapshotAddresses[64];
+        RakNetGUID                          snapshotGuids[64];
+        RakNetStatistics                    snapshots[64];
+        RakNetStatistics                    statistics;
+        LatencyHistogram                    histogram;
+        while (stop.load() == false) {
+            for (unsigned int i = 0; i < clientCount; i++) {
+                server->GetConnectionState(clientAddresses[i]);
+                server->GetStatistics(clientAddresses[i], &statistics);
+                server->GetLatencyHistogram(clientAddresses[i], LATENCY_ACK_RTT, &histogram);
+            }
+            server->GetSystemList(addresses, guids);
+            for (unsigned int i = 0; i < guids.Size(); i++) server->GetSystemAddressFromGuid(guids[i]);
+            // The address and guid of each snapshot must belong to the same client
+            unsigned int snapshotCount = server->GetStatisticsSnapshots(snapshotAddresses, snapshotGuids, snapshots, 64);
+            for (unsigned int i = 0; i < snapshotCount; i++) {
+                unsigned int client = 0;
+                while (client < clientCount && clientAddresses[client] != snapshotAddresses[i]) client++;
+                if (client == clientCount || clientGuids[client] != snapshotGuids[i]) mismatchedSnapshots++;
+            }
+            server->GetLatencyHistogram(UNASSIGNED_SYSTEM_ADDRESS, LATENCY_ACK_RTT, &histogram);
+            server->NumberOfConnections();
+            reads++;
+        }
+    });
+
+    int connected = 0;
+    for (int round = 0; round < rounds && started; round++) {
+        int accepted = 0;
+        for (unsigned int i = 0; i < clientCount; i++) clients[i]->Connect("127.0.0.1", serverPort, 0, 0);
+        RakNet::TimeMS timeout = RakNet::GetTimeMS() + 5000;
+        while (accepted < (int)clientCount && RakNet::GetTimeMS() < timeout) {
+            ReceiveAll(server, &accepted, 0);
+            for (unsigned int i = 0; i < clientCount; i++) ReceiveAll(clients[i], 0, 0);
+            RakSleep(1);
+        }
+        connected += accepted;
+
+        // Clients can only connect again once they have finished disconnecting as well
+        for (unsigned int i = 0; i < clientCount; i++) clients[i]->CloseConnection(server->GetMyGUID(), true);
+        unsigned int disconnecting = clientCount;
+        timeout                    = RakNet::GetTimeMS() + 5000;
+        while (disconnecting > 0 && RakNet::GetTimeMS() < timeout) {
+            ReceiveAll(server, 0, 0);
+            disconnecting = server->NumberOfConnections();
+            for (unsigned int i = 0; i < clientCount; i++) {
+                ReceiveAll(clients[i], 0, 0);
+                if (clients[i]->GetConnectionState(server->GetMyGUID()) != IS_NOT_CONNECTED) disconnecting++;
+            }
+            RakSleep(1);
+        }
+    }
+
+    stop = true;
+    reader.join();
+    for (unsigned int i = 0; i < clientCount; i++) RakPeerInterface::DestroyInstance(clients[i]);
+    RakPeerInterface::DestroyInstance(server);
+    return started && connected == (int)clientCount * rounds && reads.load() > 0 && mismatchedSnapshots.load() == 0;
+}
+
+// Counts what the reliability layer rejects
+class NotificationCounter : public PluginInterface2 {
+public:
+    NotificationCounter() { errors = 0; }
+    virtual bool UsesReliabilityLayer(void) const { return true; }
+    virtual void OnReliabilityLayerNotification(
+        const char*     errorMessage,
+        const BitSize_t bitsUsed,
+        SystemAddress   remoteSystemAddress,
+        bool            isError
+    ) {
+        (void)errorMessage;
+        (void)bitsUsed;
+        (void)remoteSystemAddress;
+        if (isError) errors++;
+    }
+
+    int errors;
+};
+
+// Appends an ack datagram with no ack ranges that says a whole datagram follows it
+static void WriteEmptyPiggybackAck(std::vector<unsigned char>& datagram) {
+    // isValid, isACK, no B and AS, usesAckFrequency, hasPiggybackedDatagram
+    datagram.push_back(0xD8);
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+    for (int i = 0; i < 4; i++) datagram.push_back(0);
+#endif
+    // No ranges
+    datagram.push_back(0);
+    datagram.push_back(0);
+}
+
+// A remote system nests piggybacked acks inside each other. Only one level is allowed, so the datagram must be rejected
+// before the reliability layer recurses into the second.
+static bool TestNestedPiggybackRejected(void) {
+    std::vector<unsigned char> datagram;
+    for (int i = 0; i < 100000; i++) WriteEmptyPiggybackAck(datagram);
+
+    ReliabilityLayer reliabilityLayer;
+    reliabilityLayer.Reset(true, MAXIMUM_MTU_SIZE, false);
+    NotificationCounter                     counter;
+    DataStructures::List<PluginInterface2*> messageHandlerList;
+    messageHandlerList.Push(&counter, _FILE_AND_LINE_);
+    SystemAddress     systemAddress("127.0.0.1", 1234);
+    RakNetRandom      rnr;
+    RakNet::BitStream updateBitStream;
+    bool              accepted = reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(
+        (const char*)&datagram[0],
+        (unsigned int)datagram.size(),
+        systemAddress,
+        messageHandlerList,
+        MAXIMUM_MTU_SIZE,
+        0,
+        &rnr,
+        RakNet::GetTimeUS(),
+        updateBitStream
+    );
+    return accepted == false && counter.errors == 1;
+}
+
+// Starts a server and a client on \a network, which becomes the clock. Stop them with StopVirtualPeers()
+static bool StartVirtualPeers(VirtualNetwork& network, RakPeerInterface** server, RakPeerInterface** client) {
+    network.UseAsClock(true);
+    *server = RakPeerInterface::GetInstance();
+    *client = RakPeerInterface::GetInstance();
+    SocketDescriptor serverDescriptor;
+    SocketDescriptor clientDescriptor;
+    serverDescriptor.virtualNetwork = &network;
+    clientDescriptor.virtualNetwork = &network;
+    bool serverStarted              = (*server)->Startup(1, &serverDescriptor, 1) == RAKNET_STARTED;
+    bool clientStarted              = (*client)->Startup(1, &clientDescriptor, 1) == RAKNET_STARTED;
+    (*server)->SetMaximumIncomingConnections(1);
+    return serverStarted && clientStarted;
+}
+
+static void StopVirtualPeers(VirtualNetwork& network, RakPeerInterface* server, RakPeerInterface* client) {
+    client->Shutdown(0);
+    server->Shutdown(0);
+    RakPeerInterface::DestroyInstance(client);
+    RakPeerInterface::DestroyInstance(server);
+    network.UseAsClock(false);
+}
+
+// Advances the clock by a millisecond and runs one update cycle of each peer. Messages are left for the caller
+static void StepVirtualPeers(VirtualNetwork& network, RakPeerInterface* server, RakPeerInterface* client) {
+    RakNet::BitStream updateBitStream;
+    network.AdvanceTime(1000);
+    server->RunUpdateCycle(updateBitStream);
+    client->RunUpdateCycle(updateBitStream);
+}
+
+// Connects the client to the server, waiting up to 5 seconds of virtual time
+static bool ConnectVirtualPeers(VirtualNetwork& network, RakPeerInterface* server, RakPeerInterface* client) {
+    char          serverHost[64];
+    SystemAddress serverAddress = server->GetMyBoundAddress();
+    serverAddress.ToString(false, serverHost);
+    if (client->Connect(serverHost, serverAddress.GetPort(), 0, 0) != CONNECTION_ATTEMPT_STARTED) return false;
+    int            accepted = 0;
+    int            incoming = 0;
+    RakNet::TimeUS timeout  = network.GetTime() + 5000000;
+    while ((accepted == 0 || incoming == 0) && network.GetTime() < timeout) {
+        StepVirtualPeers(network, server, client);
+        ReceiveAll(server, &incoming, 0);
+        ReceiveAll(client, &accepted, 0);
+    }
+    return accepted == 1 && incoming == 1;
+}
+
+// Counts the messages starting with ID_USER_PACKET_ENUM, indexed by their second byte
+static void ReceiveUserMessages(RakPeerInterface* peer, int* counts, int countsSize) {
+    for (Packet* p = peer->Receive(); p; peer->DeallocatePacket(p), p = peer->Receive()) {
+        if (p->length >= 2 && p->data[0] == ID_USER_PACKET_ENUM && p->data[1] < countsSize) counts[p->data[1]]++;
+    }
+}
+
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+static int datagramsToTamper;
+
+// Flips a bit of the authentication tag at the end of the next datagramsToTamper datagrams
+static bool TamperWithTag(RNS2RecvStruct* recvStruct) {
+    if (datagramsToTamper > 0 && recvStruct->bytesRead > DatagramCipher::OVERHEAD_BYTES) {
+        recvStruct->data[recvStruct->bytesRead - 1] ^= 1;
+        datagramsToTamper--;
+    }
+    return true;
+}
+
+// Both systems require datagram encryption, so they must agree on a suite and exchange messages both ways through it.
+// A datagram whose tag was changed on the way must fail authentication, and what it carried must arrive once resent.
+static bool TestDatagramEncryption(void) {
+    VirtualNetwork      network(1);
+    RakPeerInterface*   server;
+    RakPeerInterface*   client;
+    bool                passed = StartVirtualPeers(network, &server, &client);
+    NotificationCounter counter;
+    server->AttachPlugin(&counter);
+    server->SetDatagramEncryption(true, true);
+    client->SetDatagramEncryption(true, true);
+    passed = passed && ConnectVirtualPeers(network, server, client);
+    passed = passed && server->IsDatagramEncryptionActive(client->GetMyGUID())
+          && client->IsDatagramEncryptionActive(server->GetMyGUID());
+
+    int           serverCounts[3] = {0, 0, 0};
+    int           clientCounts[3] = {0, 0, 0};
+    unsigned char message[2]      = {ID_USER_PACKET_ENUM, 1};
+    if (passed) {
+        client->Send((const char*)message, 2, HIGH_PRIORITY, RELIABLE, 0, server->GetMyGUID(), false);
+        server->Send((const char*)message, 2, HIGH_PRIORITY, RELIABLE, 0, client->GetMyGUID(), false);
+        for (int step = 0; step < 1000 && (serverCounts[1] == 0 || clientCounts[1] == 0); step++) {
+            StepVirtualPeers(network, server, client);
+            ReceiveUserMessages(server, serverCounts, 3);
+            ReceiveUserMessages(client, clientCounts, 3);
+        }
+    }
+
+    // The first datagram carrying the second message is rejected, so only the resend delivers it
+    datagramsToTamper = 1;
+    server->SetIncomingDatagramEventHandler(TamperWithTag);
+    message[1] = 2;
+    if (passed) client->Send((const char*)message, 2, HIGH_PRIORITY, RELIABLE, 0, server->GetMyGUID(), false);
+    for (int step = 0; step < 3000 && passed; step++) {
+        StepVirtualPeers(network, server, client);
+        ReceiveUserMessages(server, serverCounts, 3);
+        ReceiveUserMessages(client, clientCounts, 3);
+    }
+    passed = passed && serverCounts[1] == 1 && clientCounts[1] == 1 && serverCounts[2] == 1 && datagramsToTamper == 0
+          && counter.errors == 1 && server->GetConnectionState(client->GetMyGUID()) == IS_CONNECTED;
+
+    server->SetIncomingDatagramEventHandler(0);
+    server->DetachPlugin(&counter);
+    StopVirtualPeers(network, server, client);
+    return passed;
+}
+#endif
+
+static int            protectedDatagramsSeen;
+static RNS2RecvStruct droppedDatagram;
+
+// Drops the second datagram covered by parity, keeping a copy in droppedDatagram
+static bool DropSecondProtectedDatagram(RNS2RecvStruct* recvStruct) {
+    // isValid set, isACK and isNAK clear, isFECProtected set
+    if (recvStruct->bytesRead > 0 && ((unsigned char)recvStruct->data[0] & 0xE2) == 0x82) {
+        if (++protectedDatagramsSeen == 2) {
+            droppedDatagram = *recvStruct;
+            return false;
+        }
+    }
+    return true;
+}
+
+// A datagram of unreliable messages on a channel with forward error correction is lost. The parity datagram of its
+// group must rebuild it, so each message arrives exactly once, and the original must be dropped when it arrives late.
+static bool TestForwardErrorCorrectionRecovery(void) {
+    const int messageCount = 12;
+
+    VirtualNetwork    network(1);
+    RakPeerInterface* server;
+    RakPeerInterface* client;
+    bool              passed = StartVirtualPeers(network, &server, &client);
+    client->SetForwardErrorCorrection(1, 4);
+    passed = passed && ConnectVirtualPeers(network, server, client);
+
+    protectedDatagramsSeen = 0;
+    server->SetIncomingDatagramEventHandler(DropSecondProtectedDatagram);
+    int  counts[messageCount];
+    char message[200];
+    memset(counts, 0, sizeof(counts));
+    memset(message, 0, sizeof(message));
+    message[0] = (char)ID_USER_PACKET_ENUM;
+    // One message per cycle, so each goes in a datagram of its own
+    for (int i = 0; i < messageCount && passed; i++) {
+        message[1] = (char)i;
+        client->Send(message, sizeof(message), HIGH_PRIORITY, UNRELIABLE, 1, server->GetMyGUID(), false);
+        StepVirtualPeers(network, server, client);
+        ReceiveUserMessages(server, counts, messageCount);
+    }
+    for (int step = 0; step < 500 && passed; step++) {
+        StepVirtualPeers(network, server, client);
+        ReceiveUserMessages(server, counts, messageCount);
+    }
+    RakNetStatistics statistics;
+    passed = passed && protectedDatagramsSeen >= messageCount
+          && server->GetStatistics(client->GetMyBoundAddress(), &statistics) != 0
+          && statistics.datagramsRecoveredByFEC == 1;
+
+    // The original arrives after it was rebuilt
+    if (passed) {
+        RNS2EventHandler* eventHandler = static_cast<RakPeer*>(server);
+        RNS2RecvStruct*   lateOriginal = eventHandler->AllocRNS2RecvStruct(_FILE_AND_LINE_);
+        *lateOriginal                  = droppedDatagram;
+        lateOriginal->timeRead         = network.GetTime();
+        eventHandler->OnRNS2Recv(lateOriginal);
+    }
+    for (int step = 0; step < 500 && passed; step++) {
+        StepVirtualPeers(network, server, client);
+        ReceiveUserMessages(server, counts, messageCount);
+    }
+    for (int i = 0; i < messageCount; i++) passed = passed && counts[i] == 1;
+
+    server->SetIncomingDatagramEventHandler(0);
+    StopVirtualPeers(network, server, client);
+    return passed;
+}
+
+// The latency histograms other threads read are the copies the update cycle publishes, in microseconds
+static bool TestLatencyHistogramSnapshot(void) {
+    VirtualNetwork      network(1);
+    VirtualLinkSettings link;
+    link.latency = 20000;
+    network.SetDefaultLinkSettings(link);
+    RakPeerInterface* server;
+    RakPeerInterface* client;
+    bool              passed = StartVirtualPeers(network, &server, &client);
+    passed                   = passed && ConnectVirtualPeers(network, server, client);
+
+    char message[2] = {(char)ID_USER_PACKET_ENUM, 0};
+    for (int i = 0; i < 50 && passed; i++) {
+        client->Send(message, sizeof(message), HIGH_PRIORITY, RELIABLE, 0, server->GetMyGUID(), false);
+        StepVirtualPeers(network, server, client);
+        ReceiveAll(server, 0, 0);
+    }
+    for (int step = 0; step < 500 && passed; step++) {
+        StepVirtualPeers(network, server, client);
+        ReceiveAll(server, 0, 0);
+    }
+
+    // Every round trip is two links of 20 ms, plus however long the acknowledgement was held
+    LatencyHistogram histogram;
+    passed = passed && client->GetLatencyHistogram(server->GetMyBoundAddress(), LATENCY_ACK_RTT, &histogram)
+          && histogram.GetCount() >= 50 && histogram.GetMinimum() >= 40000 && histogram.GetPercentile(50) < 100000;
+    LatencyHistogram merged;
+    passed = passed && client->GetLatencyHistogram(UNASSIGNED_SYSTEM_ADDRESS, LATENCY_ACK_RTT, &merged)
+          && merged.GetCount() == histogram.GetCount();
+
+    StopVirtualPeers(network, server, client);
+    return passed;
+}
+
+// Busy waits in Update(), and in OnReceive() for user messages, for as long as it is told to
+class SpinningPlugin : public PluginInterface2 {
+public:
+    SpinningPlugin() { spinNs = 0; }
+    virtual void                Update(void) { Spin(); }
+    virtual PluginReceiveResult OnReceive(Packet* packet) {
+        if (packet->data[0] == ID_USER_PACKET_ENUM) Spin();
+        return RR_CONTINUE_PROCESSING;
+    }
+
+    uint64_t spinNs;
+
+protected:
+    void Spin(void) {
+        uint64_t endNs = UpdateProfiler::GetTimeNS() + spinNs;
+        while (UpdateProfiler::GetTimeNS() < endNs) {}
+    }
+};
+
+// Sends \a count user messages from the client, and lets the server receive them
+static void ReceiveProfiledMessages(
+    VirtualNetwork&   network,
+    RakPeerInterface* server,
+    RakPeerInterface* client,
+    int               count
+) {
+    char message[2] = {(char)ID_USER_PACKET_ENUM, 0};
+    for (int i = 0; i < count; i++) {
+        client->Send(message, sizeof(message), HIGH_PRIORITY, RELIABLE, 0, server->GetMyGUID(), false);
+        StepVirtualPeers(network, server, client);
+        ReceiveAll(server, 0, 0);
+    }
+}
+
+// A slow plugin shows in the times of its own calls, of the message it handled and of the phases they ran in, while
+// another thread reads them
+static bool TestUpdateProfilePercentiles(void) {
+    const uint64_t spinNs = 2000000;
+
+    VirtualNetwork    network(1);
+    RakPeerInterface* server;
+    RakPeerInterface* client;
+    SpinningPlugin    plugin;
+    bool              passed = StartVirtualPeers(network, &server, &client);
+    passed                   = passed && ConnectVirtualPeers(network, server, client);
+    server->AttachPlugin(&plugin);
+    server->SetUpdateProfiling(true);
+
+    std::atomic<bool> stop(false);
+    std::thread       reader([&]() {
+        LatencyHistogram histogram;
+        while (stop.load() == false) {
+            for (int phase = 0; phase < UPDATE_PHASE_COUNT; phase++)
+                server->GetUpdatePhaseProfile((UpdateProfilePhase)phase, &histogram);
+            server->GetPluginProfile(&plugin, UPDATE_PLUGIN_UPDATE, &histogram);
+            server->GetMessageProfile(ID_USER_PACKET_ENUM, &histogram);
+        }
+    });
+
+    LatencyHistogram update, onReceive, message, updatePhase, receivePhase;
+    ReceiveProfiledMessages(network, server, client, 20);
+    passed = passed && server->GetPluginProfile(&plugin, UPDATE_PLUGIN_UPDATE, &update)
+          && server->GetPluginProfile(&plugin, UPDATE_PLUGIN_ON_RECEIVE, &onReceive)
+          && server->GetMessageProfile(ID_USER_PACKET_ENUM, &message)
+          && server->GetUpdatePhaseProfile(UPDATE_PHASE_PLUGIN_UPDATE, &updatePhase)
+          && server->GetUpdatePhaseProfile(UPDATE_PHASE_PLUGIN_RECEIVE, &receivePhase);
+    passed = passed && update.GetCount() > 0 && onReceive.GetCount() > 0 && message.GetCount() > 0
+          && update.GetPercentile(50) < spinNs && onReceive.GetPercentile(50) < spinNs
+          && message.GetPercentile(50) < spinNs && updatePhase.GetPercentile(50) < spinNs
+          && receivePhase.GetPercentile(50) < spinNs;
+
+    // Most calls spin from here, so the medians move past the spin
+    plugin.spinNs = spinNs;
+    ReceiveProfiledMessages(network, server, client, 60);
+    passed = passed && server->GetPluginProfile(&plugin, UPDATE_PLUGIN_UPDATE, &update)
+          && server->GetPluginProfile(&plugin, UPDATE_PLUGIN_ON_RECEIVE, &onReceive)
+          && server->GetMessageProfile(ID_USER_PACKET_ENUM, &message)
+          && server->GetUpdatePhaseProfile(UPDATE_PHASE_PLUGIN_UPDATE, &updatePhase)
+          && server->GetUpdatePhaseProfile(UPDATE_PHASE_PLUGIN_RECEIVE, &receivePhase);
+    passed = passed && update.GetPercentile(50) >= spinNs && onReceive.GetPercentile(50) >= spinNs
+          && message.GetPercentile(50) >= spinNs && updatePhase.GetPercentile(50) >= spinNs
+          && receivePhase.GetPercentile(50) >= spinNs;
+
+    stop = true;
+    reader.join();
+    server->SetUpdateProfiling(false);
+    server->DetachPlugin(&plugin);
+    StopVirtualPeers(network, server, client);
+    return passed;
+}
+
+// Once every slot of a page of remote systems has been unused for a while, the page is freed, even while another
+// thread keeps looking the systems up. A system connecting later gets a new page.
+static bool TestRemoteSystemPagesReclaimed(void) {
+    VirtualNetwork    network(1);
+    RakPeerInterface* server;
+    RakPeerInterface* client;
+    bool              passed = StartVirtualPeers(network, &server, &client);
+    passed                   = passed && ConnectVirtualPeers(network, server, client);
+    SystemAddress clientAddress = client->GetMyBoundAddress();
+
+    std::atomic<bool> stop(false);
+    std::atomic<int>  reads(0);
+    std::thread       reader([&]() {
+        DataStructures::List<SystemAddress> addresses;
+        DataStructures::List<RakNetGUID>    guids;
+        RakNetStatistics                    statistics;
+        LatencyHistogram                    histogram;
+        while (stop.load() == false) {
+            server->GetConnectionState(clientAddress);
+            server->GetStatistics(clientAddress, &statistics);
+            server->GetGuidFromSystemAddress(clientAddress);
+            server->GetSystemList(addresses, guids);
+            server->GetLatencyHistogram(UNASSIGNED_SYSTEM_ADDRESS, LATENCY_ACK_RTT, &histogram);
+            reads++;
+        }
+    });
+    while (reads.load() == 0) RakSleep(1);
+
+    client->CloseConnection(server->GetMyGUID(), true);
+    RakNet::TimeUS timeout = network.GetTime() + 5000000;
+    while ((server->NumberOfConnections() > 0 || client->GetConnectionState(server->GetMyGUID()) != IS_NOT_CONNECTED)
+           && network.GetTime() < timeout) {
+        StepVirtualPeers(network, server, client);
+        ReceiveAll(server, 0, 0);
+        ReceiveAll(client, 0, 0);
+    }
+    // The slot of a system that just left can still be looked up
+    RakNetStatistics statistics;
+    passed = passed && server->GetStatistics(clientAddress, &statistics) != 0;
+
+    timeout = network.GetTime() + 30000000;
+    while (server->GetStatistics(clientAddress, &statistics) != 0 && network.GetTime() < timeout)
+        StepVirtualPeers(network, server, client);
+    passed = passed && server->GetStatistics(clientAddress, &statistics) == 0;
+
+    passed = passed && ConnectVirtualPeers(network, server, client);
+    int  counts[1]  = {0};
+    char message[2] = {(char)ID_USER_PACKET_ENUM, 0};
+    if (passed) client->Send(message, sizeof(message), HIGH_PRIORITY, RELIABLE, 0, server->GetMyGUID(), false);
+    for (int step = 0; step < 100 && passed; step++) {
+        StepVirtualPeers(network, server, client);
+        ReceiveUserMessages(server, counts, 1);
+    }
+    passed = passed && counts[0] == 1;
+
+    stop = true;
+    reader.join();
+    StopVirtualPeers(network, server, client);
+    return passed;
+}
+
+static std::atomic<bool> threadPoolGateOpen;
+static std::atomic<int>  threadPoolJobsRun;
+static std::atomic<int>  threadPoolCancelledJobsRun;
+
+// Input is a connection number. Connection 0 holds the thread until the gate opens, and odd connections are the ones
+// that disconnect
+static int RunThreadPoolJob(int connection, bool* returnOutput, void* perThreadData) {
+    (void)perThreadData;
+    *returnOutput = false;
+    if (connection == 0) {
+        while (threadPoolGateOpen.load() == false) RakSleep(1);
+    }
+    if (connection % 2 == 1) threadPoolCancelledJobsRun++;
+    threadPoolJobsRun++;
+    return 0;
+}
+
+// FileListTransfer::RemoveReceiver() cancels the queued jobs of a system that disconnects through LockInput() and
+// RemoveInputAtIndex(). That must reach jobs in the threads' own queues as well as those that overflowed them.
+static bool TestThreadPoolCancelQueuedInput(void) {
+    const int jobCount = 1000;
+
+    threadPoolGateOpen         = false;
+    threadPoolJobsRun          = 0;
+    threadPoolCancelledJobsRun = 0;
+    ThreadPool<int, int> threadPool;
+    if (threadPool.StartThreads(1, 0) == false) return false;
+    threadPool.AddInput(RunThreadPoolJob, 0);
+    while (threadPool.NumThreadsWorking() == 0 || threadPool.HasInput()) RakSleep(1);
+    for (int i = 1; i < jobCount; i++) threadPool.AddInput(RunThreadPoolJob, i);
+
+    int removed = 0;
+    threadPool.LockInput();
+    unsigned int i = 0;
+    while (i < threadPool.InputSize()) {
+        if (threadPool.GetInputAtIndex(i) % 2 == 1) {
+            threadPool.RemoveInputAtIndex(i);
+            removed++;
+        } else i++;
+    }
+    threadPool.UnlockInput();
+
+    threadPoolGateOpen     = true;
+    RakNet::TimeMS timeout = RakNet::GetTimeMS() + 5000;
+    while (threadPool.IsWorking() && RakNet::GetTimeMS() < timeout) RakSleep(1);
+    threadPool.StopThreads();
+    return removed == jobCount / 2 && threadPoolCancelledJobsRun.load() == 0 &&
+           threadPoolJobsRun.load() == jobCount - removed;
+}
+
+// Input added while StopThreads() runs must either run or be left where InputSize() finds it, never stranded in a
+// queue no thread reads
+static bool TestThreadPoolStopKeepsInput(void) {
+    const int rounds       = 200;
+    const int jobsPerRound = 64;
+
+    threadPoolGateOpen = true;
+    for (int round = 0; round < rounds; round++) {
+        threadPoolJobsRun = 0;
+        ThreadPool<int, int> threadPool;
+        if (threadPool.StartThreads(2, 0) == false) return false;
+        std::thread adder([&]() {
+            for (int i = 0; i < jobsPerRound; i++) threadPool.AddInput(RunThreadPoolJob, 2);
+        });
+        threadPool.StopThreads();
+        adder.join();
+
+        threadPool.LockInput();
+        int left = (int)threadPool.InputSize();
+        threadPool.UnlockInput();
+        if (threadPoolJobsRun.load() + left != jobsPerRound) return false;
+    }
+    return true;
+}
+
+static const Test tests[] = {
+    {"ConnectionStateDuringChurn",     TestConnectionStateDuringChurn    },
+    {"NestedPiggybackRejected",        TestNestedPiggybackRejected       },
+#if RAKNET_DATAGRAM_ENCRYPTION == 1
+    {"DatagramEncryption",             TestDatagramEncryption            },
+#endif
+    {"ForwardErrorCorrectionRecovery", TestForwardErrorCorrectionRecovery},
+    {"LatencyHistogramSnapshot",       TestLatencyHistogramSnapshot      },
+    {"RemoteSystemPagesReclaimed",     TestRemoteSystemPagesReclaimed    },
+    {"UpdateProfilePercentiles",       TestUpdateProfilePercentiles      },
+    {"ThreadPoolCancelQueuedInput",    TestThreadPoolCancelQueuedInput   },
+    {"ThreadPoolStopKeepsInput",       TestThreadPoolStopKeepsInput      },
+};
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], tests[i].name) != 0) continue;
+        bool passed = tests[i].function();
+        printf("%s %s\n", passed ? "PASS" : "FAIL", tests[i].name);
+        if (passed == false) failed++;
+    }
+    return failed;
+}
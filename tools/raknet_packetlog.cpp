@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Turns logs written by RakNet::AsyncPacketFileLogger into the text PacketFileLogger writes. Build with xmake
+/// build raknet_packetlog
+///
+/// Usage:
+///   raknet_packetlog log.bin
+///     Writes one comma separated line per record, in the order they were logged, with a header line.
+///   raknet_packetlog --numeric-ids log.bin
+///     The same, with message identifiers as numbers rather than ID_* names, as PacketLogger::SetPrintID(false).
+///
+
+#include "AsyncPacketFileLogger.h"
+#include <stdio.h>
+#include <string.h>
+
+static void PrintUsage(void) { printf("Usage: raknet_packetlog [--numeric-ids] log.bin\n"); }
+
+int main(int argc, char** argv) {
+    bool        printId = true;
+    const char* path    = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--numeric-ids") == 0) printId = false;
+        else if (path == 0) path = argv[i];
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (path == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    FILE* fp = fopen(path, "rb");
+    if (fp == 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    RakNet::AsyncPacketFileLogger logger;
+    logger.SetPrintID(printId);
+    bool converted = logger.WriteTextLog(fp, stdout);
+    fclose(fp);
+    if (converted == false) {
+        fprintf(stderr, "%s is not a RakNet packet log, or was written on a machine with the other byte order\n", path);
+        return 1;
+    }
+    return 0;
+}
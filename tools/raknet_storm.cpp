@@ -0,0 +1,277 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Connection storm load generator. Reconnects thousands of clients to one RakPeer at once, as after a proxy
+/// restart, and reports how the server's accept path holds up. Build with xmake build raknet_storm
+///
+/// Usage:
+///   raknet_storm [clients] [rampMs] [lossPercent] [seed]
+///     Starts a server and \a clients client RakPeers on one VirtualNetwork, with 20 ms of latency each way and
+///     \a lossPercent loss, and has the clients call Connect() spread evenly over \a rampMs milliseconds, or all at once
+///     for 0. Every client runs the full offline and connection handshake. Reports accepts per second of virtual time
+///     and of server CPU time, server CPU time per accept, and the handshake latency distribution, as JSON.
+///     The virtual clock makes the counts and latencies the same on every run with the same arguments, so a change in
+///     them comes from the code. Only the CPU times vary.
+///
+/// Each client costs about 70 KB, its own RakPeer and its slot on the server, so 100000 clients need about 7 GB.
+///
+
+#include "BitStream.h"
+#include "GetTime.h"
+#include "LatencyHistogram.h"
+#include "MessageIdentifiers.h"
+#include "RakPeerInterface.h"
+#include "VirtualNetwork.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#ifdef _WIN32
+#include "WindowsIncludes.h"
+#else
+#include <time.h>
+#endif
+
+using namespace RakNet;
+
+static const RakNet::TimeUS STEP_US              = 1000;
+// How often an idle client runs an update, as RakPeer's network thread waits at most 10 ms for data
+static const int            CLIENT_TICK_STEPS    = 10;
+static const RakNet::TimeUS LINK_LATENCY_US      = 20000;
+static const RakNet::TimeUS LINK_JITTER_US       = 2000;
+static const uint64_t       SERVER_BITS_PER_SEC  = 1000000000;
+static const RakNet::TimeUS STORM_TIMEOUT_US     = 60000000;
+// Clients take 10.1.0.0 and up, so their index can be read back from the address a datagram arrives on
+static const uint32_t       FIRST_CLIENT_ADDRESS = 0x0A010000;
+
+enum ClientState { CLIENT_WAITING, CLIENT_CONNECTING, CLIENT_CONNECTED, CLIENT_FAILED };
+
+struct StormClient {
+    RakPeerInterface* peer;
+    ClientState       state;
+    RakNet::TimeUS    connectTime;
+    bool              woken;
+};
+
+// Clients that received a datagram this step, filled in by OnClientDatagram()
+static std::vector<unsigned int> wokenClients;
+static std::vector<StormClient>  clients;
+
+// CPU time used by the calling thread
+static double ThreadCpuNanoseconds(void) {
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+    unsigned long long kernel = ((unsigned long long)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    unsigned long long user   = ((unsigned long long)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    return (double)(kernel + user) * 100.0;
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+#endif
+}
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static void WakeClient(unsigned int index) {
+    if (clients[index].woken) return;
+    clients[index].woken = true;
+    wokenClients.push_back(index);
+}
+
+// Runs a client as soon as a datagram reaches it, as RakPeer's network thread would wake up
+static bool OnClientDatagram(RNS2RecvStruct* recvStruct) {
+    char address[64];
+    recvStruct->socket->GetBoundAddress().ToString(false, address);
+    unsigned int a, b, c, d;
+    if (sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+        uint32_t index = ((a << 24) | (b << 16) | (c << 8) | d) - FIRST_CLIENT_ADDRESS;
+        if (index < clients.size()) WakeClient(index);
+    }
+    return true;
+}
+
+static void UpdateClient(unsigned int index, BitStream& updateBitStream, LatencyHistogram& handshakes, int& failed) {
+    StormClient& client = clients[index];
+    client.peer->RunUpdateCycle(updateBitStream);
+    for (Packet* p = client.peer->Receive(); p; client.peer->DeallocatePacket(p), p = client.peer->Receive()) {
+        if (client.state != CLIENT_CONNECTING) continue;
+        switch (p->data[0]) {
+        case ID_CONNECTION_REQUEST_ACCEPTED:
+            client.state = CLIENT_CONNECTED;
+            handshakes.Record(RakNet::GetTimeUS() - client.connectTime);
+            break;
+        case ID_CONNECTION_ATTEMPT_FAILED:
+        case ID_NO_FREE_INCOMING_CONNECTIONS:
+        case ID_CONNECTION_BANNED:
+        case ID_INVALID_PASSWORD:
+        case ID_INCOMPATIBLE_PROTOCOL_VERSION:
+        case ID_IP_RECENTLY_CONNECTED:
+            client.state = CLIENT_FAILED;
+            failed++;
+            break;
+        }
+    }
+}
+
+static void PrintUsage(void) { printf("Usage: raknet_storm [clients=10000] [rampMs=0] [lossPercent=0] [seed=1]\n"); }
+
+int main(int argc, char** argv) {
+    int clientCount = argc > 1 ? atoi(argv[1]) : 10000;
+    int rampMs      = argc > 2 ? atoi(argv[2]) : 0;
+    int lossPercent = argc > 3 ? atoi(argv[3]) : 0;
+    int seed        = argc > 4 ? atoi(argv[4]) : 1;
+    if (argc > 5 || clientCount <= 0 || clientCount > 0xFFFF00 || rampMs < 0 || lossPercent < 0 || lossPercent > 100) {
+        PrintUsage();
+        return 1;
+    }
+
+    VirtualNetwork      network((unsigned int)seed);
+    VirtualLinkSettings link;
+    link.latency  = LINK_LATENCY_US;
+    link.jitter   = LINK_JITTER_US;
+    link.lossRate = lossPercent / 100.0f;
+    network.SetDefaultLinkSettings(link);
+    network.UseAsClock(true);
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    SocketDescriptor  serverDescriptor;
+    serverDescriptor.virtualNetwork = &network;
+    if (server->Startup((unsigned int)clientCount, &serverDescriptor, 1) != RAKNET_STARTED) {
+        fprintf(stderr, "Could not start the server\n");
+        return 1;
+    }
+    server->SetMaximumIncomingConnections((unsigned int)clientCount);
+    SystemAddress       serverAddress = server->GetMyBoundAddress();
+    VirtualLinkSettings serverLink    = link;
+    serverLink.bitsPerSecond          = SERVER_BITS_PER_SEC;
+    network.SetLinkSettings(serverAddress, serverLink);
+    char serverHost[64];
+    serverAddress.ToString(false, serverHost);
+
+    clients.resize(clientCount);
+    for (int i = 0; i < clientCount; i++) {
+        uint32_t         address = FIRST_CLIENT_ADDRESS + (uint32_t)i;
+        SocketDescriptor clientDescriptor;
+        clientDescriptor.virtualNetwork = &network;
+        clientDescriptor.port           = 60000;
+        sprintf(
+            clientDescriptor.hostAddress,
+            "%u.%u.%u.%u",
+            (address >> 24) & 0xFF,
+            (address >> 16) & 0xFF,
+            (address >> 8) & 0xFF,
+            address & 0xFF
+        );
+        clients[i].peer  = RakPeerInterface::GetInstance();
+        clients[i].state = CLIENT_WAITING;
+        clients[i].woken = false;
+        if (clients[i].peer->Startup(1, &clientDescriptor, 1) != RAKNET_STARTED) {
+            fprintf(stderr, "Could not start client %i\n", i);
+            return 1;
+        }
+        clients[i].peer->SetIncomingDatagramEventHandler(OnClientDatagram);
+    }
+
+    LatencyHistogram handshakes;
+    BitStream        updateBitStream(MAXIMUM_MTU_SIZE);
+    int              accepted        = 0;
+    int              failed          = 0;
+    int              nextConnect     = 0;
+    double           serverCpuNs     = 0.0;
+    RakNet::TimeUS   stormStart      = network.GetTime();
+    RakNet::TimeUS   lastAcceptTime  = stormStart;
+    RakNet::TimeUS   lastConnectTime = stormStart;
+    int64_t          step            = 0;
+
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    while (accepted + failed < clientCount && network.GetTime() - lastConnectTime < STORM_TIMEOUT_US) {
+        network.AdvanceTime(STEP_US);
+        RakNet::TimeUS elapsed = network.GetTime() - stormStart;
+
+        double cpuStart = ThreadCpuNanoseconds();
+        server->RunUpdateCycle(updateBitStream);
+        for (Packet* p = server->Receive(); p; server->DeallocatePacket(p), p = server->Receive()) {
+            if (p->data[0] != ID_NEW_INCOMING_CONNECTION) continue;
+            accepted++;
+            lastAcceptTime = network.GetTime();
+        }
+        serverCpuNs += ThreadCpuNanoseconds() - cpuStart;
+
+        while (nextConnect < clientCount
+               && (rampMs == 0 || elapsed >= (RakNet::TimeUS)rampMs * 1000 * nextConnect / clientCount)) {
+            StormClient& client = clients[nextConnect];
+            if (client.peer->Connect(serverHost, serverAddress.GetPort(), 0, 0) == CONNECTION_ATTEMPT_STARTED) {
+                client.state       = CLIENT_CONNECTING;
+                client.connectTime = network.GetTime();
+                WakeClient(nextConnect);
+            } else {
+                client.state = CLIENT_FAILED;
+                failed++;
+            }
+            lastConnectTime = network.GetTime();
+            nextConnect++;
+        }
+
+        // Every client runs at least every CLIENT_TICK_STEPS steps, staggered so each step runs the same share
+        for (int i = (int)(step % CLIENT_TICK_STEPS); i < clientCount; i += CLIENT_TICK_STEPS) WakeClient(i);
+        for (size_t i = 0; i < wokenClients.size(); i++) {
+            clients[wokenClients[i]].woken = false;
+            UpdateClient(wokenClients[i], updateBitStream, handshakes, failed);
+        }
+        wokenClients.clear();
+        step++;
+    }
+    double wallNs = NanosecondsSince(wallStart);
+
+    int clientsConnected = 0;
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].state == CLIENT_CONNECTED) clientsConnected++;
+    }
+    double stormSeconds = (double)(lastAcceptTime - stormStart) / 1e6;
+    const VirtualNetworkStatistics& statistics = network.GetStatistics();
+
+    printf("{\n");
+    printf("  \"tool\": \"storm\",\n");
+    printf("  \"clients\": %i,\n", clientCount);
+    printf("  \"ramp_ms\": %i,\n", rampMs);
+    printf("  \"loss_percent\": %i,\n", lossPercent);
+    printf("  \"seed\": %i,\n", seed);
+    printf("  \"accepted\": %i,\n", accepted);
+    printf("  \"clients_connected\": %i,\n", clientsConnected);
+    printf("  \"failed\": %i,\n", failed);
+    printf("  \"virtual_storm_ms\": %.1f,\n", stormSeconds * 1000.0);
+    printf("  \"accepts_per_virtual_second\": %.1f,\n", stormSeconds > 0.0 ? accepted / stormSeconds : 0.0);
+    printf("  \"server_cpu_ms\": %.1f,\n", serverCpuNs / 1e6);
+    printf("  \"server_cpu_us_per_accept\": %.2f,\n", accepted ? serverCpuNs / 1000.0 / accepted : 0.0);
+    printf("  \"accepts_per_server_cpu_second\": %.1f,\n", serverCpuNs > 0.0 ? accepted / (serverCpuNs / 1e9) : 0.0);
+    printf("  \"handshake_p50_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)handshakes.GetPercentile(50.0));
+    printf("  \"handshake_p90_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)handshakes.GetPercentile(90.0));
+    printf("  \"handshake_p99_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)handshakes.GetPercentile(99.0));
+    printf("  \"handshake_max_us\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)handshakes.GetMaximum());
+    printf("  \"datagrams_sent\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)statistics.datagramsSent);
+    printf("  \"datagrams_lost\": %" PRINTF_64_BIT_MODIFIER "u,\n", (unsigned long long)statistics.datagramsLost);
+    printf("  \"wall_ms\": %.1f\n", wallNs / 1e6);
+    printf("}\n");
+
+    for (int i = 0; i < clientCount; i++) {
+        clients[i].peer->Shutdown(0);
+        RakPeerInterface::DestroyInstance(clients[i].peer);
+    }
+    server->Shutdown(0);
+    RakPeerInterface::DestroyInstance(server);
+    return accepted == clientCount ? 0 : 1;
+}
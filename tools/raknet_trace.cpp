@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Turns captures written by RakNet::DumpEventTrace() into text. Build with xmake build raknet_trace
+///
+/// Usage:
+///   raknet_trace capture.bin
+///     Writes one line per event, oldest first, with its time in seconds since the first event.
+///   raknet_trace --csv capture.bin
+///     Writes one comma separated line per event, with absolute times in microseconds and a header line.
+///
+
+#include "EventTrace.h"
+#include <stdio.h>
+#include <string.h>
+
+static void PrintUsage(void) { printf("Usage: raknet_trace [--csv] capture.bin\n"); }
+
+int main(int argc, char** argv) {
+    bool        csv  = false;
+    const char* path = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (path == 0) path = argv[i];
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (path == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    FILE* fp = fopen(path, "rb");
+    if (fp == 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    bool decoded = RakNet::DecodeEventTrace(fp, stdout, csv);
+    fclose(fp);
+    if (decoded == false) {
+        fprintf(stderr, "%s is not a RakNet event trace, or was written on a machine with the other byte order\n", path);
+        return 1;
+    }
+    return 0;
+}
@@ -10,6 +10,42 @@ if is_os("windows") and not has_config("vs_runtime") then
     set_runtimes("MD")
 end
 
+-- Benchmarks, tools and tests linked against the library. Not built by default; build one with xmake build <name>
+function raknet_binary(name, file)
+    target(name)
+        set_kind("binary")
+        set_default(false)
+        set_languages("c++23")
+        add_deps("RakNet")
+        add_includedirs("include/raknet")
+        add_files(file)
+        add_defines(
+            "RAKNET_SUPPORT_IPV6"
+        )
+        if is_mode("debug") then
+            set_symbols("debug")
+        else
+            set_optimize("aggressive")
+        end
+
+        if is_os("windows") then
+            add_defines(
+                "NOMINMAX",
+                "_CRT_SECURE_NO_WARNINGS"
+            )
+            add_syslinks("ws2_32")
+        else
+            add_cxflags(
+                "-stdlib=libc++"
+            )
+            add_ldflags(
+                "-stdlib=libc++"
+            )
+            add_syslinks("pthread")
+        end
+    target_end()
+end
+
 target("RakNet")
     set_kind("$(libtype)")
     set_languages("c++23")
@@ -81,4 +117,13 @@ target("RakNet")
             os.cp(target:targetfile(), path.join(output_dir, path.filename(target:targetfile())))
             cprint("${bright green}[Shared Library]: ${reset}".. path.filename(target:targetfile()) .. " already generated to " .. output_dir)
         end)
-    end
\ No newline at end of file
+    end
+
+target_end()
+
+raknet_binary("raknet_bench", "bench/raknet_bench.cpp")
+raknet_binary("raknet_microbench", "bench/raknet_microbench.cpp")
+raknet_binary("raknet_trace", "tools/raknet_trace.cpp")
+raknet_binary("raknet_storm", "tools/raknet_storm.cpp")
+raknet_binary("raknet_packetlog", "tools/raknet_packetlog.cpp")
+raknet_binary("raknet_tests", "tests/raknet_tests.cpp")